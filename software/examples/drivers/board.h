@@ -36,6 +36,33 @@
 #define STM32_SRAM_SIZE         128
 #define STM32_SRAM_END          (0x20000000 + STM32_SRAM_SIZE * 1024)
 
+// <o> CCM data RAM size[Kbytes] <0-64>
+//	<i>Default: 64
+#define STM32_CCM_SIZE          64
+#define STM32_CCM_BEGIN         0x10000000
+#define STM32_CCM_END           (STM32_CCM_BEGIN + STM32_CCM_SIZE * 1024)
+
+/*
+ * placement of hot code and data, the sections are laid out by
+ * stm32_rom.ld (GNU ld) and stm32_rom.sct (MDK):
+ *  SECTION_CCM      : zero initialized, CPU only data in CCM, no DMA access
+ *  SECTION_FASTCODE : code copied from flash to SRAM at startup
+ *  SECTION_DMABUF   : zero initialized DMA buffers, kept in SRAM1
+ */
+#if defined(__CC_ARM)
+#define SECTION_CCM             __attribute__((section(".ccmdata"), zero_init))
+#define SECTION_FASTCODE        __attribute__((section(".fastcode")))
+#define SECTION_DMABUF          __attribute__((section(".dmabuf"), zero_init))
+#elif defined(__GNUC__)
+#define SECTION_CCM             __attribute__((section(".ccmdata")))
+#define SECTION_FASTCODE        __attribute__((section(".fastcode")))
+#define SECTION_DMABUF          __attribute__((section(".dmabuf")))
+#else
+#define SECTION_CCM
+#define SECTION_FASTCODE
+#define SECTION_DMABUF
+#endif
+
 // #define RT_USING_UART1
 // #define RT_USING_UART2
 #define RT_USING_UART3
@@ -4,24 +4,118 @@
 #include <rtgui/widgets/window.h>
 #include <rtgui/rtgui_app.h>
 
+#include <board.h>
 #include <dfs_posix.h>
 #include <string.h>
+#include <stdlib.h>
 
 #define PICTURE_DIR "/"
-
-/* current picture file name */
-static char current_fn[32] = {0};
+#define PICTURE_NAME_MAX    32
+
+/*
+ * Pictures rendered ahead of time: the next one, the one shown and the
+ * previous one, as many as there are slots. A slot is a screen of pixels,
+ * 750K at 800x480 in RGB565, which does not fit the 128K of internal SRAM
+ * this example has for its heap. So the slots are laid out in the 1M of
+ * external SRAM, which is not used otherwise while STM32_EXT_SRAM is 0 in
+ * board.h, and it holds one screen: the next picture. The RA8875 can not
+ * keep them either, at 800x480 and 16bpp its memory is a single layer.
+ * A picture which is in no slot is decoded when it is shown.
+ */
+#define PICTURE_SLOTS       3
+#define PREFETCH_PRIORITY   25
+#define PREFETCH_STACK      2048
+
+#define EXT_SRAM_SIZE       (STM32_EXT_SRAM_END + 1 - STM32_EXT_SRAM_BEGIN)
+
+/* a slot is a dc drawing into its pixels */
+struct picture_slot
+{
+    struct rtgui_dc dc;
+    struct rtgui_gc gc;
+    rt_uint8_t *pixels;
+
+    char name[PICTURE_NAME_MAX];
+    rt_bool_t ready;
+};
+
+/* sorted names of the pictures in PICTURE_DIR */
+static char (*names)[PICTURE_NAME_MAX] = RT_NULL;
+static int count = 0;
+/* the picture shown */
+static int current = -1;
+
+static struct picture_slot slots[PICTURE_SLOTS];
+static int slot_count = 0;
+/* what the slots are for, from the picture shown */
+static const int slot_order[PICTURE_SLOTS] = {1, 0, -1};
+static struct rt_mutex lock;
+static struct rt_semaphore prefetch_sem;
+static rt_bool_t rescan = RT_FALSE;
+
+static struct rtgui_app *app;
+static struct rtgui_win *win_main;
 static struct rtgui_container *container;
+static struct rtgui_rect view_rect;
+/* size of a slot */
+static int slot_width, slot_height, slot_pitch;
 
-static void picture_show_prev(void)
+extern void ext_sram_init(void);
+
+static const char *picture_type(const char *fn)
+{
+    if (strstr(fn, ".hdc") != RT_NULL ||
+            strstr(fn, ".HDC") != RT_NULL)
+        return "hdc";
+    if (strstr(fn, ".bmp") != RT_NULL ||
+            strstr(fn, ".BMP") != RT_NULL)
+        return "bmp";
+
+    return RT_NULL;
+}
+
+static int name_compare(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+/* the position of name in the index, or where it would be */
+static int name_find(const char *name, rt_bool_t *found)
+{
+    int low = 0, high = count - 1, middle, result;
+
+    *found = RT_FALSE;
+    while (low <= high)
+    {
+        middle = (low + high) / 2;
+        result = strcmp(names[middle], name);
+        if (result == 0)
+        {
+            *found = RT_TRUE;
+            return middle;
+        }
+
+        if (result < 0) low = middle + 1;
+        else high = middle - 1;
+    }
+
+    return low;
+}
+
+/*
+ * Read the directory into a new index and take it over, the picture
+ * shown keeps its place. The names are read without the lock, the GUI
+ * thread goes on with the old index meanwhile.
+ */
+static void picture_index_scan(void)
 {
     DIR* dir;
     struct dirent* entry;
-    rt_bool_t is_last;
-    char fn[32];
-
-    fn[0] = '\0';
-    is_last = RT_FALSE;
+    char (*list)[PICTURE_NAME_MAX] = RT_NULL;
+    void *ptr;
+    int size = 0, capacity = 0;
+    char name[PICTURE_NAME_MAX];
+    rt_bool_t found;
 
     dir = opendir(PICTURE_DIR);
     if (dir == RT_NULL)
@@ -30,103 +124,363 @@ static void picture_show_prev(void)
         return;
     }
 
-    do
+    while ((entry = readdir(dir)) != RT_NULL)
     {
-        entry = readdir(dir);
-        if (entry != RT_NULL)
+        if (picture_type(entry->d_name) == RT_NULL ||
+                strlen(entry->d_name) >= PICTURE_NAME_MAX)
+            continue;
+
+        if (size == capacity)
         {
-            if (strstr(entry->d_name, ".hdc") != RT_NULL ||
-                    strstr(entry->d_name, ".HDC") != RT_NULL ||
-                    strstr(entry->d_name, ".bmp") != RT_NULL ||
-                    strstr(entry->d_name, ".BMP") != RT_NULL)
-            {
-                /* it's a HDC image */
-                if ((strcmp(entry->d_name, current_fn) == 0) &&
-                        is_last != RT_TRUE)
-                {
-                    if (fn[0] == '\0')
-                    {
-                        /* it should be the last image */
-                        is_last = RT_TRUE;
-                    }
-                    else
-                    {
-                        /* display image */
-                        strcpy(current_fn, fn);
-                        rtgui_widget_update(RTGUI_WIDGET(container));
-                        closedir(dir);
-                        return;
-                    }
-                }
-                strcpy(fn, entry->d_name);
-            }
+            capacity = capacity ? capacity * 2 : 16;
+            ptr = rt_realloc(list, capacity * PICTURE_NAME_MAX);
+            if (ptr == RT_NULL)
+                break;
+            list = ptr;
         }
+        strcpy(list[size ++], entry->d_name);
     }
-    while(entry != RT_NULL);
-
-    /* close directory */
     closedir(dir);
 
-    if ((is_last == RT_TRUE) && fn[0] != '\0')
+    if (size > 1)
+        qsort(list, size, PICTURE_NAME_MAX, name_compare);
+
+    rt_mutex_take(&lock, RT_WAITING_FOREVER);
+    name[0] = '\0';
+    if (current >= 0)
+        strcpy(name, names[current]);
+
+    if (names != RT_NULL)
+        rt_free(names);
+    names = list;
+    count = size;
+
+    if (count == 0)
+        current = -1;
+    else if (name[0] == '\0')
+        current = 0;
+    else
     {
-        strcpy(current_fn, fn);
-        rtgui_widget_update(RTGUI_WIDGET(container));
+        current = name_find(name, &found);
+        /* removed: the one after it */
+        if (current >= count)
+            current = 0;
     }
+    rt_mutex_release(&lock);
 }
 
-static void picture_show_next(void)
+/* drop a picture which could not be opened any more */
+static void picture_index_remove(const char *name)
 {
-    DIR* dir;
-    struct dirent* entry;
-    rt_bool_t found, has_image;
+    rt_bool_t found;
+    int index;
+
+    index = name_find(name, &found);
+    if (found != RT_TRUE)
+        return;
 
-    found = RT_FALSE;
-    has_image = RT_FALSE;
+    memmove(names[index], names[index + 1], (count - index - 1) * PICTURE_NAME_MAX);
+    count --;
 
-__restart:
-    dir = opendir(PICTURE_DIR);
-    if (dir == RT_NULL)
+    if (count == 0)
+        current = -1;
+    else if (current > index || current >= count)
+        current = (current - 1 + count) % count;
+}
+
+static rt_bool_t picture_render(const char *name, struct rtgui_dc *dc, struct rtgui_rect *rect)
+{
+    struct rtgui_image* image;
+    char fn[PICTURE_NAME_MAX + 8];
+
+    rt_snprintf(fn, sizeof(fn), "%s/%s", PICTURE_DIR, name);
+    image = rtgui_image_create_from_file(picture_type(name), fn, RT_FALSE);
+    if (image == RT_NULL)
+        return RT_FALSE;
+
+    rtgui_dc_fill_rect(dc, rect);
+    rtgui_image_blit(image, dc, rect);
+    rtgui_image_destroy(image);
+
+    return RT_TRUE;
+}
+
+static rt_uint16_t slot_pixel(rtgui_color_t color)
+{
+    if (rtgui_graphic_driver_get_default()->pixel_format == RTGRAPHIC_PIXEL_FORMAT_RGB565P)
+        return rtgui_color_to_565p(color);
+
+    return rtgui_color_to_565(color);
+}
+
+static void slot_fill(struct picture_slot *slot, int x1, int x2, int y, rt_uint16_t pixel)
+{
+    rt_uint16_t *ptr;
+
+    if (y < 0 || y >= slot_height) return;
+    if (x1 < 0) x1 = 0;
+    if (x2 > slot_width) x2 = slot_width;
+
+    ptr = (rt_uint16_t *)(slot->pixels + y * slot_pitch) + x1;
+    for (; x1 < x2; x1 ++)
+        *ptr ++ = pixel;
+}
+
+static void slot_draw_point(struct rtgui_dc *dc, int x, int y)
+{
+    struct picture_slot *slot = (struct picture_slot *)dc;
+
+    slot_fill(slot, x, x + 1, y, slot_pixel(slot->gc.foreground));
+}
+
+static void slot_draw_color_point(struct rtgui_dc *dc, int x, int y, rtgui_color_t color)
+{
+    slot_fill((struct picture_slot *)dc, x, x + 1, y, slot_pixel(color));
+}
+
+static void slot_draw_vline(struct rtgui_dc *dc, int x, int y1, int y2)
+{
+    struct picture_slot *slot = (struct picture_slot *)dc;
+
+    for (; y1 < y2; y1 ++)
+        slot_fill(slot, x, x + 1, y1, slot_pixel(slot->gc.foreground));
+}
+
+static void slot_draw_hline(struct rtgui_dc *dc, int x1, int x2, int y)
+{
+    struct picture_slot *slot = (struct picture_slot *)dc;
+
+    slot_fill(slot, x1, x2, y, slot_pixel(slot->gc.foreground));
+}
+
+static void slot_fill_rect(struct rtgui_dc *dc, rtgui_rect_t *rect)
+{
+    struct picture_slot *slot = (struct picture_slot *)dc;
+    int y;
+
+    for (y = rect->y1; y < rect->y2; y ++)
+        slot_fill(slot, rect->x1, rect->x2, y, slot_pixel(slot->gc.background));
+}
+
+static void slot_blit_line(struct rtgui_dc *dc, int x1, int x2, int y, rt_uint8_t *line_data)
+{
+    struct picture_slot *slot = (struct picture_slot *)dc;
+
+    if (y < 0 || y >= slot_height) return;
+    if (x1 < 0)
     {
-        rt_kprintf("open directory failed\n");
-        return;
+        line_data -= x1 * 2;
+        x1 = 0;
     }
+    if (x2 > slot_width) x2 = slot_width;
+    if (x1 >= x2) return;
+
+    memcpy(slot->pixels + y * slot_pitch + x1 * 2, line_data, (x2 - x1) * 2);
+}
+
+/* the picture to the screen, row by row from the top left of the slot */
+static void slot_blit(struct rtgui_dc *dc, struct rtgui_point *dc_point,
+                      struct rtgui_dc *dest, rtgui_rect_t *rect)
+{
+    struct picture_slot *slot = (struct picture_slot *)dc;
+    int y, width, height;
+
+    width = rtgui_rect_width(*rect) < slot_width ? rtgui_rect_width(*rect) : slot_width;
+    height = rtgui_rect_height(*rect) < slot_height ? rtgui_rect_height(*rect) : slot_height;
+
+    for (y = 0; y < height; y ++)
+        dest->engine->blit_line(dest, rect->x1, rect->x1 + width, rect->y1 + y,
+                                slot->pixels + y * slot_pitch);
+}
+
+static void slot_set_gc(struct rtgui_dc *dc, struct rtgui_gc *gc)
+{
+    ((struct picture_slot *)dc)->gc = *gc;
+}
 
-    do
+static struct rtgui_gc *slot_get_gc(struct rtgui_dc *dc)
+{
+    return &((struct picture_slot *)dc)->gc;
+}
+
+static rt_bool_t slot_get_visible(struct rtgui_dc *dc)
+{
+    return RT_TRUE;
+}
+
+static void slot_get_rect(struct rtgui_dc *dc, rtgui_rect_t *rect)
+{
+    rect->x1 = rect->y1 = 0;
+    rect->x2 = slot_width;
+    rect->y2 = slot_height;
+}
+
+static rt_bool_t slot_fini(struct rtgui_dc *dc)
+{
+    return RT_TRUE;
+}
+
+static const struct rtgui_dc_engine slot_engine =
+{
+    slot_draw_point,
+    slot_draw_color_point,
+    slot_draw_vline,
+    slot_draw_hline,
+    slot_fill_rect,
+    slot_blit_line,
+    slot_blit,
+
+    slot_set_gc,
+    slot_get_gc,
+
+    slot_get_visible,
+    slot_get_rect,
+
+    slot_fini,
+};
+
+static struct picture_slot *slot_find(const char *name)
+{
+    int index;
+
+    for (index = 0; index < slot_count; index ++)
+    {
+        if (strcmp(slots[index].name, name) == 0)
+            return &slots[index];
+    }
+
+    return RT_NULL;
+}
+
+/*
+ * Keeps the slots filled with the pictures of slot_order, the next one
+ * first. A slot is taken over from a picture out of range and rendered
+ * without the lock, it is not ready until done.
+ */
+static void prefetch_entry(void* parameter)
+{
+    struct rtgui_rect rect;
+    struct picture_slot *slot;
+    char want[PICTURE_SLOTS][PICTURE_NAME_MAX];
+    int index, other, wanted;
+    rt_bool_t ok;
+
+    rect.x1 = rect.y1 = 0;
+    rect.x2 = rtgui_rect_width(view_rect);
+    rect.y2 = rtgui_rect_height(view_rect);
+
+    while (1)
     {
-        entry = readdir(dir);
-        if (entry != RT_NULL)
+        rt_sem_take(&prefetch_sem, RT_WAITING_FOREVER);
+
+        if (rescan == RT_TRUE)
+        {
+            rescan = RT_FALSE;
+            picture_index_scan();
+        }
+
+        for (index = 0; index < slot_count; index ++)
         {
-            if (strstr(entry->d_name, ".hdc") != RT_NULL ||
-                    strstr(entry->d_name, ".HDC") != RT_NULL ||
-                    strstr(entry->d_name, ".bmp") != RT_NULL ||
-                    strstr(entry->d_name, ".BMP") != RT_NULL)
+            rt_mutex_take(&lock, RT_WAITING_FOREVER);
+            wanted = count < slot_count ? count : slot_count;
+            for (other = 0; other < wanted; other ++)
             {
-                /* this directory includes image */
-                has_image = RT_TRUE;
+                int position = current + slot_order[other];
 
-                if (found == RT_TRUE || current_fn[0] == '\0')
-                {
-                    strcpy(current_fn, entry->d_name);
-                    rtgui_widget_update(RTGUI_WIDGET(container));
+                strcpy(want[other], names[(position % count + count) % count]);
+            }
+            if (index >= wanted)
+            {
+                rt_mutex_release(&lock);
+                break;
+            }
 
-                    closedir(dir);
-                    return;
+            slot = slot_find(want[index]);
+            if (slot != RT_NULL && slot->ready == RT_TRUE)
+            {
+                rt_mutex_release(&lock);
+                continue;
+            }
+
+            /* a slot no wanted picture is in */
+            for (other = 0; slot == RT_NULL && other < slot_count; other ++)
+            {
+                int check;
+
+                for (check = 0; check < wanted; check ++)
+                {
+                    if (strcmp(slots[other].name, want[check]) == 0)
+                        break;
                 }
+                if (check == wanted)
+                    slot = &slots[other];
+            }
+            if (slot == RT_NULL)
+            {
+                rt_mutex_release(&lock);
+                break;
+            }
+
+            strcpy(slot->name, want[index]);
+            slot->ready = RT_FALSE;
+            rt_mutex_release(&lock);
 
-                /* it's a HDC image */
-                if (strcmp(entry->d_name, current_fn) == 0)
-                    found = RT_TRUE;
+            ok = picture_render(slot->name, &slot->dc, &rect);
+
+            rt_mutex_take(&lock, RT_WAITING_FOREVER);
+            if (ok == RT_TRUE)
+                slot->ready = RT_TRUE;
+            else
+            {
+                picture_index_remove(slot->name);
+                slot->name[0] = '\0';
+            }
+            /* the picture shown may have changed during the render */
+            ok = (ok == RT_TRUE && current >= 0 && strcmp(slot->name, names[current]) == 0);
+            rt_mutex_release(&lock);
+
+            /* the picture shown is in its slot now, paint it on the GUI thread */
+            if (ok == RT_TRUE)
+            {
+                struct rtgui_event_paint epaint;
+
+                RTGUI_EVENT_PAINT_INIT(&epaint);
+                epaint.wid = win_main;
+                rtgui_send(app->tid, &epaint.parent, sizeof(epaint));
             }
         }
     }
-    while(entry != RT_NULL);
+}
 
-    /* close directory */
-    closedir(dir);
+static void picture_step(int step)
+{
+    rt_mutex_take(&lock, RT_WAITING_FOREVER);
+    if (count == 0)
+    {
+        rt_mutex_release(&lock);
+        rescan = RT_TRUE;
+        rt_sem_release(&prefetch_sem);
+        return;
+    }
+
+    current = (current + step + count) % count;
+    /* new pictures are picked up once per round */
+    if (current == 0 && step > 0)
+        rescan = RT_TRUE;
+    rt_mutex_release(&lock);
+
+    rtgui_widget_update(RTGUI_WIDGET(container));
+    rt_sem_release(&prefetch_sem);
+}
+
+static void picture_show_prev(void)
+{
+    picture_step(-1);
+}
 
-    if (has_image != RT_TRUE) return;
-    current_fn[0] = '\0';
-    goto __restart;
+static void picture_show_next(void)
+{
+    picture_step(1);
 }
 
 static rt_bool_t onkey_handle(struct rtgui_object* object, struct rtgui_event* event)
@@ -155,37 +509,40 @@ static rt_bool_t picture_view_event_handler(rtgui_object_t *object, rtgui_event_
     {
         struct rtgui_dc* dc;
         struct rtgui_rect rect;
-        struct rtgui_image* image = RT_NULL;
-        char fn[32];
+        struct picture_slot *slot;
+        char name[PICTURE_NAME_MAX];
+        rt_bool_t shown = RT_FALSE;
 
         dc = rtgui_dc_begin_drawing(RTGUI_WIDGET(object));
         if (dc == RT_NULL) return RT_FALSE;
         rtgui_widget_get_rect(RTGUI_WIDGET(object), &rect);
 
-        /* open image */
-        rt_snprintf(fn, sizeof(fn), "%s/%s", PICTURE_DIR, current_fn);
-        rt_kprintf("pic fn: %s\n", fn);
-        if (strstr(fn, ".hdc") != RT_NULL ||
-                strstr(fn, ".HDC") != RT_NULL)
-        {
-            image = rtgui_image_create_from_file("hdc",
-                                                 fn, RT_FALSE);
-        }
-        else if (strstr(fn, ".bmp") != RT_NULL ||
-                 strstr(fn, ".BMP") != RT_NULL)
+        name[0] = '\0';
+        rt_mutex_take(&lock, RT_WAITING_FOREVER);
+        if (current >= 0)
         {
-            image = rtgui_image_create_from_file("bmp",
-                                                 fn, RT_FALSE);
+            slot = slot_find(names[current]);
+            if (slot != RT_NULL && slot->ready == RT_TRUE)
+            {
+                /* rendered ahead: just a blit */
+                rtgui_dc_blit(&slot->dc, RT_NULL, dc, &rect);
+                shown = RT_TRUE;
+            }
+            else if (slot != RT_NULL)
+            {
+                /* being rendered, painted again when done */
+                shown = RT_TRUE;
+            }
+            else
+                strcpy(name, names[current]);
         }
+        rt_mutex_release(&lock);
 
-        if (image != RT_NULL)
-        {
-            /* blit image */
-            rtgui_image_blit(image, dc, &rect);
-            /* destroy image */
-            rtgui_image_destroy(image);
-        }
-        else
+        /* no slot for it, decode it here */
+        if (name[0] != '\0')
+            shown = picture_render(name, dc, &rect);
+
+        if (shown != RT_TRUE)
         {
             rtgui_dc_fill_rect(dc, &rect);
             rtgui_dc_draw_text(dc, "ûļ", &rect);
@@ -203,12 +560,49 @@ void timeout(struct rtgui_timer* timer, void* parameter)
     picture_show_next();
 }
 
+static void picture_prefetch_init(void)
+{
+    rt_thread_t tid;
+    rt_uint8_t *pixels;
+    int index;
+
+    slot_width = rtgui_rect_width(view_rect);
+    slot_height = rtgui_rect_height(view_rect);
+    slot_pitch = slot_width * 2;
+
+    for (index = 0; index < PICTURE_SLOTS; index ++)
+    {
+#if STM32_EXT_SRAM
+        /* the external SRAM is the heap */
+        pixels = (rt_uint8_t *)rt_malloc(slot_pitch * slot_height);
+        if (pixels == RT_NULL)
+            break;
+#else
+        if ((index + 1) * slot_pitch * slot_height > EXT_SRAM_SIZE)
+            break;
+        if (index == 0)
+            ext_sram_init();
+        pixels = (rt_uint8_t *)STM32_EXT_SRAM_BEGIN + index * slot_pitch * slot_height;
+#endif
+
+        slots[index].dc.type = RTGUI_DC_BUFFER;
+        slots[index].dc.engine = &slot_engine;
+        slots[index].gc = RTGUI_WIDGET(container)->gc;
+        slots[index].pixels = pixels;
+        slots[index].name[0] = '\0';
+        slots[index].ready = RT_FALSE;
+    }
+    slot_count = index;
+
+    tid = rt_thread_create("prefetch", prefetch_entry, RT_NULL,
+                           PREFETCH_STACK, PREFETCH_PRIORITY, 20);
+    if (tid != RT_NULL) rt_thread_startup(tid);
+}
+
 void picture_show(void)
 {
     /* create application */
-    struct rtgui_app *app;
     struct rtgui_rect rect1;
-    struct rtgui_win *win_main;
     rtgui_timer_t *timer;
 
     app = rtgui_app_create("gui_app");
@@ -243,15 +637,22 @@ void picture_show(void)
     rtgui_object_set_event_handler(RTGUI_OBJECT(container), picture_view_event_handler);
     rtgui_container_add_child(RTGUI_CONTAINER(win_main), RTGUI_WIDGET(container));
 
+    /* index the directory once, the prefetch thread keeps it up to date */
+    rt_mutex_init(&lock, "picture", RT_IPC_FLAG_FIFO);
+    rt_sem_init(&prefetch_sem, "prefetch", 0, RT_IPC_FLAG_FIFO);
+    picture_index_scan();
+    view_rect = rect1;
+    picture_prefetch_init();
+
     timer = rtgui_timer_create(500, RT_TIMER_FLAG_PERIODIC, timeout, RT_NULL);
     rtgui_timer_start(timer);
     rtgui_win_set_onkey(win_main, onkey_handle);
     rtgui_win_show(win_main, RT_FALSE);
 
-    /* show next picture */
-    picture_show_next();
+    /* show the first picture */
+    rtgui_widget_update(RTGUI_WIDGET(container));
+    rt_sem_release(&prefetch_sem);
 
     rtgui_app_run(app);
     rtgui_app_destroy(app);
 }
-
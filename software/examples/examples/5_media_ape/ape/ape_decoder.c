@@ -0,0 +1,350 @@
+/*
+
+libdemac - A Monkey's Audio decoder
+
+Instance based decoder for RT-Thread
+
+Copyright (C) 2013 RT-Thread Development Team
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
+
+*/
+
+#include <inttypes.h>
+#include <rtthread.h>
+#include <dfs_posix.h>
+
+#include "ape_decoder.h"
+#include "decoder.h"
+#include "filter.h"
+
+/* the vector math wants the filter histories aligned like MEM_ALIGN_ATTR */
+#define APE_ALIGN   16
+
+/* size of the buffers behind struct ape_decoder, -1 for an unknown level */
+static int ape_buffers_size(int compressiontype, int channels)
+{
+    int size = 0;
+    int i, n;
+
+    for (i = 0; i < APE_FILTER_STAGES; i++)
+    {
+        n = ape_filter_bufsize(compressiontype, i);
+        if (n < 0)
+            return -1;
+        size += RT_ALIGN(n, APE_ALIGN);
+    }
+
+    size += APE_DECODE_BLOCKS * sizeof(int32_t) * channels;
+
+    return size;
+}
+
+rt_size_t ape_decoder_memsize(int compressiontype)
+{
+    int size;
+
+    size = ape_buffers_size(compressiontype, 2);
+    if (size < 0)
+        return 0;
+
+    /* worst case alignment of the arena start */
+    return RT_ALIGN(sizeof(struct ape_decoder), APE_ALIGN) + size + APE_ALIGN;
+}
+
+static void ape_decoder_free(struct ape_decoder* dec)
+{
+    if (dec->ctx.seektable != RT_NULL)
+        rt_free(dec->ctx.seektable);
+    if (dec->buffers != RT_NULL)
+        rt_free(dec->buffers);
+    if (dec->inbuffer != RT_NULL)
+        rt_free(dec->inbuffer);
+    if (dec->heap)
+        rt_free(dec);
+}
+
+/* drop the consumed bytes and top up the compressed data window */
+static int ape_decoder_consume(struct ape_decoder* dec, int bytesconsumed)
+{
+    int n;
+
+    if (bytesconsumed > dec->bytesinbuffer)
+        return -1;
+
+    rt_memmove(dec->inbuffer, dec->inbuffer + bytesconsumed,
+               dec->bytesinbuffer - bytesconsumed);
+    dec->bytesinbuffer -= bytesconsumed;
+
+    n = read(dec->fd, dec->inbuffer + dec->bytesinbuffer,
+             APE_INPUT_CHUNKSIZE - dec->bytesinbuffer);
+    if (n > 0)
+        dec->bytesinbuffer += n;
+
+    return 0;
+}
+
+/* interleave the channels into little endian PCM */
+static void ape_decoder_to_pcm(struct ape_decoder* dec, void* pcm, int blocks)
+{
+    int32_t* decoded0 = dec->decoded0;
+    int32_t* decoded1 = dec->decoded1;
+    int i;
+
+    if (dec->ctx.bps == 16)
+    {
+        int16_t* out = (int16_t*)pcm;
+
+        if (dec->ctx.channels == 2)
+        {
+            for (i = 0; i < blocks; i++)
+            {
+                *out++ = decoded0[i];
+                *out++ = decoded1[i];
+            }
+        }
+        else
+        {
+            for (i = 0; i < blocks; i++)
+                *out++ = decoded0[i];
+        }
+    }
+    else if (dec->ctx.bps == 8)
+    {
+        /* 8 bit WAV uses unsigned samples */
+        uint8_t* p = (uint8_t*)pcm;
+
+        for (i = 0; i < blocks; i++)
+        {
+            *p++ = (decoded0[i] + 0x80) & 0xff;
+            if (decoded1 != RT_NULL)
+                *p++ = (decoded1[i] + 0x80) & 0xff;
+        }
+    }
+    else
+    {
+        uint8_t* p = (uint8_t*)pcm;
+        int32_t sample32;
+
+        for (i = 0; i < blocks; i++)
+        {
+            sample32 = decoded0[i];
+            *p++ = sample32 & 0xff;
+            *p++ = (sample32 >> 8) & 0xff;
+            *p++ = (sample32 >> 16) & 0xff;
+
+            if (decoded1 != RT_NULL)
+            {
+                sample32 = decoded1[i];
+                *p++ = sample32 & 0xff;
+                *p++ = (sample32 >> 8) & 0xff;
+                *p++ = (sample32 >> 16) & 0xff;
+            }
+        }
+    }
+}
+
+struct ape_decoder* ape_decoder_create(int fd, void* arena, rt_size_t size)
+{
+    struct ape_decoder* dec;
+    struct ape_ctx_t* ctx;
+    rt_uint8_t* ptr = RT_NULL;
+    rt_uint8_t* end = RT_NULL;
+    int bufsize;
+    int i, n;
+
+    if (arena != RT_NULL)
+    {
+        ptr = (rt_uint8_t*)RT_ALIGN((rt_ubase_t)arena, APE_ALIGN);
+        end = (rt_uint8_t*)arena + size;
+        if (ptr + RT_ALIGN(sizeof(struct ape_decoder), APE_ALIGN) > end)
+            return RT_NULL;
+
+        dec = (struct ape_decoder*)ptr;
+        ptr += RT_ALIGN(sizeof(struct ape_decoder), APE_ALIGN);
+    }
+    else
+    {
+        dec = (struct ape_decoder*)rt_malloc(sizeof(struct ape_decoder));
+        if (dec == RT_NULL)
+            return RT_NULL;
+    }
+
+    rt_memset(dec, 0, sizeof(struct ape_decoder));
+    dec->heap = (arena == RT_NULL);
+    dec->fd = fd;
+    ctx = &dec->ctx;
+
+    /* Read the file headers to populate the ape_ctx struct */
+    if (ape_parseheader(fd, ctx) < 0)
+        goto __error;
+
+    if ((ctx->fileversion < APE_MIN_VERSION) ||
+        (ctx->fileversion > APE_MAX_VERSION))
+        goto __error;
+
+    if ((ctx->channels != 1 && ctx->channels != 2) ||
+        (ctx->bps != 8 && ctx->bps != 16 && ctx->bps != 24))
+        goto __error;
+
+    /* read() may DMA straight into the window, keep it out of the arena */
+    dec->inbuffer = (unsigned char*)rt_malloc(APE_INPUT_CHUNKSIZE);
+    if (dec->inbuffer == RT_NULL)
+        goto __error;
+
+    /* the buffers depend on the compression level */
+    bufsize = ape_buffers_size(ctx->compressiontype, ctx->channels);
+    if (bufsize < 0)
+        goto __error;
+
+    if (arena != RT_NULL)
+    {
+        if (ptr + bufsize > end)
+            goto __error;
+    }
+    else
+    {
+        dec->buffers = rt_malloc(bufsize + APE_ALIGN);
+        if (dec->buffers == RT_NULL)
+            goto __error;
+        ptr = (rt_uint8_t*)RT_ALIGN((rt_ubase_t)dec->buffers, APE_ALIGN);
+    }
+
+    for (i = 0; i < APE_FILTER_STAGES; i++)
+    {
+        n = ape_filter_bufsize(ctx->compressiontype, i);
+        if (n > 0)
+        {
+            ctx->filterbuf[i] = (filter_int*)ptr;
+            ptr += RT_ALIGN(n, APE_ALIGN);
+        }
+    }
+
+    dec->decoded0 = (int32_t*)ptr;
+    ptr += APE_DECODE_BLOCKS * sizeof(int32_t);
+    if (ctx->channels == 2)
+    {
+        dec->decoded1 = (int32_t*)ptr;
+        ptr += APE_DECODE_BLOCKS * sizeof(int32_t);
+    }
+
+    if (ape_decoder_seek(dec, 0) < 0)
+        goto __error;
+
+    return dec;
+
+__error:
+    ape_decoder_free(dec);
+    return RT_NULL;
+}
+
+int ape_decoder_decode(struct ape_decoder* dec, void* pcm, int blocks)
+{
+    struct ape_ctx_t* ctx = &dec->ctx;
+    int bytesconsumed;
+    int res;
+
+    if (dec->frameblocks == 0)
+    {
+        if (dec->currentframe >= ctx->totalframes)
+            return 0;
+
+        /* Calculate how many blocks there are in this frame */
+        if (dec->currentframe == (ctx->totalframes - 1))
+            dec->frameblocks = ctx->finalframeblocks;
+        else
+            dec->frameblocks = ctx->blocksperframe;
+
+        if (dec->frameblocks <= 0)
+            return -1;
+
+        ctx->currentframeblocks = dec->frameblocks;
+
+        /* Initialise the frame decoder */
+        init_frame_decoder(ctx, dec->inbuffer, &dec->firstbyte,
+                           &bytesconsumed);
+        if (ape_decoder_consume(dec, bytesconsumed) < 0)
+            return -1;
+    }
+
+    if (blocks > APE_DECODE_BLOCKS)
+        blocks = APE_DECODE_BLOCKS;
+    if (blocks > dec->frameblocks)
+        blocks = dec->frameblocks;
+
+    res = decode_chunk(ctx, dec->inbuffer, &dec->firstbyte, &bytesconsumed,
+                       dec->decoded0, dec->decoded1, blocks);
+    if (res < 0)
+        return res;
+
+    if (ape_decoder_consume(dec, bytesconsumed) < 0)
+        return -1;
+
+    dec->frameblocks -= blocks;
+    if (dec->frameblocks == 0)
+        dec->currentframe++;
+
+    ape_decoder_to_pcm(dec, pcm, blocks);
+
+    return blocks;
+}
+
+int ape_decoder_seek(struct ape_decoder* dec, uint32_t frame)
+{
+    struct ape_ctx_t* ctx = &dec->ctx;
+    uint32_t pos;
+    int n;
+
+    if (frame >= ctx->totalframes)
+        return -1;
+
+    if (frame == 0)
+    {
+        pos = ctx->firstframe;
+    }
+    else
+    {
+        if (frame >= ctx->numseekpoints)
+            return -1;
+
+        pos = ctx->seektable[frame];
+        if (pos < ctx->firstframe)
+            return -1;
+    }
+
+    /* The frames are always 32-bit aligned - so we need to account for this */
+    if (lseek(dec->fd, pos & ~3, SEEK_SET) < 0)
+        return -1;
+
+    /* nothing more to decode unless the window fills */
+    dec->currentframe = ctx->totalframes;
+    dec->frameblocks = 0;
+
+    n = read(dec->fd, dec->inbuffer, APE_INPUT_CHUNKSIZE);
+    if (n <= 0)
+        return -1;
+
+    dec->bytesinbuffer = n;
+    dec->firstbyte = 3 - (pos & 3);
+    dec->currentframe = frame;
+
+    return 0;
+}
+
+void ape_decoder_destroy(struct ape_decoder* dec)
+{
+    if (dec != RT_NULL)
+        ape_decoder_free(dec);
+}
@@ -0,0 +1,86 @@
+/*
+
+libdemac - A Monkey's Audio decoder
+
+Instance based decoder for RT-Thread
+
+Copyright (C) 2013 RT-Thread Development Team
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
+
+*/
+
+#ifndef _APE_INSTANCE_H
+#define _APE_INSTANCE_H
+
+#include <rtthread.h>
+#include "parser.h"
+
+/* Blocks decoded per call at most, and size of the compressed data window */
+#define APE_DECODE_BLOCKS   1152
+#define APE_INPUT_CHUNKSIZE (5*1024)
+
+/* All the state of one stream. The buffers are carved from the arena
+ * given to ape_decoder_create(), or from the heap when there is none:
+ *
+ *   struct ape_decoder                 ~2.6K
+ *   filter histories                   0 (1000) ... 24768 bytes (5000)
+ *   decoded samples                    APE_DECODE_BLOCKS * 4 per channel
+ *
+ * The compressed data window (APE_INPUT_CHUNKSIZE) is always taken from
+ * the heap: the SD card driver reads by DMA straight into an aligned
+ * buffer, and the DMA can not reach an arena in CCM.
+ */
+struct ape_decoder
+{
+    struct ape_ctx_t ctx;           /* header info and decoder state */
+
+    int fd;
+    unsigned char* inbuffer;
+    int bytesinbuffer;
+    int firstbyte;
+
+    int32_t* decoded0;
+    int32_t* decoded1;
+
+    uint32_t currentframe;
+    int frameblocks;                /* blocks left in the current frame */
+
+    void* buffers;                  /* heap block of the buffers, or RT_NULL */
+    rt_uint8_t heap;                /* the decoder itself is on the heap */
+};
+
+/* bytes an arena needs for a stream of the given compression level, 0 if
+   the level is unknown */
+rt_size_t ape_decoder_memsize(int compressiontype);
+
+/* an arena of this size takes a stream of any level: 5000 needs the most,
+   some 36K on the Cortex-M4 */
+#define APE_DECODER_ARENA_SIZE  (38*1024)
+
+/* parse the header of the file open at fd; arena may be RT_NULL */
+struct ape_decoder* ape_decoder_create(int fd, void* arena, rt_size_t size);
+
+/* decode up to blocks (APE_DECODE_BLOCKS at most) into interleaved PCM of
+   ctx.bps bits; returns the blocks decoded, 0 at the end of the stream */
+int ape_decoder_decode(struct ape_decoder* dec, void* pcm, int blocks);
+
+/* continue decoding at the start of frame, through the seek table */
+int ape_decoder_seek(struct ape_decoder* dec, uint32_t frame);
+
+/* release the buffers; the file is left open */
+void ape_decoder_destroy(struct ape_decoder* dec);
+
+#endif
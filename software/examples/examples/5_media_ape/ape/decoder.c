@@ -31,34 +31,29 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 #include "filter.h"
 #include "demac_config.h"
 
-/* Statically allocate the filter buffers */
-
-#ifdef FILTER256_IRAM
-static filter_int filterbuf32[(32*3 + FILTER_HISTORY_SIZE) * 2]   
-                  IBSS_ATTR_DEMAC MEM_ALIGN_ATTR; 
-                  /* 2432 or 4864 bytes */
-static filter_int filterbuf256[(256*3 + FILTER_HISTORY_SIZE) * 2]
-                  IBSS_ATTR_DEMAC MEM_ALIGN_ATTR; 
-                  /* 5120 or 10240 bytes */
-#define FILTERBUF64 filterbuf256
-#define FILTERBUF32 filterbuf32
-#define FILTERBUF16 filterbuf32
-#else
-static filter_int filterbuf64[(64*3 + FILTER_HISTORY_SIZE) * 2]   
-                  IBSS_ATTR_DEMAC MEM_ALIGN_ATTR; 
-                  /* 2432 or 4864 bytes */
-static filter_int filterbuf256[(256*3 + FILTER_HISTORY_SIZE) * 2]
-                  MEM_ALIGN_ATTR; /* 5120 or 10240 bytes */
-#define FILTERBUF64 filterbuf64
-#define FILTERBUF32 filterbuf64
-#define FILTERBUF16 filterbuf64
-#endif
+/* Filter orders of each compression level, in the order they are applied.
+   The history buffers are allocated by the caller, see ape_filter_bufsize() */
+static const int16_t filter_orders[5][APE_FILTER_STAGES] =
+{
+    {    0,    0,    0 },   /* 1000 */
+    {   16,    0,    0 },   /* 2000 */
+    {   64,    0,    0 },   /* 3000 */
+    {   32,  256,    0 },   /* 4000 */
+    {   16,  256, 1280 },   /* 5000 */
+};
+
+int ape_filter_bufsize(int compressiontype, int stage)
+{
+    int level = compressiontype / 1000 - 1;
 
-/* This is only needed for "insane" files, and no current Rockbox targets
-   can hope to decode them in realtime, except the Gigabeat S (at 528MHz). */
-static filter_int filterbuf1280[(1280*3 + FILTER_HISTORY_SIZE) * 2] 
-                  IBSS_ATTR_DEMAC_INSANEBUF MEM_ALIGN_ATTR;
-                  /* 17408 or 34816 bytes */
+    if ((compressiontype % 1000) != 0 || level < 0 || level > 4)
+        return -1;
+
+    if (filter_orders[level][stage] == 0)
+        return 0;
+
+    return FILTER_BUFSIZE(filter_orders[level][stage]);
+}
 
 void init_frame_decoder(struct ape_ctx_t* ape_ctx,
                         unsigned char* inbuffer, int* firstbyte,
@@ -73,22 +68,22 @@ void init_frame_decoder(struct ape_ctx_t* ape_ctx,
     switch (ape_ctx->compressiontype)
     {
         case 2000:
-            init_filter_16_11(FILTERBUF16);
+            init_filter_16_11(ape_ctx->filter[0], ape_ctx->filterbuf[0]);
             break;
 
         case 3000:
-            init_filter_64_11(FILTERBUF64);
+            init_filter_64_11(ape_ctx->filter[0], ape_ctx->filterbuf[0]);
             break;
 
         case 4000:
-            init_filter_256_13(filterbuf256);
-            init_filter_32_10(FILTERBUF32);
+            init_filter_32_10(ape_ctx->filter[0], ape_ctx->filterbuf[0]);
+            init_filter_256_13(ape_ctx->filter[1], ape_ctx->filterbuf[1]);
             break;
 
         case 5000:
-            init_filter_1280_15(filterbuf1280);
-            init_filter_256_13(filterbuf256);
-            init_filter_16_11(FILTERBUF32);
+            init_filter_16_11(ape_ctx->filter[0], ape_ctx->filterbuf[0]);
+            init_filter_256_13(ape_ctx->filter[1], ape_ctx->filterbuf[1]);
+            init_filter_1280_15(ape_ctx->filter[2], ape_ctx->filterbuf[2]);
     }
 }
 
@@ -121,22 +116,22 @@ int  decode_chunk(struct ape_ctx_t* ape_ctx,
         switch (ape_ctx->compressiontype)
         {
             case 2000:
-                apply_filter_16_11(ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_16_11(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
                 break;
     
             case 3000:
-                apply_filter_64_11(ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_64_11(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
                 break;
     
             case 4000:
-                apply_filter_32_10(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_256_13(ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_32_10(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_256_13(ape_ctx->filter[1],ape_ctx->fileversion,0,decoded0,count);
                 break;
     
             case 5000:
-                apply_filter_16_11(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_256_13(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_1280_15(ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_16_11(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_256_13(ape_ctx->filter[1],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_1280_15(ape_ctx->filter[2],ape_ctx->fileversion,0,decoded0,count);
         }
 
         /* Now apply the predictor decoding */
@@ -174,29 +169,29 @@ int  decode_chunk(struct ape_ctx_t* ape_ctx,
         switch (ape_ctx->compressiontype)
         {
             case 2000:
-                apply_filter_16_11(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_16_11(ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_16_11(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_16_11(ape_ctx->filter[0],ape_ctx->fileversion,1,decoded1,count);
                 break;
     
             case 3000:
-                apply_filter_64_11(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_64_11(ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_64_11(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_64_11(ape_ctx->filter[0],ape_ctx->fileversion,1,decoded1,count);
                 break;
     
             case 4000:
-                apply_filter_32_10(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_32_10(ape_ctx->fileversion,1,decoded1,count);
-                apply_filter_256_13(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_256_13(ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_32_10(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_32_10(ape_ctx->filter[0],ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_256_13(ape_ctx->filter[1],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_256_13(ape_ctx->filter[1],ape_ctx->fileversion,1,decoded1,count);
                 break;
     
             case 5000:
-                apply_filter_16_11(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_16_11(ape_ctx->fileversion,1,decoded1,count);
-                apply_filter_256_13(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_256_13(ape_ctx->fileversion,1,decoded1,count);
-                apply_filter_1280_15(ape_ctx->fileversion,0,decoded0,count);
-                apply_filter_1280_15(ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_16_11(ape_ctx->filter[0],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_16_11(ape_ctx->filter[0],ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_256_13(ape_ctx->filter[1],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_256_13(ape_ctx->filter[1],ape_ctx->fileversion,1,decoded1,count);
+                apply_filter_1280_15(ape_ctx->filter[2],ape_ctx->fileversion,0,decoded0,count);
+                apply_filter_1280_15(ape_ctx->filter[2],ape_ctx->fileversion,1,decoded1,count);
         }
 
         /* Now apply the predictor decoding */
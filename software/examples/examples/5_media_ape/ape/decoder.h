@@ -37,4 +37,9 @@ int decode_chunk(struct ape_ctx_t* ape_ctx,
                  int* bytesconsumed,
                  int32_t* decoded0, int32_t* decoded1, 
                  int count);
+
+/* Bytes of filter history for a stage of a compression level: 0 when the
+   stage is not used, -1 for an unknown compression level */
+int ape_filter_bufsize(int compressiontype, int stage);
+
 #endif
@@ -25,21 +25,23 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 /* 
 
 This example is intended to demonstrate how the decoder can be used in
-embedded devices - there is no usage of dynamic memory (i.e. no
-malloc/free) and small buffer sizes are chosen to minimise both the
+embedded devices - small buffer sizes are chosen to minimise both the
 memory usage and decoding latency.
 
-This implementation requires the following memory and supports decoding of all APE files up to 24-bit Stereo.
+All the decoder state is kept in one struct ape_decoder (ape_decoder.c),
+carved from a static arena in CCM, where the filters read and write it
+without contending with the audio DMA for SRAM. Its size depends on the
+compression level of the file (ape_decoder_memsize()):
 
-32768 - data from the input stream to be presented to the decoder in one contiguous chunk.
-18432 - decoding buffer (left channel)
-18432 - decoding buffer (right channel)
+4608 - decoding buffer (left channel)
+4608 - decoding buffer (right channel)
+2624 - decoder state, including the predictor histories
 
-17408+5120+2240 - buffers used for filter histories (compression levels 2000-5000)
+0 to 17408+5120+2240 - buffers used for filter histories (compression levels 1000-5000)
 
-In addition, this example uses a static 27648 byte buffer as temporary
-storage for outputting the data to a WAV file but that could be
-avoided by writing the decoded data one sample at a time.
+In addition, the heap holds what a DMA reads or writes: the 5120 byte
+window of the input stream presented to the decoder in one contiguous
+chunk, and two PCM buffers of APE_DECODE_BLOCKS samples for the audio.
 
 */
 
@@ -48,91 +50,17 @@ avoided by writing the decoded data one sample at a time.
 #include <dfs_posix.h>
 #include "demac.h"
 #include "board.h"
-#include "parser.h"
+#include "ape_decoder.h"
 
+/* the decoder of the file being played, one at a time like ape_sem */
+static rt_uint8_t ape_arena[APE_DECODER_ARENA_SIZE] SECTION_CCM;
 
-#define BLOCKS_PER_LOOP     1152//4608
-#define MAX_CHANNELS        2
-
-#define INPUT_CHUNKSIZE     (5*1024)
-
-#ifndef MIN
-#define MIN(a,b) ((a) < (b) ? (a) : (b))
-#endif
-
-//apeṹȫֱ
-struct ape_ctx_t ape_ctx;
-
-
-// PCM Buffer
-static unsigned char PCM_buffer[BLOCKS_PER_LOOP*4];
-static unsigned char PCM_buffer1[BLOCKS_PER_LOOP*4];
-static int32_t decoded0[BLOCKS_PER_LOOP];
-static int32_t decoded1[BLOCKS_PER_LOOP];
-
-/* We assume that 32KB of compressed data is enough to extract up to
-   27648 bytes of decompressed data. */
-//file buffer
-static unsigned char inbuffer[INPUT_CHUNKSIZE];
+/* seek request in ms from the shell, -1 if none */
+static volatile int ape_seek_request = -1;
 
 //õź
 static struct rt_semaphore ape_sem;
 
-//ʱdecoded0decoded1ϳCODEPCM
-void __inline decoded_to_PCM(int32_t* decoded0, int32_t* decoded1,unsigned char *PCM_buffer ,int blockstodecode)
-{
-		    unsigned char* p;
-		    int16_t  sample16;
-		    int32_t  sample32;
-			int i;
-
-
-            /* Convert the output samples to WAV format and write to output file */
-            p = PCM_buffer;
-            if (ape_ctx.bps == 8) {
-                for (i = 0 ; i < blockstodecode ; i++)
-                {
-                    /* 8 bit WAV uses unsigned samples */
-                    *(p++) = (decoded0[i] + 0x80) & 0xff;
-
-                    if (ape_ctx.channels == 2) {
-                        *(p++) = (decoded1[i] + 0x80) & 0xff;
-                    }
-                }
-            } else if (ape_ctx.bps == 16) {
-                for (i = 0 ; i < blockstodecode ; i++)
-                {
-                    sample16 = decoded0[i];
-                    *(p++) = sample16 & 0xff;
-                    *(p++) = (sample16 >> 8) & 0xff;
-
-                    if (ape_ctx.channels == 2) {
-                        sample16 = decoded1[i];
-                        *(p++) = sample16 & 0xff;
-                        *(p++) = (sample16 >> 8) & 0xff;
-                    }
-                }
-            } else if (ape_ctx.bps == 24) {
-                for (i = 0 ; i < blockstodecode ; i++)
-                {
-                    sample32 = decoded0[i];
-                    *(p++) = sample32 & 0xff;
-                    *(p++) = (sample32 >> 8) & 0xff;
-                    *(p++) = (sample32 >> 16) & 0xff;
-
-                    if (ape_ctx.channels == 2) {
-                        sample32 = decoded1[i];
-                        *(p++) = sample32 & 0xff;
-                        *(p++) = (sample32 >> 8) & 0xff;
-                        *(p++) = (sample32 >> 16) & 0xff;
-                    }
-                }
-            }
-
-
-}
-
-
 //DMAص,DMAPCM bufferݷ,ִд˺
 static rt_err_t ape_decoder_tx_done(rt_device_t dev, void *buffer)
 {
@@ -142,33 +70,48 @@ static rt_err_t ape_decoder_tx_done(rt_device_t dev, void *buffer)
 	return RT_EOK;
 }
 
-
 int ape(char* path)
 {
     int fd;
-    int currentframe;
-    int nblocks;
-    int bytesconsumed;
-    int bytesinbuffer;
-    int blockstodecode;
-    int res;
-    int firstbyte;
-	int n;
-    int crc_errors = 0;
-	int cnt = 0;
+    int res = 0;
+    int blocks;
+    int blockalign;
+    int cnt = 0;
+    uint32_t frame;
+    struct ape_decoder* dec;
+    unsigned char* pcm;
+    unsigned char* buffer;
 	rt_device_t snd_device;
 
 	extern void vol(uint16_t v) ;
 	vol(50); 
 
+	fd=open(path,O_RDONLY,0);
+    if (fd < 0) return -1;
+
+    /* Read the file headers and allocate the decoder for this file */
+    dec = ape_decoder_create(fd, ape_arena, sizeof(ape_arena));
+    if (dec == RT_NULL) {
+        rt_kprintf("Cannot read header or out of memory\n");
+        close(fd);
+        return -1;
+    }
+
+    ape_dumpinfo(&dec->ctx);
+
+    /* two PCM buffers, one is played while the other one is decoded */
+    blockalign = dec->ctx.channels * (dec->ctx.bps / 8);
+    pcm = (unsigned char*)rt_malloc(APE_DECODE_BLOCKS * blockalign * 2);
+    if (pcm == RT_NULL) {
+        ape_decoder_destroy(dec);
+        close(fd);
+        return -1;
+    }
+
 	//ûڴ..ҪΪ²֪ʹ
 	if (rt_sem_init(&ape_sem, "ape_sem", 2, RT_IPC_FLAG_FIFO) != RT_EOK)
 		rt_kprintf("init ape_sem semaphore failed\n");
 
-
-	fd=open(path,O_RDONLY,0);
-    if (fd < 0) return -1;
-
 	/* open audio device */
 	snd_device = rt_device_find("snd");
 	if (snd_device != RT_NULL)
@@ -180,116 +123,64 @@ int ape(char* path)
 		rt_device_open(snd_device, RT_DEVICE_OFLAG_WRONLY);
 	}
 
-
-    /* Read the file headers to populate the ape_ctx struct */
-    if (ape_parseheader(fd,&ape_ctx) < 0) {
-        rt_kprintf("Cannot read header\n");
-        close(fd);
-        return -1;
-    }
-
-    if ((ape_ctx.fileversion < APE_MIN_VERSION) || (ape_ctx.fileversion > APE_MAX_VERSION)) {
-        rt_kprintf("Unsupported file version - %.2f\n", ape_ctx.fileversion/1000.0);
-        close(fd);
-        return -2;
-    }
-
-    ape_dumpinfo(&ape_ctx);
-
-    currentframe = 0;
-
-    /* Initialise the buffer */
-    lseek(fd, ape_ctx.firstframe, SEEK_SET);
-    bytesinbuffer = read(fd, inbuffer, INPUT_CHUNKSIZE);
-    firstbyte = 3;  /* Take account of the little-endian 32-bit byte ordering */
-
 	//set CODEC's samplerate
-	rt_device_control(snd_device, 2, &(ape_ctx.samplerate));
+	rt_device_control(snd_device, 2, &(dec->ctx.samplerate));
 
+    ape_seek_request = -1;
 
     /* The main decoding loop - we decode the frames a small chunk at a time */
-    while (currentframe < ape_ctx.totalframes)
+    while (1)
     {
+        if (ape_seek_request >= 0)
+        {
+            /* the seek table points to frames, start at the one holding ms */
+            frame = (uint32_t)((uint64_t)ape_seek_request *
+                    dec->ctx.samplerate / 1000 / dec->ctx.blocksperframe);
+            if (ape_decoder_seek(dec, frame) < 0)
+                rt_kprintf("ape: seek to frame %d failed\n", frame);
+            ape_seek_request = -1;
+        }
 
-        /* Calculate how many blocks there are in this frame */
-        if (currentframe == (ape_ctx.totalframes - 1))
-            nblocks = ape_ctx.finalframeblocks;
-        else
-            nblocks = ape_ctx.blocksperframe;
-
-        ape_ctx.currentframeblocks = nblocks;
-
-        /* Initialise the frame decoder */
-        init_frame_decoder(&ape_ctx, inbuffer, &firstbyte, &bytesconsumed);
-
-        /* Update buffer */
-        rt_memmove(inbuffer,inbuffer + bytesconsumed, bytesinbuffer - bytesconsumed);
-        bytesinbuffer -= bytesconsumed;
+		//Իź,ȡ.
+		rt_sem_take(&ape_sem, RT_WAITING_FOREVER);
 
-        n = read(fd, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
-        bytesinbuffer += n;
+		//ʹPCM_buffer
+		buffer = pcm + (cnt++ & 1) * APE_DECODE_BLOCKS * blockalign;
 
-        /* Decode the frame a chunk at a time */
-        while (nblocks > 0)
+        blocks = ape_decoder_decode(dec, buffer, APE_DECODE_BLOCKS);
+        if (blocks <= 0)
         {
-            blockstodecode = MIN(BLOCKS_PER_LOOP, nblocks);
-
-			//Իź,ȡ.
-		 	rt_sem_take(&ape_sem, RT_WAITING_FOREVER);
-
-			 //ʹPCM_buffer
-	   		 if(cnt++ & 1)
-	   		 {	   
-			       if ((res = decode_chunk(&ape_ctx, inbuffer, &firstbyte,
-                                   		   &bytesconsumed,
-                                   		   decoded0, decoded1,
-                                           blockstodecode)) < 0)
-            		{
-                		/* Frame decoding error, abort */
-                		close(fd);
-                		return res;
-            		}
-			  		decoded_to_PCM(decoded0,decoded1,PCM_buffer ,blockstodecode);
-		   			rt_device_write(snd_device, 0, (int16_t *)PCM_buffer, ((BLOCKS_PER_LOOP * 4) ));
-		 	 }
-			 else
-		 	 {
-			        if ((res = decode_chunk(&ape_ctx, inbuffer, &firstbyte,
-                                      		&bytesconsumed,
-                                    		decoded0, decoded1,
-                                    		blockstodecode)) < 0)
-            		{
-                		/* Frame decoding error, abort */
-                		close(fd);
-                		return res;
-            		}
-
-					decoded_to_PCM(decoded0,decoded1,PCM_buffer1 ,blockstodecode);
-		   			rt_device_write(snd_device, 0, (int16_t *)PCM_buffer1, ((BLOCKS_PER_LOOP * 4) ));
-		 	 }
-
-            /* Update the buffer */
-            memmove(inbuffer,inbuffer + bytesconsumed, bytesinbuffer - bytesconsumed);
-            bytesinbuffer -= bytesconsumed;
-
-            n = read(fd, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
-            bytesinbuffer += n;
-
-            /* Decrement the block count */
-            nblocks -= blockstodecode;
+            /* end of stream, or frame decoding error */
+            res = blocks;
+            rt_sem_release(&ape_sem);
+            break;
         }
 
-        currentframe++;
+		rt_device_write(snd_device, 0, buffer, blocks * blockalign);
     }
 
+    /* wait until both PCM buffers are played */
+    rt_sem_take(&ape_sem, RT_TICK_PER_SECOND);
+    rt_sem_take(&ape_sem, RT_TICK_PER_SECOND);
+    rt_sem_detach(&ape_sem);
+
+    rt_free(pcm);
+    ape_decoder_destroy(dec);
     close(fd);
 
-    if (crc_errors > 0)
-        return -1;
-    else
-        return 0;
+    return res;
+}
+
+/* seek the file being played to ms */
+int ape_seek(int ms)
+{
+    if (ms < 0) return -1;
+    ape_seek_request = ms;
+    return 0;
 }
+
 #ifdef RT_USING_FINSH
 #include <finsh.h>
 FINSH_FUNCTION_EXPORT(ape, ape(char* path) );
+FINSH_FUNCTION_EXPORT(ape_seek, seek the playing ape file to ms);
 #endif
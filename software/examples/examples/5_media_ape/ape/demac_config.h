@@ -92,10 +92,24 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 #define MEM_ALIGN_ATTR __attribute__((aligned(16)))
         /* adjust to target architecture for best performance */
 
-#define ICODE_ATTR_DEMAC
+#ifndef __ASSEMBLER__
+#include "board.h"
+#endif
+
+/* Code in SRAM. The filter buffers and decoder state belong to struct
+ * ape_decoder; demac.c creates it in a CCM arena. Nothing in the decoder
+ * uses the IBSS attributes any more. */
+#define FILTER256_IRAM
+#define ICODE_ATTR_DEMAC          SECTION_FASTCODE
 #define ICONST_ATTR_DEMAC
-#define IBSS_ATTR_DEMAC
-#define IBSS_ATTR_DEMAC_INSANEBUF
+#define IBSS_ATTR_DEMAC           SECTION_CCM
+#define IBSS_ATTR_DEMAC_INSANEBUF SECTION_CCM
+
+/* Cortex-M4: the filters use the packed 16-bit DSP instructions (SMLAD,
+ * SADD16, SSUB16) through the CMSIS intrinsics. */
+#if defined(__ARM_ARCH_7EM__) || defined(__TARGET_ARCH_7E_M) || defined(__ARM7EM__)
+#define CPU_ARM_V7EM
+#endif
 
 /* Use to give gcc hints on which branch is most likely taken */
 #if defined(__GNUC__) && __GNUC__ >= 3
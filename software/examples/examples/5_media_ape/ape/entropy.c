@@ -122,21 +122,20 @@ each function (and the RNGC macro)).
    for aligned reads.
 */
 
-static unsigned char* bytebuffer IBSS_ATTR_DEMAC;
-static int bytebufferoffset IBSS_ATTR_DEMAC;
+/* The decoder state lives in struct entropy_t (parser.h), one per stream */
 
-static __inline  void skip_byte(void)
+static __inline  void skip_byte(struct entropy_t* e)
 {
-    bytebufferoffset--;
-    bytebuffer += bytebufferoffset & 4;
-    bytebufferoffset &= 3;
+    e->bytebufferoffset--;
+    e->bytebuffer += e->bytebufferoffset & 4;
+    e->bytebufferoffset &= 3;
 }
 
-static __inline  int read_byte(void)
+static __inline  int read_byte(struct entropy_t* e)
 {
-    int ch = bytebuffer[bytebufferoffset];
+    int ch = e->bytebuffer[e->bytebufferoffset];
 
-    skip_byte();
+    skip_byte(e);
 
     return ch;
 }
@@ -151,31 +150,21 @@ static __inline  int read_byte(void)
 #define EXTRA_BITS ((CODE_BITS-2) % 8 + 1)
 #define BOTTOM_VALUE (TOP_VALUE >> 8)
 
-struct rangecoder_t
-{
-    uint32_t low;        /* low end of interval */
-    uint32_t range;      /* length of interval */
-    uint32_t help;       /* bytes_to_follow resp. intermediate value */
-    unsigned int buffer; /* buffer for input/output */
-};
-
-static struct rangecoder_t rc IBSS_ATTR_DEMAC;
-
 /* Start the decoder */
-static __inline  void range_start_decoding(void)
+static __inline  void range_start_decoding(struct entropy_t* e)
 {
-    rc.buffer = read_byte();
-    rc.low = rc.buffer >> (8 - EXTRA_BITS);
-    rc.range = (uint32_t) 1 << EXTRA_BITS;
+    e->rc.buffer = read_byte(e);
+    e->rc.low = e->rc.buffer >> (8 - EXTRA_BITS);
+    e->rc.range = (uint32_t) 1 << EXTRA_BITS;
 }
 
-static __inline  void range_dec_normalize(void)
+static __inline  void range_dec_normalize(struct entropy_t* e)
 {
-    while (rc.range <= BOTTOM_VALUE)
+    while (e->rc.range <= BOTTOM_VALUE)
     {   
-        rc.buffer = (rc.buffer << 8) | read_byte();
-        rc.low = (rc.low << 8) | ((rc.buffer >> 1) & 0xff);
-        rc.range <<= 8;
+        e->rc.buffer = (e->rc.buffer << 8) | read_byte(e);
+        e->rc.low = (e->rc.low << 8) | ((e->rc.buffer >> 1) & 0xff);
+        e->rc.range <<= 8;
     }
 }
 
@@ -183,55 +172,55 @@ static __inline  void range_dec_normalize(void)
 /* tot_f is the total frequency                              */
 /* or: totf is (code_value)1<<shift                                      */
 /* returns the culmulative frequency                         */
-static __inline  int range_decode_culfreq(int tot_f)
+static __inline  int range_decode_culfreq(struct entropy_t* e, int tot_f)
 {
-    range_dec_normalize();
-    rc.help = UDIV32(rc.range, tot_f);
-    return UDIV32(rc.low, rc.help);
+    range_dec_normalize(e);
+    e->rc.help = UDIV32(e->rc.range, tot_f);
+    return UDIV32(e->rc.low, e->rc.help);
 }
 
-static __inline  int range_decode_culshift(int shift)
+static __inline  int range_decode_culshift(struct entropy_t* e, int shift)
 {
-    range_dec_normalize();
-    rc.help = rc.range >> shift;
-    return UDIV32(rc.low, rc.help);
+    range_dec_normalize(e);
+    e->rc.help = e->rc.range >> shift;
+    return UDIV32(e->rc.low, e->rc.help);
 }
 
 
 /* Update decoding state                                     */
 /* sy_f is the interval length (frequency of the symbol)     */
 /* lt_f is the lower end (frequency sum of < symbols)        */
-static __inline  void range_decode_update(int sy_f, int lt_f)
+static __inline  void range_decode_update(struct entropy_t* e, int sy_f, int lt_f)
 {
-    rc.low -= rc.help * lt_f;
-    rc.range = rc.help * sy_f;
+    e->rc.low -= e->rc.help * lt_f;
+    e->rc.range = e->rc.help * sy_f;
 }
 
 
 /* Decode a byte/short without modelling                     */
-static __inline  unsigned char decode_byte(void)
-{   int tmp = range_decode_culshift(8);
-    range_decode_update( 1,tmp);
+static __inline  unsigned char decode_byte(struct entropy_t* e)
+{   int tmp = range_decode_culshift(e, 8);
+    range_decode_update(e, 1,tmp);
     return tmp;
 }
 
-static __inline  unsigned short range_decode_short(void)
-{   int tmp = range_decode_culshift(16);
-    range_decode_update( 1,tmp);
+static __inline  unsigned short range_decode_short(struct entropy_t* e)
+{   int tmp = range_decode_culshift(e, 16);
+    range_decode_update(e, 1,tmp);
     return tmp;
 }
 
 /* Decode n bits (n <= 16) without modelling - based on range_decode_short */
-static __inline  int range_decode_bits(int n)
-{   int tmp = range_decode_culshift(n);
-    range_decode_update( 1,tmp);
+static __inline  int range_decode_bits(struct entropy_t* e, int n)
+{   int tmp = range_decode_culshift(e, n);
+    range_decode_update(e, 1,tmp);
     return tmp;
 }
 
 
 /* Finish decoding                                           */
-static __inline  void range_done_decoding(void)
-{   range_dec_normalize();      /* normalize to use up all bytes */
+static __inline  void range_done_decoding(struct entropy_t* e)
+{   range_dec_normalize(e);      /* normalize to use up all bytes */
 }
 
 /*
@@ -240,45 +229,36 @@ static __inline  void range_done_decoding(void)
   (c) Michael Schindler
 */
 
-static __inline int range_get_symbol_3980(void)
+static __inline int range_get_symbol_3980(struct entropy_t* e)
 {
     int symbol, cf;
 
-    cf = range_decode_culshift(16);
+    cf = range_decode_culshift(e, 16);
 
     /* figure out the symbol inefficiently; a binary search would be much better */
     for (symbol = 0; counts_3980[symbol+1] <= cf; symbol++);
 
-    range_decode_update(counts_diff_3980[symbol],counts_3980[symbol]);
+    range_decode_update(e, counts_diff_3980[symbol],counts_3980[symbol]);
 
     return symbol;
 }
 
-static __inline int range_get_symbol_3970(void)
+static __inline int range_get_symbol_3970(struct entropy_t* e)
 {
     int symbol, cf;
 
-    cf = range_decode_culshift(16);
+    cf = range_decode_culshift(e, 16);
 
     /* figure out the symbol inefficiently; a binary search would be much better */
     for (symbol = 0; counts_3970[symbol+1] <= cf; symbol++);
 
-    range_decode_update(counts_diff_3970[symbol],counts_3970[symbol]);
+    range_decode_update(e, counts_diff_3970[symbol],counts_3970[symbol]);
 
     return symbol;
 }
 
 /* MAIN DECODING FUNCTIONS */
 
-struct rice_t
-{
-  uint32_t k;
-  uint32_t ksum;
-};
-
-static struct rice_t riceX IBSS_ATTR_DEMAC;
-static struct rice_t riceY IBSS_ATTR_DEMAC;
-
 static __inline void update_rice(struct rice_t* rice, int x)
 {
     rice->ksum += ((x + 1) / 2) - ((rice->ksum + 16) >> 5);
@@ -295,7 +275,7 @@ static __inline void update_rice(struct rice_t* rice, int x)
     }
 }
 
-static __inline int entropy_decode3980(struct rice_t* rice)
+static __inline int entropy_decode3980(struct entropy_t* e, struct rice_t* rice)
 {
     int base, x, pivot, overflow;
 
@@ -303,11 +283,11 @@ static __inline int entropy_decode3980(struct rice_t* rice)
     if (UNLIKELY(pivot == 0))
         pivot=1;
 
-    overflow = range_get_symbol_3980();
+    overflow = range_get_symbol_3980(e);
 
     if (UNLIKELY(overflow == (MODEL_ELEMENTS-1))) {
-        overflow = range_decode_short() << 16;
-        overflow |= range_decode_short();
+        overflow = range_decode_short(e) << 16;
+        overflow |= range_decode_short(e);
     }
 
     if (pivot >= 0x10000) {
@@ -323,17 +303,17 @@ static __inline int entropy_decode3980(struct rice_t* rice)
         */
         lo_bits = (nbits - 16);
 
-        base_hi = range_decode_culfreq((pivot >> lo_bits) + 1);
-        range_decode_update(1, base_hi);
+        base_hi = range_decode_culfreq(e, (pivot >> lo_bits) + 1);
+        range_decode_update(e, 1, base_hi);
 
-        base_lo = range_decode_culshift(lo_bits);
-        range_decode_update(1, base_lo);
+        base_lo = range_decode_culshift(e, lo_bits);
+        range_decode_update(e, 1, base_lo);
 
         base = (base_hi << lo_bits) + base_lo;
     } else {
         /* Codepath for 16-bit streams */
-        base = range_decode_culfreq(pivot);
-        range_decode_update(1, base);
+        base = range_decode_culfreq(e, pivot);
+        range_decode_update(e, 1, base);
     }
 
     x = base + (overflow * pivot);
@@ -347,24 +327,24 @@ static __inline int entropy_decode3980(struct rice_t* rice)
 }
 
 
-static __inline int entropy_decode3970(struct rice_t* rice)
+static __inline int entropy_decode3970(struct entropy_t* e, struct rice_t* rice)
 {
     int x, tmpk;
 
-    int overflow = range_get_symbol_3970();
+    int overflow = range_get_symbol_3970(e);
 
     if (UNLIKELY(overflow == (MODEL_ELEMENTS - 1))) {
-        tmpk = range_decode_bits(5);
+        tmpk = range_decode_bits(e, 5);
         overflow = 0;
     } else {
         tmpk = (rice->k < 1) ? 0 : rice->k - 1;
     }
 
     if (tmpk <= 16) {
-        x = range_decode_bits(tmpk);
+        x = range_decode_bits(e, tmpk);
     } else {
-        x = range_decode_short();
-        x |= (range_decode_bits(tmpk - 16) << 16);
+        x = range_decode_short(e);
+        x |= (range_decode_bits(e, tmpk - 16) << 16);
     }
     x += (overflow << tmpk);
 
@@ -381,42 +361,44 @@ void init_entropy_decoder(struct ape_ctx_t* ape_ctx,
                           unsigned char* inbuffer, int* firstbyte,
                           int* bytesconsumed)
 {
-    bytebuffer = inbuffer;
-    bytebufferoffset = *firstbyte;
+    struct entropy_t* e = &ape_ctx->entropy;
+
+    e->bytebuffer = inbuffer;
+    e->bytebufferoffset = *firstbyte;
 
     /* Read the CRC */
-    ape_ctx->CRC = read_byte();
-    ape_ctx->CRC = (ape_ctx->CRC << 8) | read_byte();
-    ape_ctx->CRC = (ape_ctx->CRC << 8) | read_byte();
-    ape_ctx->CRC = (ape_ctx->CRC << 8) | read_byte();
+    ape_ctx->CRC = read_byte(e);
+    ape_ctx->CRC = (ape_ctx->CRC << 8) | read_byte(e);
+    ape_ctx->CRC = (ape_ctx->CRC << 8) | read_byte(e);
+    ape_ctx->CRC = (ape_ctx->CRC << 8) | read_byte(e);
 
     /* Read the frame flags if they exist */
     ape_ctx->frameflags = 0;
     if ((ape_ctx->fileversion > 3820) && (ape_ctx->CRC & 0x80000000)) {
         ape_ctx->CRC &= ~0x80000000;
 
-        ape_ctx->frameflags = read_byte();
-        ape_ctx->frameflags = (ape_ctx->frameflags << 8) | read_byte();
-        ape_ctx->frameflags = (ape_ctx->frameflags << 8) | read_byte();
-        ape_ctx->frameflags = (ape_ctx->frameflags << 8) | read_byte();
+        ape_ctx->frameflags = read_byte(e);
+        ape_ctx->frameflags = (ape_ctx->frameflags << 8) | read_byte(e);
+        ape_ctx->frameflags = (ape_ctx->frameflags << 8) | read_byte(e);
+        ape_ctx->frameflags = (ape_ctx->frameflags << 8) | read_byte(e);
     }
     /* Keep a count of the blocks decoded in this frame */
     ape_ctx->blocksdecoded = 0;
 
     /* Initialise the rice structs */
-    riceX.k = 10;
-    riceX.ksum = (1 << riceX.k) * 16;
-    riceY.k = 10;
-    riceY.ksum = (1 << riceY.k) * 16;
+    e->riceX.k = 10;
+    e->riceX.ksum = (1 << e->riceX.k) * 16;
+    e->riceY.k = 10;
+    e->riceY.ksum = (1 << e->riceY.k) * 16;
 
     /* The first 8 bits of input are ignored. */
-    skip_byte();
+    skip_byte(e);
 
-    range_start_decoding();
+    range_start_decoding(e);
 
     /* Return the new state of the buffer */
-    *bytesconsumed = (intptr_t)bytebuffer - (intptr_t)inbuffer;
-    *firstbyte = bytebufferoffset;
+    *bytesconsumed = (intptr_t)e->bytebuffer - (intptr_t)inbuffer;
+    *firstbyte = e->bytebufferoffset;
 }
 
 void ICODE_ATTR_DEMAC entropy_decode(struct ape_ctx_t* ape_ctx,
@@ -425,8 +407,10 @@ void ICODE_ATTR_DEMAC entropy_decode(struct ape_ctx_t* ape_ctx,
                                      int32_t* decoded0, int32_t* decoded1,
                                      int blockstodecode)
 {
-    bytebuffer = inbuffer;
-    bytebufferoffset = *firstbyte;
+    struct entropy_t* e = &ape_ctx->entropy;
+
+    e->bytebuffer = inbuffer;
+    e->bytebufferoffset = *firstbyte;
 
     ape_ctx->blocksdecoded += blockstodecode;
 
@@ -440,25 +424,25 @@ void ICODE_ATTR_DEMAC entropy_decode(struct ape_ctx_t* ape_ctx,
     } else {
         if (ape_ctx->fileversion > 3970) {
             while (LIKELY(blockstodecode--)) {
-                *(decoded0++) = entropy_decode3980(&riceY);
+                *(decoded0++) = entropy_decode3980(e, &e->riceY);
                 if (decoded1 != NULL)
-                    *(decoded1++) = entropy_decode3980(&riceX);
+                    *(decoded1++) = entropy_decode3980(e, &e->riceX);
             }
         } else {
             while (LIKELY(blockstodecode--)) {
-                *(decoded0++) = entropy_decode3970(&riceY);
+                *(decoded0++) = entropy_decode3970(e, &e->riceY);
                 if (decoded1 != NULL)
-                    *(decoded1++) = entropy_decode3970(&riceX);
+                    *(decoded1++) = entropy_decode3970(e, &e->riceX);
             }
         }
     }
 
     if (ape_ctx->blocksdecoded == ape_ctx->currentframeblocks)
     {
-        range_done_decoding();
+        range_done_decoding(e);
     }
 
     /* Return the new state of the buffer */
-    *bytesconsumed = bytebuffer - inbuffer;
-    *firstbyte = bytebufferoffset;
+    *bytesconsumed = e->bytebuffer - inbuffer;
+    *firstbyte = e->bytebufferoffset;
 }
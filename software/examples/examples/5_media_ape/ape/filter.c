@@ -41,6 +41,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 
 #ifdef CPU_COLDFIRE
 #include "vector_math16_cf.h"
+#elif defined(CPU_ARM_V7EM)
+#include "vector_math16_armv7m.h"
 #elif defined(CPU_ARM) && (ARM_ARCH >= 7)
 #include "vector_math16_armv7.h"
 #elif defined(CPU_ARM) && (ARM_ARCH >= 6)
@@ -57,18 +59,6 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 
 #endif /* FILTER_BITS */
 
-struct filter_t {
-    filter_int* coeffs; /* ORDER entries */
-
-    /* We store all the filter delays in a single buffer */
-    filter_int* history_end;
-
-    filter_int* delay;
-    filter_int* adaptcoeffs;
-
-    int avg;
-};
-
 /* We name the functions according to the ORDER and FRACBITS
    pre-processor symbols and build multiple .o files from this .c file
    - this increases code-size but gives the compiler more scope for
@@ -121,6 +111,8 @@ struct filter_t {
     __res; \
 })
 #endif /* ARM_ARCH */
+#elif defined(CPU_ARM_V7EM)
+#define SATURATE(x) __SSAT(x, 16)
 #else /* CPU_ARM */
 #define SATURATE(x) (LIKELY((x) == (int16_t)(x)) ? (x) : ((x) >> 31) ^ 0x7FFF)
 #endif
@@ -262,8 +254,6 @@ static __inline void ICODE_ATTR_DEMAC do_apply_filter_3970(struct filter_t* f,
     }
 }
 
-static struct filter_t filter[2] IBSS_ATTR_DEMAC;
-
 static __inline void do_init_filter(struct filter_t* f, filter_int* buf)
 {
     f->coeffs = buf;
@@ -280,14 +270,16 @@ static __inline void do_init_filter(struct filter_t* f, filter_int* buf)
     f->avg = 0;
 }
 
-void INIT_FILTER(filter_int* buf)
+/* filter points to the pair of filters of one stage, buf holds
+   FILTER_BUFSIZE(ORDER) bytes for both channels */
+void INIT_FILTER(struct filter_t* filter, filter_int* buf)
 {
     do_init_filter(&filter[0], buf);
     do_init_filter(&filter[1], buf + ORDER*3 + FILTER_HISTORY_SIZE);
 }
 
-void ICODE_ATTR_DEMAC APPLY_FILTER(int fileversion, int channel,
-                                   int32_t* data, int count)
+void ICODE_ATTR_DEMAC APPLY_FILTER(struct filter_t* filter, int fileversion,
+                                   int channel, int32_t* data, int count)
 {
     if (fileversion >= 3980)
         do_apply_filter_3980(&filter[channel], data, count);
@@ -27,24 +27,30 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 
 #include "demac_config.h"
 
-void init_filter_16_11(filter_int* buf);
-void apply_filter_16_11(int fileversion, int channel,
-                        int32_t* decoded, int count);
+/* Bytes of history buffer for the two channels of a filter stage */
+#define FILTER_BUFSIZE(order) \
+    (((order)*3 + FILTER_HISTORY_SIZE) * 2 * sizeof(filter_int))
 
-void init_filter_64_11(filter_int* buf);
-void apply_filter_64_11(int fileversion, int channel,
-                        int32_t* decoded, int count);
+struct filter_t;
 
-void init_filter_32_10(filter_int* buf);
-void apply_filter_32_10(int fileversion, int channel,
-                        int32_t* decoded, int count);
+void init_filter_16_11(struct filter_t* filter, filter_int* buf);
+void apply_filter_16_11(struct filter_t* filter, int fileversion,
+                        int channel, int32_t* decoded, int count);
 
-void init_filter_256_13(filter_int* buf);
-void apply_filter_256_13(int fileversion, int channel,
-                         int32_t* decoded, int count);
+void init_filter_64_11(struct filter_t* filter, filter_int* buf);
+void apply_filter_64_11(struct filter_t* filter, int fileversion,
+                        int channel, int32_t* decoded, int count);
 
-void init_filter_1280_15(filter_int* buf);
-void apply_filter_1280_15(int fileversion, int channel,
-                          int32_t* decoded, int count);
+void init_filter_32_10(struct filter_t* filter, filter_int* buf);
+void apply_filter_32_10(struct filter_t* filter, int fileversion,
+                        int channel, int32_t* decoded, int count);
+
+void init_filter_256_13(struct filter_t* filter, filter_int* buf);
+void apply_filter_256_13(struct filter_t* filter, int fileversion,
+                         int channel, int32_t* decoded, int count);
+
+void init_filter_1280_15(struct filter_t* filter, filter_int* buf);
+void apply_filter_1280_15(struct filter_t* filter, int fileversion,
+                          int channel, int32_t* decoded, int count);
 
 #endif
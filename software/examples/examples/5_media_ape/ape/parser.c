@@ -340,9 +340,11 @@ int ape_parseheader(int fd, struct ape_ctx_t* ape_ctx)
             if (read_uint32(fd,&ape_ctx->seektable[i]) < 0)
             {
                  rt_free(ape_ctx->seektable);
+                 ape_ctx->seektable = NULL;
                  return -1;
             }
         }
+        ape_ctx->numseekpoints = ape_ctx->seektablelength / sizeof(uint32_t);
     }
 
     ape_ctx->firstframe = ape_ctx->junklength + ape_ctx->descriptorlength +
@@ -86,6 +86,48 @@ struct predictor_t
     int32_t historybuffer[PREDICTOR_HISTORY_SIZE + PREDICTOR_SIZE];
 };
 
+/* Range decoder state, see entropy.c */
+struct rangecoder_t
+{
+    uint32_t low;        /* low end of interval */
+    uint32_t range;      /* length of interval */
+    uint32_t help;       /* bytes_to_follow resp. intermediate value */
+    unsigned int buffer; /* buffer for input/output */
+};
+
+struct rice_t
+{
+    uint32_t k;
+    uint32_t ksum;
+};
+
+struct entropy_t
+{
+    unsigned char* bytebuffer;
+    int bytebufferoffset;
+
+    struct rangecoder_t rc;
+    struct rice_t riceX;
+    struct rice_t riceY;
+};
+
+/* Filter state, see filter.c */
+struct filter_t
+{
+    filter_int* coeffs; /* ORDER entries */
+
+    /* We store all the filter delays in a single buffer */
+    filter_int* history_end;
+
+    filter_int* delay;
+    filter_int* adaptcoeffs;
+
+    int avg;
+};
+
+/* Compression level 5000 runs three filters in a row */
+#define APE_FILTER_STAGES 3
+
 struct ape_ctx_t
 {
     /* Derived fields */
@@ -127,7 +169,13 @@ struct ape_ctx_t
     int           frameflags;
     int           currentframeblocks;
     int           blocksdecoded;
+    struct entropy_t entropy;
     struct predictor_t predictor;
+
+    /* Filters of each stage for both channels, in the order they are
+       applied, and their history buffers (allocated by the caller) */
+    struct filter_t filter[APE_FILTER_STAGES][2];
+    filter_int*   filterbuf[APE_FILTER_STAGES];
 };
 
 int ape_parseheader(int fd, struct ape_ctx_t* ape_ctx);
@@ -0,0 +1,156 @@
+/*
+
+libdemac - A Monkey's Audio decoder
+
+ARMv7E-M (Cortex-M4) vector math using the packed 16-bit DSP instructions
+
+Copyright (C) 2007 Thom Johansen
+Copyright (C) 2013 RT-Thread Development Team
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
+
+*/
+
+#include "demac_config.h"
+
+/* The CMSIS intrinsics (__SMLAD, __SADD16 ...) come in through board.h.
+ *
+ * v1 (the coefficients) is always word aligned. The second operands walk
+ * through the history buffer one sample at a time, so they are word aligned
+ * on every other sample only. Both of them move in lockstep, a single check
+ * selects the path. On the unaligned path the words are loaded aligned and
+ * the pairs are rebuilt with PKHBT (swapped, consumed by SMLADX) or with a
+ * shift/or for the add/sub operand. Wrapping 16-bit lane arithmetic and the
+ * 32-bit accumulator of SMLAD give the same results as the generic code. */
+
+#define FUSED_VECTOR_MATH
+
+/* one pair of the aligned path: res += v1 . f2, v1 op= s2 */
+#define SP_PAIR_ALIGNED(op)                         \
+    c = *d;                                         \
+    res = __SMLAD(c, *f++, res);                    \
+    *d++ = op(c, *s++);
+
+/* one pair of the unaligned path, f0 and s0 hold the previous words */
+#define SP_PAIR_UNALIGNED(op)                       \
+    c = *d;                                         \
+    f1 = *f++;                                      \
+    s1 = *s++;                                      \
+    res = __SMLADX(c, __PKHBT(f1, f0, 0), res);     \
+    *d++ = op(c, (s0 >> 16) | (s1 << 16));          \
+    f0 = f1;                                        \
+    s0 = s1;
+
+#define SP_PAIRS_ALIGNED(op)                        \
+    SP_PAIR_ALIGNED(op) SP_PAIR_ALIGNED(op)         \
+    SP_PAIR_ALIGNED(op) SP_PAIR_ALIGNED(op)         \
+    SP_PAIR_ALIGNED(op) SP_PAIR_ALIGNED(op)         \
+    SP_PAIR_ALIGNED(op) SP_PAIR_ALIGNED(op)
+
+#define SP_PAIRS_UNALIGNED(op)                      \
+    SP_PAIR_UNALIGNED(op) SP_PAIR_UNALIGNED(op)     \
+    SP_PAIR_UNALIGNED(op) SP_PAIR_UNALIGNED(op)     \
+    SP_PAIR_UNALIGNED(op) SP_PAIR_UNALIGNED(op)     \
+    SP_PAIR_UNALIGNED(op) SP_PAIR_UNALIGNED(op)
+
+/* Calculate scalarproduct of v1 and f2, then add/sub s2 to/from v1; the
+ * result is the product of the coefficients before the update. */
+#define VECTOR_SP(op)                                                       \
+    uint32_t *d = (uint32_t *)v1;                                           \
+    uint32_t c, f0, f1, s0, s1;                                             \
+    const uint32_t *f, *s;                                                  \
+    int32_t res = 0;                                                        \
+    int cnt = ORDER >> 4;                                                   \
+                                                                            \
+    if (((uint32_t)f2 & 2) == 0)                                            \
+    {                                                                       \
+        f = (const uint32_t *)f2;                                           \
+        s = (const uint32_t *)s2;                                           \
+        do                                                                  \
+        {                                                                   \
+            SP_PAIRS_ALIGNED(op)                                            \
+        } while (--cnt);                                                    \
+    }                                                                       \
+    else                                                                    \
+    {                                                                       \
+        f = (const uint32_t *)(f2 - 1);                                     \
+        s = (const uint32_t *)(s2 - 1);                                     \
+        f0 = *f++;                                                          \
+        s0 = *s++;                                                          \
+        do                                                                  \
+        {                                                                   \
+            SP_PAIRS_UNALIGNED(op)                                          \
+        } while (--cnt);                                                    \
+    }                                                                       \
+    return res;
+
+static __inline int32_t vector_sp_add(filter_int* v1, filter_int* f2,
+                                      filter_int* s2)
+{
+    VECTOR_SP(__SADD16)
+}
+
+static __inline int32_t vector_sp_sub(filter_int* v1, filter_int* f2,
+                                      filter_int* s2)
+{
+    VECTOR_SP(__SSUB16)
+}
+
+/* This version fetches data as 32 bit words, and *requires* v1 to be
+ * 32 bit aligned. */
+static __inline int32_t scalarproduct(filter_int* v1, filter_int* v2)
+{
+    const uint32_t *c = (const uint32_t *)v1;
+    const uint32_t *f;
+    uint32_t f0, f1;
+    int32_t res = 0;
+    int cnt = ORDER >> 3;
+
+    if (((uint32_t)v2 & 2) == 0)
+    {
+        f = (const uint32_t *)v2;
+        do
+        {
+            res = __SMLAD(*c++, *f++, res);
+            res = __SMLAD(*c++, *f++, res);
+            res = __SMLAD(*c++, *f++, res);
+            res = __SMLAD(*c++, *f++, res);
+        } while (--cnt);
+    }
+    else
+    {
+        f = (const uint32_t *)(v2 - 1);
+        f0 = *f++;
+        do
+        {
+            f1 = *f++;
+            res = __SMLADX(*c++, __PKHBT(f1, f0, 0), res);
+            f0 = *f++;
+            res = __SMLADX(*c++, __PKHBT(f0, f1, 0), res);
+            f1 = *f++;
+            res = __SMLADX(*c++, __PKHBT(f1, f0, 0), res);
+            f0 = *f++;
+            res = __SMLADX(*c++, __PKHBT(f0, f1, 0), res);
+        } while (--cnt);
+    }
+
+    return res;
+}
+
+#undef SP_PAIR_ALIGNED
+#undef SP_PAIR_UNALIGNED
+#undef SP_PAIRS_ALIGNED
+#undef SP_PAIRS_UNALIGNED
+#undef VECTOR_SP
@@ -45,7 +45,8 @@ if PLATFORM == 'gcc':
     else:
         CFLAGS += ' -O2'
 
-    POST_ACTION = OBJCPY + ' -O binary $TARGET rtthread.bin\n' + SIZE + ' $TARGET \n'
+    # report the size of .fastcode, .ccmdata and .dmabuf as well
+    POST_ACTION = OBJCPY + ' -O binary $TARGET rtthread.bin\n' + SIZE + ' $TARGET \n' + SIZE + ' -A -x $TARGET \n'
 
 elif PLATFORM == 'armcc':
     # toolchains
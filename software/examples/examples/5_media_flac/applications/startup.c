@@ -11,6 +11,7 @@
  * Date           Author       Notes
  * 2006-08-31     Bernard      first implementation
  * 2011-06-05     Bernard      modify for STM32F107 version
+ * 2013-03-14     realtouch    init .fastcode, .ccmdata and .dmabuf sections
  */
 
 #include <rthw.h>
@@ -39,8 +40,33 @@ extern int Image$$RW_IRAM1$$ZI$$Limit;
 #else
 extern int __bss_end;
 #define STM32_SRAM_BEGIN    (&__bss_end)
+
+extern unsigned int _sifastcode, _sfastcode, _efastcode;
+extern unsigned int _sccmdata, _eccmdata;
+extern unsigned int _sdmabuf, _edmabuf;
 #endif
 
+/**
+ * This function copies the hot code to SRAM and clears the CCM and DMA
+ * buffer sections. The MDK scatter loader already does this for the
+ * execution regions in stm32_rom.sct.
+ */
+static void stm32_section_init(void)
+{
+#if defined(__GNUC__) && !defined(__CC_ARM)
+	unsigned int *src, *dst;
+
+	for (src = &_sifastcode, dst = &_sfastcode; dst < &_efastcode; )
+		*dst++ = *src++;
+
+	for (dst = &_sccmdata; dst < &_eccmdata; )
+		*dst++ = 0;
+
+	for (dst = &_sdmabuf; dst < &_edmabuf; )
+		*dst++ = 0;
+#endif
+}
+
 /*******************************************************************************
 * Function Name  : assert_failed
 * Description    : Reports the name of the source file and the source line number
@@ -64,6 +90,9 @@ void assert_failed(u8* file, u32 line)
  */
 void rtthread_startup(void)
 {
+	/* init memory sections, before any hot code runs */
+	stm32_section_init();
+
 	/* init board */
 	rt_hw_board_init();
 
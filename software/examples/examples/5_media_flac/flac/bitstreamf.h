@@ -7,9 +7,12 @@
 #define BITSTREAMF_H
 
 
-#define IBSS_ATTR
+#include "board.h"
+
+/* IRAM on Rockbox targets: hot code runs from SRAM, state lives in CCM */
+#define IBSS_ATTR       SECTION_CCM
 #define ICONST_ATTR
-#define ICODE_ATTR
+#define ICODE_ATTR      SECTION_FASTCODE
 
 #ifndef ICODE_ATTR_FLAC
 #define ICODE_ATTR_FLAC ICODE_ATTR
@@ -100,7 +100,7 @@ static int64_t get_utf8(GetBitContext *gb)
         ones++;
 
     if     (ones==0) bytes=0;
-    else if(ones==1) return -1;
+    else if(ones==1 || ones>7) return -1;
     else             bytes= ones - 1;
     
     val= get_bits(gb, 7-ones);
@@ -128,6 +128,66 @@ static int get_crc8(const uint8_t *buf, int count)
     return crc;
 }
 
+/* 32 bits of the stream from bit index on */
+static __inline uint32_t rice_load(const uint8_t *buffer, int index)
+{
+    uint32_t cache = __REV(unaligned32(buffer + (index >> 3))) << (index & 0x07);
+
+    if (index & 0x07)
+        cache |= buffer[(index >> 3) + 4] >> (8 - (index & 0x07));
+    return cache;
+}
+
+/* Decode count signed Rice codes with parameter k. The bit position stays
+ * in a local, each code reloads one big-endian word from the byte stream
+ * and CLZ counts the unary prefix. Codes which do not fit into the loaded
+ * word (at least 25 bits are valid), as the wide parameters of 24-bit
+ * streams produce, count the prefix word by word and read the low bits on
+ * their own; the generic reader assumes 25 bits are enough. */
+static void decode_rice_block(GetBitContext *gb, int32_t *dst, int count, int k) ICODE_ATTR_FLAC;
+static void decode_rice_block(GetBitContext *gb, int32_t *dst, int count, int k)
+{
+    const uint8_t *buffer = gb->buffer;
+    int index = gb->index;
+    uint32_t cache, v;
+    int q, valid;
+
+    while (count-- > 0)
+    {
+        cache = __REV(unaligned32(buffer + (index >> 3))) << (index & 0x07);
+        valid = 32 - (index & 0x07);
+        q = __CLZ(cache);
+
+        if (q + 1 + k <= valid)
+        {
+            v = q << k;
+            if (k)
+                v |= (cache << q << 1) >> (32 - k);
+            index += q + 1 + k;
+        }
+        else
+        {
+            q = 0;
+            while ((cache = rice_load(buffer, index)) == 0)
+            {
+                q += 32;
+                index += 32;
+            }
+            q += __CLZ(cache);
+            index += __CLZ(cache) + 1;
+
+            v = q << k;
+            if (k)
+                v |= rice_load(buffer, index) >> (32 - k);
+            index += k;
+        }
+
+        *dst++ = (v >> 1) ^ -(int32_t)(v & 1);
+    }
+
+    gb->index = index;
+}
+
 static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order) ICODE_ATTR_FLAC;
 static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order)
 {
@@ -156,11 +216,10 @@ static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order)
             for (; i < samples; i++, sample++)
                 decoded[sample] = get_sbits(&s->gb, tmp);
         }
-        else
+        else if (i < samples)
         {
-            for (; i < samples; i++, sample++){
-                decoded[sample] = get_sr_golomb_flac(&s->gb, tmp, INT_MAX, 0);
-            }
+            decode_rice_block(&s->gb, decoded + sample, samples - i, tmp);
+            sample += samples - i;
         }
         i= 0;
     }
@@ -183,39 +242,161 @@ static int decode_subframe_fixed(FLACContext *s, int32_t* decoded, int pred_orde
     if (decode_residuals(s, decoded, pred_order) < 0)
         return -4;
 
-    a = decoded[pred_order-1];
-    b = a - decoded[pred_order-2];
-    c = b - decoded[pred_order-2] + decoded[pred_order-3];
-    d = c - decoded[pred_order-2] + 2*decoded[pred_order-3] - decoded[pred_order-4];
+    /* only the warm up samples there are, decoded[-1] is not ours */
+    a = b = c = d = 0;
+    if (pred_order > 0)
+        a = decoded[pred_order-1];
+    if (pred_order > 1)
+        b = a - decoded[pred_order-2];
+    if (pred_order > 2)
+        c = b - decoded[pred_order-2] + decoded[pred_order-3];
+    if (pred_order > 3)
+        d = c - decoded[pred_order-2] + 2*decoded[pred_order-3] - decoded[pred_order-4];
+
+/* two samples per iteration, the odd one is done by the tail */
+#define FIXED_RESTORE(expr)                                 \
+    {                                                       \
+        int32_t *ptr = decoded + pred_order;                \
+        int32_t *end = decoded + blocksize;                 \
+        for (; ptr < end - 1; ptr += 2)                     \
+        {                                                   \
+            ptr[0] = expr(ptr[0]);                          \
+            ptr[1] = expr(ptr[1]);                          \
+        }                                                   \
+        if (ptr < end)                                      \
+            ptr[0] = expr(ptr[0]);                          \
+    }
+#define FIXED_1(x) (a += (x))
+#define FIXED_2(x) (a += b += (x))
+#define FIXED_3(x) (a += b += c += (x))
+#define FIXED_4(x) (a += b += c += d += (x))
 
     switch(pred_order)
     {
         case 0:
             break;
         case 1:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += decoded[i];
+            FIXED_RESTORE(FIXED_1)
             break;
         case 2:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += b += decoded[i];
+            FIXED_RESTORE(FIXED_2)
             break;
         case 3:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += b += c += decoded[i];
+            FIXED_RESTORE(FIXED_3)
             break;
         case 4:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += b += c += d += decoded[i];
+            FIXED_RESTORE(FIXED_4)
             break;
         default:
             return -5;
     }
 
+#undef FIXED_RESTORE
+#undef FIXED_1
+#undef FIXED_2
+#undef FIXED_3
+#undef FIXED_4
+
     return 0;
 }
 
 
+/*
+ * LPC restoration kernels specialised by predictor order. The taps are
+ * generated by the LPC_TAPS_n macros, so the inner loop is fully unrolled
+ * and the compiler emits one MLA (or SMLAL for the wide kernels) per tap.
+ * The residual of side channels needs 17 bits, therefore the 16-bit
+ * packed SMLAD does not apply here.
+ *
+ * The 32-bit sum is what the generic path has always used for streams of
+ * up to 16 bits per sample; streams with more bits need 64-bit sums.
+ */
+#define LPC_MUL32(n)    coeffs[n] * d[-(n)-1]
+#define LPC_MUL64(n)    (int64_t)coeffs[n] * d[-(n)-1]
+
+#define LPC_TAPS_1(M)   sum  = M(0);
+#define LPC_TAPS_2(M)   LPC_TAPS_1(M) sum += M(1);
+#define LPC_TAPS_3(M)   LPC_TAPS_2(M) sum += M(2);
+#define LPC_TAPS_4(M)   LPC_TAPS_3(M) sum += M(3);
+#define LPC_TAPS_5(M)   LPC_TAPS_4(M) sum += M(4);
+#define LPC_TAPS_6(M)   LPC_TAPS_5(M) sum += M(5);
+#define LPC_TAPS_7(M)   LPC_TAPS_6(M) sum += M(6);
+#define LPC_TAPS_8(M)   LPC_TAPS_7(M) sum += M(7);
+#define LPC_TAPS_9(M)   LPC_TAPS_8(M) sum += M(8);
+#define LPC_TAPS_10(M)  LPC_TAPS_9(M) sum += M(9);
+#define LPC_TAPS_11(M)  LPC_TAPS_10(M) sum += M(10);
+#define LPC_TAPS_12(M)  LPC_TAPS_11(M) sum += M(11);
+#define LPC_TAPS_32(M)  LPC_TAPS_12(M) \
+    sum += M(12); sum += M(13); sum += M(14); sum += M(15); \
+    sum += M(16); sum += M(17); sum += M(18); sum += M(19); \
+    sum += M(20); sum += M(21); sum += M(22); sum += M(23); \
+    sum += M(24); sum += M(25); sum += M(26); sum += M(27); \
+    sum += M(28); sum += M(29); sum += M(30); sum += M(31);
+
+typedef void (*lpc_kernel_t)(int32_t *decoded, const int *coeffs, int qlevel, int blocksize);
+
+#define LPC_KERNEL(order)                                                       \
+static void lpc_restore_##order(int32_t *decoded, const int *coeffs,            \
+                                int qlevel, int blocksize) ICODE_ATTR_FLAC;     \
+static void lpc_restore_##order(int32_t *decoded, const int *coeffs,            \
+                                int qlevel, int blocksize)                      \
+{                                                                               \
+    int32_t *d = decoded + order;                                               \
+    int32_t *end = decoded + blocksize;                                         \
+    int sum;                                                                    \
+                                                                                \
+    for (; d < end; d++)                                                        \
+    {                                                                           \
+        LPC_TAPS_##order(LPC_MUL32)                                             \
+        *d += sum >> qlevel;                                                    \
+    }                                                                           \
+}                                                                               \
+static void lpc_restore_wide_##order(int32_t *decoded, const int *coeffs,       \
+                                     int qlevel, int blocksize)                 \
+{                                                                               \
+    int32_t *d = decoded + order;                                               \
+    int32_t *end = decoded + blocksize;                                         \
+    int64_t sum;                                                                \
+                                                                                \
+    for (; d < end; d++)                                                        \
+    {                                                                           \
+        LPC_TAPS_##order(LPC_MUL64)                                             \
+        *d += (int32_t)(sum >> qlevel);                                         \
+    }                                                                           \
+}
+
+LPC_KERNEL(1)
+LPC_KERNEL(2)
+LPC_KERNEL(3)
+LPC_KERNEL(4)
+LPC_KERNEL(5)
+LPC_KERNEL(6)
+LPC_KERNEL(7)
+LPC_KERNEL(8)
+LPC_KERNEL(9)
+LPC_KERNEL(10)
+LPC_KERNEL(11)
+LPC_KERNEL(12)
+LPC_KERNEL(32)
+
+#define LPC_KERNEL_MAX_UNROLLED 12
+
+static const lpc_kernel_t lpc_kernels[LPC_KERNEL_MAX_UNROLLED + 1] ICONST_ATTR =
+{
+    0,
+    lpc_restore_1, lpc_restore_2, lpc_restore_3, lpc_restore_4,
+    lpc_restore_5, lpc_restore_6, lpc_restore_7, lpc_restore_8,
+    lpc_restore_9, lpc_restore_10, lpc_restore_11, lpc_restore_12,
+};
+
+static const lpc_kernel_t lpc_kernels_wide[LPC_KERNEL_MAX_UNROLLED + 1] ICONST_ATTR =
+{
+    0,
+    lpc_restore_wide_1, lpc_restore_wide_2, lpc_restore_wide_3, lpc_restore_wide_4,
+    lpc_restore_wide_5, lpc_restore_wide_6, lpc_restore_wide_7, lpc_restore_wide_8,
+    lpc_restore_wide_9, lpc_restore_wide_10, lpc_restore_wide_11, lpc_restore_wide_12,
+};
+
 /* level8 õ
  * ֮ǰ汾֤ǲе
  * arm,ֲɹ
@@ -250,6 +431,19 @@ int decode_subframe_lpc(FLACContext *s, int32_t* decoded, int pred_order)
  
      if (decode_residuals(s, decoded, pred_order) < 0)
          return -1;
+
+     /* specialised kernels for the orders encoders produce */
+     if (pred_order <= LPC_KERNEL_MAX_UNROLLED || pred_order == 32) {
+         lpc_kernel_t kernel;
+
+         if (s->bps > 16)
+             kernel = (pred_order == 32) ? lpc_restore_wide_32 : lpc_kernels_wide[pred_order];
+         else
+             kernel = (pred_order == 32) ? lpc_restore_32 : lpc_kernels[pred_order];
+
+         kernel(decoded, coeffs, qlevel, s->blocksize);
+         return 0;
+     }
  
      if (s->bps > 16) {
          int64_t sum;
@@ -374,21 +568,41 @@ static __inline int decode_subframe(FLACContext *s, int channel, int32_t* decode
     return 0;
 }
 
-static int decode_frame(FLACContext *s) ICODE_ATTR_FLAC;
-static int decode_frame(FLACContext *s){
+struct frame_header
+{
+    int blocksize;
+    int samplerate;
+    int bps;
+    int decorrelation;
+    unsigned long samplenumber;
+};
+
+/* Parse and check the header of the frame at the start of the bitstream.
+ * The context is only read, so the function can also be used to validate
+ * candidate sync codes while seeking. */
+static int decode_frame_header(FLACContext *s, struct frame_header *h) ICODE_ATTR_FLAC;
+static int decode_frame_header(FLACContext *s, struct frame_header *h)
+{
 	int blocksize_code, sample_rate_code, sample_size_code, assignment, crc8;
-	int decorrelation, bps, blocksize, samplerate;
-	int res;
-    
+	int variable_blocksize;
+	int64_t number;
+
+    /* 14 bits sync code and one reserved bit */
+    if (get_bits(&s->gb, 15) != 0x7ffc)
+    {
+        return -12;
+    }
+    variable_blocksize = get_bits1(&s->gb);
+
     blocksize_code = get_bits(&s->gb, 4);
 
     sample_rate_code = get_bits(&s->gb, 4);
     
     assignment = get_bits(&s->gb, 4); /* channel assignment */
     if (assignment < 8 && s->channels == assignment+1)
-        decorrelation = INDEPENDENT;
+        h->decorrelation = INDEPENDENT;
     else if (assignment >=8 && assignment < 11 && s->channels == 2)
-        decorrelation = LEFT_SIDE + assignment - 8;
+        h->decorrelation = LEFT_SIDE + assignment - 8;
     else
     {
         return -13;
@@ -396,9 +610,9 @@ static int decode_frame(FLACContext *s){
         
     sample_size_code = get_bits(&s->gb, 3);
     if(sample_size_code == 0)
-        bps= s->bps;
+        h->bps= s->bps;
     else if((sample_size_code != 3) && (sample_size_code != 7))
-        bps = sample_size_table[sample_size_code];
+        h->bps = sample_size_table[sample_size_code];
     else 
     {
         return -14;
@@ -410,45 +624,43 @@ static int decode_frame(FLACContext *s){
     }
 
     /* Get the samplenumber of the first sample in this block */
-    s->samplenumber=get_utf8(&s->gb);
+    number=get_utf8(&s->gb);
+    if (number < 0)
+    {
+        return -15;
+    }
+    h->samplenumber=(unsigned long)number;
 
     /* samplenumber actually contains the frame number for streams
-       with a constant block size - so we multiply by blocksize to
+       with a fixed block size - so we multiply by blocksize to
        get the actual sample number */
-    if (s->min_blocksize == s->max_blocksize) {
-        s->samplenumber*=s->min_blocksize;
-    }
-
-#if 0    
-    if (/*((blocksize_code == 6) || (blocksize_code == 7)) &&*/
-        (s->min_blocksize != s->max_blocksize)){
-    }else{
+    if (!variable_blocksize) {
+        h->samplenumber*=s->min_blocksize;
     }
-#endif
 
     if (blocksize_code == 0)
-        blocksize = s->min_blocksize;
+        h->blocksize = s->min_blocksize;
     else if (blocksize_code == 6)
-        blocksize = get_bits(&s->gb, 8)+1;
+        h->blocksize = get_bits(&s->gb, 8)+1;
     else if (blocksize_code == 7)
-        blocksize = get_bits(&s->gb, 16)+1;
+        h->blocksize = get_bits(&s->gb, 16)+1;
     else 
-        blocksize = blocksize_table[blocksize_code];
+        h->blocksize = blocksize_table[blocksize_code];
 
-    if(blocksize > s->max_blocksize){
+    if(h->blocksize > s->max_blocksize){
         return -16;
     }
 
     if (sample_rate_code == 0){
-        samplerate= s->samplerate;
+        h->samplerate= s->samplerate;
     }else if ((sample_rate_code > 3) && (sample_rate_code < 12))
-        samplerate = sample_rate_table[sample_rate_code];
+        h->samplerate = sample_rate_table[sample_rate_code];
     else if (sample_rate_code == 12)
-        samplerate = get_bits(&s->gb, 8) * 1000;
+        h->samplerate = get_bits(&s->gb, 8) * 1000;
     else if (sample_rate_code == 13)
-        samplerate = get_bits(&s->gb, 16);
+        h->samplerate = get_bits(&s->gb, 16);
     else if (sample_rate_code == 14)
-        samplerate = get_bits(&s->gb, 16) * 10;
+        h->samplerate = get_bits(&s->gb, 16) * 10;
     else{
         return -17;
     }
@@ -458,11 +670,23 @@ static int decode_frame(FLACContext *s){
     if(crc8){
         return -18;
     }
-    
-    s->blocksize    = blocksize;
-    s->samplerate   = samplerate;
-    s->bps          = bps;
-    s->decorrelation= decorrelation;
+
+    return 0;
+}
+
+static int decode_frame(FLACContext *s) ICODE_ATTR_FLAC;
+static int decode_frame(FLACContext *s){
+    struct frame_header h;
+	int res;
+
+    if ((res = decode_frame_header(s, &h)) < 0)
+        return res;
+
+    s->samplenumber = h.samplenumber;
+    s->blocksize    = h.blocksize;
+    s->samplerate   = h.samplerate;
+    s->bps          = h.bps;
+    s->decorrelation= h.decorrelation;
 
     /* subframes */
     if ((res=decode_subframe(s, 0, s->decoded0)) < 0){
@@ -489,7 +713,6 @@ int flac_decode_frame(FLACContext *fc, uint8_t *buf, int buf_size, int16_t *wavb
 	int sampleCnt, *ch0, *ch1;
 	
 	init_get_bits(&fc->gb, buf, buf_size*8);
-	skip_bits(&fc->gb, 16);
 
 	if((sampleCnt = decode_frame(fc)) < 0){
 		fc->bitstream_size=0;
@@ -552,3 +775,29 @@ int flac_decode_frame(FLACContext *fc, uint8_t *buf, int buf_size, int16_t *wavb
 
     return 0;
 }
+
+/* Check whether buf starts with a valid frame header and return the number
+ * of the first sample and the blocksize of the frame. */
+int flac_parse_frame_header(FLACContext *fc, uint8_t *buf, int buf_size,
+                            unsigned long *samplenumber, int *blocksize)
+{
+    struct frame_header h;
+    GetBitContext gb;
+    int res;
+
+    /* the header is at most 16 bytes, keep the caller's bit reader */
+    if (buf_size < 16)
+        return -1;
+
+    gb = fc->gb;
+    init_get_bits(&fc->gb, buf, buf_size*8);
+    res = decode_frame_header(fc, &h);
+    fc->gb = gb;
+
+    if (res < 0)
+        return res;
+
+    *samplenumber = h.samplenumber;
+    *blocksize = h.blocksize;
+    return 0;
+}
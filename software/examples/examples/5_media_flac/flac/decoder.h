@@ -50,5 +50,7 @@ typedef struct FLACContext {
 } FLACContext;
 
 int flac_decode_frame(FLACContext *s, uint8_t *buf, int buf_size, int16_t *wavbuf) ICODE_ATTR_FLAC;
+int flac_parse_frame_header(FLACContext *fc, uint8_t *buf, int buf_size,
+                            unsigned long *samplenumber, int *blocksize);
 
 #endif
@@ -34,14 +34,27 @@
 
 #define MAX_CHANNELS 2         /* Maximum supported channels */
 
-#define MAX_BLOCKSIZE 4608 
+#define MAX_BLOCKSIZE 4608     /* Largest blocksize served by the static buffers */
+#define LIMIT_BLOCKSIZE 16384  /* Largest blocksize one codec DMA transfer can take */
   
-#define MAX_FRAMESIZE 20*1024  /* Maxsize in bytes of one compressed frame */
+#define MAX_FRAMESIZE 20*1024  /* Frame size assumed when STREAMINFO leaves it open */
 #define FLAC_OUTPUT_DEPTH 16   /* Provide samples left-shifted to 28 bits+sign */
 
-int8_t PCM_buffer0[4 * MAX_BLOCKSIZE ];  
-int8_t PCM_buffer1[4 * MAX_BLOCKSIZE ];	 
-int8_t temp_buffer[4 * MAX_BLOCKSIZE ];
+#define MAX_SEEKPOINTS 256     /* SEEKTABLE entries kept in memory */
+
+int8_t PCM_buffer0[4 * MAX_BLOCKSIZE ] SECTION_DMABUF;
+int8_t PCM_buffer1[4 * MAX_BLOCKSIZE ] SECTION_DMABUF;
+int8_t temp_buffer[4 * MAX_BLOCKSIZE ] IBSS_ATTR;
+
+struct flac_seekpoint
+{
+    unsigned long sample;       /* first sample of the target frame */
+    unsigned long offset;       /* offset of the frame from the first frame */
+};
+
+static struct flac_seekpoint *seektable;
+static bool flac_playing = false;
+static volatile int flac_seek_request = -1;
 
 static void dump_headers(FLACContext *s)
 {
@@ -56,6 +69,55 @@ static void dump_headers(FLACContext *s)
     rt_kprintf("  Total Samples: %lu\n\r",s->totalsamples);
     rt_kprintf("  Duration: %d ms\n\r",s->length);
     rt_kprintf("  Bitrate: %d kbps\n\r",s->bitrate);
+    rt_kprintf("  Seekpoints: %d\n\r",s->seekpoints);
+}
+
+static unsigned long read_be32(const unsigned char *buf)
+{
+    return ((unsigned long)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+/* Load the SEEKTABLE block. Placeholders are dropped, large tables are
+ * thinned out to MAX_SEEKPOINTS entries. Offsets beyond 4GB are not used. */
+static bool flac_load_seektable(int fd, FLACContext* fc, int blocklength)
+{
+    unsigned char buf[18];
+    int count, stride, index;
+    struct flac_seekpoint *point;
+
+    count = blocklength / 18;
+    stride = (count + MAX_SEEKPOINTS - 1) / MAX_SEEKPOINTS;
+    if (stride == 0)
+        stride = 1;
+
+    seektable = (struct flac_seekpoint *)rt_malloc(sizeof(struct flac_seekpoint) *
+                                                   (count / stride + 1));
+    fc->seekpoints = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        if (read(fd, buf, 18) < 18)
+            return false;
+
+        if (seektable == RT_NULL || (index % stride) != 0)
+            continue;
+
+        /* placeholder, or sample/offset not in 32 bits */
+        if (read_be32(&buf[0]) != 0 || read_be32(&buf[8]) != 0)
+            continue;
+
+        point = &seektable[fc->seekpoints];
+        point->sample = read_be32(&buf[4]);
+        point->offset = read_be32(&buf[12]);
+
+        /* the points have to be sorted */
+        if (fc->seekpoints > 0 && point->sample <= seektable[fc->seekpoints - 1].sample)
+            continue;
+
+        fc->seekpoints++;
+    }
+
+    return lseek(fd, blocklength - count * 18, SEEK_CUR) >= 0;
 }
 
 static bool flac_init(int fd, FLACContext* fc)
@@ -65,10 +127,6 @@ static bool flac_init(int fd, FLACContext* fc)
     bool found_streaminfo=false;
     int endofmetadata=0;
     int blocklength;
-    uint32_t* p;
-    uint32_t seekpoint_lo,seekpoint_hi;
-   	uint32_t offset_lo,offset_hi;
-	int n;
 
     if (lseek(fd, 0, SEEK_SET) < 0) 
     {
@@ -85,6 +143,8 @@ static bool flac_init(int fd, FLACContext* fc)
         return false;
     }
     fc->metadatalength = 4;
+    fc->seekpoints = 0;
+    fc->bitrate = 0;
 
     while (!endofmetadata) 
 	{
@@ -99,11 +159,11 @@ static bool flac_init(int fd, FLACContext* fc)
 
         if ((buf[0] & 0x7f) == 0)       /* 0 is the STREAMINFO block */
         {
-            /* FIXME: Don't trust the value of blocklength */
-            if (read(fd, buf, blocklength) < 0)
+            if (blocklength < 34 || read(fd, buf, 34) < 34)
             {
                 return false;
             }
+            lseek(fd, blocklength - 34, SEEK_CUR);
           
             fstat(fd,&statbuf);
             fc->filesize = statbuf.st_size;
@@ -123,44 +183,33 @@ static bool flac_init(int fd, FLACContext* fc)
 
             /* Calculate track length (in ms) and estimate the bitrate 
                (in kbit/s) */
-            fc->length = (fc->totalsamples / fc->samplerate) * 1000;
+            fc->length = ((uint64_t)fc->totalsamples * 1000) / fc->samplerate;
 
             found_streaminfo=true;
         }
-		else 
-		    if ((buf[0] & 0x7f) == 3) 	/* 3 is the SEEKTABLE block */
-		    { 
-               // rt_kprintf("Seektable length = %d bytes\n",blocklength);
-                while (blocklength >= 18) {
-                n=read(fd,buf,18);
-                if (n < 18) return false;
-                blocklength-=n;
-
-                p=(uint32_t*)buf;
-                seekpoint_hi=betoh32(*(p++));
-                seekpoint_lo=betoh32(*(p++));
-                offset_hi=betoh32(*(p++));
-                offset_lo=betoh32(*(p++));
-            
-                if ((seekpoint_hi != 0xffffffff) && (seekpoint_lo != 0xffffffff))
-				{
-         	         //rt_kprintf("Seekpoint: %u, Offset=%u\n",seekpoint_lo,offset_lo);
-                }
+		else if ((buf[0] & 0x7f) == 3) 	/* 3 is the SEEKTABLE block */
+		{ 
+            if (seektable != RT_NULL || !flac_load_seektable(fd, fc, blocklength))
+            {
+                /* only the first table is used */
+                if (lseek(fd, blocklength, SEEK_CUR) < 0)
+                    return false;
             }
-            lseek(fd, blocklength, SEEK_CUR);
-        } else 
-		  {
+        }
+        else 
+		{
             /* Skip to next metadata block */
             if (lseek(fd, blocklength, SEEK_CUR) < 0)
             {
                 return false;
             }
-          }
+        }
     }
 
-   if (found_streaminfo)
+   if (found_streaminfo && fc->samplerate != 0)
    {
-       fc->bitrate = ((fc->filesize-fc->metadatalength) * 8) / fc->length;
+       if (fc->length != 0)
+           fc->bitrate = ((uint64_t)(fc->filesize-fc->metadatalength) * 8) / fc->length;
        return true;
    } 
    else 
@@ -169,6 +218,104 @@ static bool flac_init(int fd, FLACContext* fc)
    }
 }
 
+/* Find the first frame header at or after file offset pos. buf is used as
+ * scratch. Returns the offset of the frame, -1 when there is none. */
+static long flac_find_frame(int fd, FLACContext* fc, unsigned char *buf, int bufsize,
+                            long pos, unsigned long *sample, int *blocksize)
+{
+    int n, index;
+
+    while (pos < fc->filesize)
+    {
+        if (lseek(fd, pos, SEEK_SET) < 0)
+            return -1;
+
+        n = read(fd, buf, bufsize);
+        if (n < 16)
+            return -1;
+
+        for (index = 0; index <= n - 16; index++)
+        {
+            if (buf[index] != 0xff || (buf[index + 1] & 0xfe) != 0xf8)
+                continue;
+
+            if (flac_parse_frame_header(fc, &buf[index], n - index, sample, blocksize) == 0 &&
+                (fc->totalsamples == 0 || *sample < fc->totalsamples))
+                return pos + index;
+        }
+
+        /* a header may straddle the end of the buffer */
+        pos += n - 15;
+    }
+
+    return -1;
+}
+
+/* Locate the frame which contains sample target. The search range comes
+ * from the SEEKTABLE when there is one, it is narrowed down by bisecting
+ * on frame sync codes and finished by walking the last few frames. */
+static long flac_seek_frame(int fd, FLACContext* fc, unsigned char *buf, int bufsize,
+                            unsigned long target, unsigned long *frame_sample)
+{
+    long lo_pos, hi_pos, pos, frame;
+    unsigned long lo_sample, sample;
+    int index, blocksize;
+
+    lo_pos = fc->metadatalength;
+    lo_sample = 0;
+    hi_pos = fc->filesize;
+
+    for (index = 0; index < fc->seekpoints; index++)
+    {
+        pos = fc->metadatalength + seektable[index].offset;
+        if (pos >= fc->filesize)
+            break;
+
+        if (seektable[index].sample > target)
+        {
+            hi_pos = pos;
+            break;
+        }
+        lo_pos = pos;
+        lo_sample = seektable[index].sample;
+    }
+
+    while (hi_pos - lo_pos > 2 * bufsize)
+    {
+        pos = lo_pos + (hi_pos - lo_pos) / 2;
+
+        frame = flac_find_frame(fd, fc, buf, bufsize, pos, &sample, &blocksize);
+        if (frame < 0 || frame >= hi_pos)
+        {
+            hi_pos = pos;
+        }
+        else if (sample <= target)
+        {
+            lo_pos = frame;
+            lo_sample = sample;
+        }
+        else
+        {
+            hi_pos = frame;
+        }
+    }
+
+    /* walk to the frame holding the target */
+    pos = lo_pos;
+    while ((frame = flac_find_frame(fd, fc, buf, bufsize, pos, &sample, &blocksize)) >= 0 &&
+           frame < hi_pos && sample <= target)
+    {
+        lo_pos = frame;
+        lo_sample = sample;
+        if (sample + blocksize > target)
+            break;
+        pos = frame + 1;
+    }
+
+    *frame_sample = lo_sample;
+    return lo_pos;
+}
+
 static struct rt_semaphore flac_sem;
 	
 static rt_err_t flac_decoder_tx_done(rt_device_t dev, void *buffer)
@@ -179,6 +326,20 @@ static rt_err_t flac_decoder_tx_done(rt_device_t dev, void *buffer)
 	return RT_EOK;
 }
 
+/**
+ * Request the running flac() player to continue at ms milliseconds.
+ *
+ * @return RT_EOK when the request is queued, -RT_ERROR when no stream is
+ *         being played or the position is out of range.
+ */
+int flac_seek(int ms)
+{
+    if (!flac_playing || ms < 0)
+        return -RT_ERROR;
+
+    flac_seek_request = ms;
+    return RT_EOK;
+}
 
 int flac(char* path) 
 {
@@ -186,10 +347,17 @@ int flac(char* path)
     int fd;
     int n;
     int bytesleft;
+    int bufsize, framesize, offset;
     int consumed;
-	int8_t i;
+    int skip;
+    bool eof = false;
+	int8_t i = 0;
+    unsigned long target, frame_sample;
+    long pos;
 
 	unsigned char *filebuf ; 
+    int8_t *pcm_buffer[2], *decode_buffer;
+    int16_t *wavbuf;
 
 	/* audio device */
 	rt_device_t snd_device;
@@ -207,91 +375,163 @@ int flac(char* path)
         return(1);
     }
 
-	/* open audio device */
-	snd_device = rt_device_find("snd");
-	if (snd_device != RT_NULL)
-	{
-		/*  set tx complete call back function 	 */
-		rt_device_set_tx_complete(snd_device, flac_decoder_tx_done);
-		rt_device_open(snd_device, RT_DEVICE_OFLAG_WRONLY);
-	}
-
-
     /* Read the metadata and position the file pointer at the start of the 
        first audio frame */
-    flac_init(fd,&fc); 
+    if (!flac_init(fd,&fc))
+    {
+        rt_kprintf("Can not parse %s\n",path);
+        goto __exit_file;
+    }
     dump_headers(&fc);
 
-	if((fc.min_blocksize != fc.max_blocksize) || (fc.max_blocksize > MAX_BLOCKSIZE ) || (fc.max_framesize > MAX_FRAMESIZE))
+	if((fc.channels > MAX_CHANNELS) || (fc.max_blocksize > LIMIT_BLOCKSIZE))
 	{
 	  rt_kprintf("\n\rOo Do not support this file!!\n\r"); 
 	  rt_kprintf("You can choose another Converter.Such as foobar2000 ^_^\n\r"); 
-	  return false;
+	  goto __exit_file;
 	}
 
+    /* size the input buffer from STREAMINFO, a frame is never larger than
+       its samples stored verbatim */
+    framesize = fc.max_framesize;
+    if (framesize == 0)
+        framesize = MAX_FRAMESIZE;
+    if (framesize > fc.max_blocksize * fc.channels * 4 + 32)
+        framesize = fc.max_blocksize * fc.channels * 4 + 32;
+    bufsize = framesize * 2;
+
+    if (fc.max_blocksize <= MAX_BLOCKSIZE)
+    {
+        pcm_buffer[0] = PCM_buffer0;
+        pcm_buffer[1] = PCM_buffer1;
+        decode_buffer = temp_buffer;
+    }
+    else
+    {
+        pcm_buffer[0] = (int8_t *)rt_malloc(4 * fc.max_blocksize);
+        pcm_buffer[1] = (int8_t *)rt_malloc(4 * fc.max_blocksize);
+        decode_buffer = (int8_t *)rt_malloc(4 * fc.max_blocksize);
+    }
+
+	filebuf = (unsigned char *)rt_malloc(bufsize); /* The input buffer */
+    if (filebuf == RT_NULL || pcm_buffer[0] == RT_NULL ||
+        pcm_buffer[1] == RT_NULL || decode_buffer == RT_NULL)
+    {
+        rt_kprintf("no memory for the flac buffers\n");
+        goto __exit_buffer;
+    }
+
+	/* open audio device */
+	snd_device = rt_device_find("snd");
+	if (snd_device == RT_NULL)
+        goto __exit_buffer;
+
+    /*  set tx complete call back function 	 */
+    rt_device_set_tx_complete(snd_device, flac_decoder_tx_done);
+    rt_device_open(snd_device, RT_DEVICE_OFLAG_WRONLY);
 
 	//set CODEC's samplerate
 	rt_device_control(snd_device, CODEC_CMD_SAMPLERATE, &(fc.samplerate));
 
-	filebuf = (unsigned char *)rt_malloc(MAX_FRAMESIZE); /* The input buffer */
-    bytesleft=read(fd,filebuf,MAX_FRAMESIZE);
+    lseek(fd, fc.metadatalength, SEEK_SET);
+    bytesleft=read(fd,filebuf,bufsize);
+    offset = 0;
+    target = 0;
+    flac_seek_request = -1;
+    flac_playing = true;
+
+    while (bytesleft > 0)
+    {
+        if (flac_seek_request >= 0)
+        {
+            target = ((uint64_t)flac_seek_request * fc.samplerate) / 1000;
+            flac_seek_request = -1;
+            if (fc.totalsamples != 0 && target >= fc.totalsamples)
+                break;
+
+            pos = flac_seek_frame(fd, &fc, filebuf, bufsize, target, &frame_sample);
+            rt_kprintf("seek to sample %lu, frame at %ld (sample %lu)\n",
+                       target, pos, frame_sample);
+
+            lseek(fd, pos, SEEK_SET);
+            bytesleft = read(fd, filebuf, bufsize);
+            offset = 0;
+            eof = false;
+            if (bytesleft <= 0)
+                break;
+        }
 
-      
-       while (bytesleft) 
-	   {
-    
 		rt_sem_take(&flac_sem, RT_WAITING_FOREVER);
 
 		//ʹPCM_buffer
-	    if(i++ & 1)
-	    {
-	    	//decoded0,decoded1ʱPCM
-			fc.decoded0 = (int32_t *)PCM_buffer0;
-			fc.decoded1 = (int32_t *)temp_buffer;
-
-        	if(flac_decode_frame(&fc,filebuf,bytesleft,(int16_t *)PCM_buffer0) < 0) 
-			{
-             rt_kprintf("DECODE ERROR, ABORTING\n");
-             break;
- 	        }
-
-			rt_device_write(snd_device, 0, (int16_t *)PCM_buffer0, ((fc.max_blocksize * 4) ));
-	    }
-	    else
-	    {	
-	     	//decoded0,decoded1ʱPCM
-	  		fc.decoded0 = (int32_t *)PCM_buffer1;
-    		fc.decoded1 = (int32_t *)temp_buffer;
-
-	  		if(flac_decode_frame(&fc,filebuf,bytesleft,(int16_t *)PCM_buffer1) < 0) 
-			{
-       	      rt_kprintf("DECODE ERROR, ABORTING\n");
-       	      break;
-       		}
-
-			rt_device_write(snd_device, 0, (int16_t *)PCM_buffer1, ((fc.max_blocksize * 4) ));
-	    }
+        wavbuf = (int16_t *)pcm_buffer[i++ & 1];
+
+        //decoded0,decoded1ʱPCM
+        fc.decoded0 = (int32_t *)wavbuf;
+        fc.decoded1 = (int32_t *)decode_buffer;
+
+        if(flac_decode_frame(&fc,&filebuf[offset],bytesleft,wavbuf) < 0) 
+        {
+            rt_kprintf("DECODE ERROR, ABORTING\n");
+            break;
+        }
+
+        /* the first frame after a seek starts before the target */
+        skip = 0;
+        if (target > fc.samplenumber)
+        {
+            skip = target - fc.samplenumber;
+            if (skip > fc.blocksize)
+                skip = fc.blocksize;
+        }
+        target = 0;
+
+        if (skip < fc.blocksize)
+            rt_device_write(snd_device, 0, wavbuf + skip * 2, (fc.blocksize - skip) * 4);
+        else
+            rt_sem_release(&flac_sem);
 
         consumed=fc.gb.index/8;
-        rt_memmove(filebuf,&filebuf[consumed],bytesleft-consumed);
-        bytesleft-=consumed;
+        offset += consumed;
+        bytesleft -= consumed;
 
-        n=read(fd,&filebuf[bytesleft],MAX_FRAMESIZE-bytesleft);
-        if (n > 0) 
-		{
-            bytesleft+=n;
+        /* refill once less than one frame is buffered */
+        if (bytesleft < framesize && !eof)
+        {
+            rt_memmove(filebuf, &filebuf[offset], bytesleft);
+            offset = 0;
+
+            n=read(fd,&filebuf[bytesleft],bufsize-bytesleft);
+            if (n > 0) 
+                bytesleft+=n;
+            else
+                eof = true;
         }
-		 
-		
-      }
+    }
+    flac_playing = false;
 
 	/* close device and file */
     rt_device_close(snd_device);
+
+__exit_buffer:
 	rt_free(filebuf);
+    if (pcm_buffer[0] != PCM_buffer0)
+    {
+        rt_free(pcm_buffer[0]);
+        rt_free(pcm_buffer[1]);
+        rt_free(decode_buffer);
+    }
+__exit_file:
+    if (seektable != RT_NULL)
+    {
+        rt_free(seektable);
+        seektable = RT_NULL;
+    }
     close(fd);
     return(0);
 }
 #ifdef RT_USING_FINSH
 #include <finsh.h>
 FINSH_FUNCTION_EXPORT(flac, flac(char* path) );
+FINSH_FUNCTION_EXPORT(flac_seek, seek the playing flac stream to ms);
 #endif
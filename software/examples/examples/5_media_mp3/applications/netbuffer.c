@@ -1,12 +1,13 @@
 #include <rthw.h>
 #include <rtthread.h>
 
+#include "board.h"
 #include "netbuffer.h"
 
 #define MP3_DECODE_MP_CNT   2
 #define MP3_DECODE_MP_SZ    2560
 
-static rt_uint8_t mempool[(MP3_DECODE_MP_SZ * 2 + 4)* 2]; // 5k x 2
+static rt_uint8_t mempool[(MP3_DECODE_MP_SZ * 2 + 4)* 2] SECTION_DMABUF; // 5k x 2
 static struct rt_mempool _mp;
 static rt_bool_t is_inited = RT_FALSE;
 
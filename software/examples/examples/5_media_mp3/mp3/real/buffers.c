@@ -49,17 +49,19 @@
 
 
 #include "coder.h"
+#include "board.h"
 
 #define static_buffers
 #ifdef static_buffers
-MP3DecInfo  mp3DecInfo;     //  0x7f0 =  2032 
-SubbandInfo sbi;            // 0x2204 =  8708
-IMDCTInfo mi;               // 0x1b20 =  6944
-HuffmanInfo hi;             // 0x1210 =  4624
-DequantInfo di;             //  0x348 =   840
-ScaleFactorInfo sfi;        //  0x124 =   292
-SideInfo si;                //  0x148 =   328
-FrameHeader fh;             //   0x38 =    56
+/* decoder state is only touched by the CPU, keep it in CCM */
+MP3DecInfo  mp3DecInfo SECTION_CCM;     //  0x7f0 =  2032 
+SubbandInfo sbi SECTION_CCM;            // 0x2204 =  8708
+IMDCTInfo mi SECTION_CCM;               // 0x1b20 =  6944
+HuffmanInfo hi SECTION_CCM;             // 0x1210 =  4624
+DequantInfo di SECTION_CCM;             //  0x348 =   840
+ScaleFactorInfo sfi SECTION_CCM;        //  0x124 =   292
+SideInfo si SECTION_CCM;                //  0x148 =   328
+FrameHeader fh SECTION_CCM;             //   0x38 =    56
 #else
 #include <rtthread.h>
 #define malloc rt_malloc
@@ -8,7 +8,7 @@
 //mempoolС.
 #define  mempll_block_size      16384
 //ǹmempool,4ֽΪƿ.
-static rt_uint8_t mempool[ (mempll_block_size+4) *2];
+static rt_uint8_t mempool[ (mempll_block_size+4) *2] SECTION_DMABUF;
 static struct rt_mempool _mp;
 //ڴسʼʶ
 static rt_bool_t is_inited = RT_FALSE;
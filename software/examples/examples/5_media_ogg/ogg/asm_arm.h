@@ -11,7 +11,7 @@
  *                                                                  *
  ********************************************************************
 
- function: arm7 and later wide math functions
+ function: arm7 and later, and Cortex-M4, wide math functions
 
  ********************************************************************/
 
@@ -241,3 +241,108 @@ static inline void lsp_norm_asm(ogg_uint32_t *qip,ogg_int32_t *qexpp){
 #endif
 #endif
 
+#ifdef _ARM_ASSEM_V7EM_
+
+#if !defined(_V_WIDE_MATH) && !defined(_LOW_ACCURACY_)
+#define _V_WIDE_MATH
+
+/*
+ * Cortex-M4 (ARMv7E-M, Thumb-2 only). SMMUL returns the high word of the
+ * 32x32 product in a single cycle and SMMLA adds it to an accumulator, so
+ * every product is truncated on its own exactly like MULT32() in misc.h.
+ * The results are bit-exact with the generic C code, unlike the ARM7
+ * versions above which round MULT31_SHIFT15 and sum the XPROD products
+ * in 64 bits.
+ */
+
+/* GCC for the Cortex-M4; armcc --gnu also says __GNUC__ but takes no
+   inline assembler in Thumb code */
+#if defined(__GNUC__) && defined(__ARM_ARCH_7EM__)
+
+static inline ogg_int32_t _SMMUL(ogg_int32_t x, ogg_int32_t y) {
+  ogg_int32_t r;
+  asm("smmul\t%0, %1, %2"
+      : "=r"(r)
+      : "%r"(x),"r"(y));
+  return(r);
+}
+
+static inline ogg_int32_t _SMMLA(ogg_int32_t x, ogg_int32_t y,
+                                 ogg_int32_t a) {
+  ogg_int32_t r;
+  asm("smmla\t%0, %1, %2, %3"
+      : "=r"(r)
+      : "%r"(x),"r"(y),"r"(a));
+  return(r);
+}
+
+#else
+
+/* MDK and IAR: a 64-bit product, which they turn into SMULL */
+static inline ogg_int32_t _SMMUL(ogg_int32_t x, ogg_int32_t y) {
+  return (ogg_int32_t)(((ogg_int64_t)x * y) >> 32);
+}
+
+static inline ogg_int32_t _SMMLA(ogg_int32_t x, ogg_int32_t y,
+                                 ogg_int32_t a) {
+  return a + _SMMUL(x, y);
+}
+
+#endif
+
+static inline ogg_int32_t MULT32(ogg_int32_t x, ogg_int32_t y) {
+  return _SMMUL(x, y);
+}
+
+static inline ogg_int32_t MULT31(ogg_int32_t x, ogg_int32_t y) {
+  return _SMMUL(x, y) << 1;
+}
+
+/* SMULL, then bits 15..46 of the product: LSR/ORR with a shifted operand */
+static inline ogg_int32_t MULT31_SHIFT15(ogg_int32_t x, ogg_int32_t y) {
+  return (ogg_int32_t)(((ogg_int64_t)x * y) >> 15);
+}
+
+/* enough registers to keep the butterfly operands, no barrier needed */
+#define MB()
+
+static inline void XPROD32(ogg_int32_t  a, ogg_int32_t  b,
+			   ogg_int32_t  t, ogg_int32_t  v,
+			   ogg_int32_t *x, ogg_int32_t *y)
+{
+  *x = _SMMLA(b, v, _SMMUL(a, t));
+  *y = _SMMUL(b, t) - _SMMUL(a, v);
+}
+
+static inline void XPROD31(ogg_int32_t  a, ogg_int32_t  b,
+			   ogg_int32_t  t, ogg_int32_t  v,
+			   ogg_int32_t *x, ogg_int32_t *y)
+{
+  *x = _SMMLA(b, v, _SMMUL(a, t)) << 1;
+  *y = (_SMMUL(b, t) - _SMMUL(a, v)) << 1;
+}
+
+static inline void XNPROD31(ogg_int32_t  a, ogg_int32_t  b,
+			    ogg_int32_t  t, ogg_int32_t  v,
+			    ogg_int32_t *x, ogg_int32_t *y)
+{
+  *x = (_SMMUL(a, t) - _SMMUL(b, v)) << 1;
+  *y = _SMMLA(a, v, _SMMUL(b, t)) << 1;
+}
+
+#endif
+
+#ifndef _V_CLIP_MATH
+#define _V_CLIP_MATH
+
+/* SSAT from the CMSIS intrinsics in board.h */
+static inline ogg_int32_t CLIP_TO_15(ogg_int32_t x) {
+  return __SSAT(x, 16);
+}
+
+#endif
+
+/* lsp_loop_asm() relies on ARM mode conditional execution, floor0 keeps
+   the C loop here */
+
+#endif
@@ -27,33 +27,6 @@
 
 #define memset rt_memset
 
-/*************************************************************************/
-#include <rtthread.h>
-#define buffsize 20*1024
-
-volatile char buffer[buffsize];
-volatile int total=0;
-
-void* alloca(rt_size_t size)
-{
-	int *temp;
-
-
-	if(total<buffsize)
-    {
-	  	temp = (int * )&buffer[total+128];
-		total += size ;
-	}
-	else
-	{
-	  total = 0;
-	  temp = (int * )&buffer[total];
-	}
-
-	return (void *)temp;
-}
-/*********************ʵ *************************************************/
-
 /**** pack/unpack helpers ******************************************/
 int _ilog(unsigned int v){
   int ret=0;
@@ -219,21 +192,26 @@ static int _make_decode_table(codebook *s,char *lengthlist,long quantvals,
 			      oggpack_buffer *opb,int maptype){
   int i;
   ogg_uint32_t *work;
-
+  long scratch;
 
   if(s->dec_nodeb==4){
-    s->dec_table=(void *)_ogg_malloc((s->used_entries*2+1)*sizeof(*work));
+    s->dec_table=(void *)_ogg_setup_malloc((s->used_entries*2+1)*sizeof(*work));
     /* +1 (rather than -2) is to accommodate 0 and 1 sized books,
        which are specialcased to nodeb==4 */
+    if(!s->dec_table)return 1;
     if(_make_words(lengthlist,s->entries,
 		   s->dec_table,quantvals,s,opb,maptype))return 1;
     
     return 0;
   }
 
+  scratch=_ogg_tmp_mark();
   work=(ogg_uint32_t *)alloca((s->used_entries*2-2)*sizeof(*work));
-  if(_make_words(lengthlist,s->entries,work,quantvals,s,opb,maptype))return 1;
-  s->dec_table=(void *)_ogg_malloc((s->used_entries*(s->dec_leafw+1)-2)*
+  if(!work || _make_words(lengthlist,s->entries,work,quantvals,s,opb,maptype)){
+    _ogg_tmp_release(scratch);
+    return 1;
+  }
+  s->dec_table=(void *)_ogg_setup_malloc((s->used_entries*(s->dec_leafw+1)-2)*
 			   s->dec_nodeb);
   
   if(s->dec_leafw==1){
@@ -317,7 +295,8 @@ static int _make_decode_table(codebook *s,char *lengthlist,long quantvals,
       }
     }
   }
-  //rt_free(work);	
+
+  _ogg_tmp_release(scratch);
   return 0;
 }
 
@@ -359,8 +338,8 @@ long _book_maptype1_quantvals(codebook *b){
 void vorbis_book_clear(codebook *b){
   /* static book is not cleared; we're likely called on the lookup and
      the static codebook belongs to the info struct */
-  if(b->q_val)_ogg_free(b->q_val);
-  if(b->dec_table)_ogg_free(b->dec_table);
+  if(b->q_val)_ogg_setup_free(b->q_val);
+  if(b->dec_table)_ogg_setup_free(b->dec_table);
 
   memset(b,0,sizeof(*b));
 }
@@ -370,6 +349,7 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
   int           quantvals=0;
   long          i,j;
   int           maptype;
+  long          scratch=_ogg_tmp_mark();
 
   memset(s,0,sizeof(*s));
 
@@ -386,6 +366,7 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
   case 0:
     /* unordered */
     lengthlist=(char *)alloca(sizeof(*lengthlist)*s->entries);
+    if(!lengthlist)goto _errout;
 
     /* allocated but unused entries? */
     if(oggpack_read(opb,1)){
@@ -422,6 +403,7 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
 
       s->used_entries=s->entries;
       lengthlist=(char *)alloca(sizeof(*lengthlist)*s->entries);
+      if(!lengthlist)goto _errout;
       
       for(i=0;i<s->entries;){
 			long num=oggpack_read(opb,_ilog(s->entries-i));
@@ -486,6 +468,7 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
 
 	/* need quantized values before  */
 	s->q_val=(void *)alloca(sizeof(ogg_uint16_t)*quantvals);
+	if(!s->q_val)goto _errout;
 	for(i=0;i<quantvals;i++)
 	  ((ogg_uint16_t *)s->q_val)[i]=oggpack_read(opb,s->q_bits);
 	
@@ -514,11 +497,11 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
 
 	/* need quantized values before */
 	if(s->q_bits<=8){
-	  s->q_val=(void *)_ogg_malloc(quantvals);
+	  s->q_val=(void *)_ogg_setup_malloc(quantvals);
 	  for(i=0;i<quantvals;i++)
 	    ((unsigned char *)s->q_val)[i]=oggpack_read(opb,s->q_bits);
 	}else{
-	  s->q_val=(void *)_ogg_malloc(quantvals*2);
+	  s->q_val=(void *)_ogg_setup_malloc(quantvals*2);
 	  for(i=0;i<quantvals;i++)
 	    ((ogg_uint16_t *)s->q_val)[i]=oggpack_read(opb,s->q_bits);
 	}
@@ -560,7 +543,7 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
 
       /* get the vals & pack them */
       s->q_pack=(s->q_bits+7)/8*s->dim;
-      s->q_val=(void *)_ogg_malloc(s->q_pack*s->used_entries);
+      s->q_val=(void *)_ogg_setup_malloc(s->q_pack*s->used_entries);
 
       if(s->q_bits<=8){
 	for(i=0;i<s->used_entries*s->dim;i++)
@@ -577,12 +560,12 @@ int vorbis_book_unpack(oggpack_buffer *opb,codebook *s){
 
   if(oggpack_eop(opb))goto _eofout;
 
-  //rt_free(lengthlist);
-
+  _ogg_tmp_release(scratch);
   return 0;
  _errout:
  _eofout:
   vorbis_book_clear(s);
+  _ogg_tmp_release(scratch);
   return -1;
 }
 
@@ -745,66 +728,91 @@ int decode_map(codebook *s, oggpack_buffer *b, ogg_int32_t *v, int point){
   return 0;
 }
 
-/* returns 0 on OK or -1 on eof *************************************/
+/* returns 0 on OK, -1 on eof or OV_EFAULT without scratch memory ****/
 long vorbis_book_decodevs_add(codebook *book,ogg_int32_t *a,
 			      oggpack_buffer *b,int n,int point){
+  long scratch=_ogg_tmp_mark();
   int step=n/book->dim;
   ogg_int32_t *v = (ogg_int32_t *)alloca(sizeof(*v)*book->dim);
   int i,j,o;
+  long ret=0;
+
+  if(!v)return OV_EFAULT;
 
   for (j=0;j<step;j++){
-    if(decode_map(book,b,v,point))return -1;
+    if(decode_map(book,b,v,point)){
+      ret=-1;
+      break;
+    }
     for(i=0,o=j;i<book->dim;i++,o+=step)
       a[o]+=v[i];
   }
 
-  //rt_free(v);
-
-  return 0;
+  _ogg_tmp_release(scratch);
+  return ret;
 }
 
 long vorbis_book_decodev_add(codebook *book,ogg_int32_t *a,
 			     oggpack_buffer *b,int n,int point){
+  long scratch=_ogg_tmp_mark();
   ogg_int32_t *v = (ogg_int32_t *)alloca(sizeof(*v)*book->dim);
   int i,j;
+  long ret=0;
+
+  if(!v)return OV_EFAULT;
   
   for(i=0;i<n;){
-    if(decode_map(book,b,v,point))return -1;
+    if(decode_map(book,b,v,point)){
+      ret=-1;
+      break;
+    }
     for (j=0;j<book->dim;j++)
       a[i++]+=v[j];
   }
-  
-  ////rt_free(v);
 
-  return 0;
+  _ogg_tmp_release(scratch);
+  return ret;
 }
 
 long vorbis_book_decodev_set(codebook *book,ogg_int32_t *a,
 			     oggpack_buffer *b,int n,int point){
+  long scratch=_ogg_tmp_mark();
   ogg_int32_t *v = (ogg_int32_t *)alloca(sizeof(*v)*book->dim);
   int i,j;
+  long ret=0;
+
+  if(!v)return OV_EFAULT;
 
   for(i=0;i<n;){
-    if(decode_map(book,b,v,point))return -1;
+    if(decode_map(book,b,v,point)){
+      ret=-1;
+      break;
+    }
     for (j=0;j<book->dim;j++)
       a[i++]=v[j];
   }
 
-  //rt_free(v);
-
-  return 0;
+  _ogg_tmp_release(scratch);
+  return ret;
 }
 
 long vorbis_book_decodevv_add(codebook *book,ogg_int32_t **a,
 			      long offset,int ch,
 			      oggpack_buffer *b,int n,int point){
 
+  long scratch=_ogg_tmp_mark();
   ogg_int32_t *v = (ogg_int32_t *)alloca(sizeof(*v)*book->dim);
   long i,j;
   int chptr=0;
+  long ret=0;
+
+  if(!v)return OV_EFAULT;
     
   for(i=offset;i<offset+n;){
-    if(decode_map(book,b,v,point))return -1;
+    if(decode_map(book,b,v,point)){
+      ret=-1;
+      break;
+    }
     for (j=0;j<book->dim;j++){
       a[chptr++][i]+=v[j];
       if(chptr==ch){
@@ -814,6 +822,6 @@ long vorbis_book_decodevv_add(codebook *book,ogg_int32_t **a,
     }
   }
   
-  //rt_free(v);
-  return 0;
+  _ogg_tmp_release(scratch);
+  return ret;
 }
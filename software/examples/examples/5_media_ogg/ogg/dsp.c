@@ -180,7 +180,7 @@ static int ilog(ogg_uint32_t v){
 int vorbis_dsp_synthesis(vorbis_dsp_state *vd,ogg_packet *op,int decodep){
   vorbis_info          *vi=vd->vi;
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
-  int                   mode,i;
+  int                   mode,i,ret;
 
   oggpack_readinit(&vd->opb,op->packet);
 
@@ -209,7 +209,8 @@ int vorbis_dsp_synthesis(vorbis_dsp_state *vd,ogg_packet *op,int decodep){
   
   /* packet decode and portions of synthesis that rely on only this block */
   if(decodep){
-    mapping_inverse(vd,ci->map_param+ci->mode_param[mode].mapping);
+    ret=mapping_inverse(vd,ci->map_param+ci->mode_param[mode].mapping);
+    if(ret)return ret;
 
     if(vd->out_begin==-1){
       vd->out_begin=0;
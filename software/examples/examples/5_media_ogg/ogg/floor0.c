@@ -122,7 +122,8 @@ static const unsigned char MLOOP_2[64]={
 
 static const unsigned char MLOOP_3[8]={0,1,2,2,3,3,3,3};
 
-void vorbis_lsp_to_curve(ogg_int32_t *curve,int n,int ln,
+/* returns 0, or OV_EFAULT without scratch memory */
+int vorbis_lsp_to_curve(ogg_int32_t *curve,int n,int ln,
 			 ogg_int32_t *lsp,int m,
 			 ogg_int32_t amp,
 			 ogg_int32_t ampoffset,
@@ -134,12 +135,15 @@ void vorbis_lsp_to_curve(ogg_int32_t *curve,int n,int ln,
   int i;
   int ampoffseti=ampoffset*4096;
   int ampi=amp;
+  long scratch=_ogg_tmp_mark();
   ogg_int32_t *ilsp=(ogg_int32_t *)alloca(m*sizeof(*ilsp));
 
   ogg_uint32_t inyq= (1UL<<31) / toBARK(nyq);
   ogg_uint32_t imap= (1UL<<31) / ln;
   ogg_uint32_t tBnyq1 = toBARK(nyq)<<1;
 
+  if(!ilsp)return OV_EFAULT;
+
   /* Besenham for frequency scale to avoid a division */
   int f=0;
   int fdx=n;
@@ -167,7 +171,8 @@ void vorbis_lsp_to_curve(ogg_int32_t *curve,int n,int ln,
     /* safeguard against a malicious stream */
     if(val<0 || (val>>COS_LOOKUP_I_SHIFT)>=COS_LOOKUP_I_SZ){
       memset(curve,0,sizeof(*curve)*n);
-      return;
+      _ogg_tmp_release(scratch);
+      return 0;
     }
 
     ilsp[i]=vorbis_coslook_i(val);
@@ -335,21 +340,22 @@ void vorbis_lsp_to_curve(ogg_int32_t *curve,int n,int ln,
     }
   }
 
-  //rt_free(ilsp);
+  _ogg_tmp_release(scratch);
+  return 0;
 }
 
 /*************** vorbis decode glue ************/
 
 void floor0_free_info(vorbis_info_floor *i){
   vorbis_info_floor0 *info=(vorbis_info_floor0 *)i;
-  if(info)_ogg_free(info);
+  if(info)_ogg_setup_free(info);
 }
 
 vorbis_info_floor *floor0_info_unpack (vorbis_info *vi,oggpack_buffer *opb){
   codec_setup_info     *ci=(codec_setup_info *)vi->codec_setup;
   int j;
 
-  vorbis_info_floor0 *info=(vorbis_info_floor0 *)_ogg_malloc(sizeof(*info));
+  vorbis_info_floor0 *info=(vorbis_info_floor0 *)_ogg_setup_malloc(sizeof(*info));
   info->order=oggpack_read(opb,8);
   info->rate=oggpack_read(opb,16);
   info->barkmap=oggpack_read(opb,16);
@@ -419,9 +425,10 @@ int floor0_inverse2(vorbis_dsp_state *vd,vorbis_info_floor *i,
     ogg_int32_t amp=lsp[info->order];
 
     /* take the coefficients back to a spectral envelope curve */
-    vorbis_lsp_to_curve(out,ci->blocksizes[vd->W]/2,info->barkmap,
-			lsp,info->order,amp,info->ampdB,
-			info->rate>>1);
+    if(vorbis_lsp_to_curve(out,ci->blocksizes[vd->W]/2,info->barkmap,
+			   lsp,info->order,amp,info->ampdB,
+			   info->rate>>1))
+      return(OV_EFAULT);
     return(1);
   }
   memset(out,0,sizeof(*out)*ci->blocksizes[vd->W]/2);
@@ -56,29 +56,35 @@ char *vorbis_comment_query(vorbis_comment *vc, char *tag, int count){
   long i;
   int found = 0;
   int taglen = strlen(tag)+1; /* +1 for the = we append */
+  long scratch=_ogg_tmp_mark();
   char *fulltag = (char *)alloca(taglen+ 1);
 
+  if(!fulltag)return NULL;
   strcpy(fulltag, tag);
   strcat(fulltag, "=");
   
   for(i=0;i<vc->comments;i++){
     if(!tagcompare(vc->user_comments[i], fulltag, taglen)){
-      if(count == found)
+      if(count == found){
 	/* We return a pointer to the data, not a copy */
+	_ogg_tmp_release(scratch);
       	return vc->user_comments[i] + taglen;
-      else
+      }else
 	found++;
     }
   }
 
-  //rt_free(fulltag);
+  _ogg_tmp_release(scratch);
   return NULL; /* didn't find anything */
 }
 
 int vorbis_comment_query_count(vorbis_comment *vc, char *tag){
   int i,count=0;
   int taglen = strlen(tag)+1; /* +1 for the = we append */
+  long scratch=_ogg_tmp_mark();
   char *fulltag = (char *)alloca(taglen+1);
+
+  if(!fulltag)return 0;
   strcpy(fulltag,tag);
   strcat(fulltag, "=");
 
@@ -87,7 +93,7 @@ int vorbis_comment_query_count(vorbis_comment *vc, char *tag){
       count++;
   }
 
-  //rt_free(fulltag);
+  _ogg_tmp_release(scratch);
   return count;
 }
 
@@ -113,7 +119,7 @@ int vorbis_info_blocksize(vorbis_info *vi,int zo){
 /* used by synthesis, which has a full, alloced vi */
 void vorbis_info_init(vorbis_info *vi){
   memset(vi,0,sizeof(*vi));
-  vi->codec_setup=(codec_setup_info *)_ogg_calloc(1,sizeof(codec_setup_info));
+  vi->codec_setup=(codec_setup_info *)_ogg_setup_calloc(1,sizeof(codec_setup_info));
 }
 
 void vorbis_info_clear(vorbis_info *vi){
@@ -122,12 +128,12 @@ void vorbis_info_clear(vorbis_info *vi){
 
   if(ci){
 
-    if(ci->mode_param)_ogg_free(ci->mode_param);
+    if(ci->mode_param)_ogg_setup_free(ci->mode_param);
 
     if(ci->map_param){
       for(i=0;i<ci->maps;i++) /* unpack does the range checking */
 	mapping_clear_info(ci->map_param+i);
-      _ogg_free(ci->map_param);
+      _ogg_setup_free(ci->map_param);
     }
 
     if(ci->floor_param){
@@ -136,23 +142,23 @@ void vorbis_info_clear(vorbis_info *vi){
 	  floor1_free_info(ci->floor_param[i]);
 	else
 	  floor0_free_info(ci->floor_param[i]);
-      _ogg_free(ci->floor_param);
-      _ogg_free(ci->floor_type);
+      _ogg_setup_free(ci->floor_param);
+      _ogg_setup_free(ci->floor_type);
     }
 
     if(ci->residue_param){
       for(i=0;i<ci->residues;i++) /* unpack does the range checking */
 	res_clear_info(ci->residue_param+i);
-      _ogg_free(ci->residue_param);
+      _ogg_setup_free(ci->residue_param);
     }
 
     if(ci->book_param){
       for(i=0;i<ci->books;i++)
 	vorbis_book_clear(ci->book_param+i);
-      _ogg_free(ci->book_param);
+      _ogg_setup_free(ci->book_param);
     }
     
-    _ogg_free(ci);
+    _ogg_setup_free(ci);
   }
 
   memset(vi,0,sizeof(*vi));
@@ -232,7 +238,7 @@ static int _vorbis_unpack_books(vorbis_info *vi,oggpack_buffer *opb){
 
   /* codebooks */
   ci->books=oggpack_read(opb,8)+1;
-  ci->book_param=(codebook *)_ogg_calloc(ci->books,sizeof(*ci->book_param));
+  ci->book_param=(codebook *)_ogg_setup_calloc(ci->books,sizeof(*ci->book_param));
   for(i=0;i<ci->books;i++)
     if(vorbis_book_unpack(opb,ci->book_param+i))goto err_out;
 
@@ -243,8 +249,8 @@ static int _vorbis_unpack_books(vorbis_info *vi,oggpack_buffer *opb){
 
   /* floor backend settings */
   ci->floors=oggpack_read(opb,6)+1;
-  ci->floor_param=(vorbis_info_floor     **)_ogg_malloc(sizeof(*ci->floor_param)*ci->floors);
-  ci->floor_type=(char *)_ogg_malloc(sizeof(*ci->floor_type)*ci->floors);
+  ci->floor_param=(vorbis_info_floor     **)_ogg_setup_malloc(sizeof(*ci->floor_param)*ci->floors);
+  ci->floor_type=(char *)_ogg_setup_malloc(sizeof(*ci->floor_type)*ci->floors);
   for(i=0;i<ci->floors;i++){
     ci->floor_type[i]=oggpack_read(opb,16);
     if(ci->floor_type[i]<0 || ci->floor_type[i]>=VI_FLOORB)goto err_out;
@@ -257,13 +263,13 @@ static int _vorbis_unpack_books(vorbis_info *vi,oggpack_buffer *opb){
 
   /* residue backend settings */
   ci->residues=oggpack_read(opb,6)+1;
-  ci->residue_param=(vorbis_info_residue    *)_ogg_malloc(sizeof(*ci->residue_param)*ci->residues);
+  ci->residue_param=(vorbis_info_residue    *)_ogg_setup_malloc(sizeof(*ci->residue_param)*ci->residues);
   for(i=0;i<ci->residues;i++)
     if(res_unpack(ci->residue_param+i,vi,opb))goto err_out;
 
   /* map backend settings */
   ci->maps=oggpack_read(opb,6)+1;
-  ci->map_param=(vorbis_info_mapping    *)_ogg_malloc(sizeof(*ci->map_param)*ci->maps);
+  ci->map_param=(vorbis_info_mapping    *)_ogg_setup_malloc(sizeof(*ci->map_param)*ci->maps);
   for(i=0;i<ci->maps;i++){
     if(oggpack_read(opb,16)!=0)goto err_out;
     if(mapping_info_unpack(ci->map_param+i,vi,opb))goto err_out;
@@ -272,7 +278,7 @@ static int _vorbis_unpack_books(vorbis_info *vi,oggpack_buffer *opb){
   /* mode settings */
   ci->modes=oggpack_read(opb,6)+1;
   ci->mode_param=
-    (vorbis_info_mode *)_ogg_malloc(ci->modes*sizeof(*ci->mode_param));
+    (vorbis_info_mode *)_ogg_setup_malloc(ci->modes*sizeof(*ci->mode_param));
   for(i=0;i<ci->modes;i++){
     ci->mode_param[i].blockflag=oggpack_read(opb,1);
     if(oggpack_read(opb,16))goto err_out;
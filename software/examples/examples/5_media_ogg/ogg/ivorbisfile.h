@@ -25,6 +25,7 @@ extern "C"
 
 #include <stdio.h>
 #include "ivorbiscodec.h"
+#include "ogg_arena.h"
 
 /* The function prototypes for the callbacks are basically the same as for
  * the stdio functions fread, fseek, fclose, ftell. 
@@ -75,6 +76,10 @@ typedef struct OggVorbis_File {
 
   ov_callbacks callbacks;
 
+  /* bound by each ov_* call, one OggVorbis_File decodes at a time */
+  ogg_arena        setup_arena;   /* codec setup and codebook tables */
+  ogg_arena        scratch_arena; /* alloca() of the decoder */
+
 } OggVorbis_File;
 
 extern int ov_clear(OggVorbis_File *vf);
@@ -113,6 +118,9 @@ extern vorbis_comment *ov_comment(OggVorbis_File *vf,int link);
 extern long ov_read(OggVorbis_File *vf,void *buffer,int length,
 		    int *bitstream);
 
+extern void ov_arena_usage(OggVorbis_File *vf,long *setup_peak,
+			   long *scratch_peak);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -144,6 +144,15 @@ int ogg(char * path)
 
   }
 
+  /* report what the decoder arenas needed for this stream */
+  {
+    long setup_peak,scratch_peak;
+
+    ov_arena_usage(&vf,&setup_peak,&scratch_peak);
+    rt_kprintf("arena peak: setup %d bytes, scratch %d bytes\n",
+	       setup_peak,scratch_peak);
+  }
+
   /* cleanup */
   ov_clear(&vf);
     
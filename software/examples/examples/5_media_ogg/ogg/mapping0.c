@@ -29,9 +29,9 @@
 
 void mapping_clear_info(vorbis_info_mapping *info){
   if(info){
-    if(info->chmuxlist)_ogg_free(info->chmuxlist);
-    if(info->submaplist)_ogg_free(info->submaplist);
-    if(info->coupling)_ogg_free(info->coupling);
+    if(info->chmuxlist)_ogg_setup_free(info->chmuxlist);
+    if(info->submaplist)_ogg_setup_free(info->submaplist);
+    if(info->coupling)_ogg_setup_free(info->coupling);
     memset(info,0,sizeof(*info));
   }
 }
@@ -61,7 +61,7 @@ int mapping_info_unpack(vorbis_info_mapping *info,vorbis_info *vi,
   if(oggpack_read(opb,1)){
     info->coupling_steps=oggpack_read(opb,8)+1;
     info->coupling=
-      (coupling_step *)_ogg_malloc(info->coupling_steps*sizeof(*info->coupling));
+      (coupling_step *)_ogg_setup_malloc(info->coupling_steps*sizeof(*info->coupling));
     
     for(i=0;i<info->coupling_steps;i++){
       int testM=info->coupling[i].mag=oggpack_read(opb,ilog(vi->channels));
@@ -79,14 +79,14 @@ int mapping_info_unpack(vorbis_info_mapping *info,vorbis_info *vi,
   if(oggpack_read(opb,2)>0)goto err_out; /* 2,3:reserved */
     
   if(info->submaps>1){
-    info->chmuxlist=(unsigned char *)_ogg_malloc(sizeof(*info->chmuxlist)*vi->channels);
+    info->chmuxlist=(unsigned char *)_ogg_setup_malloc(sizeof(*info->chmuxlist)*vi->channels);
     for(i=0;i<vi->channels;i++){
       info->chmuxlist[i]=oggpack_read(opb,4);
       if(info->chmuxlist[i]>=info->submaps)goto err_out;
     }
   }
 
-  info->submaplist=(submap *)_ogg_malloc(sizeof(*info->submaplist)*info->submaps);
+  info->submaplist=(submap *)_ogg_setup_malloc(sizeof(*info->submaplist)*info->submaps);
   for(i=0;i<info->submaps;i++){
     int temp=oggpack_read(opb,8);
     info->submaplist[i].floor=oggpack_read(opb,8);
@@ -108,6 +108,7 @@ int mapping_inverse(vorbis_dsp_state *vd,vorbis_info_mapping *info){
 
   int                   i,j;
   long                  n=ci->blocksizes[vd->W];
+  long                  scratch=_ogg_tmp_mark();
 
   ogg_int32_t **pcmbundle=
     (ogg_int32_t **)alloca(sizeof(*pcmbundle)*vi->channels);
@@ -117,6 +118,8 @@ int mapping_inverse(vorbis_dsp_state *vd,vorbis_info_mapping *info){
     (int *)alloca(sizeof(*nonzero)*vi->channels);
   ogg_int32_t **floormemo=
     (ogg_int32_t **)alloca(sizeof(*floormemo)*vi->channels);
+
+  if(!pcmbundle || !zerobundle || !nonzero || !floormemo)goto errout;
   
   /* recover the spectral envelope; store it in the PCM vector for now */
   for(i=0;i<vi->channels;i++){
@@ -131,11 +134,13 @@ int mapping_inverse(vorbis_dsp_state *vd,vorbis_info_mapping *info){
       /* floor 1 */
       floormemo[i]=( ogg_int32_t *)alloca(sizeof(*floormemo[i])*
 			  floor1_memosize(ci->floor_param[floorno]));
+      if(!floormemo[i])goto errout;
       floormemo[i]=floor1_inverse1(vd,ci->floor_param[floorno],floormemo[i]);
     }else{
       /* floor 0 */
       floormemo[i]=( ogg_int32_t *)alloca(sizeof(*floormemo[i])*
 			  floor0_memosize(ci->floor_param[floorno]));
+      if(!floormemo[i])goto errout;
       floormemo[i]=floor0_inverse1(vd,ci->floor_param[floorno],floormemo[i]);
     }
     
@@ -168,8 +173,8 @@ int mapping_inverse(vorbis_dsp_state *vd,vorbis_info_mapping *info){
       }
     }
     
-    res_inverse(vd,ci->residue_param+info->submaplist[i].residue,
-		pcmbundle,zerobundle,ch_in_bundle);
+    if(res_inverse(vd,ci->residue_param+info->submaplist[i].residue,
+		   pcmbundle,zerobundle,ch_in_bundle))goto errout;
   }
 
   //for(j=0;j<vi->channels;j++)
@@ -221,7 +226,8 @@ int mapping_inverse(vorbis_dsp_state *vd,vorbis_info_mapping *info){
       floor1_inverse2(vd,ci->floor_param[floorno],floormemo[i],pcm);
     }else{
       /* floor 0 */
-      floor0_inverse2(vd,ci->floor_param[floorno],floormemo[i],pcm);
+      if(floor0_inverse2(vd,ci->floor_param[floorno],floormemo[i],pcm)<0)
+	goto errout;
     }
   }
 
@@ -237,14 +243,13 @@ int mapping_inverse(vorbis_dsp_state *vd,vorbis_info_mapping *info){
   //_analysis_output("imdct",seq+j,vb->pcm[j],-24,n,0,0);
 
 
-    for(i=0;i<vi->channels;i++)
-	 //rt_free(floormemo[i]);
-
-   //rt_free(pcmbundle);
-	//rt_free(zerobundle);
-	//rt_free(floormemo) ;
-    
+  _ogg_tmp_release(scratch);
 
   /* all done! */
   return(0);
+
+ errout:
+  /* out of scratch memory */
+  _ogg_tmp_release(scratch);
+  return(OV_EFAULT);
 }
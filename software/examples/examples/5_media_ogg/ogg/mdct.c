@@ -379,7 +379,7 @@ STIN void mdct_step8(DATA_TYPE *x, int n, int step){
 
 /* partial; doesn't perform last-step deinterleave/unrolling.  That
    can be done more efficiently during pcm output */
-void mdct_backward(int n, DATA_TYPE *in){
+void ICODE_ATTR_TREMOR_MDCT mdct_backward(int n, DATA_TYPE *in){
   int shift;
   int step;
   
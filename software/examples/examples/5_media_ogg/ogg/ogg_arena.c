@@ -0,0 +1,236 @@
+/*
+ * File      : ogg_arena.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-16     realtouch    first version
+ */
+
+#include "os_types.h"
+
+#define ARENA_ALIGN             8
+#define ARENA_CHUNK_MIN         1024
+#define ARENA_CHUNK_DEFAULT     4096
+#define ARENA_POOL_SIZE         (20*1024)
+
+struct ogg_arena_chunk {
+  ogg_arena_chunk *next;
+  long size;        /* usable bytes after the header */
+  long offset;      /* bytes in use */
+};
+
+#define CHUNK_HEAD      RT_ALIGN(sizeof(ogg_arena_chunk),ARENA_ALIGN)
+#define CHUNK_DATA(c)   ((char *)(c)+CHUNK_HEAD)
+
+/* scratch for callers which do not go through vorbisfile */
+static ogg_arena _default_scratch;
+
+/* zero wait state memory for the first scratch chunk of one arena */
+static ogg_int64_t _pool[ARENA_POOL_SIZE/8] IBSS_ATTR_TREMOR;
+static ogg_arena *_pool_owner=RT_NULL;
+
+/* arenas of the stream being decoded; one stream is decoded at a time */
+static ogg_arena *_setup_arena=RT_NULL;
+static ogg_arena *_scratch_arena=&_default_scratch;
+
+static ogg_arena_chunk *_chunk_create(ogg_arena *a,long bytes){
+  ogg_arena_chunk *c;
+
+  if(bytes<a->chunk_size)bytes=a->chunk_size;
+  if(bytes<ARENA_CHUNK_MIN)bytes=ARENA_CHUNK_DEFAULT;
+
+  c=(ogg_arena_chunk *)_ogg_malloc(CHUNK_HEAD+bytes);
+  if(c==RT_NULL)return RT_NULL;
+
+  c->next=RT_NULL;
+  c->size=bytes;
+  c->offset=0;
+  a->size+=bytes;
+  return c;
+}
+
+void ogg_arena_init(ogg_arena *a,long chunk_size){
+  rt_memset(a,0,sizeof(*a));
+  a->chunk_size=chunk_size;
+}
+
+/* Take the CCM pool as first chunk if no other arena holds it. Returns 0
+   when the arena has to live on the heap. */
+int ogg_arena_use_pool(ogg_arena *a){
+  ogg_arena_chunk *c=(ogg_arena_chunk *)_pool;
+
+  if(_pool_owner!=RT_NULL || a->first!=RT_NULL)return 0;
+
+  c->next=RT_NULL;
+  c->size=ARENA_POOL_SIZE-CHUNK_HEAD;
+  c->offset=0;
+  a->first=a->current=c;
+  a->size+=c->size;
+  _pool_owner=a;
+  return 1;
+}
+
+/* Set the chunk size from what the stream headers tell and take the
+   first chunk right away. */
+void ogg_arena_size(ogg_arena *a,long bytes){
+  a->chunk_size=RT_ALIGN(bytes,ARENA_ALIGN);
+
+  if(a->first==RT_NULL)
+    a->first=a->current=_chunk_create(a,0);
+}
+
+void *ogg_arena_alloc(ogg_arena *a,long bytes){
+  ogg_arena_chunk *c=a->current;
+  ogg_arena_chunk *n;
+  void *ptr;
+
+  bytes=RT_ALIGN(bytes>0?bytes:1,ARENA_ALIGN);
+
+  if(c==RT_NULL){
+    c=_chunk_create(a,bytes);
+    if(c==RT_NULL)return RT_NULL;
+    a->first=a->current=c;
+  }else if(c->offset+bytes>c->size){
+    /* continue in the next chunk, or replace it by a large enough one;
+       the tail of the current chunk counts as used */
+    n=c->next;
+    if(n!=RT_NULL && n->size<bytes){
+      c->next=n->next;
+      a->size-=n->size;
+      _ogg_free(n);
+      n=RT_NULL;
+    }
+    if(n==RT_NULL){
+      n=_chunk_create(a,bytes);
+      if(n==RT_NULL)return RT_NULL;
+      n->next=c->next;
+      c->next=n;
+    }
+
+    a->used+=c->size-c->offset;
+    c->offset=c->size;
+    n->offset=0;
+    a->current=c=n;
+  }
+
+  ptr=CHUNK_DATA(c)+c->offset;
+  c->offset+=bytes;
+  a->used+=bytes;
+  if(a->used>a->peak)a->peak=a->used;
+
+  return ptr;
+}
+
+long ogg_arena_mark(ogg_arena *a){
+  return a->used;
+}
+
+/* release everything allocated after mark was taken */
+void ogg_arena_release(ogg_arena *a,long mark){
+  ogg_arena_chunk *c=a->first;
+  long offset=mark;
+
+  if(c==RT_NULL)return;
+
+  while(offset>c->size && c->next){
+    offset-=c->size;
+    c=c->next;
+  }
+
+  c->offset=offset;
+  a->current=c;
+  a->used=mark;
+}
+
+void ogg_arena_reset(ogg_arena *a){
+  ogg_arena_release(a,0);
+}
+
+/* give the chunks following the current one back to the heap */
+void ogg_arena_trim(ogg_arena *a){
+  ogg_arena_chunk *c=a->current;
+  ogg_arena_chunk *n;
+
+  if(c==RT_NULL)return;
+
+  n=c->next;
+  c->next=RT_NULL;
+  while(n){
+    c=n->next;
+    a->size-=n->size;
+    _ogg_free(n);
+    n=c;
+  }
+}
+
+/* give the chunks back to the heap */
+void ogg_arena_clear(ogg_arena *a){
+  ogg_arena_chunk *c=a->first;
+  ogg_arena_chunk *n;
+
+  while(c){
+    n=c->next;
+    if((char *)c==(char *)_pool)
+      _pool_owner=RT_NULL;
+    else
+      _ogg_free(c);
+    c=n;
+  }
+
+  a->first=a->current=RT_NULL;
+  a->used=0;
+  a->size=0;
+}
+
+int ogg_arena_owns(ogg_arena *a,void *ptr){
+  ogg_arena_chunk *c;
+
+  for(c=a->first;c;c=c->next)
+    if((char *)ptr>=CHUNK_DATA(c) && (char *)ptr<CHUNK_DATA(c)+c->size)
+      return 1;
+
+  return 0;
+}
+
+void ogg_arena_select(ogg_arena *setup,ogg_arena *scratch){
+  _setup_arena=setup;
+  _scratch_arena=scratch?scratch:&_default_scratch;
+}
+
+void *_ogg_setup_malloc(long bytes){
+  if(_setup_arena)
+    return ogg_arena_alloc(_setup_arena,bytes);
+  return _ogg_malloc(bytes);
+}
+
+void *_ogg_setup_calloc(long count,long bytes){
+  void *ptr=_ogg_setup_malloc(count*bytes);
+
+  if(ptr)rt_memset(ptr,0,count*bytes);
+  return ptr;
+}
+
+/* arena blocks go away with the arena */
+void _ogg_setup_free(void *ptr){
+  if(ptr==RT_NULL)return;
+  if(_setup_arena && ogg_arena_owns(_setup_arena,ptr))return;
+  _ogg_free(ptr);
+}
+
+void *_ogg_tmp_alloc(long bytes){
+  return ogg_arena_alloc(_scratch_arena,bytes);
+}
+
+long _ogg_tmp_mark(void){
+  return ogg_arena_mark(_scratch_arena);
+}
+
+void _ogg_tmp_release(long mark){
+  ogg_arena_release(_scratch_arena,mark);
+}
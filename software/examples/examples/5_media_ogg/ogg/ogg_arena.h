@@ -0,0 +1,74 @@
+/*
+ * File      : ogg_arena.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-16     realtouch    first version
+ */
+
+#ifndef _OGG_ARENA_H
+#define _OGG_ARENA_H
+
+/*
+ * Bump allocators for the decoder.
+ *
+ * Each OggVorbis_File owns two arenas:
+ *  - setup: codebook decode tables and the codec setup parsed from the
+ *    header packets. Blocks are never released one by one, the arena is
+ *    reset when the stream info is cleared.
+ *  - scratch: what libvorbis gets from alloca(). Every function taking
+ *    scratch memory marks the arena on entry and releases it on return.
+ *    alloca() returns NULL when no chunk can be added, the decoder then
+ *    fails with OV_EFAULT.
+ *
+ * An arena is a list of chunks taken from the system heap. Chunks are
+ * kept until the arena is cleared, so after the first packet the decoder
+ * does not touch the heap any more.
+ */
+
+typedef struct ogg_arena_chunk ogg_arena_chunk;
+
+typedef struct ogg_arena {
+  ogg_arena_chunk *first;
+  ogg_arena_chunk *current;
+  long chunk_size;  /* size of chunks added on demand */
+
+  long used;        /* position: bytes handed out, including chunk tails */
+  long peak;        /* high water mark of used */
+  long size;        /* bytes held in chunks */
+} ogg_arena;
+
+extern void  ogg_arena_init(ogg_arena *a,long chunk_size);
+extern int   ogg_arena_use_pool(ogg_arena *a);
+extern void  ogg_arena_size(ogg_arena *a,long bytes);
+extern void *ogg_arena_alloc(ogg_arena *a,long bytes);
+extern long  ogg_arena_mark(ogg_arena *a);
+extern void  ogg_arena_release(ogg_arena *a,long mark);
+extern void  ogg_arena_reset(ogg_arena *a);
+extern void  ogg_arena_trim(ogg_arena *a);
+extern void  ogg_arena_clear(ogg_arena *a);
+extern int   ogg_arena_owns(ogg_arena *a,void *ptr);
+
+/* Bind the arenas of the stream being decoded, RT_NULL for the defaults.
+   The binding is global, so only one OggVorbis_File can be inside an ov_*
+   call at a time: decoding two streams from two threads needs a lock
+   around the calls. */
+extern void  ogg_arena_select(ogg_arena *setup,ogg_arena *scratch);
+
+/* setup storage; blocks not taken from the setup arena go to the heap */
+extern void *_ogg_setup_malloc(long bytes);
+extern void *_ogg_setup_calloc(long count,long bytes);
+extern void  _ogg_setup_free(void *ptr);
+
+/* scratch storage, scoped by _ogg_tmp_mark()/_ogg_tmp_release() */
+extern void *_ogg_tmp_alloc(long bytes);
+extern long  _ogg_tmp_mark(void);
+extern void  _ogg_tmp_release(long mark);
+
+#endif  /* _OGG_ARENA_H */
@@ -18,9 +18,17 @@
 #define _OS_TYPES_H
 
 #include <rtthread.h>
+#include "board.h"
 
 
+/* Cortex-M4 multiplies 32x32->64 in a single cycle: keep full precision
+   there with the math of asm_arm.h, use the 32 bit approximation on the
+   others */
+#if defined(__ARM_ARCH_7EM__) || defined(__TARGET_ARCH_7E_M) || defined(__ARM7EM__)
+#define  _ARM_ASSEM_V7EM_
+#else
 #define  _LOW_ACCURACY_
+#endif
 #define inline __inline
 #define BYTE_ORDER  LITTLE_ENDIAN
 
@@ -37,11 +45,18 @@
 
 /* make it easy on the folks that want to compile the libs with a
    different malloc than stdlib */
+/* IRAM on Rockbox targets: MDCT runs from SRAM, scratch lives in CCM */
+#define ICODE_ATTR_TREMOR_MDCT  SECTION_FASTCODE
+#define IBSS_ATTR_TREMOR        SECTION_CCM
+
 #define _ogg_malloc  rt_malloc
 #define _ogg_calloc  rt_calloc
 #define _ogg_realloc rt_realloc
 #define _ogg_free    rt_free
 
-extern void* alloca(rt_size_t size);
+/* alloca() takes scratch memory from the decoder arena; the callers scope
+   it with _ogg_tmp_mark()/_ogg_tmp_release() */
+#include "ogg_arena.h"
+#define alloca(size) _ogg_tmp_alloc(size)
 
 #endif  /* _OS_TYPES_H */
@@ -27,8 +27,8 @@
 
 void res_clear_info(vorbis_info_residue *info){
   if(info){
-    if(info->stagemasks)_ogg_free(info->stagemasks);
-    if(info->stagebooks)_ogg_free(info->stagebooks);
+    if(info->stagemasks)_ogg_setup_free(info->stagemasks);
+    if(info->stagebooks)_ogg_setup_free(info->stagebooks);
     memset(info,0,sizeof(*info));
   }
 }
@@ -50,8 +50,8 @@ int res_unpack(vorbis_info_residue *info,
   info->groupbook=oggpack_read(opb,8);
   if(info->groupbook>=ci->books)goto errout;
 
-  info->stagemasks=(unsigned char *)_ogg_malloc(info->partitions*sizeof(*info->stagemasks));
-  info->stagebooks=(unsigned char *)_ogg_malloc(info->partitions*8*sizeof(*info->stagebooks));
+  info->stagemasks=(unsigned char *)_ogg_setup_malloc(info->partitions*sizeof(*info->stagemasks));
+  info->stagebooks=(unsigned char *)_ogg_setup_malloc(info->partitions*8*sizeof(*info->stagebooks));
 
   for(j=0;j<info->partitions;j++){
     int cascade=oggpack_read(opb,3);
@@ -91,6 +91,8 @@ int res_inverse(vorbis_dsp_state *vd,vorbis_info_residue *info,
   int n=info->end-info->begin;
   int partvals=n/samples_per_partition;
   int partwords=(partvals+partitions_per_word-1)/partitions_per_word;
+  long scratch=_ogg_tmp_mark();
+  long ret=0;
 
   if(info->type<2){
     for(i=0;i<ch;i++)
@@ -101,9 +103,12 @@ int res_inverse(vorbis_dsp_state *vd,vorbis_info_residue *info,
     if(used){
       
       char **partword=(char **)alloca(ch*sizeof(*partword));
-      for(j=0;j<ch;j++)
+      if(!partword)goto errout;
+      for(j=0;j<ch;j++){
 	partword[j]=(char *)alloca(partwords*partitions_per_word*
 				   sizeof(*partword[j]));
+	if(!partword[j])goto errout;
+      }
 
       for(s=0;s<info->stages;s++){
 	
@@ -142,21 +147,18 @@ int res_inverse(vorbis_dsp_state *vd,vorbis_info_residue *info,
 		codebook *stagebook=ci->book_param+
 		  info->stagebooks[(partword[j][i]<<3)+s];
 		if(info->type){
-		  if(vorbis_book_decodev_add(stagebook,in[j]+offset,&vd->opb,
-					     samples_per_partition,-8)==-1)
-		    goto eopbreak;
+		  ret=vorbis_book_decodev_add(stagebook,in[j]+offset,&vd->opb,
+					      samples_per_partition,-8);
 		}else{
-		  if(vorbis_book_decodevs_add(stagebook,in[j]+offset,&vd->opb,
-					      samples_per_partition,-8)==-1)
-		    goto eopbreak;
+		  ret=vorbis_book_decodevs_add(stagebook,in[j]+offset,&vd->opb,
+					       samples_per_partition,-8);
 		}
+		if(ret==OV_EFAULT)goto errout;
+		if(ret==-1)goto eopbreak;
 	      }
 	    }
 	}
       } 
-
-	  	  //rt_free(partword);
-
     }
 
 
@@ -166,8 +168,9 @@ int res_inverse(vorbis_dsp_state *vd,vorbis_info_residue *info,
       (char *)alloca(partwords*partitions_per_word*sizeof(*partword));
     int beginoff=info->begin/ch;
     
+    if(!partword)goto errout;
     for(i=0;i<ch;i++)if(nonzero[i])break;
-    if(i==ch)return(0); /* no nonzero vectors */
+    if(i==ch)goto eopbreak; /* no nonzero vectors */
     
     samples_per_partition/=ch;
     
@@ -198,21 +201,25 @@ int res_inverse(vorbis_dsp_state *vd,vorbis_info_residue *info,
 	  if(info->stagemasks[partword[i]]&(1<<s)){
 	    codebook *stagebook=ci->book_param+
 	      info->stagebooks[(partword[i]<<3)+s];
-	    if(vorbis_book_decodevv_add(stagebook,in,
-					i*samples_per_partition+beginoff,ch,
-					&vd->opb,
-					samples_per_partition,-8)==-1)
-	      goto eopbreak;
+	    ret=vorbis_book_decodevv_add(stagebook,in,
+					 i*samples_per_partition+beginoff,ch,
+					 &vd->opb,
+					 samples_per_partition,-8);
+	    if(ret==OV_EFAULT)goto errout;
+	    if(ret==-1)goto eopbreak;
 	  }
       }
     }
-	  //rt_free(partword);
- 
   }
   
-// errout:
+  /* a short packet leaves the rest of the residue zero */
  eopbreak:
-  
+  _ogg_tmp_release(scratch);
   return 0;
+
+  /* out of scratch memory */
+ errout:
+  _ogg_tmp_release(scratch);
+  return OV_EFAULT;
 }    
 
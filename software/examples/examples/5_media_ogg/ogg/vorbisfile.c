@@ -35,6 +35,11 @@
 #define  LINKSET   4 /* serialno and link set to current link */
 #define  INITSET   5
 
+/* bind the arenas of vf before calling into the decoder */
+static void _select_arenas(OggVorbis_File *vf){
+  ogg_arena_select(&vf->setup_arena,&vf->scratch_arena);
+}
+
 /* A 'chained bitstream' is a Vorbis bitstream that contains more than
    one logical bitstream arranged end to end (the only form of Ogg
    multiplexing allowed in a Vorbis bitstream; grouping [parallel
@@ -237,6 +242,7 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
 }
 
 static int _decode_clear(OggVorbis_File *vf){
+  _select_arenas(vf);
   if(vf->ready_state==INITSET){
     vorbis_dsp_destroy(vf->vd);
     vf->vd=0;
@@ -246,6 +252,7 @@ static int _decode_clear(OggVorbis_File *vf){
   if(vf->ready_state>=STREAMSET){
     vorbis_info_clear(&vf->vi);
     vorbis_comment_clear(&vf->vc);
+    ogg_arena_reset(&vf->setup_arena);
     vf->ready_state=OPENED;
   }
   return 0;
@@ -266,6 +273,7 @@ static int _fetch_headers(OggVorbis_File *vf,
   int i,ret;
   
   if(vf->ready_state>OPENED)_decode_clear(vf);
+  _select_arenas(vf);
 
   if(!og_ptr){
     ogg_int64_t llret=_get_next_page(vf,&og,CHUNKSIZE);
@@ -293,9 +301,14 @@ static int _fetch_headers(OggVorbis_File *vf,
 	ret=OV_EBADHEADER;
 	goto bail_header;
       }
+      /* the codebook tables take a few times the setup packet */
+      if(i==2)ogg_arena_size(&vf->setup_arena,op.bytes*4);
       if((ret=vorbis_dsp_headerin(vi,vc,&op))){
 	goto bail_header;
       }
+      /* per packet scratch scales with the long block */
+      if(i==0)ogg_arena_size(&vf->scratch_arena,
+			     vi->channels*vorbis_info_blocksize(vi,1)/4);
       i++;
     }
     if(i<3)
@@ -307,6 +320,8 @@ static int _fetch_headers(OggVorbis_File *vf,
 
   ogg_packet_release(&op);
   ogg_page_release(&og);
+  /* the codebook construction scratch is not needed any more */
+  ogg_arena_trim(&vf->scratch_arena);
   vf->ready_state=LINKSET;
   return 0; 
 
@@ -315,6 +330,7 @@ static int _fetch_headers(OggVorbis_File *vf,
   ogg_page_release(&og);
   vorbis_info_clear(vi);
   vorbis_comment_clear(vc);
+  ogg_arena_reset(&vf->setup_arena);
   vf->ready_state=OPENED;
 
   return ret;
@@ -441,6 +457,7 @@ static void _prefetch_all_offsets(OggVorbis_File *vf, ogg_int64_t dataoffset){
 	  /* this should not be possible */
 	  vorbis_info_clear(&vf->vi);
 	  vorbis_comment_clear(&vf->vc);
+	  ogg_arena_reset(&vf->setup_arena);
 	  break;
 	}
 	if(ogg_page_granulepos(&og)!=-1){
@@ -535,6 +552,8 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
   ogg_packet op={0,0,0,0,0,0};
   int ret=0;
 
+  _select_arenas(vf);
+
   /* handle one packet.  Try to fetch it from current stream state */
   /* extract packets from page */
   while(1){
@@ -553,7 +572,12 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
 	if(result>0){
 	  /* got a packet.  process it */
 	  granulepos=op.granulepos;
-	  if(!vorbis_dsp_synthesis(vf->vd,&op,1)){ /* lazy check for lazy
+	  result=vorbis_dsp_synthesis(vf->vd,&op,1);
+	  if(result==OV_EFAULT){
+	    ret=OV_EFAULT; /* out of scratch memory */
+	    goto cleanup;
+	  }
+	  if(!result){ /* lazy check for lazy
 						      header handling.  The
 						      header packets aren't
 						      audio, so if/when we
@@ -698,6 +722,9 @@ static int _ov_open1(void *f,OggVorbis_File *vf,char *initial,
 
 
   memset(vf,0,sizeof(*vf));
+  ogg_arena_init(&vf->setup_arena,0);
+  ogg_arena_init(&vf->scratch_arena,0);
+  ogg_arena_use_pool(&vf->scratch_arena);
 
   /* Tremor assumes in multiple places that right shift of a signed
      integer is an arithmetic shift */
@@ -754,6 +781,7 @@ static int _ov_open2(OggVorbis_File *vf){
 /* clear out the OggVorbis_File struct */
 int ov_clear(OggVorbis_File *vf){
   if(vf){
+    _select_arenas(vf);
     vorbis_dsp_destroy(vf->vd);
     vf->vd=0;
     ogg_stream_destroy(vf->os);
@@ -764,6 +792,9 @@ int ov_clear(OggVorbis_File *vf){
     if(vf->serialnos)_ogg_free(vf->serialnos);
     if(vf->offsets)_ogg_free(vf->offsets);
     ogg_sync_destroy(vf->oy);
+    ogg_arena_select(NULL,NULL);
+    ogg_arena_clear(&vf->setup_arena);
+    ogg_arena_clear(&vf->scratch_arena);
 
     if(vf->datasource >= 0)(vf->callbacks.close_func)(vf->datasource);
     memset(vf,0,sizeof(*vf));
@@ -1340,6 +1371,7 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
   int ret=ov_pcm_seek_page(vf,pos);
   if(ret<0)return ret;
   if(_make_decode_ready(vf))return OV_EBADLINK;
+  _select_arenas(vf);
 
   /* discard leading packets we don't need for the lapping of the
      position we want; don't decode them */
@@ -1545,6 +1577,13 @@ vorbis_info *ov_info(OggVorbis_File *vf,int link){
   return &vf->vi;
 }
 
+/* high water marks of the setup and the scratch arena, in bytes; used
+   to size the arenas for a given set of streams */
+void ov_arena_usage(OggVorbis_File *vf,long *setup_peak,long *scratch_peak){
+  if(setup_peak)*setup_peak=vf->setup_arena.peak;
+  if(scratch_peak)*scratch_peak=vf->scratch_arena.peak;
+}
+
 /* grr, strong typing, grr, no templates/inheritence, grr */
 vorbis_comment *ov_comment(OggVorbis_File *vf,int link){
   if(vf->seekable){
@@ -9,6 +9,9 @@
 
 #define PICTURE_DIR "/picture"
 
+/* exported by the firmware: decodes a JPEG to the size of rect */
+extern rt_err_t jpeg_scaled_blit(const char *filename, struct rtgui_dc *dc, struct rtgui_rect *rect);
+
 /* current picture file name */
 rt_bool_t key_pressed = RT_FALSE;
 static char current_fn[32] = {0};
@@ -154,6 +157,7 @@ static rt_bool_t picture_view_event_handler(rtgui_object_t *object, rtgui_event_
         struct rtgui_dc* dc;
         struct rtgui_rect rect;
         struct rtgui_image* image = RT_NULL;
+        struct rtgui_image_engine* engine;
         char fn[32];
 
         dc = rtgui_dc_begin_drawing(RTGUI_WIDGET(object));
@@ -163,7 +167,20 @@ static rt_bool_t picture_view_event_handler(rtgui_object_t *object, rtgui_event_
         /* open image */
         rt_snprintf(fn, sizeof(fn), "%s/%s", PICTURE_DIR, current_fn);
         rt_kprintf("pic fn: %s\n", fn);
-        image = rtgui_image_create(fn, RT_FALSE);
+
+        /* photos are far larger than the screen, scale them while decoding */
+        engine = rtgui_image_get_engine_by_filename(fn);
+        if (engine != RT_NULL && strcmp(engine->name, "jpeg") == 0)
+        {
+            rtgui_dc_fill_rect(dc, &rect);
+            if (jpeg_scaled_blit(fn, dc, &rect) == RT_EOK)
+            {
+                rtgui_dc_end_drawing(dc);
+                return RT_FALSE;
+            }
+        }
+        else
+            image = rtgui_image_create(fn, RT_FALSE);
 
         if (image != RT_NULL)
         {
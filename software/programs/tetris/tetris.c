@@ -5,6 +5,7 @@
 #include <rtgui/widgets/window.h>
 #include <rtgui/dc.h>
 #include <rtgui/font.h>
+#include "tetris_ui.h"
 
 
 
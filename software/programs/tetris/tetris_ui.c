@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include "tetris_ui.h"
 
 /*ʱ*/
@@ -581,6 +581,13 @@ uint32_t USB_OTG_USBH_handle_hc_n_Out_ISR (USB_OTG_CORE_HANDLE *pdev , uint32_t
         pdev->host.ErrCnt[num] = 0;
       }
     }
+    
+    if(pdev->host.HC_Status[num] != HC_XFRC)
+    {
+      /* a NAK or an error halts an OUT channel, the class driver decides 
+         whether to send the rest again */
+      USBH_HCD_INT_fops->UrbDone(pdev, num);
+    }
     CLEAR_HC_INT(hcreg , chhltd);    
   }
   
@@ -696,6 +703,7 @@ uint32_t USB_OTG_USBH_handle_hc_n_In_ISR (USB_OTG_CORE_HANDLE *pdev , uint32_t n
     else if (pdev->host.HC_Status[num] == HC_STALL) 
     {
       pdev->host.URB_State[num] = URB_STALL;
+      USBH_HCD_INT_fops->UrbDone(pdev, num);
     }   
     
     else if((pdev->host.HC_Status[num] == HC_XACTERR) ||
@@ -703,7 +711,7 @@ uint32_t USB_OTG_USBH_handle_hc_n_In_ISR (USB_OTG_CORE_HANDLE *pdev , uint32_t n
     {
       pdev->host.ErrCnt[num] = 0;
       pdev->host.URB_State[num] = URB_ERROR;  
-      
+      USBH_HCD_INT_fops->UrbDone(pdev, num);
     }
     else if(hcchar.b.eptype == EP_TYPE_INTR)
     {
@@ -48,6 +48,7 @@ extern realtouch_ui_init(void);
 
 extern rt_platform_init(void);
 extern rt_err_t codec_hw_init(const char *bus_name);
+extern rt_err_t audio_mixer_init(void);
 
 void rt_init_thread_entry(void *parameter)
 {
@@ -135,7 +136,8 @@ void rt_init_thread_entry(void *parameter)
     net_buf_init(320 * 1024);
 #endif
 
-    codec_hw_init("i2c1");
+    if (codec_hw_init("i2c1") == RT_EOK)
+        audio_mixer_init();
 
 #ifdef RT_USING_RTGUI
     realtouch_ui_init();
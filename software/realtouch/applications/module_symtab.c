@@ -0,0 +1,190 @@
+/*
+ * File      : module_symtab.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <rtm.h>
+
+#include "mem_region.h"
+#include "module_symtab.h"
+
+#ifdef RT_USING_MODULE
+
+#if defined(__CC_ARM)
+extern int RTMSymTab$$Base;
+extern int RTMSymTab$$Limit;
+#define SYMTAB_BEGIN    ((struct rt_module_symtab *)&RTMSymTab$$Base)
+#define SYMTAB_END      ((struct rt_module_symtab *)&RTMSymTab$$Limit)
+#elif defined(__ICCARM__)
+#pragma section="RTMSymTab"
+#define SYMTAB_BEGIN    ((struct rt_module_symtab *)__section_begin("RTMSymTab"))
+#define SYMTAB_END      ((struct rt_module_symtab *)__section_end("RTMSymTab"))
+#elif defined(__GNUC__)
+extern int __rtmsymtab_start;
+extern int __rtmsymtab_end;
+#define SYMTAB_BEGIN    ((struct rt_module_symtab *)&__rtmsymtab_start)
+#define SYMTAB_END      ((struct rt_module_symtab *)&__rtmsymtab_end)
+#endif
+
+/* slot: symbol number + 1 in the low half, 0 is empty; hash bits in the high half */
+#define SLOT_INDEX(s)   ((s) & 0xFFFF)
+#define SLOT_TAG(s)     ((s) >> 16)
+#define SLOT(i, tag)    (((rt_uint32_t)(tag) << 16) | ((i) + 1))
+
+static struct module_symtab
+{
+    struct rt_module_symtab *symbols;
+    rt_uint32_t count;
+
+    rt_uint32_t *slots;
+    rt_uint32_t mask;
+    rt_bool_t built;            /* module_symtab_init() has run */
+
+    struct module_symtab_stat stat;
+} _symtab;
+
+static rt_uint32_t _hash(const char *name)
+{
+    rt_uint32_t hash = 2166136261u;
+
+    while (*name)
+    {
+        hash ^= (rt_uint8_t)*name++;
+        hash *= 16777619u;
+    }
+
+    /* fold the better mixed high bits into the slot number */
+    return hash ^ (hash >> 15);
+}
+
+rt_err_t module_symtab_init(void)
+{
+    struct rt_module_symtab *symbol;
+    rt_uint32_t size, hash, slot, probe, i;
+
+    _symtab.built = RT_TRUE;
+    _symtab.symbols = SYMTAB_BEGIN;
+    _symtab.count = SYMTAB_END - SYMTAB_BEGIN;
+    if (_symtab.count == 0 || _symtab.count >= 0xFFFF)
+        return -RT_ERROR;
+
+    for (size = 16; size < _symtab.count * 2; size <<= 1);
+
+    /* looked at on every module load, keep it in CCM */
+    _symtab.slots = (rt_uint32_t *)mem_region_calloc(MEM_REGION_FAST, size, sizeof(rt_uint32_t));
+    if (_symtab.slots == RT_NULL)
+        return -RT_ENOMEM;
+    _symtab.mask = size - 1;
+
+    _symtab.stat.symbols = _symtab.count;
+    _symtab.stat.slots = size;
+
+    for (i = 0; i < _symtab.count; i ++)
+    {
+        symbol = &_symtab.symbols[i];
+        hash = _hash(symbol->name);
+
+        /* linear probing, a name already in the table keeps its first symbol */
+        for (probe = 0; ; probe ++)
+        {
+            slot = _symtab.slots[(hash + probe) & _symtab.mask];
+            if (slot == 0)
+                break;
+            if (SLOT_TAG(slot) == (hash >> 16) &&
+                    rt_strcmp(_symtab.symbols[SLOT_INDEX(slot) - 1].name, symbol->name) == 0)
+                break;
+        }
+
+        if (slot == 0)
+        {
+            _symtab.slots[(hash + probe) & _symtab.mask] = SLOT(i, hash >> 16);
+            if (probe + 1 > _symtab.stat.max_probe)
+                _symtab.stat.max_probe = probe + 1;
+        }
+    }
+
+    return RT_EOK;
+}
+
+void *module_symtab_find(const char *name)
+{
+    struct rt_module_symtab *symbol;
+    rt_uint32_t hash, slot, probe;
+
+    /* built on the first lookup, there is no lookup on most boots */
+    if (_symtab.built == RT_FALSE)
+        module_symtab_init();
+
+    _symtab.stat.lookups ++;
+
+    /* no index: scan the section */
+    if (_symtab.slots == RT_NULL)
+    {
+        for (symbol = SYMTAB_BEGIN; symbol < SYMTAB_END; symbol ++)
+        {
+            _symtab.stat.probes ++;
+            if (rt_strcmp(symbol->name, name) == 0)
+                return symbol->addr;
+        }
+
+        return RT_NULL;
+    }
+
+    hash = _hash(name);
+    for (probe = 0; probe <= _symtab.mask; probe ++)
+    {
+        slot = _symtab.slots[(hash + probe) & _symtab.mask];
+        _symtab.stat.probes ++;
+        if (slot == 0)
+            break;
+
+        if (SLOT_TAG(slot) != (hash >> 16))
+            continue;
+
+        symbol = &_symtab.symbols[SLOT_INDEX(slot) - 1];
+        if (rt_strcmp(symbol->name, name) == 0)
+            return symbol->addr;
+    }
+
+    return RT_NULL;
+}
+
+void module_symtab_get_stat(struct module_symtab_stat *stat)
+{
+    *stat = _symtab.stat;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void msym(const char *name)
+{
+    struct module_symtab_stat *stat = &_symtab.stat;
+    void *addr;
+
+    if (name != RT_NULL)
+    {
+        addr = module_symtab_find(name);
+        if (addr == RT_NULL)
+            rt_kprintf("%s: not exported\n", name);
+        else
+            rt_kprintf("%s: 0x%08x\n", name, addr);
+    }
+
+    rt_kprintf("%d symbols in %d slots, longest probe %d, %d lookups with %d probes\n",
+               stat->symbols, stat->slots, stat->max_probe,
+               stat->lookups, stat->probes);
+}
+FINSH_FUNCTION_EXPORT(msym, find a symbol exported to modules);
+#endif
+
+#endif
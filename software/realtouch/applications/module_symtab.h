@@ -0,0 +1,52 @@
+/*
+ * File      : module_symtab.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#ifndef __MODULE_SYMTAB_H__
+#define __MODULE_SYMTAB_H__
+
+#include <rtthread.h>
+
+/*
+ * Hash index over the RTMSymTab section, the symbols RTM_EXPORT makes
+ * available to application modules.
+ *
+ * The index is built on the first lookup: an open addressing table of at
+ * least twice the number of symbols, each slot holding the symbol number
+ * and 16 more bits of the FNV-1a hash of its name, so a lookup compares
+ * strings only for the symbol it returns. Like the linear scan of the
+ * section the first of several symbols with the same name wins.
+ *
+ * The module loader is rt_module_symbol_find() of the kernel in RTT_ROOT,
+ * which is not in this tree and still scans the section; only msym looks
+ * symbols up here until the kernel calls module_symtab_find().
+ */
+struct module_symtab_stat
+{
+    rt_uint32_t symbols;
+    rt_uint32_t slots;
+    rt_uint32_t max_probe;      /* longest probe sequence of a symbol */
+
+    rt_uint32_t lookups;
+    rt_uint32_t probes;         /* slots looked at by all lookups */
+};
+
+/* build the index, module_symtab_find() does it when it has not run */
+rt_err_t module_symtab_init(void);
+
+/* address of the exported symbol, RT_NULL if the kernel does not export it */
+void *module_symtab_find(const char *name);
+
+void module_symtab_get_stat(struct module_symtab_stat *stat);
+
+#endif
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "board.h"
+#include "mem_region.h"
 #include "netbuffer.h"
 #include "codec_wm8978_i2c.h"
 
@@ -14,6 +15,8 @@
 
 rt_uint8_t mp3_fd_buffer[MP3_AUDIO_BUF_SZ];
 int current_sample_rate = 0;
+/* audio device of the track being played */
+static rt_device_t mp3_device = RT_NULL;
 
 struct mp3_decoder
 {
@@ -59,12 +62,13 @@ void mp3_decoder_init(struct mp3_decoder* decoder)
     decoder->decoder = MP3InitDecoder();
 
 	/* open audio device */
-	decoder->snd_device = rt_device_find("snd");
+	decoder->snd_device = rt_device_find("mix0");
 	if (decoder->snd_device != RT_NULL)
 	{
 		/* set tx complete call back function */
 		rt_device_set_tx_complete(decoder->snd_device, mp3_decoder_tx_done);
 		rt_device_open(decoder->snd_device, RT_DEVICE_OFLAG_WRONLY);
+		mp3_device = decoder->snd_device;
 	}
 }
 
@@ -74,7 +78,10 @@ void mp3_decoder_detach(struct mp3_decoder* decoder)
 
 	/* close audio device */
 	if (decoder->snd_device != RT_NULL)
+	{
+		mp3_device = RT_NULL;
 		rt_device_close(decoder->snd_device);
+	}
 
 	/* release mp3 decoder */
     MP3FreeDecoder(decoder->decoder);
@@ -85,7 +92,8 @@ struct mp3_decoder* mp3_decoder_create()
     struct mp3_decoder* decoder;
 
 	/* allocate object */
-    decoder = (struct mp3_decoder*) rt_malloc (sizeof(struct mp3_decoder));
+    decoder = (struct mp3_decoder*) mem_region_malloc(MEM_REGION_FAST,
+        sizeof(struct mp3_decoder));
     if (decoder != RT_NULL)
     {
         mp3_decoder_init(decoder);
@@ -101,7 +109,7 @@ void mp3_decoder_delete(struct mp3_decoder* decoder)
 	/* de-init mp3 decoder object */
 	mp3_decoder_detach(decoder);
 	/* release this object */
-    rt_free(decoder);
+    mem_region_free(decoder);
 }
 
 rt_uint32_t current_offset = 0;
@@ -264,7 +272,22 @@ int mp3_decoder_run(struct mp3_decoder* decoder)
 	return 0;
 }
 
+/* ms of the current track that went out of the codec, 0 if none plays */
+rt_uint32_t mp3_elapsed(void)
+{
+	struct codec_position pos;
+	rt_device_t device = mp3_device;
+
+	if (device == RT_NULL ||
+		rt_device_control(device, CODEC_CMD_GET_POSITION, &pos) != RT_EOK)
+		return 0;
+
+	return pos.time;
+}
+
 #include <finsh.h>
+FINSH_FUNCTION_EXPORT(mp3_elapsed, ms played of the current mp3 track);
+
 rt_size_t fd_fetch(void* parameter, rt_uint8_t *buffer, rt_size_t length)
 {
 	int fd = (int)parameter;
@@ -1,6 +1,9 @@
 #ifndef __MP3_H__
 #define __MP3_H__
 
+#include <rtthread.h>
+
 void mp3(char* filename);
+rt_uint32_t mp3_elapsed(void);
 
 #endif
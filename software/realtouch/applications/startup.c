@@ -11,6 +11,7 @@
  * Date           Author       Notes
  * 2006-08-31     Bernard      first implementation
  * 2011-06-05     Bernard      modify for STM32F107 version
+ * 2013-03-12     realtouch    manage CCM and internal SRAM as memory regions
  */
 
 #include <rthw.h>
@@ -18,6 +19,7 @@
 
 #include "stm32f4xx.h"
 #include "board.h"
+#include "mem_region.h"
 
 /**
  * @addtogroup STM32
@@ -88,6 +90,9 @@ void rtthread_startup(void)
     rt_system_heap_init((void*)STM32_SRAM_BEGIN, (void*)STM32_SRAM_END);
 #endif /* STM32_EXT_SRAM */
 
+    /* internal SRAM and CCM are handed out by placement hint */
+    rt_hw_mem_region_init((void*)STM32_SRAM_BEGIN, (void*)STM32_SRAM_END);
+
     /* init scheduler system */
     rt_system_scheduler_init();
 
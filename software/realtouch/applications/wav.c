@@ -1,17 +1,63 @@
 #include <rtthread.h>
 #include <finsh.h>
 #include <dfs_posix.h>
+#include <string.h>
+
 #include "board.h"
+#include "mem_region.h"
+#include "codec_wm8978_i2c.h"
+#include "wav_pcm.h"
 
-#define CODEC_CMD_SAMPLERATE	2
+/*
+ * Streaming WAV player.
+ *
+ * A reader thread reads whole frames from the file into the read pool and
+ * queues them in file order, the player converts them to 16-bit stereo and
+ * writes them to the codec. 16-bit stereo data is read straight into the
+ * codec blocks. The reader runs WAV_READ_AHEAD blocks ahead of the player,
+ * so a slow SD card read is covered by the blocks already queued on the
+ * codec.
+ */
 
 //mempoolС.
-#define  mempll_block_size      16384
-//ǹmempool,4ֽΪƿ.
-static rt_uint8_t mempool[ (mempll_block_size+4) *2];
-static struct rt_mempool _mp;
-//ڴسʼʶ
-static rt_bool_t is_inited = RT_FALSE;
+#define WAV_PCM_BLOCK_SIZE      8192
+#define WAV_PCM_BLOCKS          4       /* the codec queues at most 4 blocks */
+#define WAV_READ_AHEAD          2
+#define WAV_READ_MAX            16384   /* largest disk read */
+#define WAV_HEADER_SIZE         512
+
+#define WAV_READER_STACK        2048
+
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+struct wav_block
+{
+    rt_uint8_t *data;           /* RT_NULL: end of the stream */
+    rt_size_t size;
+};
+
+struct wav_player
+{
+    int fd;
+    struct wav_pcm_format format;
+    wav_pcm_convert_t convert;  /* RT_NULL for 16-bit stereo */
+
+    rt_uint32_t data_offset;
+    rt_uint32_t data_size;      /* bytes of sample data not read yet */
+    rt_size_t read_size;        /* bytes per disk read, whole frames */
+
+    /* codec blocks, and the read pool when the data has to be converted */
+    struct rt_mempool pcm_mp, raw_mp;
+    void *pcm_pool, *raw_pool;
+    struct rt_mempool *read_mp;
+
+    rt_mq_t mq;                 /* blocks read, in file order */
+    rt_device_t device;
+
+    volatile rt_bool_t stop;
+};
+
+static struct wav_player *_player = RT_NULL;
 
 static rt_err_t wav_tx_done(rt_device_t dev, void *buffer)
 {
@@ -21,189 +67,454 @@ static rt_err_t wav_tx_done(rt_device_t dev, void *buffer)
     return RT_EOK;
 }
 
-struct RIFF_HEADER_DEF
+static rt_uint16_t _le16(const rt_uint8_t *p)
 {
-    char riff_id[4];     // 'R','I','F','F'
-    uint32_t riff_size;
-    char riff_format[4]; // 'W','A','V','E'
-};
+    return p[0] | (p[1] << 8);
+}
 
-struct WAVE_FORMAT_DEF
+static rt_uint32_t _le32(const rt_uint8_t *p)
 {
-    uint16_t FormatTag;
-    uint16_t Channels;
-    uint32_t SamplesPerSec;
-    uint32_t AvgBytesPerSec;
-    uint16_t BlockAlign;
-    uint16_t BitsPerSample;
-};
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((rt_uint32_t)p[3] << 24);
+}
 
-struct FMT_BLOCK_DEF
+/* make [pos, pos + size) of the file available in the header buffer */
+static rt_uint8_t *wav_header_window(int fd, rt_uint8_t *header,
+                                     rt_uint32_t *base, rt_uint32_t *length,
+                                     rt_uint32_t pos, rt_uint32_t size)
 {
-    char fmt_id[4];    // 'f','m','t',' '
-    uint32_t fmt_size;
-    struct WAVE_FORMAT_DEF wav_format;
-};
+    int result;
 
-void wav(char* filename)
+    if (pos < *base || pos + size > *base + *length)
+    {
+        if ((rt_uint32_t)lseek(fd, pos, SEEK_SET) != pos)
+            return RT_NULL;
+
+        result = read(fd, header, WAV_HEADER_SIZE);
+        if (result < 0)
+            result = 0;
+
+        *base = pos;
+        *length = result;
+        if (size > *length)
+            return RT_NULL;
+    }
+
+    return header + (pos - *base);
+}
+
+/* walk the RIFF/RF64 chunks up to the data chunk */
+static rt_err_t wav_parse_header(struct wav_player *player, rt_uint8_t *header)
 {
-    int fd;
-    struct FMT_BLOCK_DEF   fmt_block;
+    struct wav_pcm_format *format = &player->format;
+    rt_uint32_t base, length, pos, chunk_size;
+    rt_uint32_t ds64_data_size = 0;
+    rt_bool_t rf64, fmt_found = RT_FALSE;
+    rt_uint16_t tag = 0;
+    rt_uint8_t *p;
+    int result;
 
-    //mempoolǷ񱻳ʼ,гʼ.
-    if (is_inited == RT_FALSE)
+    result = read(player->fd, header, WAV_HEADER_SIZE);
+    if (result < 12)
     {
-        rt_mp_init(&_mp, "wav_buf", &mempool[0], sizeof(mempool), mempll_block_size);
-        is_inited = RT_TRUE;
+        rt_kprintf("read riff chunk fail!\r\n");
+        return -RT_EIO;
     }
+    base = 0;
+    length = result;
 
+    if (memcmp(header, "RIFF", 4) == 0)
+        rf64 = RT_FALSE;
+    else if (memcmp(header, "RF64", 4) == 0)
+        rf64 = RT_TRUE;
+    else
+    {
+        rt_kprintf("not a RIFF file!\r\n");
+        return -RT_ERROR;
+    }
 
-    //ļ
-    fd = open(filename, O_RDONLY, 0);
-    if (fd >= 0)
+    if (memcmp(header + 8, "WAVE", 4) != 0)
     {
-        rt_uint8_t* buf;
-        rt_size_t 	len;
-        rt_device_t device;
-        char riff_chunk[4];
+        rt_kprintf("RIFF format error:%.4s\r\n", header + 8);
+        return -RT_ERROR;
+    }
 
-        /* wav format check */
-        do
+    for (pos = 12; ; pos += 8 + chunk_size + (chunk_size & 1))
+    {
+        p = wav_header_window(player->fd, header, &base, &length, pos, 8);
+        if (p == RT_NULL)
         {
-            len = read(fd, riff_chunk, sizeof(riff_chunk));
-            if(len != sizeof(riff_chunk))
-            {
-                rt_kprintf("read riff chunk fail!\r\n");
-                return;
-            }
-
-            if(strncmp(riff_chunk, "RIFF", sizeof(riff_chunk)) == 0)
-            {
-                struct RIFF_HEADER_DEF riff_header;
-
-                /* read riff header */
-                len = read(fd, (void*)((uint32_t)&riff_header + sizeof(riff_chunk)),
-                           sizeof(struct RIFF_HEADER_DEF) - sizeof(riff_chunk));
-                if(strncmp(riff_header.riff_format, "WAVE", 4) != 0)
-                {
-                    rt_kprintf("RIFF format error:%-4s\r\n", riff_header.riff_format);
-                    return;
-                }
-            }
-            else if(strncmp(riff_chunk, "fmt ", sizeof(riff_chunk)) == 0)
-            {
-                /* read riff format block */
-                len = read(fd, (void*)((uint32_t)&fmt_block + sizeof(riff_chunk)),
-                           sizeof(struct FMT_BLOCK_DEF) - sizeof(riff_chunk));
-                if(len != sizeof(struct FMT_BLOCK_DEF) - sizeof(riff_chunk))
-                {
-                    rt_kprintf("read riff format block fail!\r\n");
-                    return;
-                }
-
-                if(fmt_block.fmt_size != 16)
-                {
-                    char tmp[2];
-                    read(fd, tmp, fmt_block.fmt_size - 16);
-                }
-
-                if(fmt_block.wav_format.Channels != 2)
-                {
-                    rt_kprintf("[err] only support stereo!\r\n");
-                    return;
-                }
-            }
+            rt_kprintf("no data chunk!\r\n");
+            return -RT_ERROR;
         }
-        while(strncmp(riff_chunk, "data", 4) != 0);
+        chunk_size = _le32(p + 4);
 
-        /* get data size */
+        if (memcmp(p, "data", 4) == 0)
+            break;
+
+        if (memcmp(p, "fmt ", 4) == 0)
         {
-            rt_size_t size;
-            len = read(fd, &size, 4);
-            if(len != 4)
+            if (chunk_size < 16 || chunk_size > WAV_HEADER_SIZE - 8 ||
+                (p = wav_header_window(player->fd, header, &base, &length,
+                                       pos, 8 + chunk_size)) == RT_NULL)
             {
-                rt_kprintf("read data size fail!\r\n");
-                return;
+                rt_kprintf("read riff format block fail!\r\n");
+                return -RT_ERROR;
             }
 
-            /* print paly time */
+            tag = _le16(p + 8);
+            format->channels    = _le16(p + 10);
+            format->sample_rate = _le32(p + 12);
+            format->block_align = _le16(p + 20);
+            format->bits        = _le16(p + 22);
+
+            /* the real format is in the first word of the SubFormat GUID */
+            if (tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40)
+                tag = _le16(p + 32);
+
+            format->format = tag;
+            fmt_found = RT_TRUE;
+        }
+        else if (rf64 && memcmp(p, "ds64", 4) == 0)
+        {
+            if (chunk_size < 24 ||
+                (p = wav_header_window(player->fd, header, &base, &length,
+                                       pos, 8 + 24)) == RT_NULL)
             {
-                uint32_t hour, min, sec;
-
-                hour = min = 0;
-                sec = size / fmt_block.wav_format.AvgBytesPerSec;
-
-                if(sec / (60*60))
-                {
-                    hour = sec / (60*60);
-                    sec -= hour * (60*60);
-                }
-
-                if(sec / 60)
-                {
-                    min = sec / 60;
-                    sec -= min * 60;
-                }
-
-                /* dump wav info, (only in finsh) */
-                if(strncmp(rt_thread_self()->name, "tshell", sizeof("tshell") -1) == 0)
-                {
-                    rt_kprintf("wav info:\r\n");
-                    rt_kprintf("Channels:%d ", fmt_block.wav_format.Channels);
-                    rt_kprintf("SamplesPerSec:%d ", fmt_block.wav_format.SamplesPerSec);
-                    rt_kprintf("BitsPerSample:%d\r\n", fmt_block.wav_format.BitsPerSample);
-                    rt_kprintf("paly time: %02d:%02d:%02d\r\n", hour, min, sec);
-                }
+                rt_kprintf("read ds64 chunk fail!\r\n");
+                return -RT_ERROR;
             }
-        } /* get data size */
 
-        /* open audio device and set tx done call back */
-        device = rt_device_find("snd");
-        if(device == RT_NULL)
+            /* 64-bit data size; files on FAT stay below 4G */
+            ds64_data_size = _le32(p + 16);
+            if (_le32(p + 20) != 0)
+                ds64_data_size = 0xFFFFFFFF;
+        }
+    }
+
+    if (fmt_found == RT_FALSE)
+    {
+        rt_kprintf("no format chunk!\r\n");
+        return -RT_ERROR;
+    }
+
+    /* the play time and the codec setup divide by it */
+    if (format->sample_rate == 0)
+    {
+        rt_kprintf("[err] sample rate of 0\r\n");
+        return -RT_ERROR;
+    }
+
+    player->data_offset = pos + 8;
+    player->data_size = chunk_size;
+    if (rf64 && chunk_size == 0xFFFFFFFF)
+        player->data_size = ds64_data_size;
+    /* size not filled in by a streaming writer: play up to the end */
+    if (player->data_size == 0)
+        player->data_size = 0xFFFFFFFF;
+
+    player->convert = wav_pcm_converter(format);
+    if (player->convert == RT_NULL)
+    {
+        rt_kprintf("[err] unsupported format: tag 0x%04x, %d channels, %d bits\r\n",
+                   tag, format->channels, format->bits);
+        return -RT_ERROR;
+    }
+
+    return RT_EOK;
+}
+
+static void wav_reader_entry(void *parameter)
+{
+    struct wav_player *player = (struct wav_player *)parameter;
+    struct wav_block block;
+    rt_size_t length;
+    int result;
+
+    while (player->stop == RT_FALSE && player->data_size > 0)
+    {
+        block.data = (rt_uint8_t *)rt_mp_alloc(player->read_mp, RT_WAITING_FOREVER);
+
+        length = player->read_size;
+        if (length > player->data_size)
+            length = player->data_size;
+
+        result = read(player->fd, (char *)block.data, length);
+        if (result <= 0)
         {
-            rt_kprintf("audio device not found!\r\n");
-            return;
+            rt_mp_free(block.data);
+            break;
         }
+        player->data_size -= result;
 
-        /* set samplerate */
+        /* drop a partial frame at the end of the file */
+        block.size = result - result % player->format.block_align;
+        if (block.size == 0)
         {
-            int SamplesPerSec = fmt_block.wav_format.SamplesPerSec;
-            if(rt_device_control(device, CODEC_CMD_SAMPLERATE, &SamplesPerSec)
-                    != RT_EOK)
-            {
-                rt_kprintf("audio device doesn't support this sample rate: %d\r\n",
-                           SamplesPerSec);
-                return;
-            }
+            rt_mp_free(block.data);
+            break;
         }
 
-        //÷ɻص,DACݷʱִwav_tx_doneͷſռ.
-        rt_device_set_tx_complete(device, wav_tx_done);
-        rt_device_open(device, RT_DEVICE_OFLAG_WRONLY);
+        rt_mq_send(player->mq, &block, sizeof(block));
+    }
+
+    block.data = RT_NULL;
+    block.size = 0;
+    rt_mq_send(player->mq, &block, sizeof(block));
+}
+
+static void wav_player_free(struct wav_player *player)
+{
+    if (player->mq != RT_NULL)
+        rt_mq_delete(player->mq);
+    if (player->pcm_pool != RT_NULL)
+    {
+        rt_mp_detach(&player->pcm_mp);
+        mem_region_free(player->pcm_pool);
+    }
+    if (player->raw_pool != RT_NULL)
+    {
+        rt_mp_detach(&player->raw_mp);
+        mem_region_free(player->raw_pool);
+    }
+
+    mem_region_free(player);
+}
+
+static struct wav_player *wav_player_create(int fd)
+{
+    struct wav_player *player;
+    rt_uint8_t *header;
+    rt_size_t frames, pcm_count, size;
+    rt_err_t result;
+
+    player = (struct wav_player *)mem_region_calloc(MEM_REGION_FAST, 1, sizeof(struct wav_player));
+    if (player == RT_NULL)
+        return RT_NULL;
+    player->fd = fd;
+
+    /* wav format check */
+    header = (rt_uint8_t *)rt_malloc(WAV_HEADER_SIZE);
+    if (header == RT_NULL)
+    {
+        mem_region_free(player);
+        return RT_NULL;
+    }
+    result = wav_parse_header(player, header);
+    rt_free(header);
+
+    if (result != RT_EOK || (rt_uint32_t)lseek(fd, player->data_offset, SEEK_SET) != player->data_offset)
+    {
+        mem_region_free(player);
+        return RT_NULL;
+    }
+
+    //ǹmempool,4ֽΪƿ.
+    if (wav_pcm_is_native(&player->format))
+    {
+        /* read straight into the codec blocks */
+        player->convert = RT_NULL;
+        player->read_size = WAV_PCM_BLOCK_SIZE;
+        pcm_count = WAV_PCM_BLOCKS + WAV_READ_AHEAD;
+    }
+    else
+    {
+        frames = WAV_PCM_BLOCK_SIZE / 4;
+        if (frames * player->format.block_align > WAV_READ_MAX)
+            frames = WAV_READ_MAX / player->format.block_align;
+        player->read_size = frames * player->format.block_align;
+        pcm_count = WAV_PCM_BLOCKS;
+
+        /* one more block than read ahead: the one being converted */
+        size = RT_ALIGN(player->read_size, RT_ALIGN_SIZE);
+        player->raw_pool = mem_region_malloc(MEM_REGION_BULK,
+            (WAV_READ_AHEAD + 1) * (size + sizeof(rt_uint8_t *)));
+        if (player->raw_pool == RT_NULL)
+            goto __nomem;
+        rt_mp_init(&player->raw_mp, "wav_raw", player->raw_pool,
+                   (WAV_READ_AHEAD + 1) * (size + sizeof(rt_uint8_t *)), size);
+    }
+
+    /* the codec blocks are read by DMA */
+    player->pcm_pool = mem_region_malloc(MEM_REGION_DMA,
+        pcm_count * (WAV_PCM_BLOCK_SIZE + sizeof(rt_uint8_t *)));
+    if (player->pcm_pool == RT_NULL)
+        goto __nomem;
+    rt_mp_init(&player->pcm_mp, "wav_buf", player->pcm_pool,
+               pcm_count * (WAV_PCM_BLOCK_SIZE + sizeof(rt_uint8_t *)),
+               WAV_PCM_BLOCK_SIZE);
+
+    player->read_mp = (player->raw_pool != RT_NULL) ? &player->raw_mp : &player->pcm_mp;
 
-        do
+    /* every block of the read pool and the end marker */
+    player->mq = rt_mq_create("wav", sizeof(struct wav_block),
+                              WAV_PCM_BLOCKS + WAV_READ_AHEAD + 1, RT_IPC_FLAG_FIFO);
+    if (player->mq == RT_NULL)
+        goto __nomem;
+
+    return player;
+
+__nomem:
+    rt_kprintf("wav: no memory for the buffers\r\n");
+    wav_player_free(player);
+    return RT_NULL;
+}
+
+static void wav_print_info(struct wav_player *player)
+{
+    uint32_t hour, min, sec;
+
+    /* dump wav info, (only in finsh) */
+    if (strncmp(rt_thread_self()->name, "tshell", sizeof("tshell") -1) != 0)
+        return;
+
+    sec = 0;
+    if (player->data_size != 0xFFFFFFFF)
+        sec = player->data_size / player->format.block_align / player->format.sample_rate;
+
+    hour = sec / (60*60);
+    sec -= hour * (60*60);
+    min = sec / 60;
+    sec -= min * 60;
+
+    rt_kprintf("wav info:\r\n");
+    rt_kprintf("Channels:%d ", player->format.channels);
+    rt_kprintf("SamplesPerSec:%d ", player->format.sample_rate);
+    rt_kprintf("BitsPerSample:%d%s\r\n", player->format.bits,
+               player->format.format == WAV_PCM_FLOAT ? " float" : "");
+    rt_kprintf("play time: %02d:%02d:%02d\r\n", hour, min, sec);
+}
+
+static void wav_play(struct wav_player *player)
+{
+    struct wav_block block;
+    rt_uint8_t *buf;
+    rt_size_t len, frames;
+    rt_uint8_t priority;
+    rt_thread_t reader;
+    int i;
+
+    /* the reader has to get the disk before the player */
+    priority = rt_thread_self()->current_priority;
+    if (priority > 1)
+        priority --;
+
+    reader = rt_thread_create("wav_rd", wav_reader_entry, player,
+                              WAV_READER_STACK, priority, 10);
+    if (reader == RT_NULL)
+        return;
+    rt_thread_startup(reader);
+
+    while (1)
+    {
+        rt_mq_recv(player->mq, &block, sizeof(block), RT_WAITING_FOREVER);
+        if (block.data == RT_NULL)
+            break;
+
+        if (player->convert == RT_NULL)
+        {
+            buf = block.data;
+            len = block.size;
+        }
+        else
         {
             //mempollռ,벻ɹһֱڴ˵ȴ.
-            buf = rt_mp_alloc(&_mp, RT_WAITING_FOREVER);
-            //ļȡ
-            len = read(fd, (char*)buf, mempll_block_size);
-            //ȡɹͰд豸
-            if (len > 0)
-            {
-                rt_device_write(device, 0, buf, len);
-            }
-            //ͷŸղĿռ,Ƕļβʱ.
-            else
-            {
-                rt_mp_free(buf);
-            }
+            buf = (rt_uint8_t *)rt_mp_alloc(&player->pcm_mp, RT_WAITING_FOREVER);
+
+            frames = block.size / player->format.block_align;
+            player->convert((rt_uint32_t *)buf, block.data, frames,
+                            player->format.block_align);
+            rt_mp_free(block.data);
+            len = frames * 4;
         }
-        while (len != 0);
 
-        /* close device and file */
-        rt_device_close(device);
+        if (rt_device_write(player->device, 0, buf, len) != len)
+            rt_mp_free(buf);
+    }
+
+    /* wait until the codec has played and released all blocks */
+    for (i = 0; i < player->pcm_mp.block_total_count; i ++)
+        rt_mp_alloc(&player->pcm_mp, RT_WAITING_FOREVER);
+}
+
+void wav(char* filename)
+{
+    int fd;
+    struct wav_player *player;
+
+    if (_player != RT_NULL)
+    {
+        rt_kprintf("wav: already playing\r\n");
+        return;
+    }
+
+    //ļ
+    fd = open(filename, O_RDONLY, 0);
+    if (fd < 0)
+        return;
+
+    player = wav_player_create(fd);
+    if (player == RT_NULL)
+    {
         close(fd);
+        return;
     }
+    wav_print_info(player);
+
+    /* open audio device and set tx done call back */
+    player->device = rt_device_find("mix0");
+    if (player->device == RT_NULL)
+    {
+        rt_kprintf("audio device not found!\r\n");
+        goto __exit;
+    }
+
+    /* set samplerate */
+    {
+        int SamplesPerSec = player->format.sample_rate;
+        if (rt_device_control(player->device, CODEC_CMD_SAMPLERATE, &SamplesPerSec)
+                != RT_EOK)
+        {
+            rt_kprintf("audio device doesn't support this sample rate: %d\r\n",
+                       SamplesPerSec);
+            goto __exit;
+        }
+    }
+
+    //÷ɻص,DACݷʱִwav_tx_doneͷſռ.
+    rt_device_set_tx_complete(player->device, wav_tx_done);
+    rt_device_open(player->device, RT_DEVICE_OFLAG_WRONLY);
+
+    _player = player;
+    wav_play(player);
+    _player = RT_NULL;
+
+    /* close device and file */
+    rt_device_close(player->device);
+
+__exit:
+    wav_player_free(player);
+    close(fd);
 }
 FINSH_FUNCTION_EXPORT(wav, wav test. e.g: wav("/test.wav"))
 
+/* ms of the current file that went out of the codec, 0 if none plays */
+rt_uint32_t wav_elapsed(void)
+{
+    struct codec_position pos;
+    struct wav_player *player = _player;
+
+    if (player == RT_NULL ||
+            rt_device_control(player->device, CODEC_CMD_GET_POSITION, &pos) != RT_EOK)
+        return 0;
+
+    return pos.time;
+}
+FINSH_FUNCTION_EXPORT(wav_elapsed, ms played of the current wav file)
+
+/* stop the running player after the blocks already read */
+void wav_stop(void)
+{
+    if (_player != RT_NULL)
+        _player->stop = RT_TRUE;
+}
+FINSH_FUNCTION_EXPORT(wav_stop, stop wav playback)
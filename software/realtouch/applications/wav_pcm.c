@@ -0,0 +1,260 @@
+/*
+ * File      : wav_pcm.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-18     realtouch    first version
+ */
+
+#include "wav_pcm.h"
+
+/*
+ * The common layouts are converted a word at a time: the 16-bit halves of
+ * the output frames are cut out of the loaded words with masks and shifts,
+ * which the compiler turns into PKHBT/PKHTB/UXTB16 on the Cortex-M4. The
+ * per-frame kernels handle everything else and the tails.
+ *
+ * src must be word aligned. The stride is the size of one input frame, a
+ * stride equal to one sample means a mono stream.
+ */
+
+#define FRAME(l, r)     (((l) & 0xFFFF) | ((rt_uint32_t)(r) << 16))
+
+/* unsigned 8-bit to signed, in all four bytes */
+#define U8_BIAS         0x80808080
+
+static void _u8_any(rt_uint32_t *dst, const rt_uint8_t *src,
+                    rt_size_t frames, rt_size_t stride)
+{
+    rt_size_t right = (stride == 1) ? 0 : 1;
+
+    while (frames--)
+    {
+        *dst++ = FRAME((src[0] ^ 0x80) << 8, (src[right] ^ 0x80) << 8);
+        src += stride;
+    }
+}
+
+static void _u8_mono(rt_uint32_t *dst, const rt_uint8_t *src,
+                     rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint32_t *s = (const rt_uint32_t *)src;
+    rt_uint32_t w;
+
+    for (; frames >= 4; frames -= 4)
+    {
+        w = *s++ ^ U8_BIAS;
+        *dst++ = ((w      ) & 0xFF) * 0x01000100;
+        *dst++ = ((w >>  8) & 0xFF) * 0x01000100;
+        *dst++ = ((w >> 16) & 0xFF) * 0x01000100;
+        *dst++ = ((w >> 24)       ) * 0x01000100;
+    }
+
+    _u8_any(dst, (const rt_uint8_t *)s, frames, stride);
+}
+
+static void _u8_stereo(rt_uint32_t *dst, const rt_uint8_t *src,
+                       rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint32_t *s = (const rt_uint32_t *)src;
+    rt_uint32_t w;
+
+    for (; frames >= 2; frames -= 2)
+    {
+        w = *s++ ^ U8_BIAS;
+        *dst++ = ((w & 0x000000FF) << 8) | ((w & 0x0000FF00) << 16);
+        *dst++ = ((w & 0x00FF0000) >> 8) | (w & 0xFF000000);
+    }
+
+    _u8_any(dst, (const rt_uint8_t *)s, frames, stride);
+}
+
+static void _s16_any(rt_uint32_t *dst, const rt_uint8_t *src,
+                     rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint16_t *s;
+    rt_size_t right = (stride == 2) ? 0 : 1;
+
+    while (frames--)
+    {
+        s = (const rt_uint16_t *)src;
+        *dst++ = FRAME(s[0], s[right]);
+        src += stride;
+    }
+}
+
+static void _s16_mono(rt_uint32_t *dst, const rt_uint8_t *src,
+                      rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint32_t *s = (const rt_uint32_t *)src;
+    rt_uint32_t w;
+
+    for (; frames >= 2; frames -= 2)
+    {
+        w = *s++;
+        *dst++ = (w & 0x0000FFFF) | (w << 16);
+        *dst++ = (w & 0xFFFF0000) | (w >> 16);
+    }
+
+    _s16_any(dst, (const rt_uint8_t *)s, frames, stride);
+}
+
+static void _s16_stereo(rt_uint32_t *dst, const rt_uint8_t *src,
+                        rt_size_t frames, rt_size_t stride)
+{
+    rt_memcpy(dst, src, frames * 4);
+}
+
+static void _s24_any(rt_uint32_t *dst, const rt_uint8_t *src,
+                     rt_size_t frames, rt_size_t stride)
+{
+    rt_size_t right = (stride == 3) ? 0 : 3;
+
+    while (frames--)
+    {
+        *dst++ = FRAME(src[1] | (src[2] << 8),
+                       src[right + 1] | (src[right + 2] << 8));
+        src += stride;
+    }
+}
+
+/*
+ * Four 24-bit samples are three words:
+ *   w0 = a0 a1 a2 b0, w1 = b1 b2 c0 c1, w2 = c2 d0 d1 d2
+ * and the upper two bytes of each sample are cut out of them.
+ */
+#define S24_SPLIT(s, a, b, c, d)                    \
+    w0 = s[0];                                      \
+    w1 = s[1];                                      \
+    w2 = s[2];                                      \
+    a = (w0 >> 8) & 0xFFFF;                         \
+    b = w1 & 0xFFFF;                                \
+    c = (w1 >> 24) | ((w2 & 0xFF) << 8);            \
+    d = w2 >> 16;
+
+static void _s24_mono(rt_uint32_t *dst, const rt_uint8_t *src,
+                      rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint32_t *s = (const rt_uint32_t *)src;
+    rt_uint32_t w0, w1, w2, a, b, c, d;
+
+    for (; frames >= 4; frames -= 4)
+    {
+        S24_SPLIT(s, a, b, c, d)
+        s += 3;
+
+        *dst++ = a | (a << 16);
+        *dst++ = b | (b << 16);
+        *dst++ = c | (c << 16);
+        *dst++ = d | (d << 16);
+    }
+
+    _s24_any(dst, (const rt_uint8_t *)s, frames, stride);
+}
+
+static void _s24_stereo(rt_uint32_t *dst, const rt_uint8_t *src,
+                        rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint32_t *s = (const rt_uint32_t *)src;
+    rt_uint32_t w0, w1, w2, a, b, c, d;
+
+    for (; frames >= 2; frames -= 2)
+    {
+        S24_SPLIT(s, a, b, c, d)
+        s += 3;
+
+        *dst++ = a | (b << 16);
+        *dst++ = c | (d << 16);
+    }
+
+    _s24_any(dst, (const rt_uint8_t *)s, frames, stride);
+}
+
+static void _s32_any(rt_uint32_t *dst, const rt_uint8_t *src,
+                     rt_size_t frames, rt_size_t stride)
+{
+    const rt_uint16_t *s;
+    rt_size_t right = (stride == 4) ? 1 : 3;
+
+    /* the upper half of each sample */
+    while (frames--)
+    {
+        s = (const rt_uint16_t *)src;
+        *dst++ = FRAME(s[1], s[right]);
+        src += stride;
+    }
+}
+
+static rt_uint32_t _f32_sample(const rt_uint8_t *src)
+{
+    float v = *(const float *)src * 32768.0f;
+
+    if (v >= 32767.0f) return 32767;
+    /* NaN ends up here as well */
+    if (!(v > -32768.0f)) return 0x8000;
+
+    return (rt_uint16_t)(rt_int16_t)v;
+}
+
+static void _f32_any(rt_uint32_t *dst, const rt_uint8_t *src,
+                     rt_size_t frames, rt_size_t stride)
+{
+    rt_size_t right = (stride == 4) ? 0 : 4;
+
+    while (frames--)
+    {
+        *dst++ = FRAME(_f32_sample(src), _f32_sample(src + right));
+        src += stride;
+    }
+}
+
+wav_pcm_convert_t wav_pcm_converter(const struct wav_pcm_format *format)
+{
+    rt_uint16_t channels = format->channels;
+
+    if (channels == 0 || format->block_align != channels * (format->bits / 8))
+        return RT_NULL;
+
+    if (format->format == WAV_PCM_FLOAT)
+        return (format->bits == 32) ? _f32_any : RT_NULL;
+
+    if (format->format != WAV_PCM_INT)
+        return RT_NULL;
+
+    switch (format->bits)
+    {
+    case 8:
+        if (channels == 1) return _u8_mono;
+        if (channels == 2) return _u8_stereo;
+        return _u8_any;
+
+    case 16:
+        if (channels == 1) return _s16_mono;
+        if (channels == 2) return _s16_stereo;
+        return _s16_any;
+
+    case 24:
+        if (channels == 1) return _s24_mono;
+        if (channels == 2) return _s24_stereo;
+        return _s24_any;
+
+    case 32:
+        return _s32_any;
+    }
+
+    return RT_NULL;
+}
+
+rt_bool_t wav_pcm_is_native(const struct wav_pcm_format *format)
+{
+    return (format->format == WAV_PCM_INT &&
+            format->bits == 16 &&
+            format->channels == 2 &&
+            format->block_align == 4) ? RT_TRUE : RT_FALSE;
+}
@@ -0,0 +1,51 @@
+/*
+ * File      : wav_pcm.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-18     realtouch    first version
+ */
+
+#ifndef __WAV_PCM_H__
+#define __WAV_PCM_H__
+
+#include <rtthread.h>
+
+/*
+ * Conversion of WAV sample data to the 16-bit interleaved stereo frames
+ * taken by the "snd" device.
+ *
+ * Integer samples are cut to their 16 most significant bits, unsigned 8-bit
+ * samples are re-biased first. Float samples are scaled by 32768, truncated
+ * towards zero and saturated. Mono is sent to both channels, of streams with
+ * more channels only the first two are played.
+ */
+#define WAV_PCM_INT             1
+#define WAV_PCM_FLOAT           3
+
+struct wav_pcm_format
+{
+    rt_uint16_t format;         /* WAV_PCM_INT or WAV_PCM_FLOAT */
+    rt_uint16_t channels;
+    rt_uint16_t bits;           /* container size: 8, 16, 24 or 32 */
+    rt_uint16_t block_align;    /* bytes per frame */
+    rt_uint32_t sample_rate;
+};
+
+/* convert frames from src to dst, one 32-bit stereo frame per input frame */
+typedef void (*wav_pcm_convert_t)(rt_uint32_t *dst, const rt_uint8_t *src,
+                                  rt_size_t frames, rt_size_t stride);
+
+/* RT_NULL if the format is not supported */
+wav_pcm_convert_t wav_pcm_converter(const struct wav_pcm_format *format);
+
+/* the data can go to the device unchanged */
+rt_bool_t wav_pcm_is_native(const struct wav_pcm_format *format);
+
+#endif
@@ -0,0 +1,657 @@
+/*
+ * File      : audio_mixer.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-20     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "mem_region.h"
+#include "audio_resample.h"
+#include "audio_mixer.h"
+#include "codec_wm8978_i2c.h"
+
+/* output block: 512 frames, 11.6ms at 44.1kHz */
+#define MIXER_FRAMES            512
+#define MIXER_BLOCKS            3
+#define MIXER_NODE_MAX          8
+#define MIXER_QUALITY           AUDIO_RESAMPLE_MEDIUM
+
+#define MIXER_THREAD_STACK      1024
+#define MIXER_THREAD_PRIORITY   12
+
+/* how long a stream may be late before its gap is filled with silence */
+#define MIXER_WAIT_TICK         (MIXER_FRAMES * RT_TICK_PER_SECOND / AUDIO_MIXER_RATE + 1)
+
+#if defined(__ARM_ARCH_7EM__) || defined(__TARGET_ARCH_7E_M) || defined(__ARM7EM__)
+#define MIXER_USING_DSP
+#endif
+
+enum mixer_state
+{
+    MIXER_IDLE,                 /* no stream has data */
+    MIXER_SHORT,                /* a stream has less than a block */
+    MIXER_READY,
+};
+
+struct mixer_node
+{
+    rt_uint32_t *data;
+    rt_size_t frames;
+};
+
+struct mixer_stream
+{
+    struct rt_device parent;
+
+    /* buffers written and not mixed yet */
+    struct mixer_node list[MIXER_NODE_MAX];
+    rt_uint16_t read_index, put_index;
+    rt_size_t offset;           /* frames of the first buffer already mixed */
+    rt_size_t queued;           /* frames not mixed yet */
+
+    rt_uint32_t gain;
+    rt_uint32_t rate;
+    rt_bool_t opened;
+    rt_bool_t rs_active;
+    struct audio_resampler resampler;
+
+    rt_bool_t playing;          /* filled the last block */
+    rt_bool_t starved;          /* silence went out since then */
+    struct audio_mixer_stats stats;
+};
+
+struct audio_mixer
+{
+    struct mixer_stream stream[AUDIO_MIXER_STREAMS];
+    rt_uint8_t opened;          /* number of open streams */
+
+    rt_device_t snd;            /* while a stream is open */
+    struct rt_mutex lock;
+    struct rt_semaphore wakeup; /* released on every write */
+
+    /* output blocks, read by the I2S DMA */
+    struct rt_mempool mp;
+    void *pool;
+    rt_uint32_t *scratch;       /* resampler output */
+};
+static struct audio_mixer _mixer;
+
+#ifdef MIXER_USING_DSP
+#define MIXER_QADD16(a, b)      __QADD16(a, b)
+#else
+static rt_uint32_t _qadd16(rt_uint32_t a, rt_uint32_t b)
+{
+    rt_int32_t l = (rt_int16_t)a + (rt_int16_t)b;
+    rt_int32_t r = (rt_int16_t)(a >> 16) + (rt_int16_t)(b >> 16);
+
+    if (l > 32767) l = 32767;
+    if (l < -32768) l = -32768;
+    if (r > 32767) r = 32767;
+    if (r < -32768) r = -32768;
+
+    return (l & 0xFFFF) | ((rt_uint32_t)r << 16);
+}
+#define MIXER_QADD16(a, b)      _qadd16(a, b)
+#endif
+
+void audio_mixer_add(rt_uint32_t *dst, const rt_uint32_t *src,
+                     rt_size_t frames, rt_uint32_t gain)
+{
+    rt_uint32_t s;
+    rt_int32_t l, r;
+
+    if (gain >= MIXER_GAIN_UNITY)
+    {
+        for (; frames >= 2; frames -= 2)
+        {
+            dst[0] = MIXER_QADD16(dst[0], src[0]);
+            dst[1] = MIXER_QADD16(dst[1], src[1]);
+            dst += 2;
+            src += 2;
+        }
+        if (frames)
+            *dst = MIXER_QADD16(*dst, *src);
+
+        return;
+    }
+
+    /* the scaled samples always fit into 16 bits, gain < 1.0 */
+    while (frames--)
+    {
+        s = *src++;
+        l = ((rt_int16_t)s * (rt_int32_t)gain) >> 15;
+        r = ((rt_int16_t)(s >> 16) * (rt_int32_t)gain) >> 15;
+
+        *dst = MIXER_QADD16(*dst, (l & 0xFFFF) | ((rt_uint32_t)r << 16));
+        dst ++;
+    }
+}
+
+/* hand the first buffer back to the writer */
+static void _stream_release(struct mixer_stream *s)
+{
+    void *data = s->list[s->read_index].data;
+
+    s->read_index ++;
+    if (s->read_index >= MIXER_NODE_MAX)
+        s->read_index = 0;
+    s->offset = 0;
+
+    if (s->parent.tx_complete != RT_NULL)
+        s->parent.tx_complete(&s->parent, data);
+}
+
+static void _stream_flush(struct mixer_stream *s)
+{
+    while (s->read_index != s->put_index)
+        _stream_release(s);
+
+    s->queued = 0;
+    if (s->rs_active)
+        audio_resampler_reset(&s->resampler);
+}
+
+/* input frames a block takes, and how many the stream has */
+static rt_size_t _stream_need(struct mixer_stream *s)
+{
+    struct audio_resampler *rs = &s->resampler;
+
+    if (!s->rs_active)
+        return MIXER_FRAMES;
+
+    return (MIXER_FRAMES * rs->down + rs->up - 1) / rs->up + rs->taps;
+}
+
+static rt_size_t _stream_avail(struct mixer_stream *s)
+{
+    struct audio_resampler *rs = &s->resampler;
+
+    if (s->rs_active && rs->pos < rs->length)
+        return s->queued + rs->length - rs->pos;
+
+    return s->queued;
+}
+
+/* mix up to one block of the stream into dst, returns the output frames */
+static rt_size_t _stream_mix(struct mixer_stream *s, rt_uint32_t *dst)
+{
+    struct mixer_node *node;
+    rt_size_t done = 0, n, taken;
+
+    while (done < MIXER_FRAMES && s->read_index != s->put_index)
+    {
+        node = &s->list[s->read_index];
+        taken = node->frames - s->offset;
+
+        if (s->rs_active)
+        {
+            n = audio_resampler_process(&s->resampler,
+                (const rt_int16_t *)(node->data + s->offset), &taken,
+                (rt_int16_t *)(_mixer.scratch + done), MIXER_FRAMES - done);
+        }
+        else
+        {
+            if (taken > MIXER_FRAMES - done)
+                taken = MIXER_FRAMES - done;
+            audio_mixer_add(dst + done, node->data + s->offset, taken, s->gain);
+            n = taken;
+        }
+
+        done += n;
+        s->offset += taken;
+        s->queued -= taken;
+        s->stats.frames += taken;
+
+        if (s->offset == node->frames)
+            _stream_release(s);
+    }
+
+    if (s->rs_active && done > 0)
+        audio_mixer_add(dst, _mixer.scratch, done, s->gain);
+
+    return done;
+}
+
+static enum mixer_state _mixer_state(void)
+{
+    struct mixer_stream *s;
+    enum mixer_state state = MIXER_IDLE;
+    int i;
+
+    rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+    for (i = 0; i < AUDIO_MIXER_STREAMS; i ++)
+    {
+        s = &_mixer.stream[i];
+        if (!s->opened || s->queued == 0)
+            continue;
+
+        if (_stream_avail(s) < _stream_need(s))
+        {
+            state = MIXER_SHORT;
+            break;
+        }
+        state = MIXER_READY;
+    }
+    rt_mutex_release(&_mixer.lock);
+
+    return state;
+}
+
+/* mix all streams into block, returns RT_FALSE if nothing was mixed */
+static rt_bool_t _mixer_mix(rt_uint32_t *block)
+{
+    struct mixer_stream *s;
+    rt_size_t done, flight;
+    rt_bool_t mixed = RT_FALSE;
+    int i;
+
+    rt_memset(block, 0, MIXER_FRAMES * 4);
+
+    /* blocks handed to the codec, this one included */
+    flight = (_mixer.mp.block_total_count - _mixer.mp.block_free_count) * MIXER_FRAMES;
+
+    for (i = 0; i < AUDIO_MIXER_STREAMS; i ++)
+    {
+        s = &_mixer.stream[i];
+        if (!s->opened)
+            continue;
+
+        done = (s->queued > 0) ? _stream_mix(s, block) : 0;
+        if (done > 0)
+        {
+            mixed = RT_TRUE;
+
+            s->stats.latency = (s->queued * 1000 / s->rate) +
+                               (flight * 1000 / AUDIO_MIXER_RATE);
+            if (s->stats.latency > s->stats.latency_max)
+                s->stats.latency_max = s->stats.latency;
+        }
+
+        if (done < MIXER_FRAMES && s->playing)
+            s->starved = RT_TRUE;
+        s->playing = (done == MIXER_FRAMES) ? RT_TRUE : RT_FALSE;
+    }
+
+    return mixed;
+}
+
+static void _mixer_thread_entry(void *parameter)
+{
+    rt_uint32_t *block;
+
+    while (1)
+    {
+        switch (_mixer_state())
+        {
+        case MIXER_IDLE:
+            rt_sem_take(&_mixer.wakeup, RT_WAITING_FOREVER);
+            continue;
+
+        case MIXER_SHORT:
+            /* give the writer a block time, then play what is there */
+            if (rt_sem_take(&_mixer.wakeup, MIXER_WAIT_TICK) == RT_EOK)
+                continue;
+            break;
+
+        case MIXER_READY:
+            break;
+        }
+
+        /* paced by the codec giving blocks back */
+        block = (rt_uint32_t *)rt_mp_alloc(&_mixer.mp, RT_WAITING_FOREVER);
+
+        rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+        if (_mixer_mix(block) && _mixer.snd != RT_NULL &&
+                rt_device_write(_mixer.snd, 0, block, MIXER_FRAMES * 4) == MIXER_FRAMES * 4)
+            block = RT_NULL;
+        rt_mutex_release(&_mixer.lock);
+
+        if (block != RT_NULL)
+            rt_mp_free(block);
+    }
+}
+
+static rt_err_t _mixer_tx_done(rt_device_t dev, void *buffer)
+{
+    rt_mp_free(buffer);
+
+    return RT_EOK;
+}
+
+/* the first stream opened takes "snd" over */
+static rt_err_t _mixer_attach(void)
+{
+    rt_device_t snd;
+    int rate = AUDIO_MIXER_RATE;
+
+    snd = rt_device_find("snd");
+    if (snd == RT_NULL)
+        return -RT_ENOSYS;
+
+    rt_device_set_tx_complete(snd, _mixer_tx_done);
+    if (rt_device_open(snd, RT_DEVICE_OFLAG_WRONLY) != RT_EOK)
+        return -RT_EIO;
+
+    if (rt_device_control(snd, CODEC_CMD_SAMPLERATE, &rate) != RT_EOK)
+    {
+        rt_device_close(snd);
+        return -RT_EIO;
+    }
+
+    _mixer.snd = snd;
+    return RT_EOK;
+}
+
+/* wait for the codec to play the mixed blocks and release "snd" */
+static void _mixer_detach(void)
+{
+    void *blocks[MIXER_BLOCKS];
+    int i, count;
+
+    for (count = 0; count < MIXER_BLOCKS; count ++)
+    {
+        blocks[count] = rt_mp_alloc(&_mixer.mp, RT_TICK_PER_SECOND);
+        if (blocks[count] == RT_NULL)
+            break;
+    }
+    for (i = 0; i < count; i ++)
+        rt_mp_free(blocks[i]);
+
+    rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+    /* a stream may have been opened in the meantime */
+    if (_mixer.opened == 0 && _mixer.snd != RT_NULL)
+    {
+        rt_device_close(_mixer.snd);
+        _mixer.snd = RT_NULL;
+    }
+    rt_mutex_release(&_mixer.lock);
+}
+
+static rt_err_t _stream_set_rate(struct mixer_stream *s, int rate)
+{
+    rt_err_t result;
+
+    if (rate <= 0)
+        return -RT_ERROR;
+
+    if (rate == AUDIO_MIXER_RATE)
+    {
+        audio_resampler_deinit(&s->resampler);
+        s->rs_active = RT_FALSE;
+    }
+    else if (!s->rs_active || s->resampler.in_rate != rate)
+    {
+        audio_resampler_deinit(&s->resampler);
+        s->rs_active = RT_FALSE;
+
+        result = audio_resampler_init(&s->resampler, rate, AUDIO_MIXER_RATE, MIXER_QUALITY);
+        if (result != RT_EOK)
+            return result;
+        s->rs_active = RT_TRUE;
+    }
+
+    s->rate = rate;
+    return RT_EOK;
+}
+
+static rt_err_t _stream_open(rt_device_t dev, rt_uint16_t oflag)
+{
+    struct mixer_stream *s = (struct mixer_stream *)dev;
+    rt_err_t result = RT_EOK;
+
+    rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+    if (_mixer.opened == 0)
+        result = _mixer_attach();
+
+    if (result == RT_EOK)
+    {
+        s->read_index = s->put_index = 0;
+        s->offset = 0;
+        s->queued = 0;
+        s->playing = s->starved = RT_FALSE;
+        rt_memset(&s->stats, 0, sizeof(s->stats));
+        /* the rate may have been set before the stream was opened */
+        if (_stream_set_rate(s, s->rate) != RT_EOK)
+            _stream_set_rate(s, AUDIO_MIXER_RATE);
+
+        s->opened = RT_TRUE;
+        _mixer.opened ++;
+    }
+    rt_mutex_release(&_mixer.lock);
+
+    return result;
+}
+
+/* like "snd": buffers not mixed yet are handed back right away */
+static rt_err_t _stream_close(rt_device_t dev)
+{
+    struct mixer_stream *s = (struct mixer_stream *)dev;
+    rt_bool_t last;
+
+    rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+    _stream_flush(s);
+    audio_resampler_deinit(&s->resampler);
+    s->rs_active = RT_FALSE;
+
+    s->opened = RT_FALSE;
+    _mixer.opened --;
+    last = (_mixer.opened == 0) ? RT_TRUE : RT_FALSE;
+    rt_mutex_release(&_mixer.lock);
+
+    if (last)
+        _mixer_detach();
+
+    return RT_EOK;
+}
+
+static rt_size_t _stream_write(rt_device_t dev, rt_off_t pos,
+                               const void *buffer, rt_size_t size)
+{
+    struct mixer_stream *s = (struct mixer_stream *)dev;
+    struct mixer_node *node;
+    rt_uint16_t next_index;
+
+    if (size < 4)
+        return 0;
+
+    rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+    next_index = s->put_index + 1;
+    if (next_index >= MIXER_NODE_MAX)
+        next_index = 0;
+
+    /* check for list full */
+    if (next_index == s->read_index)
+    {
+        rt_mutex_release(&_mixer.lock);
+        return 0;
+    }
+
+    node = &s->list[s->put_index];
+    node->data = (rt_uint32_t *)buffer;
+    node->frames = size / 4;
+    s->put_index = next_index;
+    s->queued += node->frames;
+
+    if (s->starved)
+    {
+        s->stats.underruns ++;
+        s->starved = RT_FALSE;
+    }
+    rt_mutex_release(&_mixer.lock);
+
+    rt_sem_release(&_mixer.wakeup);
+
+    return size;
+}
+
+/*
+ * The frames of the stream still in the mixed blocks "snd" has not played
+ * yet count as queued. The blocks hold all open streams, so this is exact
+ * as long as the stream had no gaps.
+ */
+static void _stream_position(struct mixer_stream *s, struct codec_position *pos)
+{
+    struct codec_position out;
+    struct audio_resampler *rs = &s->resampler;
+    rt_uint32_t pending;
+
+    rt_memset(&out, 0, sizeof(out));
+    if (_mixer.snd != RT_NULL)
+        rt_device_control(_mixer.snd, CODEC_CMD_GET_POSITION, &out);
+
+    /* output frames at the stream rate, and the resampler history */
+    pending = (rt_uint32_t)((uint64_t)out.queued * s->rate / AUDIO_MIXER_RATE);
+    if (s->rs_active && rs->pos < rs->length)
+        pending += rs->length - rs->pos;
+
+    pos->played = (s->stats.frames > pending) ? s->stats.frames - pending : 0;
+    pos->queued = s->queued + pending;
+    pos->rate = s->rate;
+    pos->time = pos->played / pos->rate * 1000 +
+                (pos->played % pos->rate) * 1000 / pos->rate;
+}
+
+static rt_err_t _stream_control(rt_device_t dev, rt_uint8_t cmd, void *args)
+{
+    struct mixer_stream *s = (struct mixer_stream *)dev;
+    rt_device_t snd;
+    rt_err_t result = RT_EOK;
+    int value;
+
+    switch (cmd)
+    {
+    case CODEC_CMD_SAMPLERATE:
+        rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+        result = _stream_set_rate(s, *(int *)args);
+        rt_mutex_release(&_mixer.lock);
+        break;
+
+    case MIXER_CMD_GAIN:
+        value = *(int *)args;
+        if (value < 0 || value > 100)
+            return -RT_ERROR;
+        s->gain = value * MIXER_GAIN_UNITY / 100;
+        break;
+
+    case CODEC_CMD_GET_POSITION:
+        rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+        _stream_position(s, (struct codec_position *)args);
+        rt_mutex_release(&_mixer.lock);
+        break;
+
+    case CODEC_CMD_GET_LATENCY:
+        {
+            struct codec_position pos;
+
+            rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+            _stream_position(s, &pos);
+            rt_mutex_release(&_mixer.lock);
+            *(int *)args = pos.queued * 1000 / pos.rate;
+        }
+        break;
+
+    case MIXER_CMD_GET_STATS:
+        rt_mutex_take(&_mixer.lock, RT_WAITING_FOREVER);
+        rt_memcpy(args, &s->stats, sizeof(struct audio_mixer_stats));
+        rt_mutex_release(&_mixer.lock);
+        break;
+
+    default:
+        /* volume, EQ: the codec is shared by all streams */
+        snd = rt_device_find("snd");
+        if (snd == RT_NULL)
+            return -RT_ENOSYS;
+        result = rt_device_control(snd, cmd, args);
+        break;
+    }
+
+    return result;
+}
+
+rt_err_t audio_mixer_init(void)
+{
+    struct mixer_stream *s;
+    rt_thread_t tid;
+    char name[RT_NAME_MAX];
+    rt_size_t size;
+    int i;
+
+    size = MIXER_BLOCKS * (MIXER_FRAMES * 4 + sizeof(rt_uint8_t *));
+    _mixer.pool = mem_region_malloc(MEM_REGION_DMA, size);
+    _mixer.scratch = (rt_uint32_t *)mem_region_malloc(MEM_REGION_FAST, MIXER_FRAMES * 4);
+    if (_mixer.pool == RT_NULL || _mixer.scratch == RT_NULL)
+    {
+        if (_mixer.pool != RT_NULL)
+            mem_region_free(_mixer.pool);
+        if (_mixer.scratch != RT_NULL)
+            mem_region_free(_mixer.scratch);
+        return -RT_ENOMEM;
+    }
+
+    rt_mp_init(&_mixer.mp, "mixer", _mixer.pool, size, MIXER_FRAMES * 4);
+    rt_mutex_init(&_mixer.lock, "mixer", RT_IPC_FLAG_FIFO);
+    rt_sem_init(&_mixer.wakeup, "mixer", 0, RT_IPC_FLAG_FIFO);
+
+    for (i = 0; i < AUDIO_MIXER_STREAMS; i ++)
+    {
+        s = &_mixer.stream[i];
+        s->gain = MIXER_GAIN_UNITY;
+        s->rate = AUDIO_MIXER_RATE;
+
+        s->parent.type = RT_Device_Class_Sound;
+        s->parent.rx_indicate = RT_NULL;
+        s->parent.tx_complete = RT_NULL;
+        s->parent.user_data   = RT_NULL;
+
+        s->parent.init    = RT_NULL;
+        s->parent.open    = _stream_open;
+        s->parent.close   = _stream_close;
+        s->parent.read    = RT_NULL;
+        s->parent.write   = _stream_write;
+        s->parent.control = _stream_control;
+
+        rt_snprintf(name, sizeof(name), "mix%d", i);
+        rt_device_register(&s->parent, name,
+                           RT_DEVICE_FLAG_WRONLY | RT_DEVICE_FLAG_STANDALONE);
+    }
+
+    tid = rt_thread_create("mixer", _mixer_thread_entry, RT_NULL,
+                           MIXER_THREAD_STACK, MIXER_THREAD_PRIORITY, 10);
+    if (tid == RT_NULL)
+        return -RT_ENOMEM;
+    rt_thread_startup(tid);
+
+    return RT_EOK;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void mixer(void)
+{
+    struct mixer_stream *s;
+    int i;
+
+    rt_kprintf("stream rate  gain frames     underruns latency(max)\n");
+    rt_kprintf("------ ----- ---- ---------- --------- ------------\n");
+    for (i = 0; i < AUDIO_MIXER_STREAMS; i ++)
+    {
+        s = &_mixer.stream[i];
+        rt_kprintf("mix%d%c  %5d %3d%% %10d %9d %4dms(%d)\n", i,
+                   s->opened ? '*' : ' ', s->rate,
+                   s->gain * 100 / MIXER_GAIN_UNITY, s->stats.frames,
+                   s->stats.underruns, s->stats.latency, s->stats.latency_max);
+    }
+}
+FINSH_FUNCTION_EXPORT(mixer, show mixer streams);
+#endif
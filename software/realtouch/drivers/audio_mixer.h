@@ -0,0 +1,60 @@
+/*
+ * File      : audio_mixer.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-20     realtouch    first version
+ */
+
+#ifndef __AUDIO_MIXER_H__
+#define __AUDIO_MIXER_H__
+
+#include <rtthread.h>
+
+/*
+ * Software mixer on top of the "snd" device.
+ *
+ * Every stream is a device of its own, "mix0" .. "mix3", used like "snd":
+ * set tx_complete, open, set CODEC_CMD_SAMPLERATE and write 16-bit stereo
+ * buffers. A buffer is handed back through tx_complete once it has been
+ * mixed. Streams at another rate than AUDIO_MIXER_RATE are resampled.
+ *
+ * The mixer owns "snd" while at least one stream is open, "snd" must not
+ * be used directly during that time. CODEC_CMD_GET_POSITION and
+ * CODEC_CMD_GET_LATENCY count the frames of the stream itself, other
+ * CODEC_CMD_xxx commands sent to a stream are passed on to "snd".
+ */
+#define AUDIO_MIXER_STREAMS     4
+#define AUDIO_MIXER_RATE        44100
+
+#define MIXER_CMD_GAIN          0x20    /* int, 0 .. 100 percent */
+#define MIXER_CMD_GET_STATS     0x21    /* struct audio_mixer_stats* */
+
+#define MIXER_GAIN_UNITY        32768
+
+struct audio_mixer_stats
+{
+    rt_uint32_t frames;         /* input frames mixed */
+    rt_uint32_t underruns;      /* gaps filled with silence */
+
+    /* from the write to the codec, in ms */
+    rt_uint32_t latency;
+    rt_uint32_t latency_max;
+};
+
+rt_err_t audio_mixer_init(void);
+
+/*
+ * dst += src * gain / MIXER_GAIN_UNITY on 16-bit stereo frames, with
+ * saturation. gain is at most MIXER_GAIN_UNITY.
+ */
+void audio_mixer_add(rt_uint32_t *dst, const rt_uint32_t *src,
+                     rt_size_t frames, rt_uint32_t gain);
+
+#endif
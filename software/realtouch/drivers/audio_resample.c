@@ -0,0 +1,376 @@
+/*
+ * File      : audio_resample.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-19     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "mem_region.h"
+#include "audio_resample.h"
+
+#ifndef M_PI
+#define M_PI                    3.14159265358979323846
+#endif
+
+/* input frames taken into the history at once */
+#define RS_BLOCK                256
+
+#if defined(__ARM_ARCH_7EM__) || defined(__TARGET_ARCH_7E_M) || defined(__ARM7EM__)
+#define RS_USING_DSP
+#endif
+
+struct rs_quality
+{
+    rt_uint16_t taps;
+    float beta;                 /* Kaiser window */
+    float cutoff;               /* -6dB point, relative to the lower Nyquist rate */
+};
+
+static const struct rs_quality _quality[] =
+{
+    {16, 5.0f, 0.88f},          /* LOW */
+    {24, 7.0f, 0.91f},          /* MEDIUM */
+    {32, 8.6f, 0.93f},          /* HIGH */
+};
+
+static rt_uint32_t _gcd(rt_uint32_t a, rt_uint32_t b)
+{
+    rt_uint32_t t;
+
+    while (b != 0)
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* zeroth order modified Bessel function of the first kind */
+static double _bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    int k;
+
+    x = x * x / 4;
+    for (k = 1; k < 32; k ++)
+    {
+        term *= x / ((double)k * k);
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+
+    return sum;
+}
+
+/*
+ * Design the prototype low pass at up * in_rate and split it into phases.
+ * Each phase is normalised to a DC gain of exactly 1.0 after rounding, so
+ * the gain does not change from one output sample to the next.
+ */
+static void _design(struct audio_resampler *rs, const struct rs_quality *q)
+{
+    rt_uint32_t n = rs->up * rs->taps;
+    rt_uint32_t rate = (rs->in_rate < rs->out_rate) ? rs->in_rate : rs->out_rate;
+    double fc, t, h, i0_beta, x;
+    rt_int32_t sum, v, peak;
+    rt_uint16_t phase, tap, center;
+    rt_int16_t *coef;
+
+    /* cut-off in cycles per sample of the prototype */
+    fc = 0.5 * q->cutoff * rate / ((double)rs->in_rate * rs->up);
+    i0_beta = _bessel_i0(q->beta);
+
+    for (phase = 0; phase < rs->up; phase ++)
+    {
+        coef = rs->coef + phase * rs->taps;
+        sum = 0;
+        center = 0;
+        peak = 0;
+
+        /* the newest sample is the last one in the history */
+        for (tap = 0; tap < rs->taps; tap ++)
+        {
+            rt_uint32_t k = phase + (rs->taps - 1 - tap) * rs->up;
+
+            t = k - (n - 1) / 2.0;
+            if (t == 0)
+                h = 2 * fc;
+            else
+                h = sin(2 * M_PI * fc * t) / (M_PI * t);
+
+            x = 2.0 * k / (n - 1) - 1.0;
+            h *= _bessel_i0(q->beta * sqrt(1.0 - x * x)) / i0_beta;
+
+            v = (rt_int32_t)floor(h * rs->up * 32768.0 + 0.5);
+            if (v > 32767) v = 32767;
+            if (v < -32768) v = -32768;
+
+            coef[tap] = (rt_int16_t)v;
+            sum += v;
+            if (v > peak)
+            {
+                peak = v;
+                center = tap;
+            }
+        }
+
+        v = coef[center] + 32768 - sum;
+        if (v > 32767) v = 32767;
+        coef[center] = (rt_int16_t)v;
+    }
+}
+
+rt_err_t audio_resampler_init(struct audio_resampler *rs, rt_uint32_t in_rate,
+                              rt_uint32_t out_rate, int quality)
+{
+    const struct rs_quality *q;
+    rt_uint32_t g, size;
+    rt_int16_t *ptr;
+    int c;
+
+    rt_memset(rs, 0, sizeof(struct audio_resampler));
+
+    if (quality < AUDIO_RESAMPLE_LOW || quality > AUDIO_RESAMPLE_HIGH ||
+            in_rate == 0 || out_rate == 0)
+        return -RT_ERROR;
+    q = &_quality[quality - AUDIO_RESAMPLE_LOW];
+
+    g = _gcd(in_rate, out_rate);
+    if (out_rate / g > AUDIO_RESAMPLE_UP_MAX || in_rate / g > 0xFFFF)
+        return -RT_ERROR;
+
+    rs->in_rate  = in_rate;
+    rs->out_rate = out_rate;
+    rs->up       = out_rate / g;
+    rs->down     = in_rate / g;
+    rs->taps     = q->taps;
+    /* keep the transition band as narrow when decimating */
+    if (in_rate > out_rate)
+        rs->taps = RT_ALIGN(q->taps * in_rate / out_rate, 4);
+    /* a full filter of history and a block of new input */
+    rs->capacity = RT_ALIGN(rs->taps + RS_BLOCK, 2);
+
+    /* coefficients and four history buffers, all CPU only */
+    size = rs->up * rs->taps + 4 * rs->capacity;
+    rs->memory = mem_region_malloc(MEM_REGION_FAST, size * sizeof(rt_int16_t));
+    if (rs->memory == RT_NULL)
+        return -RT_ENOMEM;
+
+    ptr = (rt_int16_t *)rs->memory;
+    rs->coef = ptr;
+    ptr += rs->up * rs->taps;
+    for (c = 0; c < 2; c ++)
+    {
+        rs->history[c][0] = ptr;
+        ptr += rs->capacity;
+        rs->history[c][1] = ptr;
+        ptr += rs->capacity;
+    }
+
+    _design(rs, q);
+    audio_resampler_reset(rs);
+
+    return RT_EOK;
+}
+
+void audio_resampler_deinit(struct audio_resampler *rs)
+{
+    if (rs->memory != RT_NULL)
+        mem_region_free(rs->memory);
+
+    rt_memset(rs, 0, sizeof(struct audio_resampler));
+}
+
+/* start a new stream: silence before the first sample */
+void audio_resampler_reset(struct audio_resampler *rs)
+{
+    int c;
+
+    for (c = 0; c < 2; c ++)
+    {
+        rt_memset(rs->history[c][0], 0, rs->capacity * sizeof(rt_int16_t));
+        rt_memset(rs->history[c][1], 0, rs->capacity * sizeof(rt_int16_t));
+    }
+
+    rs->length = rs->taps - 1;
+    rs->pos = 0;
+    rs->phase = 0;
+}
+
+rt_size_t audio_resampler_out_frames(struct audio_resampler *rs, rt_size_t in_frames)
+{
+    return ((uint64_t)in_frames * rs->up + rs->phase) / rs->down + 1;
+}
+
+/*
+ * Drop the samples before pos and append up to frames input frames to the
+ * history. Returns the frames taken, including those skipped when pos is
+ * beyond the end of the history.
+ */
+static rt_size_t _refill(struct audio_resampler *rs, const rt_int16_t *in,
+                         rt_size_t frames)
+{
+    rt_int16_t *l0, *l1, *r0, *r1;
+    rt_size_t skip, n, i;
+    rt_uint32_t keep;
+
+    if (rs->pos >= rs->length)
+    {
+        rs->pos -= rs->length;
+        rs->length = 0;
+    }
+    else if (rs->pos > 0)
+    {
+        keep = rs->length - rs->pos;
+        rt_memmove(rs->history[0][0], rs->history[0][0] + rs->pos, keep * sizeof(rt_int16_t));
+        rt_memmove(rs->history[0][1], rs->history[0][1] + rs->pos, keep * sizeof(rt_int16_t));
+        rt_memmove(rs->history[1][0], rs->history[1][0] + rs->pos, keep * sizeof(rt_int16_t));
+        rt_memmove(rs->history[1][1], rs->history[1][1] + rs->pos, keep * sizeof(rt_int16_t));
+        rs->length = keep;
+        rs->pos = 0;
+    }
+
+    /* input the next output does not need */
+    skip = (rs->pos < frames) ? rs->pos : frames;
+    rs->pos -= skip;
+    in += skip * 2;
+    frames -= skip;
+
+    n = rs->capacity - rs->length;
+    if (n > frames)
+        n = frames;
+
+    l0 = rs->history[0][0] + rs->length;
+    l1 = rs->history[0][1] + rs->length - 1;
+    r0 = rs->history[1][0] + rs->length;
+    r1 = rs->history[1][1] + rs->length - 1;
+
+    i = 0;
+    if (rs->length == 0 && n > 0)
+    {
+        /* no shifted copy of the first sample */
+        l0[0] = in[0];
+        r0[0] = in[1];
+        i = 1;
+    }
+    for (; i < n; i ++)
+    {
+        l0[i] = l1[i] = in[i * 2];
+        r0[i] = r1[i] = in[i * 2 + 1];
+    }
+    rs->length += n;
+
+    return skip + n;
+}
+
+#ifdef RS_USING_DSP
+/* the rounded and saturated Q15 result */
+#define RS_OUTPUT(acc)  ((rt_int16_t)__SSAT((rt_int32_t)(((int64_t)(acc) + 0x4000) >> 15), 16))
+
+/* SMLALD: two 16x16 products per instruction, 64-bit accumulator */
+#define RS_DOT(c, l, r, taps, acc_l, acc_r)                         \
+    do                                                              \
+    {                                                               \
+        const rt_uint32_t *cw = (const rt_uint32_t *)(c);           \
+        const rt_uint32_t *lw = (const rt_uint32_t *)(l);           \
+        const rt_uint32_t *rw = (const rt_uint32_t *)(r);           \
+        rt_uint32_t cc;                                             \
+        int cnt = (taps) >> 2;                                      \
+                                                                    \
+        do                                                          \
+        {                                                           \
+            cc = *cw++;                                             \
+            acc_l = __SMLALD(cc, *lw++, acc_l);                     \
+            acc_r = __SMLALD(cc, *rw++, acc_r);                     \
+            cc = *cw++;                                             \
+            acc_l = __SMLALD(cc, *lw++, acc_l);                     \
+            acc_r = __SMLALD(cc, *rw++, acc_r);                     \
+        } while (--cnt);                                            \
+    } while (0)
+#else
+static rt_int16_t _output(int64_t acc)
+{
+    rt_int32_t v = (rt_int32_t)((acc + 0x4000) >> 15);
+
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (rt_int16_t)v;
+}
+#define RS_OUTPUT(acc)  _output((int64_t)(acc))
+
+#define RS_DOT(c, l, r, taps, acc_l, acc_r)                         \
+    do                                                              \
+    {                                                               \
+        int i;                                                      \
+                                                                    \
+        for (i = 0; i < (taps); i ++)                               \
+        {                                                           \
+            acc_l += (rt_int32_t)(c)[i] * (l)[i];                   \
+            acc_r += (rt_int32_t)(c)[i] * (r)[i];                   \
+        }                                                           \
+    } while (0)
+#endif
+
+rt_size_t audio_resampler_process(struct audio_resampler *rs,
+                                  const rt_int16_t *in, rt_size_t *in_frames,
+                                  rt_int16_t *out, rt_size_t out_frames)
+{
+    rt_size_t consumed = 0, produced = 0;
+    const rt_int16_t *c, *l, *r;
+    rt_uint32_t phase;
+    uint64_t acc_l, acc_r;
+
+    while (produced < out_frames)
+    {
+        if (rs->pos + rs->taps > rs->length)
+        {
+            if (consumed == *in_frames)
+                break;
+
+            consumed += _refill(rs, in + consumed * 2, *in_frames - consumed);
+            continue;
+        }
+
+        c = rs->coef + rs->phase * rs->taps;
+        if (rs->pos & 1)
+        {
+            l = rs->history[0][1] + rs->pos - 1;
+            r = rs->history[1][1] + rs->pos - 1;
+        }
+        else
+        {
+            l = rs->history[0][0] + rs->pos;
+            r = rs->history[1][0] + rs->pos;
+        }
+
+        acc_l = acc_r = 0;
+        RS_DOT(c, l, r, rs->taps, acc_l, acc_r);
+
+        out[0] = RS_OUTPUT(acc_l);
+        out[1] = RS_OUTPUT(acc_r);
+        out += 2;
+        produced ++;
+
+        phase = rs->phase + rs->down;
+        rs->pos += phase / rs->up;
+        rs->phase = phase % rs->up;
+    }
+
+    *in_frames = consumed;
+    return produced;
+}
@@ -0,0 +1,87 @@
+/*
+ * File      : audio_resample.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-19     realtouch    first version
+ */
+
+#ifndef __AUDIO_RESAMPLE_H__
+#define __AUDIO_RESAMPLE_H__
+
+#include <rtthread.h>
+
+/*
+ * Polyphase sample-rate converter for 16-bit interleaved stereo.
+ *
+ * The ratio out/in is reduced to up/down and a Kaiser windowed sinc of
+ * up * taps coefficients is split into up phases of taps Q15 coefficients
+ * each, so every output sample is one dot product over the last taps input
+ * samples. The quality selects taps and window, measured on a PC for
+ * 8000 .. 96000 -> 44100:
+ *
+ *           taps  gain at 0.8 Nyquist  rejection  SINAD 1kHz -1dBFS
+ *   LOW     16    -1.8dB               52dB       62 .. 72dB
+ *   MEDIUM  24    -0.5dB               70dB       80 .. 91dB
+ *   HIGH    32    -0.07dB              75dB       82 .. 91dB
+ *
+ * Nyquist is the one of the lower rate, rejection is of images and aliases
+ * beyond 1.1 times it. When decimating the taps grow by in/out to keep the
+ * transition band, e.g. 28 for 48000 and 52 for 96000 at MEDIUM. A frame
+ * takes about taps * 2.5 + 30 cycles on the Cortex-M4.
+ *
+ * The coefficient table takes up * taps * 2 bytes, e.g. 21K at MEDIUM for
+ * 32000 -> 44100 (up = 441), 8K for 48000 -> 44100 (up = 147).
+ */
+#define AUDIO_RESAMPLE_OFF      0
+#define AUDIO_RESAMPLE_LOW      1
+#define AUDIO_RESAMPLE_MEDIUM   2
+#define AUDIO_RESAMPLE_HIGH     3
+
+#define AUDIO_RESAMPLE_UP_MAX   512
+
+struct audio_resampler
+{
+    rt_uint32_t in_rate, out_rate;
+    rt_uint16_t up, down;       /* out_rate / in_rate == up / down */
+    rt_uint16_t taps;           /* per phase, multiple of 4 */
+    rt_uint16_t phase;          /* phase of the next output, 0 .. up - 1 */
+
+    rt_int16_t *coef;           /* up phases of taps coefficients */
+
+    /*
+     * History of each channel, and a copy shifted by one sample: the dot
+     * product reads the copy at odd positions, so the sample pairs are
+     * always word aligned.
+     */
+    rt_int16_t *history[2][2];
+    rt_uint16_t capacity;       /* samples per history buffer */
+    rt_uint16_t length;         /* samples in the history */
+    rt_uint32_t pos;            /* first sample of the next output */
+
+    void *memory;
+};
+
+rt_err_t audio_resampler_init(struct audio_resampler *rs, rt_uint32_t in_rate,
+                              rt_uint32_t out_rate, int quality);
+void audio_resampler_deinit(struct audio_resampler *rs);
+void audio_resampler_reset(struct audio_resampler *rs);
+
+/* output frames for in_frames input frames, at most */
+rt_size_t audio_resampler_out_frames(struct audio_resampler *rs, rt_size_t in_frames);
+
+/*
+ * Convert up to *in_frames frames from in to at most out_frames frames at
+ * out. Returns the frames written, *in_frames is set to the frames taken.
+ */
+rt_size_t audio_resampler_process(struct audio_resampler *rs,
+                                  const rt_int16_t *in, rt_size_t *in_frames,
+                                  rt_int16_t *out, rt_size_t out_frames);
+
+#endif
@@ -41,6 +41,12 @@
 #define STM32_SRAM_SIZE         128
 #define STM32_SRAM_END          (0x20000000 + STM32_SRAM_SIZE * 1024)
 
+// <o> CCM data RAM size[Kbytes] <0-64>
+//	<i>Default: 64
+#define STM32_CCM_SIZE          64
+#define STM32_CCM_BEGIN         0x10000000
+#define STM32_CCM_END           (STM32_CCM_BEGIN + STM32_CCM_SIZE * 1024)
+
 // #define RT_USING_UART1
 // #define RT_USING_UART2
 #define RT_USING_UART3
@@ -3,11 +3,20 @@
 #include <rtdevice.h>
 
 #include "board.h"
+#include "mem_region.h"
+#include "audio_resample.h"
 #include "codec_wm8978_i2c.h"
 
 /* CODEC config */
 #define CODEC_MASTER_MODE       1 /* 0: mcu-master, 1: codec-master. */
 
+/* Resampler config: with a quality other than AUDIO_RESAMPLE_OFF every
+ * stream is converted to CODEC_FIXED_RATE and the codec clock is only set
+ * once, otherwise the PLL is reprogrammed for every sample rate. */
+#define CODEC_RESAMPLE_QUALITY  AUDIO_RESAMPLE_MEDIUM
+#define CODEC_FIXED_RATE        44100
+#define CODEC_RS_BLOCK_SIZE     4096
+
 /* CODEC PLL config */
 /* MCLK : 25M (PLLPRESCALE) (divide by 2 sets the required) */
 #define PLL_N_112896            (7 | PLLPRESCALE)
@@ -39,8 +48,11 @@ struct codec_data_node
 {
     rt_uint16_t *data_ptr;
     rt_size_t  data_size;
+    rt_bool_t  resampled; /* block of the resampler pool */
 };
 
+#define CODEC_RS_BLOCKS         (DATA_NODE_MAX - 1)
+
 struct codec_device
 {
     /* inherit from rt_device */
@@ -52,10 +64,24 @@ struct codec_device
 
     /* i2c mode */
     struct rt_i2c_bus_device * i2c_device;
+
+    /* sample rate converter in front of the data list */
+    int rs_quality;
+    int stream_rate;
+    rt_bool_t rs_active;
+    struct audio_resampler resampler;
+    struct rt_mempool rs_mp;
+    void *rs_pool;
+    rt_uint16_t *rs_block;  /* output block being filled */
+    rt_size_t rs_fill;      /* frames in rs_block */
+
+    /* frames of the completed DMA transfers since open */
+    rt_uint32_t played;
 };
 struct codec_device codec;
 
 static uint16_t r06 = REG_CLOCK_GEN | CLKSEL_PLL | MCLK_DIV2 | BCLK_DIV8;
+static int codec_clock = 0; /* sample rate the codec is set to, 0: unknown */
 
 #if !CODEC_MASTER_MODE
 static int codec_sr_new = 0;
@@ -176,6 +202,7 @@ static void codec_send(rt_uint16_t s_data)
 static rt_err_t codec_init(rt_device_t dev)
 {
     codec_send(REG_SOFTWARE_RESET);
+    codec_clock = 0;
 
     // 1.5x boost power up sequence.
     // Mute all outputs.
@@ -293,11 +320,15 @@ void eq3d(uint8_t depth)
     codec_send(REG_3D | ((depth & DEPTH3D_MASK) << DEPTH3D_POS));
 }
 
-rt_err_t sample_rate(int sr)
+static rt_err_t codec_set_clock(int sr)
 {
     uint16_t r07 = REG_ADDITIONAL;
     uint32_t PLL_N, PLL_K;
 
+    /* no I2C traffic when the clock does not change */
+    if (sr == codec_clock)
+        return RT_EOK;
+
     switch (sr)
     {
     case 8000: /* MCLK : 12.288 */
@@ -388,6 +419,133 @@ rt_err_t sample_rate(int sr)
 #if !CODEC_MASTER_MODE
     codec_sr_new = sr;
 #endif
+    codec_clock = sr;
+
+    return RT_EOK;
+}
+
+static rt_size_t codec_queue(struct codec_device* device, rt_uint16_t* data,
+                             rt_size_t size, rt_bool_t resampled);
+
+/* queue the partly filled output block of the resampler */
+static void codec_resampler_flush(void)
+{
+    if (codec.rs_block == RT_NULL)
+        return;
+
+    if (codec.rs_fill == 0)
+        rt_mp_free(codec.rs_block);
+    else
+    {
+        /* caller buffers still in the list: wait for the DMA to take them */
+        while (codec_queue(&codec, codec.rs_block, codec.rs_fill * 4, RT_TRUE) == 0)
+            rt_thread_delay(1);
+    }
+
+    codec.rs_block = RT_NULL;
+    codec.rs_fill = 0;
+}
+
+/* play everything converted so far and wait until the DMA is done with it */
+static void codec_resampler_drain(void)
+{
+    void* blocks[CODEC_RS_BLOCKS];
+    int i, count;
+
+    if (codec.rs_pool == RT_NULL)
+        return;
+
+    codec_resampler_flush();
+
+    for (count = 0; count < CODEC_RS_BLOCKS; count ++)
+    {
+        blocks[count] = rt_mp_alloc(&codec.rs_mp, RT_TICK_PER_SECOND);
+        if (blocks[count] == RT_NULL)
+            break;
+    }
+    for (i = 0; i < count; i ++)
+        rt_mp_free(blocks[i]);
+}
+
+/* convert the stream to CODEC_FIXED_RATE, the codec clock stays as it is */
+static rt_err_t codec_resampler_rate(int sr)
+{
+    rt_err_t result;
+
+    result = codec_set_clock(CODEC_FIXED_RATE);
+    if (result != RT_EOK)
+        return result;
+
+    if (sr == CODEC_FIXED_RATE)
+    {
+        codec_resampler_flush();
+        codec.rs_active = RT_FALSE;
+        return RT_EOK;
+    }
+
+    /* a new track at the same rate keeps the history */
+    if (codec.rs_active && codec.resampler.in_rate == sr)
+        return RT_EOK;
+
+    codec_resampler_flush();
+    codec.rs_active = RT_FALSE;
+    audio_resampler_deinit(&codec.resampler);
+
+    if (codec.rs_pool == RT_NULL)
+    {
+        /* the output blocks are read by DMA */
+        codec.rs_pool = mem_region_malloc(MEM_REGION_DMA,
+            CODEC_RS_BLOCKS * (CODEC_RS_BLOCK_SIZE + sizeof(rt_uint8_t*)));
+        if (codec.rs_pool == RT_NULL)
+            return codec_set_clock(sr);
+
+        rt_mp_init(&codec.rs_mp, "codec_rs", codec.rs_pool,
+                   CODEC_RS_BLOCKS * (CODEC_RS_BLOCK_SIZE + sizeof(rt_uint8_t*)),
+                   CODEC_RS_BLOCK_SIZE);
+    }
+
+    /* the resampler can not take this rate: let the codec follow it */
+    if (audio_resampler_init(&codec.resampler, sr, CODEC_FIXED_RATE,
+                             codec.rs_quality) != RT_EOK)
+        return codec_set_clock(sr);
+
+    codec.rs_active = RT_TRUE;
+    return RT_EOK;
+}
+
+rt_err_t sample_rate(int sr)
+{
+    codec.stream_rate = sr;
+
+    if (codec.rs_quality == AUDIO_RESAMPLE_OFF)
+        return codec_set_clock(sr);
+
+    return codec_resampler_rate(sr);
+}
+
+/* AUDIO_RESAMPLE_OFF .. AUDIO_RESAMPLE_HIGH */
+rt_err_t resample(int quality)
+{
+    if (quality < AUDIO_RESAMPLE_OFF || quality > AUDIO_RESAMPLE_HIGH)
+        return -RT_ERROR;
+    if (quality == codec.rs_quality)
+        return RT_EOK;
+
+    codec_resampler_drain();
+    codec.rs_active = RT_FALSE;
+    audio_resampler_deinit(&codec.resampler);
+
+    if (quality == AUDIO_RESAMPLE_OFF && codec.rs_pool != RT_NULL)
+    {
+        rt_mp_detach(&codec.rs_mp);
+        mem_region_free(codec.rs_pool);
+        codec.rs_pool = RT_NULL;
+    }
+    codec.rs_quality = quality;
+
+    /* set up the stream being played again */
+    if (codec.stream_rate != 0)
+        return sample_rate(codec.stream_rate);
 
     return RT_EOK;
 }
@@ -403,10 +561,13 @@ FINSH_FUNCTION_EXPORT(eq4, Set EQ4(Center, Gain, Bandwidth));
 FINSH_FUNCTION_EXPORT(eq5, Set EQ5(Cut-off, Gain));
 FINSH_FUNCTION_EXPORT(eq3d, Set 3D(Depth));
 FINSH_FUNCTION_EXPORT(sample_rate, Set sample rate);
+FINSH_FUNCTION_EXPORT(resample, Set resampler quality(0: off - 3: high));
 #endif
 
 static rt_err_t codec_open(rt_device_t dev, rt_uint16_t oflag)
 {
+    codec.played = 0;
+
 #if !CODEC_MASTER_MODE
     /* enable I2S */
     I2S_Cmd(CODEC_I2S_PORT, ENABLE);
@@ -417,6 +578,11 @@ static rt_err_t codec_open(rt_device_t dev, rt_uint16_t oflag)
 
 static rt_err_t codec_close(rt_device_t dev)
 {
+    /* the caller got its buffers back already, play the converted tail */
+    codec_resampler_drain();
+    if (codec.rs_active)
+        audio_resampler_reset(&codec.resampler);
+
 #if CODEC_MASTER_MODE
     if (r06 & MS)
     {
@@ -439,7 +605,10 @@ static rt_err_t codec_close(rt_device_t dev)
 
             while (codec.read_index != codec.put_index)
             {
-                codec.parent.tx_complete(&codec.parent, codec.data_list[codec.read_index].data_ptr);
+                if (codec.data_list[codec.read_index].resampled)
+                    rt_mp_free(codec.data_list[codec.read_index].data_ptr);
+                else
+                    codec.parent.tx_complete(&codec.parent, codec.data_list[codec.read_index].data_ptr);
                 codec.read_index++;
                 if (codec.read_index >= DATA_NODE_MAX)
                 {
@@ -455,9 +624,55 @@ static rt_err_t codec_close(rt_device_t dev)
     return RT_EOK;
 }
 
+/*
+ * The frames of the completed transfers plus what the DMA stream has
+ * moved of the current one, from NDTR. The ISR can not run in between, so
+ * a transfer that just completed is counted once.
+ */
+static void codec_get_position(struct codec_position* pos)
+{
+    struct codec_data_node* node;
+    rt_uint32_t level, left;
+    rt_uint16_t index;
+
+    level = rt_hw_interrupt_disable();
+
+    pos->played = codec.played;
+    pos->queued = codec.rs_fill;
+    for (index = codec.read_index; index != codec.put_index; )
+    {
+        node = &codec.data_list[index];
+        if (index == codec.read_index)
+        {
+            /* the transfer in progress, in half words */
+            left = DMA_GetCurrDataCounter(AUDIO_I2S_DMA_STREAM);
+            if (left > node->data_size)
+                left = node->data_size;
+            /* a frame half way out counts as queued */
+            pos->played += (node->data_size - left) / 2;
+            pos->queued += node->data_size / 2 - (node->data_size - left) / 2;
+        }
+        else
+            pos->queued += node->data_size / 2;
+
+        index ++;
+        if (index >= DATA_NODE_MAX)
+            index = 0;
+    }
+
+    rt_hw_interrupt_enable(level);
+
+    pos->rate = codec_clock;
+    pos->time = 0;
+    if (pos->rate != 0)
+        pos->time = pos->played / pos->rate * 1000 +
+                    (pos->played % pos->rate) * 1000 / pos->rate;
+}
+
 static rt_err_t codec_control(rt_device_t dev, rt_uint8_t cmd, void *args)
 {
     rt_err_t result = RT_EOK;
+    struct codec_position pos;
 
     switch (cmd)
     {
@@ -481,23 +696,32 @@ static rt_err_t codec_control(rt_device_t dev, rt_uint8_t cmd, void *args)
         eq3d(*((uint8_t*) args));
         break;
 
+    case CODEC_CMD_RESAMPLE:
+        result = resample(*((int*) args));
+        break;
+
+    case CODEC_CMD_GET_POSITION:
+        codec_get_position((struct codec_position*) args);
+        break;
+
+    case CODEC_CMD_GET_LATENCY:
+        codec_get_position(&pos);
+        *((int*) args) = (pos.rate != 0) ? pos.queued * 1000 / pos.rate : 0;
+        break;
+
     default:
         result = RT_ERROR;
     }
     return result;
 }
 
-static rt_size_t codec_write(rt_device_t dev, rt_off_t pos,
-                             const void* buffer, rt_size_t size)
+static rt_size_t codec_queue(struct codec_device* device, rt_uint16_t* data,
+                             rt_size_t size, rt_bool_t resampled)
 {
-    struct codec_device* device;
     struct codec_data_node* node;
     rt_uint32_t level;
     rt_uint16_t next_index;
 
-    device = (struct codec_device*) dev;
-    RT_ASSERT(device != RT_NULL);
-
     next_index = device->put_index + 1;
     if (next_index >= DATA_NODE_MAX)
         next_index = 0;
@@ -514,8 +738,9 @@ static rt_size_t codec_write(rt_device_t dev, rt_off_t pos,
     device->put_index = next_index;
 
     /* set node attribute */
-    node->data_ptr = (rt_uint16_t*) buffer;
+    node->data_ptr = data;
     node->data_size = size >> 1; /* size is byte unit, convert to half word unit */
+    node->resampled = resampled;
 
     next_index = device->read_index + 1;
     if (next_index >= DATA_NODE_MAX)
@@ -546,6 +771,56 @@ static rt_size_t codec_write(rt_device_t dev, rt_off_t pos,
     return size;
 }
 
+/*
+ * Convert the buffer into the blocks of the resampler pool. The buffer is
+ * handed back through tx_complete right away, the pool blocks the writer
+ * while the data list is full.
+ */
+static rt_size_t codec_write_resampled(struct codec_device* device,
+                                       const void* buffer, rt_size_t size)
+{
+    const rt_int16_t* in = (const rt_int16_t*) buffer;
+    rt_size_t frames = size / 4, taken;
+
+    while (frames > 0)
+    {
+        if (device->rs_block == RT_NULL)
+        {
+            device->rs_block = (rt_uint16_t*) rt_mp_alloc(&device->rs_mp, RT_WAITING_FOREVER);
+            device->rs_fill = 0;
+        }
+
+        taken = frames;
+        device->rs_fill += audio_resampler_process(&device->resampler, in, &taken,
+            (rt_int16_t*) device->rs_block + device->rs_fill * 2,
+            CODEC_RS_BLOCK_SIZE / 4 - device->rs_fill);
+        in += taken * 2;
+        frames -= taken;
+
+        if (device->rs_fill == CODEC_RS_BLOCK_SIZE / 4)
+            codec_resampler_flush();
+    }
+
+    if (device->parent.tx_complete != RT_NULL)
+        device->parent.tx_complete(&device->parent, (void*) buffer);
+
+    return size;
+}
+
+static rt_size_t codec_write(rt_device_t dev, rt_off_t pos,
+                             const void* buffer, rt_size_t size)
+{
+    struct codec_device* device;
+
+    device = (struct codec_device*) dev;
+    RT_ASSERT(device != RT_NULL);
+
+    if (device->rs_active)
+        return codec_write_resampled(device, buffer, size);
+
+    return codec_queue(device, (rt_uint16_t*) buffer, size, RT_FALSE);
+}
+
 rt_err_t codec_hw_init(const char * i2c_bus_device_name)
 {
     struct rt_i2c_bus_device * i2c_device;
@@ -589,6 +864,8 @@ rt_err_t codec_hw_init(const char * i2c_bus_device_name)
     codec.read_index = 0;
     codec.put_index = 0;
 
+    codec.rs_quality = CODEC_RESAMPLE_QUALITY;
+
     /* register the device */
     return rt_device_register(&codec.parent, "snd", RT_DEVICE_FLAG_WRONLY | RT_DEVICE_FLAG_DMA_TX);
 }
@@ -598,6 +875,7 @@ static void codec_dma_isr(void)
     /* switch to next buffer */
     rt_uint16_t next_index;
     void* data_ptr;
+    rt_bool_t resampled;
 
     /* enter interrupt */
     rt_interrupt_enter();
@@ -608,6 +886,8 @@ static void codec_dma_isr(void)
 
     /* save current data pointer */
     data_ptr = codec.data_list[codec.read_index].data_ptr;
+    resampled = codec.data_list[codec.read_index].resampled;
+    codec.played += codec.data_list[codec.read_index].data_size / 2;
 
 #if !CODEC_MASTER_MODE
     if (codec_sr_new)
@@ -654,7 +934,11 @@ static void codec_dma_isr(void)
     } /* codec tx done. */
 
     /* notify transmitted complete. */
-    if (codec.parent.tx_complete != RT_NULL)
+    if (resampled)
+    {
+        rt_mp_free(data_ptr);
+    }
+    else if (codec.parent.tx_complete != RT_NULL)
     {
         codec.parent.tx_complete(&codec.parent, data_ptr);
     }
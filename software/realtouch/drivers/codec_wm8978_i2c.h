@@ -632,6 +632,9 @@
 #define CODEC_CMD_SAMPLERATE	2
 #define CODEC_CMD_EQ			3
 #define CODEC_CMD_3D			4
+#define CODEC_CMD_RESAMPLE		5	/* int, AUDIO_RESAMPLE_OFF .. AUDIO_RESAMPLE_HIGH */
+#define CODEC_CMD_GET_POSITION	6	/* struct codec_position* */
+#define CODEC_CMD_GET_LATENCY	7	/* int, ms from a write to the speaker */
 
 #define CODEC_VOLUME_MAX		(63)
 
@@ -644,6 +647,15 @@ struct codec_eq_args
 };
 typedef struct codec_eq_args* codec_eq_args_t;
 
+/* playback position since the device was opened */
+struct codec_position
+{
+    uint32_t played;    /* frames gone out, to the DMA transfer in progress */
+    uint32_t queued;    /* frames written and not played yet */
+    uint32_t rate;      /* of played and queued */
+    uint32_t time;      /* played, in ms */
+};
+
 extern rt_err_t codec_hw_init(const char * i2c_bus_device_name);
 
 #endif	// #ifndef __CODEC_H__
@@ -0,0 +1,250 @@
+/*
+ * File      : input_queue.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <rtgui/rtgui_app.h>
+#include <rtgui/rtgui_server.h>
+#include <rtgui/rtgui_system.h>
+
+#include "input_queue.h"
+
+/* the longest a move is held for a busy GUI, then it is sent anyway */
+#define INPUT_HOLD_MAX          (RT_TICK_PER_SECOND / 10)
+
+struct input_entry
+{
+    struct rtgui_event_mouse event;
+    rt_tick_t tick;
+    rt_bool_t move;
+};
+
+static struct
+{
+    struct input_entry entries[INPUT_QUEUE_SIZE];
+    rt_uint16_t head, count;
+
+    /* the button of the last event posted, a press after a press is a move */
+    rt_uint16_t last_button;
+
+    rt_mq_t watched[INPUT_WATCH_MAX];
+
+    struct rt_semaphore sem;
+    struct input_queue_stat stat;
+} _queue;
+
+static rt_bool_t _is_move(struct rtgui_event_mouse *event)
+{
+    if (event->parent.type == RTGUI_EVENT_MOUSE_MOTION)
+        return RT_TRUE;
+
+    return (event->button & RTGUI_MOUSE_BUTTON_DOWN) &&
+           (_queue.last_button & RTGUI_MOUSE_BUTTON_DOWN) &&
+           (event->button == _queue.last_button);
+}
+
+rt_err_t input_queue_post(struct rtgui_event_mouse *event)
+{
+    struct input_entry *tail;
+    rt_bool_t move;
+    rt_err_t result = RT_EOK;
+
+    RT_ASSERT(event != RT_NULL);
+
+    rt_enter_critical();
+    _queue.stat.posted ++;
+    move = _is_move(event);
+    if (event->parent.type == RTGUI_EVENT_MOUSE_BUTTON)
+        _queue.last_button = event->button;
+
+    tail = RT_NULL;
+    if (_queue.count > 0)
+        tail = &_queue.entries[(_queue.head + _queue.count - 1) % INPUT_QUEUE_SIZE];
+
+    if (move && tail != RT_NULL && tail->move &&
+            tail->event.parent.type == event->parent.type &&
+            tail->event.button == event->button && tail->event.wid == event->wid)
+    {
+        /* keep the time of the older sample, it is the one waiting */
+        tail->event.x = event->x;
+        tail->event.y = event->y;
+        _queue.stat.merged ++;
+        rt_exit_critical();
+
+        return RT_EOK;
+    }
+
+    if (_queue.count == INPUT_QUEUE_SIZE)
+    {
+        _queue.stat.dropped ++;
+        result = -RT_EFULL;
+    }
+    else
+    {
+        tail = &_queue.entries[(_queue.head + _queue.count) % INPUT_QUEUE_SIZE];
+        tail->event = *event;
+        tail->tick = rt_tick_get();
+        tail->move = move;
+
+        _queue.count ++;
+        _queue.stat.depth = _queue.count;
+        if (_queue.count > _queue.stat.max_depth)
+            _queue.stat.max_depth = _queue.count;
+    }
+    rt_exit_critical();
+
+    if (result == RT_EOK)
+        rt_sem_release(&_queue.sem);
+
+    return result;
+}
+
+rt_err_t input_queue_watch(rt_mq_t mq)
+{
+    int index;
+    rt_err_t result = -RT_EFULL;
+
+    rt_enter_critical();
+    for (index = 0; index < INPUT_WATCH_MAX; index ++)
+    {
+        if (_queue.watched[index] == mq)
+        {
+            result = RT_EOK;
+            break;
+        }
+    }
+    for (index = 0; result != RT_EOK && index < INPUT_WATCH_MAX; index ++)
+    {
+        if (_queue.watched[index] == RT_NULL)
+        {
+            _queue.watched[index] = mq;
+            result = RT_EOK;
+        }
+    }
+    rt_exit_critical();
+
+    return result;
+}
+
+void input_queue_unwatch(rt_mq_t mq)
+{
+    int index;
+
+    rt_enter_critical();
+    for (index = 0; index < INPUT_WATCH_MAX; index ++)
+    {
+        if (_queue.watched[index] == mq)
+            _queue.watched[index] = RT_NULL;
+    }
+    rt_exit_critical();
+}
+
+/* the server or an application has not taken all events it was sent yet */
+static rt_bool_t _gui_busy(void)
+{
+    rt_thread_t tid;
+    struct rtgui_app *server;
+    rt_bool_t busy = RT_FALSE;
+    int index;
+
+    tid = rtgui_get_server();
+    if (tid != RT_NULL)
+    {
+        server = (struct rtgui_app *)tid->user_data;
+        if (server != RT_NULL && server->mq != RT_NULL && server->mq->entry > 0)
+            return RT_TRUE;
+    }
+
+    rt_enter_critical();
+    for (index = 0; index < INPUT_WATCH_MAX && busy == RT_FALSE; index ++)
+    {
+        if (_queue.watched[index] != RT_NULL && _queue.watched[index]->entry > 0)
+            busy = RT_TRUE;
+    }
+    rt_exit_critical();
+
+    return busy;
+}
+
+static void input_thread_entry(void *parameter)
+{
+    struct input_entry entry;
+    rt_tick_t latency;
+    int wait;
+
+    while (1)
+    {
+        rt_sem_take(&_queue.sem, RT_WAITING_FOREVER);
+
+        /* moves posted meanwhile are merged into the waiting one */
+        for (wait = 0; wait < INPUT_HOLD_MAX && _queue.entries[_queue.head].move &&
+                _gui_busy(); wait ++)
+            rt_thread_delay(1);
+
+        rt_enter_critical();
+        entry = _queue.entries[_queue.head];
+        _queue.head = (_queue.head + 1) % INPUT_QUEUE_SIZE;
+        _queue.count --;
+        _queue.stat.depth = _queue.count;
+        rt_exit_critical();
+
+        rtgui_server_post_event(&entry.event.parent, sizeof(struct rtgui_event_mouse));
+
+        latency = rt_tick_get() - entry.tick;
+        rt_enter_critical();
+        _queue.stat.delivered ++;
+        _queue.stat.latency_sum += latency;
+        if (latency > _queue.stat.latency_max)
+            _queue.stat.latency_max = latency;
+        rt_exit_critical();
+    }
+}
+
+rt_err_t input_queue_init(void)
+{
+    rt_thread_t tid;
+
+    rt_sem_init(&_queue.sem, "input", 0, RT_IPC_FLAG_FIFO);
+
+    tid = rt_thread_create("input", input_thread_entry, RT_NULL,
+                           1024, RTGUI_SVR_THREAD_PRIORITY - 1, 1);
+    if (tid == RT_NULL)
+        return -RT_ENOMEM;
+    rt_thread_startup(tid);
+
+    return RT_EOK;
+}
+
+void input_queue_get_stat(struct input_queue_stat *stat)
+{
+    rt_enter_critical();
+    *stat = _queue.stat;
+    rt_exit_critical();
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void iqueue(void)
+{
+    struct input_queue_stat stat;
+
+    input_queue_get_stat(&stat);
+    rt_kprintf("posted %d, delivered %d, merged %d, dropped %d\n",
+               stat.posted, stat.delivered, stat.merged, stat.dropped);
+    rt_kprintf("depth %d, max depth %d\n", stat.depth, stat.max_depth);
+    rt_kprintf("latency avg %d, max %d ticks\n",
+               stat.delivered ? stat.latency_sum / stat.delivered : 0,
+               stat.latency_max);
+}
+FINSH_FUNCTION_EXPORT(iqueue, show touch events queued for the server);
+#endif
@@ -0,0 +1,61 @@
+/*
+ * File      : input_queue.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#ifndef __INPUT_QUEUE_H__
+#define __INPUT_QUEUE_H__
+
+#include <rtthread.h>
+#include <rtgui/event.h>
+
+/*
+ * Mouse events on their way from the touch screen to the RTGUI server.
+ *
+ * The touch thread samples far more often than a busy server and its
+ * applications take events, so a pen move is held here while the server
+ * or one of the watched applications still has events pending. A move
+ * queued behind another move of the same button and window takes its
+ * place: only the newest position is sent, with the time of the oldest
+ * sample. Presses and releases are never merged and keep their order.
+ *
+ * The window manager watches the queue of each application it is told
+ * about, the server passes mouse events on to them without looking at
+ * how far behind they are.
+ */
+#define INPUT_QUEUE_SIZE        16
+#define INPUT_WATCH_MAX         8
+
+struct input_queue_stat
+{
+    rt_uint32_t posted;         /* events handed to input_queue_post() */
+    rt_uint32_t delivered;      /* events sent to the server */
+    rt_uint32_t merged;         /* moves replaced by a newer one */
+    rt_uint32_t dropped;        /* events lost on a full queue */
+
+    rt_uint16_t depth;          /* events waiting now */
+    rt_uint16_t max_depth;
+
+    rt_uint32_t latency_sum;    /* ticks from post to delivery, all events */
+    rt_uint32_t latency_max;
+};
+
+rt_err_t input_queue_init(void);
+rt_err_t input_queue_post(struct rtgui_event_mouse *event);
+
+/* hold moves while mq has events pending */
+rt_err_t input_queue_watch(rt_mq_t mq);
+void input_queue_unwatch(rt_mq_t mq);
+
+void input_queue_get_stat(struct input_queue_stat *stat);
+
+#endif
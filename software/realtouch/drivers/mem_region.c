@@ -0,0 +1,239 @@
+/*
+ * File      : mem_region.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-12     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include "board.h"
+#include "mem_region.h"
+
+/*
+ * The board has three RAMs with very different properties:
+ *  - CCM, 64K at 0x10000000: zero wait state, D-bus only, no DMA access.
+ *  - internal SRAM, 128K at 0x20000000: zero wait state, DMA capable.
+ *  - external SRAM, 1M at 0x60000000: 16-bit FSMC, several wait states.
+ *
+ * The system heap (rt_malloc) keeps living in the external SRAM, the two
+ * internal RAMs are managed as memheaps and reached through the placement
+ * hints of mem_region_malloc().
+ */
+struct mem_region
+{
+    struct rt_memheap *heap;    /* RT_NULL means the region is the system heap */
+    rt_uint32_t begin, end;
+
+    struct mem_region_stat stat;
+};
+
+static struct rt_memheap _ccm_heap;
+#if STM32_EXT_SRAM
+static struct rt_memheap _sram_heap;
+#endif
+static struct mem_region _regions[MEM_REGION_MAX];
+
+/* search order for each kind of hint, terminated with MEM_REGION_MAX */
+static const rt_uint8_t _fast_order[] = {MEM_REGION_CCM, MEM_REGION_SRAM, MEM_REGION_EXT, MEM_REGION_MAX};
+static const rt_uint8_t _dma_order[]  = {MEM_REGION_SRAM, MEM_REGION_EXT, MEM_REGION_MAX};
+static const rt_uint8_t _bulk_order[] = {MEM_REGION_EXT, MEM_REGION_SRAM, MEM_REGION_CCM, MEM_REGION_MAX};
+
+static void _region_setup(enum mem_region_id id, const char *name,
+                          struct rt_memheap *heap, void *begin, void *end)
+{
+    struct mem_region *region = &_regions[id];
+
+    region->heap  = heap;
+    region->begin = RT_ALIGN((rt_uint32_t)begin, RT_ALIGN_SIZE);
+    region->end   = RT_ALIGN_DOWN((rt_uint32_t)end, RT_ALIGN_SIZE);
+
+    region->stat.name  = name;
+    region->stat.total = region->end - region->begin;
+
+    if (heap != RT_NULL)
+        rt_memheap_init(heap, name, (void *)region->begin, region->stat.total);
+}
+
+/**
+ * This function initializes the memory regions. It must be called after
+ * rt_system_heap_init() and before any thread uses mem_region_malloc().
+ *
+ * @param sram_begin the first free byte of internal SRAM, after .bss
+ * @param sram_end the end of internal SRAM
+ */
+void rt_hw_mem_region_init(void *sram_begin, void *sram_end)
+{
+    rt_memset(_regions, 0, sizeof(_regions));
+
+    _region_setup(MEM_REGION_CCM, "ccm", &_ccm_heap,
+                  (void *)STM32_CCM_BEGIN, (void *)STM32_CCM_END);
+#if STM32_EXT_SRAM
+    _region_setup(MEM_REGION_SRAM, "sram", &_sram_heap, sram_begin, sram_end);
+    _region_setup(MEM_REGION_EXT, "extsram", RT_NULL,
+                  (void *)STM32_EXT_SRAM_BEGIN, (void *)STM32_EXT_SRAM_END);
+#else
+    /* no external SRAM: internal SRAM is the system heap */
+    _region_setup(MEM_REGION_SRAM, "sram", RT_NULL, sram_begin, sram_end);
+#endif
+}
+
+static void *_region_alloc(struct mem_region *region, rt_size_t size)
+{
+    void *ptr;
+    rt_uint32_t used, total, max_used;
+
+    if (region->stat.total == 0)
+        return RT_NULL;
+
+    if (region->heap == RT_NULL)
+    {
+        ptr = rt_malloc(size);
+        rt_memory_info(&total, &used, &max_used);
+    }
+    else
+    {
+        rt_enter_critical();
+        ptr = rt_memheap_alloc(region->heap, size);
+        used = region->heap->pool_size - region->heap->available_size;
+        rt_exit_critical();
+    }
+
+    if (ptr == RT_NULL)
+    {
+        region->stat.fail_count ++;
+        return RT_NULL;
+    }
+
+    region->stat.alloc_count ++;
+    region->stat.used = used;
+    if (used > region->stat.max_used)
+        region->stat.max_used = used;
+
+    return ptr;
+}
+
+/**
+ * This function allocates a memory block from the region which matches the
+ * placement hint best.
+ *
+ * @param hint MEM_REGION_FAST, MEM_REGION_DMA or MEM_REGION_BULK. FAST and
+ *        DMA may be combined to request DMA capable zero wait state memory.
+ * @param size the size of memory block
+ *
+ * @return the allocated memory block, RT_NULL on failure
+ */
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size)
+{
+    const rt_uint8_t *order;
+    void *ptr;
+
+    if (hint & MEM_REGION_DMA)
+        order = _dma_order;
+    else if (hint & MEM_REGION_FAST)
+        order = _fast_order;
+    else
+        order = _bulk_order;
+
+    for (; *order != MEM_REGION_MAX; order ++)
+    {
+        ptr = _region_alloc(&_regions[*order], size);
+        if (ptr != RT_NULL)
+            return ptr;
+    }
+
+    return RT_NULL;
+}
+
+void *mem_region_calloc(rt_uint32_t hint, rt_size_t count, rt_size_t size)
+{
+    void *ptr;
+
+    ptr = mem_region_malloc(hint, count * size);
+    if (ptr != RT_NULL)
+        rt_memset(ptr, 0, count * size);
+
+    return ptr;
+}
+
+/**
+ * This function releases a memory block allocated by mem_region_malloc().
+ *
+ * @param ptr the memory block, RT_NULL is ignored
+ */
+void mem_region_free(void *ptr)
+{
+    struct mem_region *region;
+    rt_uint32_t addr = (rt_uint32_t)ptr;
+
+    if (ptr == RT_NULL)
+        return;
+
+    for (region = &_regions[0]; region < &_regions[MEM_REGION_MAX]; region ++)
+    {
+        if (addr < region->begin || addr >= region->end)
+            continue;
+
+        if (region->heap == RT_NULL)
+        {
+            rt_free(ptr);
+        }
+        else
+        {
+            rt_enter_critical();
+            rt_memheap_free(ptr);
+            region->stat.used = region->heap->pool_size - region->heap->available_size;
+            rt_exit_critical();
+        }
+        return;
+    }
+
+    /* not from any region, give it to the system heap */
+    rt_free(ptr);
+}
+
+rt_err_t mem_region_stat(enum mem_region_id id, struct mem_region_stat *stat)
+{
+    if (id >= MEM_REGION_MAX || stat == RT_NULL)
+        return -RT_ERROR;
+
+    *stat = _regions[id].stat;
+    if (_regions[id].heap == RT_NULL && stat->total != 0)
+    {
+        rt_uint32_t total;
+
+        /* the system heap is also used by plain rt_malloc */
+        rt_memory_info(&total, &stat->used, &stat->max_used);
+    }
+
+    return RT_EOK;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void list_mem_region(void)
+{
+    int index;
+    struct mem_region_stat stat;
+
+    rt_kprintf("region   total    used     max used alloc    fail\n");
+    rt_kprintf("-------- -------- -------- -------- -------- --------\n");
+    for (index = 0; index < MEM_REGION_MAX; index ++)
+    {
+        mem_region_stat((enum mem_region_id)index, &stat);
+        if (stat.total == 0)
+            continue;
+
+        rt_kprintf("%-8s %-8d %-8d %-8d %-8d %-8d\n", stat.name,
+                   stat.total, stat.used, stat.max_used,
+                   stat.alloc_count, stat.fail_count);
+    }
+}
+FINSH_FUNCTION_EXPORT(list_mem_region, list memory region usage);
+#endif
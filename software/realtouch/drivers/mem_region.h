@@ -0,0 +1,64 @@
+/*
+ * File      : mem_region.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-12     realtouch    first version
+ */
+
+#ifndef __MEM_REGION_H__
+#define __MEM_REGION_H__
+
+#include <rtthread.h>
+
+/*
+ * Placement hints for mem_region_malloc().
+ *
+ * FAST: CPU-only data on the hot path, CCM first, then internal SRAM.
+ * DMA : buffers touched by a DMA stream; never placed in CCM (the DMA
+ *       controllers and the ETH/OTG masters can not reach it).
+ * BULK: large or rarely touched objects, placed in external SRAM.
+ *
+ * When the preferred region is exhausted the allocator falls back to the
+ * next region that still satisfies the hint.
+ */
+#define MEM_REGION_FAST         0x01
+#define MEM_REGION_DMA          0x02
+#define MEM_REGION_BULK         0x04
+
+enum mem_region_id
+{
+    MEM_REGION_CCM = 0,         /* 64K core coupled memory, 0x10000000 */
+    MEM_REGION_SRAM,            /* internal SRAM1/SRAM2 after .bss     */
+    MEM_REGION_EXT,             /* external SRAM on FSMC (system heap) */
+
+    MEM_REGION_MAX
+};
+
+struct mem_region_stat
+{
+    const char *name;
+
+    rt_uint32_t total;          /* size of the region in bytes */
+    rt_uint32_t used;           /* bytes in use, including block headers */
+    rt_uint32_t max_used;       /* high water mark of used */
+
+    rt_uint32_t alloc_count;    /* successful allocations */
+    rt_uint32_t fail_count;     /* allocations this region could not satisfy */
+};
+
+void rt_hw_mem_region_init(void *sram_begin, void *sram_end);
+
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size);
+void *mem_region_calloc(rt_uint32_t hint, rt_size_t count, rt_size_t size);
+void mem_region_free(void *ptr);
+
+rt_err_t mem_region_stat(enum mem_region_id id, struct mem_region_stat *stat);
+
+#endif
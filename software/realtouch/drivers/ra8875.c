@@ -2,6 +2,11 @@
 #include <rtgui/driver.h>
 #include "ra8875.h"
 
+#ifdef USE_SHADOW_FRAMEBUFFER
+#include <rtgui/region.h>
+#include "mem_region.h"
+#endif
+
 /********* control ***********/
 #include "board.h"
 
@@ -138,13 +143,19 @@ static void LCD_FSMCConfig(void)
           - Data Width = 16bit
           - Write Operation = Enable
           - Extended Mode = Enable
-          - Asynchronous Wait = Disable */
+          - Asynchronous Wait = Disable
+            (Enable with the shadow framebuffer: the flush DMA can not poll
+             LCD_busy, so NWAIT holds off the FSMC instead) */
     FSMC_NORSRAMInitStructure.FSMC_Bank = FSMC_Bank1_NORSRAM4;
     FSMC_NORSRAMInitStructure.FSMC_DataAddressMux = FSMC_DataAddressMux_Disable;
     FSMC_NORSRAMInitStructure.FSMC_MemoryType = FSMC_MemoryType_SRAM;
     FSMC_NORSRAMInitStructure.FSMC_MemoryDataWidth = FSMC_MemoryDataWidth_16b;
     FSMC_NORSRAMInitStructure.FSMC_BurstAccessMode = FSMC_BurstAccessMode_Disable;
+#ifdef USE_SHADOW_FRAMEBUFFER
+    FSMC_NORSRAMInitStructure.FSMC_AsynchronousWait = FSMC_AsynchronousWait_Enable;
+#else
     FSMC_NORSRAMInitStructure.FSMC_AsynchronousWait = FSMC_AsynchronousWait_Disable;
+#endif
     FSMC_NORSRAMInitStructure.FSMC_WaitSignalPolarity = FSMC_WaitSignalPolarity_Low;
     FSMC_NORSRAMInitStructure.FSMC_WrapMode = FSMC_WrapMode_Disable;
     FSMC_NORSRAMInitStructure.FSMC_WaitSignalActive = FSMC_WaitSignalActive_BeforeWaitState;
@@ -317,6 +328,19 @@ static void _set_write_cursor(uint32_t X, uint32_t Y)
     LCD_DataWrite(Y);
 }
 
+static void _set_active_window(uint32_t X1, uint32_t Y1, uint32_t X2, uint32_t Y2)
+{
+    LCD_write_reg(HSAW1, X1>>8);
+    LCD_write_reg(HSAW0, X1);
+    LCD_write_reg(VSAW1, Y1>>8);
+    LCD_write_reg(VSAW0, Y1);
+
+    LCD_write_reg(HEAW1, X2>>8);
+    LCD_write_reg(HEAW0, X2);
+    LCD_write_reg(VEAW1, Y2>>8);
+    LCD_write_reg(VEAW0, Y2);
+}
+
 static void _set_read_cursor(uint32_t X, uint32_t Y)
 {
     LCD_CmdWrite(RCURH1);
@@ -399,7 +423,7 @@ static void _set_mouse_image(const uint8_t *mouse_img)
     uint32_t i, j;
     LCD_write_reg(GCC0, 0xFF);
     LCD_write_reg(GCC1, 0x00);
-    LCD_write_reg(MWCR1,  2 << 2);
+    LCD_write_reg(MWCR1,  MWCR1_WRITE_CURSOR);
 
     _set_write_cursor(0, 0);
     LCD_CmdWrite(MRWC);
@@ -765,8 +789,602 @@ static const struct rtgui_graphic_ext_ops ra8875_ext_ops =
     draw_ellipse,
     fill_ellipse,
 };
+
+/* BTE, the engine is shared with the drawing functions above */
+static rt_err_t _bte_acquire(void)
+{
+    rt_uint32_t e;
+
+    if(ra8875_is_ready())
+    {
+        /* if RA8875 is ready, clear ready flag. */
+        rt_event_recv(&ra8875_event,
+                      RA8875_EVENT_READY,
+                      RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR,
+                      RT_WAITING_NO,
+                      &e);
+        return RT_EOK;
+    }
+
+    /* if RA8875 is busy, wait it. */
+    return rt_event_recv(&ra8875_event,
+                         RA8875_EVENT_READY,
+                         RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR,
+                         2,
+                         &e);
+}
+
+static void _bte_release(void)
+{
+    uint16_t status;
+
+    do
+    {
+        _wait_bus_ready();
+        status = LCD_CMD;
+    }
+    while(status & STSR_BTE_BUSY);
+
+    rt_event_send(&ra8875_event, RA8875_EVENT_READY);
+}
+
+static int _bte_area_valid(int x, int y, int width, int height)
+{
+    return (width > 0 && height > 0 &&
+            x + width <= 800 && y + height <= 480);
+}
+
+static void _bte_set_source(uint32_t X, uint32_t Y)
+{
+    LCD_write_reg(HSBE1, X>>8);
+    LCD_write_reg(HSBE0, X);
+    LCD_write_reg(VSBE1, (Y>>8) & 0x01); /* [7] layer 1 */
+    LCD_write_reg(VSBE0, Y);
+}
+
+static void _bte_set_dest(uint32_t X, uint32_t Y)
+{
+    LCD_write_reg(HDBE1, X>>8);
+    LCD_write_reg(HDBE0, X);
+    LCD_write_reg(VDBE1, (Y>>8) & 0x01);
+    LCD_write_reg(VDBE0, Y);
+}
+
+static void _bte_set_size(uint32_t width, uint32_t height)
+{
+    LCD_write_reg(BEWR1, width>>8);
+    LCD_write_reg(BEWR0, width);
+    LCD_write_reg(BEHR1, height>>8);
+    LCD_write_reg(BEHR0, height);
+}
+
+static void _bte_start(uint8_t operation, uint8_t rop)
+{
+    LCD_write_reg(BECR1, (rop << 4) | operation);
+    LCD_write_reg(BECR0, BECR0_BTE_ENABLE);
+}
+
+static rt_err_t bte_fill(const struct ra8875_bte_fill *fill)
+{
+    if (!_bte_area_valid(fill->x, fill->y, fill->width, fill->height))
+        return -RT_ERROR;
+    if (_bte_acquire() != RT_EOK)
+        return -RT_EBUSY;
+
+    _bte_set_dest(fill->x, fill->y);
+    _bte_set_size(fill->width, fill->height);
+    _set_fore_color(fill->color);
+    _bte_start(BECR1_SOLID_FILL, 0);
+
+    _bte_release();
+    return RT_EOK;
+}
+
+static rt_err_t bte_move(const struct ra8875_bte_move *move)
+{
+    uint32_t sx, sy, dx, dy;
+    uint8_t operation;
+
+    if (!_bte_area_valid(move->src_x, move->src_y, move->width, move->height) ||
+            !_bte_area_valid(move->dst_x, move->dst_y, move->width, move->height))
+        return -RT_ERROR;
+    if (_bte_acquire() != RT_EOK)
+        return -RT_EBUSY;
+
+    sx = move->src_x;
+    sy = move->src_y;
+    dx = move->dst_x;
+    dy = move->dst_y;
+
+    /* when the destination follows the source in scan order an overlapping
+     * copy has to run backwards, starting at the bottom right corner. */
+    if (dy > sy || (dy == sy && dx > sx))
+    {
+        sx += move->width - 1;
+        sy += move->height - 1;
+        dx += move->width - 1;
+        dy += move->height - 1;
+        operation = BECR1_MOVE_NEGATIVE_ROP;
+    }
+    else
+    {
+        operation = BECR1_MOVE_POSITIVE_ROP;
+    }
+
+    _bte_set_source(sx, sy);
+    _bte_set_dest(dx, dy);
+    _bte_set_size(move->width, move->height);
+    _bte_start(operation, move->rop);
+
+    _bte_release();
+    return RT_EOK;
+}
+
+static rt_err_t bte_pattern(const struct ra8875_bte_pattern *pattern)
+{
+    if (!_bte_area_valid(pattern->x, pattern->y, pattern->width, pattern->height))
+        return -RT_ERROR;
+    if (_bte_acquire() != RT_EOK)
+        return -RT_EBUSY;
+
+    LCD_write_reg(PTNO, 0x00); /* [7] 8x8, [3:0] pattern 0 */
+    if (pattern->pattern != RT_NULL)
+    {
+        const rt_uint16_t *ptr = pattern->pattern;
+        uint8_t mwcr1;
+        int i;
+
+        /* redirect memory write to the pattern RAM, from its first pixel */
+        mwcr1 = LCD_read_reg(MWCR1);
+        LCD_write_reg(MWCR1, (mwcr1 & ~MWCR1_WRITE_MASK) | MWCR1_WRITE_PATTERN);
+        LCD_write_reg(MWCR0, 0x00);
+        _set_write_cursor(0, 0);
+        LCD_CmdWrite(MRWC);
+        for (i = 0; i < 8 * 8; i++)
+        {
+            LCD_DataWrite(*ptr++);
+        }
+        LCD_write_reg(MWCR1, mwcr1);
+    }
+
+    /* source is the pattern number */
+    _bte_set_source(0, 0);
+    _bte_set_dest(pattern->x, pattern->y);
+    _bte_set_size(pattern->width, pattern->height);
+    _bte_start(BECR1_PATTERN_FILL_ROP, pattern->rop);
+
+    _bte_release();
+    return RT_EOK;
+}
+
+static rt_err_t bte_write_transparent(const struct ra8875_bte_write *write)
+{
+    const rt_uint16_t *ptr;
+    rt_uint32_t count;
+
+    if (!_bte_area_valid(write->x, write->y, write->width, write->height))
+        return -RT_ERROR;
+    if (_bte_acquire() != RT_EOK)
+        return -RT_EBUSY;
+
+    _bte_set_dest(write->x, write->y);
+    _bte_set_size(write->width, write->height);
+    /* the foreground color is the transparent key */
+    _set_fore_color(write->transparent);
+    _bte_start(BECR1_WRITE_TRANSPARENT, 0);
+
+    LCD_CmdWrite(MRWC);
+    ptr = write->pixels;
+    for (count = write->width * write->height; count > 0; count--)
+    {
+        LCD_DataWrite(*ptr++);
+    }
+
+    _bte_release();
+    return RT_EOK;
+}
+#else
+void ra8875_nwait_isr(void)
+{
+    /* EXTI6 is only enabled for the drawing engine. */
+}
 #endif /* USE_DRAW_FUNCTION */
 
+#ifdef USE_SHADOW_FRAMEBUFFER
+/*
+ * Shadow framebuffer.
+ *
+ * RTGUI draws into a 800x480 RGB565 copy of the panel in external SRAM and
+ * reports every finished drawing with RTGRAPHIC_CTRL_RECT_UPDATE. The
+ * reported rectangles are merged into a dirty region, and the flush thread
+ * pushes the merged rectangles to the RA8875 once per frame period, so a
+ * widget redrawn several times within one period reaches the panel once.
+ * The dirty region is only touched once a drawing, the pixel operations
+ * below write the framebuffer and nothing else: their users must report
+ * what they drew with RTGRAPHIC_CTRL_RECT_UPDATE, as RTGUI does.
+ *
+ * Each rectangle is sent through an active window of the same size: the
+ * write cursor is set once and the RA8875 wraps it at the window edge, the
+ * rows are copied by a DMA2 memory-to-memory stream into the FSMC data
+ * address.
+ */
+#define LCD_WIDTH               800
+#define LCD_HEIGHT              480
+
+#define FLUSH_PERIOD            (RT_TICK_PER_SECOND / 50)
+#define FLUSH_DMA_MIN           16      /* shorter spans are written by CPU */
+#define FLUSH_DMA_MAX           0xFFFF  /* NDTR is 16 bits */
+
+#define FLUSH_DMA_STREAM        DMA2_Stream4
+#define FLUSH_DMA_CHANNEL       DMA_Channel_0
+#define FLUSH_DMA_IRQ           DMA2_Stream4_IRQn
+#define FLUSH_DMA_IT_TC         DMA_IT_TCIF4
+#define FLUSH_DMA_IT_TE         DMA_IT_TEIF4
+
+static rt_uint16_t *_framebuffer = RT_NULL;
+
+static rtgui_region_t _dirty_region;
+static rt_bool_t _flush_pending;
+static struct rt_mutex _dirty_lock;
+static struct rt_semaphore _flush_sem;
+
+/* serialize the register/data accesses of flush thread and cursor */
+static struct rt_mutex _bus_lock;
+static struct rt_semaphore _dma_sem;
+
+static struct
+{
+    rt_uint32_t count;          /* flushes done */
+    rt_uint32_t rects;          /* rectangles pushed */
+    rt_uint32_t pixels;         /* pixels pushed */
+    rt_uint32_t last_us;        /* duration of the last flush */
+    rt_uint32_t max_us;         /* longest flush */
+} _flush_stat;
+
+void DMA2_Stream4_IRQHandler(void)
+{
+    /* enter interrupt */
+    rt_interrupt_enter();
+
+    if (DMA_GetITStatus(FLUSH_DMA_STREAM, FLUSH_DMA_IT_TC) ||
+            DMA_GetITStatus(FLUSH_DMA_STREAM, FLUSH_DMA_IT_TE))
+    {
+        DMA_ClearITPendingBit(FLUSH_DMA_STREAM, FLUSH_DMA_IT_TC | FLUSH_DMA_IT_TE);
+        rt_sem_release(&_dma_sem);
+    }
+
+    /* leave interrupt */
+    rt_interrupt_leave();
+}
+
+static void _flush_dma_init(void)
+{
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+    DMA_DeInit(FLUSH_DMA_STREAM);
+
+    NVIC_InitStructure.NVIC_IRQChannel = FLUSH_DMA_IRQ;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+static void _flush_dma_copy(const rt_uint16_t *src, rt_uint32_t count)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+    /* memory-to-memory: the peripheral port is the source */
+    DMA_InitStructure.DMA_Channel = FLUSH_DMA_CHANNEL;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)src;
+    DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)&LCD_DATA;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToMemory;
+    DMA_InitStructure.DMA_BufferSize = count;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Disable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+    /* direct mode is not allowed for memory-to-memory */
+    DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Enable;
+    DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+    DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+    DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+
+    DMA_Init(FLUSH_DMA_STREAM, &DMA_InitStructure);
+    DMA_ITConfig(FLUSH_DMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+    DMA_Cmd(FLUSH_DMA_STREAM, ENABLE);
+
+    rt_sem_take(&_dma_sem, RT_WAITING_FOREVER);
+    DMA_Cmd(FLUSH_DMA_STREAM, DISABLE);
+}
+
+static void _flush_span(const rt_uint16_t *src, rt_uint32_t count)
+{
+    rt_uint32_t length;
+
+    if (count < FLUSH_DMA_MIN)
+    {
+        while (count--)
+            LCD_DataWrite(*src++);
+        return;
+    }
+
+    while (count > 0)
+    {
+        length = count > FLUSH_DMA_MAX ? FLUSH_DMA_MAX : count;
+        _flush_dma_copy(src, length);
+
+        src   += length;
+        count -= length;
+    }
+}
+
+/* push one rectangle of the shadow framebuffer, the caller holds _bus_lock */
+static void _flush_rect(const rtgui_rect_t *rect)
+{
+    const rt_uint16_t *src;
+    int width, height;
+
+    width  = rect->x2 - rect->x1;
+    height = rect->y2 - rect->y1;
+    if (width <= 0 || height <= 0)
+        return;
+
+    _set_active_window(rect->x1, rect->y1, rect->x2 - 1, rect->y2 - 1);
+    LCD_write_reg(MWCR0, 0x00);
+    _set_write_cursor(rect->x1, rect->y1);
+    LCD_CmdWrite(MRWC);
+
+    src = _framebuffer + rect->y1 * LCD_WIDTH + rect->x1;
+    if (width == LCD_WIDTH)
+    {
+        /* full rows are contiguous in the framebuffer */
+        _flush_span(src, width * height);
+    }
+    else
+    {
+        for (; height > 0; height --)
+        {
+            _flush_span(src, width);
+            src += LCD_WIDTH;
+        }
+    }
+
+    _flush_stat.rects ++;
+    _flush_stat.pixels += (rect->x2 - rect->x1) * (rect->y2 - rect->y1);
+}
+
+static void _flush_region(rtgui_region_t *region)
+{
+    rtgui_rect_t *rects;
+    int index, count;
+    rt_uint32_t begin, duration;
+
+    count = rtgui_region_num_rects(region);
+    if (count == 0)
+        return;
+    rects = rtgui_region_rects(region);
+
+    rt_mutex_take(&_bus_lock, RT_WAITING_FOREVER);
+    begin = rt_hw_tick_get_microsecond();
+
+    for (index = 0; index < count; index ++)
+        _flush_rect(&rects[index]);
+
+    _set_active_window(0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1);
+
+    duration = rt_hw_tick_get_microsecond() - begin;
+    rt_mutex_release(&_bus_lock);
+
+    _flush_stat.count ++;
+    _flush_stat.last_us = duration;
+    if (duration > _flush_stat.max_us)
+        _flush_stat.max_us = duration;
+}
+
+static void _fb_mark_dirty(int x1, int y1, int x2, int y2)
+{
+    rtgui_rect_t rect;
+
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > LCD_WIDTH) x2 = LCD_WIDTH;
+    if (y2 > LCD_HEIGHT) y2 = LCD_HEIGHT;
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    rect.x1 = x1;
+    rect.y1 = y1;
+    rect.x2 = x2;
+    rect.y2 = y2;
+
+    rt_mutex_take(&_dirty_lock, RT_WAITING_FOREVER);
+    rtgui_region_union_rect(&_dirty_region, &_dirty_region, &rect);
+    if (_flush_pending == RT_FALSE)
+    {
+        _flush_pending = RT_TRUE;
+        rt_sem_release(&_flush_sem);
+    }
+    rt_mutex_release(&_dirty_lock);
+}
+
+static void _flush_thread_entry(void *parameter)
+{
+    rtgui_region_t region;
+
+    rtgui_region_init(&region);
+
+    while (1)
+    {
+        rt_sem_take(&_flush_sem, RT_WAITING_FOREVER);
+
+        /* let the updates of one frame period accumulate */
+        rt_thread_delay(FLUSH_PERIOD);
+
+        rt_mutex_take(&_dirty_lock, RT_WAITING_FOREVER);
+        rtgui_region_copy(&region, &_dirty_region);
+        rtgui_region_empty(&_dirty_region);
+        _flush_pending = RT_FALSE;
+        rt_mutex_release(&_dirty_lock);
+
+        _flush_region(&region);
+    }
+}
+
+/* pixel operations on the shadow framebuffer, the dirty area is reported per drawing */
+static void ra8875_fb_set_pixel(const char* pixel, int x, int y)
+{
+    _framebuffer[y * LCD_WIDTH + x] = *(rt_uint16_t *)pixel;
+}
+
+static void ra8875_fb_get_pixel(char* pixel, int x, int y)
+{
+    *(rt_uint16_t *)pixel = _framebuffer[y * LCD_WIDTH + x];
+}
+
+static void ra8875_fb_draw_hline(const char* pixel, int x1, int x2, int y)
+{
+    rt_uint16_t *ptr;
+    int x;
+
+    ptr = _framebuffer + y * LCD_WIDTH + x1;
+    for (x = x1; x < x2; x ++)
+        *ptr++ = *(rt_uint16_t *)pixel;
+}
+
+static void ra8875_fb_draw_vline(const char* pixel, int x, int y1, int y2)
+{
+    rt_uint16_t *ptr;
+    int y;
+
+    ptr = _framebuffer + y1 * LCD_WIDTH + x;
+    for (y = y1; y < y2; y ++)
+    {
+        *ptr = *(rt_uint16_t *)pixel;
+        ptr += LCD_WIDTH;
+    }
+}
+
+static void ra8875_fb_blit_line(const char* pixels, int x, int y, rt_size_t size)
+{
+    rt_memcpy(_framebuffer + y * LCD_WIDTH + x, pixels, size * sizeof(rt_uint16_t));
+}
+
+static const struct rt_device_graphic_ops ra8875_fb_ops =
+{
+    ra8875_fb_set_pixel,
+    ra8875_fb_get_pixel,
+    ra8875_fb_draw_hline,
+    ra8875_fb_draw_vline,
+    ra8875_fb_blit_line
+};
+
+static rt_err_t _shadow_framebuffer_init(void)
+{
+    rt_thread_t tid;
+
+    _framebuffer = (rt_uint16_t *)mem_region_calloc(MEM_REGION_BULK,
+                   LCD_WIDTH * LCD_HEIGHT, sizeof(rt_uint16_t));
+    if (_framebuffer == RT_NULL)
+    {
+        rt_kprintf("[ERR] no memory for LCD shadow framebuffer!\r\n");
+        return -RT_ENOMEM;
+    }
+
+    rtgui_region_init(&_dirty_region);
+    _flush_pending = RT_FALSE;
+    rt_mutex_init(&_dirty_lock, "lcddirty", RT_IPC_FLAG_FIFO);
+    rt_mutex_init(&_bus_lock, "lcdbus", RT_IPC_FLAG_FIFO);
+    rt_sem_init(&_flush_sem, "lcdflush", 0, RT_IPC_FLAG_FIFO);
+    rt_sem_init(&_dma_sem, "lcddma", 0, RT_IPC_FLAG_FIFO);
+
+    _flush_dma_init();
+
+    tid = rt_thread_create("lcdflush", _flush_thread_entry, RT_NULL,
+                           1024, RTGUI_SVR_THREAD_PRIORITY - 1, 10);
+    if (tid == RT_NULL)
+    {
+        mem_region_free(_framebuffer);
+        _framebuffer = RT_NULL;
+        return -RT_ENOMEM;
+    }
+    rt_thread_startup(tid);
+
+    /* the panel content is unknown, clear it with the first flush */
+    _fb_mark_dirty(0, 0, LCD_WIDTH, LCD_HEIGHT);
+
+    return RT_EOK;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void lcd_flush_stat(void)
+{
+    rt_kprintf("flush: %d, rect: %d, pixel: %d\n",
+               _flush_stat.count, _flush_stat.rects, _flush_stat.pixels);
+    rt_kprintf("last: %dus, max: %dus\n", _flush_stat.last_us, _flush_stat.max_us);
+}
+FINSH_FUNCTION_EXPORT(lcd_flush_stat, show LCD shadow framebuffer flush statistics);
+
+/* direct write of a rectangle the way the pixel ops do: cursor per row, CPU copy */
+static void _direct_write_rect(const rtgui_rect_t *rect)
+{
+    const rt_uint16_t *src;
+    int x, y;
+
+    LCD_write_reg(MWCR0, 0x00);
+    for (y = rect->y1; y < rect->y2; y ++)
+    {
+        _set_write_cursor(rect->x1, y);
+        LCD_CmdWrite(MRWC);
+
+        src = _framebuffer + y * LCD_WIDTH + rect->x1;
+        for (x = rect->x1; x < rect->x2; x ++)
+            LCD_DataWrite(*src++);
+    }
+}
+
+static rt_uint32_t _bench_rect(const rtgui_rect_t *rect, rt_bool_t shadow)
+{
+    rt_uint32_t begin, duration;
+
+    rt_mutex_take(&_bus_lock, RT_WAITING_FOREVER);
+    begin = rt_hw_tick_get_microsecond();
+    if (shadow)
+    {
+        _flush_rect(rect);
+        _set_active_window(0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1);
+    }
+    else
+    {
+        _direct_write_rect(rect);
+    }
+    duration = rt_hw_tick_get_microsecond() - begin;
+    rt_mutex_release(&_bus_lock);
+
+    return duration;
+}
+
+void lcd_bench(void)
+{
+    rtgui_rect_t full = {0, 0, LCD_WIDTH, LCD_HEIGHT};
+    rtgui_rect_t part = {100, 100, 300, 148};   /* a list item sized area */
+
+    if (_framebuffer == RT_NULL)
+        return;
+
+    rt_kprintf("full screen: direct %dus, shadow flush %dus\n",
+               _bench_rect(&full, RT_FALSE), _bench_rect(&full, RT_TRUE));
+    rt_kprintf("200x48 rect: direct %dus, shadow flush %dus\n",
+               _bench_rect(&part, RT_FALSE), _bench_rect(&part, RT_TRUE));
+}
+FINSH_FUNCTION_EXPORT(lcd_bench, measure LCD full screen and partial update time);
+#endif /* RT_USING_FINSH */
+#endif /* USE_SHADOW_FRAMEBUFFER */
+
 static rt_err_t lcd_init(rt_device_t dev)
 {
     return RT_EOK;
@@ -797,7 +1415,11 @@ static rt_err_t lcd_control(rt_device_t dev, rt_uint8_t cmd, void *args)
 
         info->bits_per_pixel = 16;
         info->pixel_format = RTGRAPHIC_PIXEL_FORMAT_RGB565P;
+#ifdef USE_SHADOW_FRAMEBUFFER
+        info->framebuffer = (rt_uint8_t *)_framebuffer;
+#else
         info->framebuffer = RT_NULL;
+#endif
         info->width = 800;
         info->height = 480;
 
@@ -816,6 +1438,22 @@ static rt_err_t lcd_control(rt_device_t dev, rt_uint8_t cmd, void *args)
         result = RT_EOK;
     }
     break;
+
+    case RA8875_CTRL_BTE_FILL:
+        result = bte_fill((const struct ra8875_bte_fill *)args);
+        break;
+
+    case RA8875_CTRL_BTE_MOVE:
+        result = bte_move((const struct ra8875_bte_move *)args);
+        break;
+
+    case RA8875_CTRL_BTE_PATTERN:
+        result = bte_pattern((const struct ra8875_bte_pattern *)args);
+        break;
+
+    case RA8875_CTRL_BTE_WRITE_TRANSPARENT:
+        result = bte_write_transparent((const struct ra8875_bte_write *)args);
+        break;
 #endif /* USE_DRAW_FUNCTION */
 
 #ifdef RTGUI_USING_HW_CURSOR
@@ -825,7 +1463,15 @@ static rt_err_t lcd_control(rt_device_t dev, rt_uint8_t cmd, void *args)
 
         if(type == RTGUI_CURSOR_ARROW)
         {
+#ifdef USE_SHADOW_FRAMEBUFFER
+            if (_framebuffer != RT_NULL)
+                rt_mutex_take(&_bus_lock, RT_WAITING_FOREVER);
             _set_mouse_image(cursor_arrow);
+            if (_framebuffer != RT_NULL)
+                rt_mutex_release(&_bus_lock);
+#else
+            _set_mouse_image(cursor_arrow);
+#endif
         }
 
         result = RT_EOK;
@@ -841,14 +1487,37 @@ static rt_err_t lcd_control(rt_device_t dev, rt_uint8_t cmd, void *args)
         x = (value >> 16) & 0xFFFF;
         y = value & 0xFFFF;
 
+#ifdef USE_SHADOW_FRAMEBUFFER
+        if (_framebuffer != RT_NULL)
+            rt_mutex_take(&_bus_lock, RT_WAITING_FOREVER);
         _set_mouse_position(x, y);
+        if (_framebuffer != RT_NULL)
+            rt_mutex_release(&_bus_lock);
+#else
+        _set_mouse_position(x, y);
+#endif
         result = RT_EOK;
     }
     break;
 #endif /* RTGUI_USING_HW_CURSOR */
 
     case RTGRAPHIC_CTRL_RECT_UPDATE:
+#ifdef USE_SHADOW_FRAMEBUFFER
+        if (_framebuffer != RT_NULL)
+        {
+            struct rt_device_rect_info *rect;
+
+            rect = (struct rt_device_rect_info *) args;
+            if (rect == RT_NULL)
+                _fb_mark_dirty(0, 0, LCD_WIDTH, LCD_HEIGHT);
+            else
+                _fb_mark_dirty(rect->x, rect->y,
+                               rect->x + rect->width, rect->y + rect->height);
+        }
+        result = RT_EOK;
+#else
         /* nothong to be done */
+#endif
         break;
 
     default:
@@ -1037,7 +1706,13 @@ static void _lcd_gpio_init(void)
 
     /*RA8875 NWAIT Pin PD6*/
     GPIO_InitStructure.GPIO_Pin = GPIO_Pin_6;
+#ifdef USE_SHADOW_FRAMEBUFFER
+    /* FSMC_NWAIT, the input data register still reflects the pin */
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
+    GPIO_PinAFConfig(GPIOD, GPIO_PinSource6, GPIO_AF_FSMC);
+#else
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN;
+#endif
     GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
     GPIO_InitStructure.GPIO_Speed = GPIO_Speed_2MHz;
     GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
@@ -1161,6 +1836,11 @@ void ra8875_init(void)
     _lcd_device.write = RT_NULL;
 
     _lcd_device.user_data = (void *)&ra8875_ops;
+#ifdef USE_SHADOW_FRAMEBUFFER
+    /* fall back to direct drawing when there is no room for the shadow */
+    if (_shadow_framebuffer_init() == RT_EOK)
+        _lcd_device.user_data = (void *)&ra8875_fb_ops;
+#endif
 
     /* register graphic device driver */
     rt_device_register(&_lcd_device, "lcd",
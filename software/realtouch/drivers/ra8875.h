@@ -5,6 +5,18 @@
 // #define USE_REGISTER_TEST
 // #define USE_GRAM_TEST
 #define USE_DRAW_FUNCTION
+/*
+ * Draw into a shadow framebuffer in external SRAM and flush the dirty
+ * rectangles. Off by default: the framebuffer takes 750K of the 1M system
+ * heap at platform init, and the internet radio net buffer (320K, see
+ * application.c) would no longer fit. Shrink the net buffer to turn it on.
+ */
+// #define USE_SHADOW_FRAMEBUFFER
+
+#ifdef USE_SHADOW_FRAMEBUFFER
+/* the drawing engine writes to the panel behind the shadow framebuffer */
+#undef USE_DRAW_FUNCTION
+#endif
 
 /* RA8875 register list */
 #define PWRR            0x01    /* Power and Display Control Register */
@@ -14,6 +26,15 @@
 #define SFCLR           0x06    /* Serial Flash/ROM CLK Setting Register */
 #define SYSR            0x10    /* System Configuration Register */
 
+#define HSAW0           0x30    /* Horizontal Start Point 0 of Active Window */
+#define HSAW1           0x31    /* Horizontal Start Point 1 of Active Window */
+#define VSAW0           0x32    /* Vertical Start Point 0 of Active Window */
+#define VSAW1           0x33    /* Vertical Start Point 1 of Active Window */
+#define HEAW0           0x34    /* Horizontal End Point 0 of Active Window */
+#define HEAW1           0x35    /* Horizontal End Point 1 of Active Window */
+#define VEAW0           0x36    /* Vertical End Point 0 of Active Window */
+#define VEAW1           0x37    /* Vertical End Point 1 of Active Window */
+
 #define MWCR0           0x40    /* Memory Write Control Register0 */
 #define MWCR1           0x41    /* Memory Write Control Register1 */
 
@@ -24,6 +45,24 @@
 #define CURV0           0x48    /* Memory Write Cursor Vertical Position Register 0 */
 #define CURV1           0x49    /* Memory Write Cursor Vertical Position Register 1 */
 
+#define BECR0           0x50    /* BTE Function Control Register 0 */
+#define BECR1           0x51    /* BTE Function Control Register 1 */
+
+#define HSBE0           0x54    /* Horizontal Source Point 0 of BTE */
+#define HSBE1           0x55    /* Horizontal Source Point 1 of BTE */
+#define VSBE0           0x56    /* Vertical Source Point 0 of BTE */
+#define VSBE1           0x57    /* Vertical Source Point 1 of BTE */
+#define HDBE0           0x58    /* Horizontal Destination Point 0 of BTE */
+#define HDBE1           0x59    /* Horizontal Destination Point 1 of BTE */
+#define VDBE0           0x5A    /* Vertical Destination Point 0 of BTE */
+#define VDBE1           0x5B    /* Vertical Destination Point 1 of BTE */
+#define BEWR0           0x5C    /* BTE Width Register 0 */
+#define BEWR1           0x5D    /* BTE Width Register 1 */
+#define BEHR0           0x5E    /* BTE Height Register 0 */
+#define BEHR1           0x5F    /* BTE Height Register 1 */
+
+#define PTNO            0x66    /* Pattern Set No for BTE */
+
 #define RCURH0          0x4A    /* Memory read Cursor Horizontal Position Register 0 */
 #define RCURH1          0x4B    /* Memory read Cursor Horizontal Position Register 1 */
 #define RCURV0          0x4C    /* Memory read Cursor Vertical Position Register 0 */
@@ -98,6 +137,78 @@
 #define DECR_DRAW3_FILL                         (1<<6)
 #define DECR_DRAW4_ELLIPSE_CIRCLE_SQUARE        (1<<7)
 
+#define STSR_BTE_BUSY                           (1<<6)
+
+#define BECR0_BTE_ENABLE                        (1<<7)
+
+#define BECR1_WRITE_ROP                         0x00
+#define BECR1_MOVE_POSITIVE_ROP                 0x02
+#define BECR1_MOVE_NEGATIVE_ROP                 0x03
+#define BECR1_WRITE_TRANSPARENT                 0x04
+#define BECR1_PATTERN_FILL_ROP                  0x06
+#define BECR1_SOLID_FILL                        0x0C
+
+#define MWCR1_WRITE_LAYER                       (0<<2)
+#define MWCR1_WRITE_CGRAM                       (1<<2)
+#define MWCR1_WRITE_CURSOR                      (2<<2)
+#define MWCR1_WRITE_PATTERN                     (3<<2)
+#define MWCR1_WRITE_MASK                        (3<<2)
+
 #define TEST            0x00    /*  */
 
+/*
+ * BTE (Block Transfer Engine) commands of the "lcd" device, only available
+ * with USE_DRAW_FUNCTION. All coordinates are in pixels of the 800x480
+ * display RAM and the areas must lie inside it. Nothing in this tree calls
+ * them yet, they are for applications and a hardware DC through
+ * rt_device_control().
+ */
+#define RA8875_CTRL_BTE_FILL                    0x40    /* struct ra8875_bte_fill */
+#define RA8875_CTRL_BTE_MOVE                    0x41    /* struct ra8875_bte_move */
+#define RA8875_CTRL_BTE_PATTERN                 0x42    /* struct ra8875_bte_pattern */
+#define RA8875_CTRL_BTE_WRITE_TRANSPARENT       0x43    /* struct ra8875_bte_write */
+
+/* raster operations, S is the source and D the destination */
+#define RA8875_ROP_BLACK                        0x00
+#define RA8875_ROP_NOT_S_AND_NOT_D              0x01
+#define RA8875_ROP_NOT_S                        0x03
+#define RA8875_ROP_NOT_D                        0x05
+#define RA8875_ROP_S_XOR_D                      0x06
+#define RA8875_ROP_S_AND_D                      0x08
+#define RA8875_ROP_D                            0x0A
+#define RA8875_ROP_S                            0x0C
+#define RA8875_ROP_S_OR_D                       0x0E
+#define RA8875_ROP_WHITE                        0x0F
+
+struct ra8875_bte_fill
+{
+    rt_uint16_t x, y, width, height;
+    rt_uint16_t color;              /* RGB565 */
+};
+
+/* copy an area inside display RAM, source and destination may overlap */
+struct ra8875_bte_move
+{
+    rt_uint16_t src_x, src_y;
+    rt_uint16_t dst_x, dst_y;
+    rt_uint16_t width, height;
+    rt_uint8_t  rop;
+};
+
+/* tile an 8x8 pattern over an area */
+struct ra8875_bte_pattern
+{
+    const rt_uint16_t *pattern;     /* 64 RGB565 pixels, RT_NULL reuses the last one */
+    rt_uint16_t x, y, width, height;
+    rt_uint8_t  rop;
+};
+
+/* write pixels from MCU, pixels equal to transparent are skipped */
+struct ra8875_bte_write
+{
+    const rt_uint16_t *pixels;      /* width * height RGB565 pixels */
+    rt_uint16_t x, y, width, height;
+    rt_uint16_t transparent;
+};
+
 #endif // RA8875_H_INCLUDED
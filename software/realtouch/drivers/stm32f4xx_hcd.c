@@ -11,6 +11,7 @@
  * Date           Author       Notes
  * 2012-05-16     Yi Qiu       first version
  * 2012-12-05     heyuanjie87  add interrupt transfer
+ * 2013-03-21     realtouch    complete bulk transfers from the channel interrupt
  */
 
 #include <rtthread.h>
@@ -34,7 +35,19 @@ struct usbh_xfer
 
 #define MAX_HC 8
 #define PXFER_FLAG_READY 0x01
+/* a bulk transfer is on the channel, size bytes from buffer are not acknowledged yet */
+#define PXFER_FLAG_BULK  0x02
+/* the device NAKed an OUT transfer without taking any data, send it again next frame */
+#define PXFER_FLAG_RETRY 0x04
+
+/* packets the core takes in one channel transaction, see USB_OTG_HC_StartXfer */
+#define HC_PKT_MAX       256
+/* an OUT transaction is written into the non-periodic FIFO at once, it must fit */
+#define HC_OUT_MAX       (TXH_NP_FS_FIFOSIZ * 4)
+
 static struct usbh_xfer _xfer[MAX_HC];
+/* released from the channel interrupt when a bulk transfer is done or failed */
+static struct rt_semaphore _xfer_done[MAX_HC];
 static struct uhcd susb_hcd;
 static struct uhubinst root_hub;
 static rt_bool_t ignore_disconnect = RT_FALSE;
@@ -46,7 +59,13 @@ ALIGN(4) static USBH_HOST USB_Host;
 
 void OTG_FS_IRQHandler(void)
 {
+    /* enter interrupt */
+    rt_interrupt_enter();
+
     USBH_OTG_ISR_Handler(&USB_OTG_Core);
+
+    /* leave interrupt */
+    rt_interrupt_leave();
 }
 
 /**
@@ -379,11 +398,19 @@ rt_uint8_t susb_connect (USB_OTG_CORE_HANDLE *pdev)
 rt_uint8_t susb_disconnect (USB_OTG_CORE_HANDLE *pdev)
 {
     struct uhost_msg msg;
+    int i;
 
     pdev->host.ConnSts = 0;
 
     rt_kprintf("susb_disconnect\n");
 
+    /* wake up bulk transfers in progress, they fail as their URB is not done */
+    for (i = 0; i < MAX_HC; i ++)
+    {
+        if (_xfer[i].flag & PXFER_FLAG_BULK)
+            rt_sem_release(&_xfer_done[i]);
+    }
+
     USBH_DeInit(&USB_OTG_Core , &USB_Host);
     USBH_DeAllocate_AllChannel(&USB_OTG_Core);
     USB_Host.gState = HOST_IDLE;
@@ -407,6 +434,13 @@ rt_uint8_t susb_sof (USB_OTG_CORE_HANDLE *pdev)
     sofcnt ++;
     for (i = 2; i < MAX_HC; i ++)
     {
+        if (_xfer[i].flag & PXFER_FLAG_RETRY)
+        {
+            _xfer[i].flag &= ~PXFER_FLAG_RETRY;
+            USBH_BulkSendData(&USB_OTG_Core, _xfer[i].buffer, _xfer[i].size, i);
+            continue;
+        }
+
         if ((_xfer[i].flag & PXFER_FLAG_READY) && (_xfer[i].pipe != RT_NULL))
         {
             ep = &_xfer[i].pipe->ep;
@@ -427,7 +461,57 @@ rt_uint8_t susb_sof (USB_OTG_CORE_HANDLE *pdev)
     return 0;
 }
 
-void susb_urb_done (USB_OTG_CORE_HANDLE *pdev, uint32_t hc)
+/* called on the halt of a bulk channel, from the channel interrupt */
+static void susb_bulk_done(USB_OTG_CORE_HANDLE *pdev, uint32_t hc)
+{
+    USB_OTG_HCTSIZn_TypeDef hctsiz;
+    URB_STATE state;
+    rt_uint8_t toggle;
+    int max_packet, acked;
+
+    /* nobody waits for it, the transfer timed out */
+    if (!(_xfer[hc].flag & PXFER_FLAG_BULK)) return;
+
+    state = HCD_GetURB_State(pdev, hc);
+    hctsiz.d32 = USB_OTG_READ_REG32(&pdev->regs.HC_REGS[hc]->HCTSIZ);
+
+    /* the core keeps the PID of the next packet, a transaction of several
+     * packets does not simply flip the toggle */
+    if (state == URB_DONE || state == URB_NOTREADY || state == URB_IDLE)
+    {
+        toggle = (hctsiz.b.pid == HC_PID_DATA1) ? 1 : 0;
+        if (pdev->host.hc[hc].ep_is_in)
+            pdev->host.hc[hc].toggle_in = toggle;
+        else
+            pdev->host.hc[hc].toggle_out = toggle;
+    }
+
+    /* a NAK, or a transaction error below the error limit, halted an OUT
+     * transfer: the packets the core counted off were acknowledged, send the rest */
+    if (!pdev->host.hc[hc].ep_is_in && (state == URB_NOTREADY || state == URB_IDLE))
+    {
+        max_packet = pdev->host.hc[hc].max_packet;
+        acked = ((_xfer[hc].size + max_packet - 1) / max_packet - hctsiz.b.pktcnt) * max_packet;
+        if (acked < 0) acked = 0;
+        if (acked > _xfer[hc].size) acked = _xfer[hc].size;
+
+        _xfer[hc].buffer += acked;
+        _xfer[hc].size   -= acked;
+
+        /* a device taking data gets the rest at once, a busy one every frame */
+        if (acked > 0)
+            USBH_BulkSendData(pdev, _xfer[hc].buffer, _xfer[hc].size, hc);
+        else
+            _xfer[hc].flag |= PXFER_FLAG_RETRY;
+
+        return;
+    }
+
+    _xfer[hc].flag = 0;
+    rt_sem_release(&_xfer_done[hc]);
+}
+
+void susb_urb_done (USB_OTG_CORE_HANDLE *pdev, uint8_t hc)
 {
     struct uhost_msg msg;
     if (_xfer[hc].pipe != RT_NULL)
@@ -437,8 +521,10 @@ void susb_urb_done (USB_OTG_CORE_HANDLE *pdev, uint32_t hc)
         case USB_EP_ATTR_CONTROL:
             return;
         case USB_EP_ATTR_BULK:
+            susb_bulk_done(pdev, hc);
             return;
         case USB_EP_ATTR_INT:
+            if (HCD_GetURB_State(pdev, hc) != URB_DONE) return;
             _xfer[hc].flag = 0;
             break;
         default:
@@ -540,21 +626,69 @@ static int susb_int_xfer(upipe_t pipe, void* buffer, int nbytes, int timeout)
     return 0;
 }
 
+/* submit one channel transaction and wait for its end, returns the bytes moved */
+static int susb_bulk_submit(upipe_t pipe, rt_uint8_t channel, rt_uint8_t *ptr,
+                            int size, rt_int32_t timeout)
+{
+    rt_base_t level;
+    URB_STATE state;
+
+    rt_sem_control(&_xfer_done[channel], RT_IPC_CMD_RESET, 0);
+
+    level = rt_hw_interrupt_disable();
+    _xfer[channel].buffer = ptr;
+    _xfer[channel].size   = size;
+    _xfer[channel].flag   = PXFER_FLAG_BULK;
+    if(pipe->ep.bEndpointAddress & USB_DIR_IN)
+        USBH_BulkReceiveData(&USB_OTG_Core, ptr, size, channel);
+    else
+        USBH_BulkSendData(&USB_OTG_Core, ptr, size, channel);
+    rt_hw_interrupt_enable(level);
+
+    if(rt_sem_take(&_xfer_done[channel], timeout) != RT_EOK)
+    {
+        level = rt_hw_interrupt_disable();
+        _xfer[channel].flag = 0;
+        USB_OTG_HC_Halt(&USB_OTG_Core, channel);
+        rt_hw_interrupt_enable(level);
+
+        rt_kprintf("bulk transfer timeout\n");
+        return -RT_ETIMEOUT;
+    }
+
+    state = HCD_GetURB_State(&USB_OTG_Core, channel);
+    if(state == URB_STALL)
+    {
+        pipe->status = UPIPE_STATUS_STALL;
+        return -RT_EIO;
+    }
+    if(state != URB_DONE)
+    {
+        pipe->status = UPIPE_STATUS_ERROR;
+        return -RT_EIO;
+    }
+
+    if(pipe->ep.bEndpointAddress & USB_DIR_IN)
+        return HCD_GetXferCnt(&USB_OTG_Core, channel);
+
+    return size;
+}
+
 /**
  * This function will do bulk transfer in lowlevel, it will send request to the host controller
  *
  * @param pipe the bulk transfer pipe.
  * @param buffer the data buffer to save requested data
  * @param nbytes the size of buffer
+ * @param timeout the ticks to wait for each channel transaction, 0 to wait forever
  *
- * @return the error code, RT_EOK on successfully.
+ * @return the bytes transferred, or a negative error code.
  */
 static int susb_bulk_xfer(upipe_t pipe, void* buffer, int nbytes, int timeout)
 {
     rt_uint8_t channel;
-    int left = nbytes;
+    int left = nbytes, size, max, result;
     rt_uint8_t *ptr;
-    URB_STATE state;
 
     RT_ASSERT(pipe != RT_NULL);
     RT_ASSERT(buffer != RT_NULL);
@@ -564,68 +698,36 @@ static int susb_bulk_xfer(upipe_t pipe, void* buffer, int nbytes, int timeout)
 
     ptr = (rt_uint8_t*)buffer;
     channel = (rt_uint32_t)pipe->user_data & 0xFF;
-
-    rt_sem_take(&sem_lock, RT_WAITING_FOREVER);
+    if(timeout <= 0) timeout = RT_WAITING_FOREVER;
 
     if(pipe->ep.bEndpointAddress & USB_DIR_IN)
-    {
-        while(left > pipe->ep.wMaxPacketSize)
-        {
-            USBH_BulkReceiveData(&USB_OTG_Core, ptr, pipe->ep.wMaxPacketSize,
-                                 channel);
-            while(1)
-            {
-                state = HCD_GetURB_State(&USB_OTG_Core , channel);
-                if(state == URB_DONE) break;
-                else if(state == URB_NOTREADY) rt_kprintf("not ready\n");
-                else if(state == URB_STALL) rt_kprintf("stall\n");
-                //else if(state == URB_IDLE) rt_kprintf("idle\n");
-            }
+        max = HC_PKT_MAX * pipe->ep.wMaxPacketSize;
+    else
+        max = HC_OUT_MAX / pipe->ep.wMaxPacketSize * pipe->ep.wMaxPacketSize;
 
-            ptr += pipe->ep.wMaxPacketSize;
-            left -= pipe->ep.wMaxPacketSize;
-        }
+    rt_sem_take(&sem_lock, RT_WAITING_FOREVER);
 
-        USBH_BulkReceiveData(&USB_OTG_Core, ptr, left, channel);
-        while(1)
-        {
-            state = HCD_GetURB_State(&USB_OTG_Core , channel);
-            if(state == URB_DONE) break;
-            else if(state == URB_NOTREADY) rt_kprintf("not ready\n");
-            else if(state == URB_STALL) rt_kprintf("stall\n");
-            //else if(state == URB_IDLE) rt_kprintf("idle\n");
-        }
-    }
-    else
+    /* the core splits a transaction into packets itself and the channel
+     * interrupt completes it, the thread sleeps until then */
+    do
     {
-send_data:
-        while(left > pipe->ep.wMaxPacketSize)
-        {
-            USBH_BulkSendData(&USB_OTG_Core, ptr, pipe->ep.wMaxPacketSize,
-                              channel);
+        size = left;
+        if(size > max) size = max;
 
-            while(1)
-            {
-                state = HCD_GetURB_State(&USB_OTG_Core, channel);
-                if(state == URB_DONE) break;
-                if(state == URB_NOTREADY) goto send_data;
-            }
+        result = susb_bulk_submit(pipe, channel, ptr, size, timeout);
+        if(result < 0) break;
 
-            ptr += pipe->ep.wMaxPacketSize;
-            left -= pipe->ep.wMaxPacketSize;
-        }
+        ptr  += result;
+        left -= result;
 
-        USBH_BulkSendData(&USB_OTG_Core, ptr, left, channel);
-        while(1)
-        {
-            state = HCD_GetURB_State(&USB_OTG_Core , channel);
-            if(state == URB_DONE) break;
-            if(state == URB_NOTREADY) goto send_data;
-        }
-    }
+        /* a short packet ends an IN transfer */
+        if(result < size) break;
+    } while(left > 0);
 
     rt_sem_release(&sem_lock);
-    return nbytes;
+
+    if(result < 0) return result;
+    return nbytes - left;
 }
 
 /**
@@ -672,14 +774,19 @@ static rt_err_t susb_alloc_pipe(upipe_t* pipe, uifinst_t ifinst, uep_desc_t ep,
     p->status = UPIPE_STATUS_OK;
     rt_memcpy(&p->ep, ep, ep->bLength);
 
-    speed = HCD_GetCurrentSpeed(&USB_OTG_Core);
-    channel = USBH_Alloc_Channel(&USB_OTG_Core, p->ep.bEndpointAddress);
-
     if((ep->bmAttributes & USB_EP_ATTR_TYPE_MASK) == USB_EP_ATTR_BULK)
         ep_type = EP_TYPE_BULK;
     else if((ep->bmAttributes & USB_EP_ATTR_TYPE_MASK) == USB_EP_ATTR_INT)
         ep_type = EP_TYPE_INTR;
-    else rt_kprintf("unsupported endpoint type\n");
+    else
+    {
+        rt_kprintf("unsupported endpoint type\n");
+        rt_free(p);
+        return -RT_ERROR;
+    }
+
+    speed = HCD_GetCurrentSpeed(&USB_OTG_Core);
+    channel = USBH_Alloc_Channel(&USB_OTG_Core, p->ep.bEndpointAddress);
 
     /* Open the new channels */
     USBH_Open_Channel(&USB_OTG_Core, channel, ifinst->uinst->address,
@@ -799,7 +906,15 @@ static struct uhcd_ops susb_ops =
  */
 static rt_err_t susb_init(rt_device_t dev)
 {
+    char name[RT_NAME_MAX];
+    int i;
+
     rt_sem_init(&sem_lock, "s_lock", 1, RT_IPC_FLAG_FIFO);
+    for (i = 0; i < MAX_HC; i ++)
+    {
+        rt_snprintf(name, sizeof(name), "hc%d", i);
+        rt_sem_init(&_xfer_done[i], name, 0, RT_IPC_FLAG_FIFO);
+    }
 
     /* roothub initilizition */
     root_hub.num_ports = 1;
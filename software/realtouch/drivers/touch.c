@@ -2,6 +2,8 @@
 
 #include "board.h"
 #include "touch.h"
+#include "touch_filter.h"
+#include "input_queue.h"
 
 /*
 TOUCH INT: PA3
@@ -15,6 +17,13 @@ TOUCH INT: PA3
 #include <rtgui/rtgui_server.h>
 #include <rtgui/rtgui_system.h>
 
+//#define TOUCH_DEBUG
+#ifdef TOUCH_DEBUG
+#define TOUCH_TRACE         rt_kprintf
+#else
+#define TOUCH_TRACE(...)
+#endif
+
 /*
 7  6 - 4  3      2     1-0
 s  A2-A0 MODE SER/DFR PD1-PD0
@@ -54,9 +63,25 @@ s  A2-A0 MODE SER/DFR PD1-PD0
 #define MAX_X_DEFAULT   0x20
 #define MIN_Y_DEFAULT   0x53
 #define MAX_Y_DEFAULT   0x79b
-#define SAMP_CNT 8                              //the adc array size
-#define SAMP_CNT_DIV2 4                         //the middle of the adc array
-#define SH   10                                 // Valve value
+
+/*
+ * Sampling: a timer starts a batch of conversions while the pen is down,
+ * every tick while it moves and every TOUCH_PERIOD_SLOW once it rested
+ * for TOUCH_IDLE_BATCHES batches. A batch is TOUCH_BATCH conversions of
+ * each axis in one SPI transfer: in the 16 clocks per conversion mode of
+ * the controller the next command goes out with the low bits of the last
+ * result, two bytes per conversion and one byte at the end.
+ */
+#define TOUCH_BATCH         8
+#define TOUCH_BATCH_BYTES   (TOUCH_BATCH * 2 * 2 + 1)
+
+#define TOUCH_PERIOD_FAST   1
+#define TOUCH_PERIOD_SLOW   (RT_TICK_PER_SECOND / 25)
+#define TOUCH_IDLE_BATCHES  10
+
+#define TOUCH_EVENT_DOWN    0x01
+#define TOUCH_EVENT_SAMPLE  0x02
+
 struct rtgui_touch_device
 {
     struct rt_device parent;
@@ -71,105 +96,79 @@ struct rtgui_touch_device
 
     struct rt_spi_device * spi_device;
     struct rt_event event;
+    struct rt_timer timer;
+    rt_tick_t period;
+
+    struct touch_filter filter;
 };
 static struct rtgui_touch_device *touch = RT_NULL;
 
 rt_inline void touch_int_cmd(FunctionalState NewState);
 
-
 #define X_WIDTH 800
 #define Y_WIDTH 480
 
-static void rtgui_touch_calculate(void)
+static const rt_uint8_t touch_batch_cmd[TOUCH_BATCH_BYTES] =
 {
-    if (touch != RT_NULL)
-    {
-        /* read touch */
-        {
-            uint8_t i, j, k, min;
-	          uint16_t temp;
-            rt_uint16_t tmpxy[2][SAMP_CNT];
-            uint8_t send_buffer[1];
-            uint8_t recv_buffer[2];
-            for(i=0; i<SAMP_CNT; i++)
-            {
-                send_buffer[0] = TOUCH_MSR_X;
-                rt_spi_send_then_recv(touch->spi_device,
-                                      send_buffer,
-                                      1,
-                                      recv_buffer,
-                                      2);
-                tmpxy[0][i]  = (recv_buffer[0] & 0x7F) << 4;
-                tmpxy[1][i] |= (recv_buffer[1] >> 4) & 0x0F;
-
-                send_buffer[0] = TOUCH_MSR_Y;
-                rt_spi_send_then_recv(touch->spi_device,
-                                      send_buffer,
-                                      1,
-                                      recv_buffer,
-                                      2);
-                tmpxy[1][i]  = (recv_buffer[0] & 0x7F) << 4;
-                tmpxy[1][i] |= (recv_buffer[1] >> 4) & 0x0F;
-            }
-            send_buffer[0] = 1 << 7;
-            rt_spi_send(touch->spi_device, send_buffer, 1);
-
-            /* calculate average */
-						{
-							rt_uint32_t total_x = 0;
-              rt_uint32_t total_y = 0;
-							for(k=0; k<2; k++)
-							{ 
-								// sorting the ADC value
-								for(i=0; i<SAMP_CNT-1; i++)
-								{
-									min=i;
-									for (j=i+1; j<SAMP_CNT; j++)
-									{
-										if (tmpxy[k][min] > tmpxy[k][j]) 
-											min=j;
-										}
-										temp = tmpxy[k][i];
-										tmpxy[k][i] = tmpxy[k][min];
-										tmpxy[k][min] = temp;
-								}
-							 //check value for Valve value
-								if((tmpxy[k][SAMP_CNT_DIV2+1]-tmpxy[k][SAMP_CNT_DIV2-2]) > SH)
-									{
-										return;
-									}
-							}
-							  total_x=tmpxy[0][SAMP_CNT_DIV2-2]+tmpxy[0][SAMP_CNT_DIV2-1]+tmpxy[0][SAMP_CNT_DIV2]+tmpxy[0][SAMP_CNT_DIV2+1];
-							 total_y=tmpxy[1][SAMP_CNT_DIV2-2]+tmpxy[1][SAMP_CNT_DIV2-1]+tmpxy[1][SAMP_CNT_DIV2]+tmpxy[1][SAMP_CNT_DIV2+1];
-								//calculate average value
-								touch->x=total_x>>2;
-								touch->y=total_y>>2;
-                rt_kprintf("touch->x:%d touch->y:%d\r\n", touch->x, touch->y);
-           } /* calculate average */
-        } /* read touch */
-
-        /* if it's not in calibration status  */
-        if (touch->calibrating != RT_TRUE)
-        {
-            if (touch->max_x > touch->min_x)
-            {
-                touch->x = (touch->x - touch->min_x) * X_WIDTH/(touch->max_x - touch->min_x);
-            }
-            else
-            {
-                touch->x = (touch->min_x - touch->x) * X_WIDTH/(touch->min_x - touch->max_x);
-            }
+    TOUCH_MSR_X, 0, TOUCH_MSR_X, 0, TOUCH_MSR_X, 0, TOUCH_MSR_X, 0,
+    TOUCH_MSR_X, 0, TOUCH_MSR_X, 0, TOUCH_MSR_X, 0, TOUCH_MSR_X, 0,
+    TOUCH_MSR_Y, 0, TOUCH_MSR_Y, 0, TOUCH_MSR_Y, 0, TOUCH_MSR_Y, 0,
+    TOUCH_MSR_Y, 0, TOUCH_MSR_Y, 0, TOUCH_MSR_Y, 0, TOUCH_MSR_Y, 0,
+    0,
+};
 
-            if (touch->max_y > touch->min_y)
-            {
-                touch->y = (touch->y - touch->min_y) * Y_WIDTH /(touch->max_y - touch->min_y);
-            }
-            else
-            {
-                touch->y = (touch->min_y - touch->y) * Y_WIDTH /(touch->min_y - touch->max_y);
-            }
-        }
-    }
+/* one batch of conversions, the 11 bit values the calibration data is in */
+static rt_err_t touch_read_batch(rt_uint16_t *xs, rt_uint16_t *ys)
+{
+    rt_uint8_t recv_buffer[TOUCH_BATCH_BYTES];
+    rt_uint8_t *ptr;
+    int i;
+
+    if (rt_spi_transfer(touch->spi_device, touch_batch_cmd, recv_buffer,
+                        TOUCH_BATCH_BYTES) != TOUCH_BATCH_BYTES)
+        return -RT_EIO;
+
+    /* the result follows its command byte */
+    ptr = &recv_buffer[1];
+    for (i = 0; i < TOUCH_BATCH; i++, ptr += 2)
+        xs[i] = ((ptr[0] & 0x7F) << 4) | (ptr[1] >> 4);
+    for (i = 0; i < TOUCH_BATCH; i++, ptr += 2)
+        ys[i] = ((ptr[0] & 0x7F) << 4) | (ptr[1] >> 4);
+
+    return RT_EOK;
+}
+
+/* ADC to screen, unless the raw values are being calibrated */
+static void touch_scale(rt_uint16_t x, rt_uint16_t y)
+{
+    touch->x = x;
+    touch->y = y;
+    if (touch->calibrating == RT_TRUE)
+        return;
+
+    if (touch->max_x > touch->min_x)
+        touch->x = (x - touch->min_x) * X_WIDTH / (touch->max_x - touch->min_x);
+    else
+        touch->x = (touch->min_x - x) * X_WIDTH / (touch->min_x - touch->max_x);
+
+    if (touch->max_y > touch->min_y)
+        touch->y = (y - touch->min_y) * Y_WIDTH / (touch->max_y - touch->min_y);
+    else
+        touch->y = (touch->min_y - y) * Y_WIDTH / (touch->min_y - touch->max_y);
+}
+
+static void touch_set_period(rt_tick_t period)
+{
+    if (touch->period == period)
+        return;
+
+    touch->period = period;
+    rt_timer_control(&touch->timer, RT_TIMER_CTRL_SET_TIME, &touch->period);
+}
+
+static void touch_timeout(void *parameter)
+{
+    rt_event_send(&touch->event, TOUCH_EVENT_SAMPLE);
 }
 
 static void NVIC_Configuration(void)
@@ -265,124 +264,95 @@ static rt_err_t rtgui_touch_control (rt_device_t dev, rt_uint8_t cmd, void *args
 
     return RT_EOK;
 }
-extern void _set_mouse_position(uint32_t X, uint32_t Y);
 static void touch_thread_entry(void *parameter)
 {
     rt_bool_t touch_down = RT_FALSE;
     rt_uint32_t event_value;
     struct rtgui_event_mouse emouse;
-    static struct _touch_previous
-    {
-        rt_uint32_t x;
-        rt_uint32_t y;
-    } touch_previous;
+    rt_uint16_t xs[TOUCH_BATCH], ys[TOUCH_BATCH];
+    rt_uint16_t x, y;
+    rt_err_t result;
+    int idle = 0;
 
     RTGUI_EVENT_MOUSE_BUTTON_INIT(&emouse);
     emouse.wid = RT_NULL;
 
     while(1)
     {
-        if(rt_event_recv(&touch->event,
-                         1,
-                         RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR,
-                         RT_WAITING_FOREVER,
-                         &event_value)
-           == RT_EOK)
+        if (rt_event_recv(&touch->event,
+                          TOUCH_EVENT_DOWN | TOUCH_EVENT_SAMPLE,
+                          RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR,
+                          RT_WAITING_FOREVER,
+                          &event_value) != RT_EOK)
+            continue;
+
+        if (event_value & TOUCH_EVENT_DOWN)
+        {
+            /* first batch one tick after the pen went down */
+            touch_filter_reset(&touch->filter);
+            touch_down = RT_FALSE;
+            idle = 0;
+            touch_set_period(TOUCH_PERIOD_FAST);
+            rt_timer_start(&touch->timer);
+            continue;
+        }
+
+        if (!IS_TOUCH_UP())
         {
-            while(1)
+            if (touch_read_batch(xs, ys) != RT_EOK)
+                continue;
+            /* lifted during the batch, the conversions are not valid */
+            if (IS_TOUCH_UP())
+                goto __touch_up;
+
+            result = touch_filter_feed(&touch->filter, xs, ys, TOUCH_BATCH, &x, &y);
+            if (result == -RT_EBUSY)
             {
-                if (IS_TOUCH_UP())
-                {
-                    /* touch up */
-                    emouse.button = (RTGUI_MOUSE_BUTTON_LEFT |RTGUI_MOUSE_BUTTON_UP);
-
-                    /* use old value */
-                    emouse.x = touch->x;
-                    emouse.y = touch->y;
-
-                    if(touch_down != RT_TRUE) 
-                    {                    
-                        touch_int_cmd(ENABLE);
-                        break;
-                    }    
-
-                    if ((touch->calibrating == RT_TRUE) && (touch->calibration_func != RT_NULL))
-                    {
-                        /* callback function */
-                        touch->calibration_func(emouse.x, emouse.y);
-											
-                    }
-                    else
-                    {
-                        rtgui_server_post_event(&emouse.parent, sizeof(struct rtgui_event_mouse));
-                    }
-                    rt_kprintf("touch up: (%d, %d)\n", emouse.x, emouse.y);
-
-                    /* clean */
-                    touch_previous.x = touch_previous.y = 0;
-                    touch_down = RT_FALSE;
-
-                    touch_int_cmd(ENABLE);
-                    break;
-                } /* touch up */
-                else /* touch down or move */
-                {
-                    if(touch_down == RT_FALSE)
-                    {
-                        rt_thread_delay(RT_TICK_PER_SECOND / 10);
-                    }
-                    else
-                    {
-                        rt_thread_delay(5);
-                    }
-
-                    if(IS_TOUCH_UP()) continue;
-
-                    /* calculation */
-                    rtgui_touch_calculate();
-                    
-                    /* send mouse event */
-                    emouse.parent.type = RTGUI_EVENT_MOUSE_BUTTON;
-                    emouse.parent.sender = RT_NULL;
-
-                    emouse.x = touch->x;
-                    emouse.y = touch->y;
-
-                    /* init mouse button */
-                    emouse.button = (RTGUI_MOUSE_BUTTON_LEFT |RTGUI_MOUSE_BUTTON_DOWN);
-
-                    /* send event to server */
-                    if (touch->calibrating != RT_TRUE)
-                    {
-#define previous_keep      8
-                        /* filter. */
-                        if((touch_previous.x > touch->x + previous_keep)
-                            || (touch_previous.x < touch->x - previous_keep)
-                            || (touch_previous.y > touch->y + previous_keep)
-                            || (touch_previous.y < touch->y - previous_keep))
-                        {
-                            touch_previous.x = touch->x;
-                            touch_previous.y = touch->y;
-                            rtgui_server_post_event(&emouse.parent, sizeof(struct rtgui_event_mouse));
-                            if(touch_down == RT_FALSE)
-                            {
-                                touch_down = RT_TRUE;
-                                rt_kprintf("touch down: (%d, %d)\n", emouse.x, emouse.y);
-                            }
-                            else
-                            {
-                                rt_kprintf("touch motion: (%d, %d)\n", emouse.x, emouse.y);
-                            }
-                        }
-                    }
-                    else
-                    {
-                        touch_down = RT_TRUE;
-                    }
-                } /* touch down or move */
-            } /* read touch */
-        } /* event recv */
-    } /* thread while(1) */
+                if (++idle == TOUCH_IDLE_BATCHES)
+                    touch_set_period(TOUCH_PERIOD_SLOW);
+                continue;
+            }
+            if (result != RT_EOK)
+                continue;
+
+            idle = 0;
+            touch_set_period(TOUCH_PERIOD_FAST);
+            touch_scale(x, y);
+
+            /* a press, then the moves; nothing is sent while calibrating */
+            if (touch->calibrating != RT_TRUE)
+            {
+                emouse.parent.type = RTGUI_EVENT_MOUSE_BUTTON;
+                emouse.parent.sender = RT_NULL;
+                emouse.button = (RTGUI_MOUSE_BUTTON_LEFT | RTGUI_MOUSE_BUTTON_DOWN);
+                emouse.x = touch->x;
+                emouse.y = touch->y;
+                input_queue_post(&emouse);
+            }
+            TOUCH_TRACE("touch %s: (%d, %d)\n", touch_down ? "motion" : "down", touch->x, touch->y);
+            touch_down = RT_TRUE;
+            continue;
+        }
+
+__touch_up:
+        rt_timer_stop(&touch->timer);
+        if (touch_down == RT_TRUE)
+        {
+            /* the last position reported */
+            emouse.button = (RTGUI_MOUSE_BUTTON_LEFT | RTGUI_MOUSE_BUTTON_UP);
+            emouse.x = touch->x;
+            emouse.y = touch->y;
+
+            if ((touch->calibrating == RT_TRUE) && (touch->calibration_func != RT_NULL))
+                touch->calibration_func(emouse.x, emouse.y);
+            else
+                input_queue_post(&emouse);
+            TOUCH_TRACE("touch up: (%d, %d)\n", emouse.x, emouse.y);
+
+            touch_down = RT_FALSE;
+        }
+        touch_int_cmd(ENABLE);
+    }
 }
 
 void EXTI3_IRQHandler(void)
@@ -390,7 +360,7 @@ void EXTI3_IRQHandler(void)
     /* disable interrupt */
     touch_int_cmd(DISABLE);
 
-    rt_event_send(&touch->event, 1);
+    rt_event_send(&touch->event, TOUCH_EVENT_DOWN);
 
     EXTI_ClearITPendingBit(EXTI_Line3);
 }
@@ -423,6 +393,9 @@ rt_err_t rtgui_touch_hw_init(const char * spi_device_name)
     rt_memset(&(touch->parent), 0, sizeof(struct rt_device));
 
     rt_event_init(&touch->event, "touch", RT_IPC_FLAG_FIFO);
+    touch->period = TOUCH_PERIOD_FAST;
+    rt_timer_init(&touch->timer, "touch", touch_timeout, RT_NULL,
+                  touch->period, RT_TIMER_FLAG_PERIODIC);
 
     touch->spi_device = spi_device;
     touch->calibrating = false;
@@ -441,6 +414,8 @@ rt_err_t rtgui_touch_hw_init(const char * spi_device_name)
     /* register touch device to RT-Thread */
     rt_device_register(&(touch->parent), "touch", RT_DEVICE_FLAG_RDWR);
 
+    input_queue_init();
+
     touch_thread = rt_thread_create("touch",
                                     touch_thread_entry, RT_NULL,
                                     1024, RTGUI_SVR_THREAD_PRIORITY-1, 1);
@@ -457,16 +432,17 @@ void touch_t( rt_uint16_t x , rt_uint16_t y )
     struct rtgui_event_mouse emouse ;
     emouse.parent.type = RTGUI_EVENT_MOUSE_BUTTON;
     emouse.parent.sender = RT_NULL;
+    emouse.wid = RT_NULL;
 
     emouse.x = x ;
     emouse.y = y ;
     /* init mouse button */
     emouse.button = (RTGUI_MOUSE_BUTTON_LEFT |RTGUI_MOUSE_BUTTON_DOWN );
-    rtgui_server_post_event(&emouse.parent, sizeof(struct rtgui_event_mouse));
+    input_queue_post(&emouse);
 
     rt_thread_delay(2) ;
     emouse.button = (RTGUI_MOUSE_BUTTON_LEFT |RTGUI_MOUSE_BUTTON_UP );
-    rtgui_server_post_event(&emouse.parent, sizeof(struct rtgui_event_mouse));
+    input_queue_post(&emouse);
 }
 
 FINSH_FUNCTION_EXPORT(touch_t, x & y ) ;
@@ -0,0 +1,158 @@
+/*
+ * File      : touch_filter.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#include <rtthread.h>
+
+#include "touch_filter.h"
+
+#define ABS(v)      ((v) < 0 ? -(v) : (v))
+
+rt_uint16_t touch_median(rt_uint16_t *values, int n)
+{
+    int left = 0, right = n - 1, k = n / 2;
+    int i, j;
+    rt_uint16_t pivot, temp;
+
+    RT_ASSERT(n > 0);
+
+    /* quickselect, every round keeps the side holding k */
+    while (left < right)
+    {
+        pivot = values[(left + right) / 2];
+        i = left;
+        j = right;
+        while (i <= j)
+        {
+            while (values[i] < pivot) i ++;
+            while (values[j] > pivot) j --;
+            if (i <= j)
+            {
+                temp = values[i];
+                values[i] = values[j];
+                values[j] = temp;
+                i ++;
+                j --;
+            }
+        }
+
+        if (k <= j)
+            right = j;
+        else if (k >= i)
+            left = i;
+        else
+            break;
+    }
+
+    return values[k];
+}
+
+/* mean of the samples near the median, in 1/16 steps */
+static rt_err_t _axis_reduce(rt_uint16_t *values, int n, rt_int32_t *result)
+{
+    rt_uint16_t median;
+    rt_int32_t sum = 0;
+    int index, count = 0;
+
+    median = touch_median(values, n);
+    for (index = 0; index < n; index ++)
+    {
+        if (ABS((rt_int32_t)values[index] - median) <= TOUCH_FILTER_SPREAD)
+        {
+            sum += values[index];
+            count ++;
+        }
+    }
+
+    /* a quarter of outliers at most */
+    if (count < n - n / 4)
+        return -RT_ERROR;
+
+    *result = (sum * 16 + count / 2) / count;
+    return RT_EOK;
+}
+
+/* one IIR step, returns the position one batch ahead */
+static rt_int32_t _axis_step(rt_int32_t *pos, rt_int32_t *velocity, rt_int32_t sample)
+{
+    rt_int32_t delta, prev = *pos;
+
+    delta = sample - *pos;
+    if (ABS(delta) >= TOUCH_FILTER_FAST * 16)
+        *pos = sample;
+    else if (ABS(delta) >= TOUCH_FILTER_FAST * 4)
+        *pos += delta / 2;
+    else
+        *pos += delta / 4;
+
+    *velocity += (*pos - prev - *velocity) / 2;
+    /* no lead for a resting pen, it only adds noise */
+    if (ABS(*velocity) < TOUCH_FILTER_DEADZONE * 16)
+        return *pos;
+
+    return *pos + *velocity;
+}
+
+static rt_uint16_t _clamp(rt_int32_t value)
+{
+    value = (value + 8) >> 4;
+    if (value < 0) return 0;
+    if (value > 0xFFF) return 0xFFF;
+
+    return value;
+}
+
+void touch_filter_reset(struct touch_filter *filter)
+{
+    rt_memset(filter, 0, sizeof(struct touch_filter));
+}
+
+rt_err_t touch_filter_feed(struct touch_filter *filter,
+                           rt_uint16_t *xs, rt_uint16_t *ys, int n,
+                           rt_uint16_t *x, rt_uint16_t *y)
+{
+    rt_int32_t sx, sy;
+    rt_uint16_t cx, cy;
+
+    RT_ASSERT(n > 0 && n <= TOUCH_FILTER_BATCH_MAX);
+
+    if (_axis_reduce(xs, n, &sx) != RT_EOK ||
+            _axis_reduce(ys, n, &sy) != RT_EOK)
+        return -RT_ERROR;
+
+    if (filter->started == RT_FALSE)
+    {
+        /* the first batch of a press is taken as it is */
+        filter->x = sx;
+        filter->y = sy;
+        filter->vx = filter->vy = 0;
+        filter->started = RT_TRUE;
+
+        cx = _clamp(sx);
+        cy = _clamp(sy);
+    }
+    else
+    {
+        cx = _clamp(_axis_step(&filter->x, &filter->vx, sx));
+        cy = _clamp(_axis_step(&filter->y, &filter->vy, sy));
+
+        if (ABS((rt_int32_t)cx - filter->out_x) < TOUCH_FILTER_DEADZONE &&
+                ABS((rt_int32_t)cy - filter->out_y) < TOUCH_FILTER_DEADZONE)
+            return -RT_EBUSY;
+    }
+
+    filter->out_x = *x = cx;
+    filter->out_y = *y = cy;
+
+    return RT_EOK;
+}
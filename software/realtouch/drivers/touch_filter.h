@@ -0,0 +1,63 @@
+/*
+ * File      : touch_filter.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#ifndef __TOUCH_FILTER_H__
+#define __TOUCH_FILTER_H__
+
+#include <rtthread.h>
+
+/*
+ * Position filter of the resistive touch screen, in ADC steps.
+ *
+ * A batch of conversions per axis is reduced to the mean of the samples
+ * near their median; a batch whose samples do not agree, the pen bouncing
+ * or lifting, is dropped. The batches then go through an IIR filter which
+ * smooths hard while the pen rests and follows closely while it moves, a
+ * velocity estimate leads the output by one batch to make up for the lag,
+ * and a dead zone keeps a resting pen from reporting noise.
+ */
+#define TOUCH_FILTER_BATCH_MAX  16
+
+/* samples further from the median are outliers */
+#define TOUCH_FILTER_SPREAD     24
+/* a move less than this from the last output is not reported */
+#define TOUCH_FILTER_DEADZONE   6
+/* moves of at least this per batch are followed without smoothing */
+#define TOUCH_FILTER_FAST       24
+
+struct touch_filter
+{
+    /* 1/16 ADC steps */
+    rt_int32_t x, y;
+    rt_int32_t vx, vy;
+
+    rt_uint16_t out_x, out_y;
+    rt_bool_t started;
+};
+
+void touch_filter_reset(struct touch_filter *filter);
+
+/*
+ * Feed n conversions of each axis, the arrays are reordered. Returns RT_EOK
+ * with a new position in x and y, -RT_EBUSY when the pen has not left the
+ * dead zone, -RT_ERROR when the batch is dropped.
+ */
+rt_err_t touch_filter_feed(struct touch_filter *filter,
+                           rt_uint16_t *xs, rt_uint16_t *ys, int n,
+                           rt_uint16_t *x, rt_uint16_t *y);
+
+/* the median of n values in O(n), the array is reordered */
+rt_uint16_t touch_median(rt_uint16_t *values, int n);
+
+#endif
@@ -50,7 +50,9 @@
 
 #include "coder.h"
 
-#define static_buffers
+/* decoder state is allocated from the fast region (CCM) when a decoder is
+ * created, define static_buffers to keep it in .bss instead. */
+// #define static_buffers
 #ifdef static_buffers
 MP3DecInfo  mp3DecInfo;     //  0x7f0 =  2032 
 SubbandInfo sbi;            // 0x2204 =  8708
@@ -62,8 +64,9 @@ SideInfo si;                //  0x148 =   328
 FrameHeader fh;             //   0x38 =    56
 #else
 #include <rtthread.h>
-#define malloc rt_malloc
-#define free rt_free
+#include "mem_region.h"
+#define malloc(size)	mem_region_malloc(MEM_REGION_FAST, (size))
+#define free			mem_region_free
 #endif
 
 /**************************************************************************************
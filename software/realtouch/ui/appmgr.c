@@ -4,8 +4,10 @@
 #include <rtgui/widgets/listbox.h>
 
 #include "apps_list.h"
+#include "program.h"
 #include "block_panel.h"
 #include "statusbar.h"
+#include "input_queue.h"
 
 #include "xpm/home.xpm"
 #include "xpm/home_gray.xpm"
@@ -21,9 +23,19 @@ rt_bool_t event_handler(struct rtgui_object* object, rtgui_event_t* event)
     switch (event->type)
     {
     case RTGUI_EVENT_APP_CREATE:
+        input_queue_watch(((struct rtgui_event_application*)event)->app->mq);
+        return apps_list_event_handler(object, event);
+
     case RTGUI_EVENT_APP_DESTROY:
+        input_queue_unwatch(((struct rtgui_event_application*)event)->app->mq);
         return apps_list_event_handler(object, event);
 
+    case RTGUI_EVENT_COMMAND:
+        if (program_event_handler(object, event) == RT_TRUE)
+            return RT_TRUE;
+        result = rtgui_app_event_handler(object, event);
+        break;
+
     default:
         /* invoke parent event handler */
         result = rtgui_app_event_handler(object, event);
@@ -101,6 +113,7 @@ void app_mgr_entry(void* parameter)
     {
         /* set as window manager */
         rtgui_app_set_as_wm(application);
+        input_queue_watch(application->mq);
 
         /* initialize status bar */
         statusbar_init();
@@ -0,0 +1,559 @@
+/*
+ * File      : font_hz_cache.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-14     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <rtgui/rtgui.h>
+#include <rtgui/dc.h>
+#include <rtgui/font.h>
+#include <rtgui/color.h>
+#include <rtgui/driver.h>
+#include <rtgui/rtgui_system.h>
+
+#include "mem_region.h"
+#include "font_hz_cache.h"
+
+#ifdef RTGUI_USING_HZ_FILE
+#include <dfs_posix.h>
+
+#define HZ_CACHE_SLOTS          96      /* glyphs kept per font size */
+#define HZ_CACHE_HASH           32      /* hash buckets, power of 2 */
+#define HZ_FONT_SIZE_MAX        16
+#define HZ_RUN_MAX              64      /* glyphs per blitted run, < HZ_CACHE_SLOTS */
+
+struct hz_glyph
+{
+    struct hz_glyph *hash_next;
+    struct hz_glyph *lru_prev, *lru_next;
+
+    rt_uint16_t hz_id;
+    rt_uint16_t fc, bc;         /* colours of pixels, in device format */
+    rt_uint8_t  expanded;
+    rt_uint8_t  invalid;        /* the bitmap could not be read, read it again */
+
+    rt_uint8_t  bitmap[HZ_FONT_SIZE_MAX * ((HZ_FONT_SIZE_MAX + 7) / 8)];
+    rt_uint16_t pixels[HZ_FONT_SIZE_MAX * HZ_FONT_SIZE_MAX];
+};
+
+struct hz_cache_font
+{
+    rt_uint16_t font_size;
+    rt_uint16_t font_data_size;
+    const char *font_fn;
+    int fd;
+
+    struct hz_glyph *slab;
+    struct hz_glyph *free_list;
+    struct hz_glyph *hash[HZ_CACHE_HASH];
+    struct hz_glyph lru;        /* lru.lru_next is the most recently used */
+
+    rt_uint16_t *line;          /* one scan-line of a run */
+    struct rt_mutex lock;
+
+    struct rtgui_hz_cache_stat stat;
+};
+
+static void hz_cache_font_init(struct rtgui_font *font);
+static void hz_cache_font_load(struct rtgui_font *font);
+static void hz_cache_font_draw_text(struct rtgui_font *font, struct rtgui_dc *dc,
+                                    const char *text, rt_ubase_t length, struct rtgui_rect *rect);
+static void hz_cache_font_get_metrics(struct rtgui_font *font, const char *text, struct rtgui_rect *rect);
+
+static const struct rtgui_font_engine hz_cache_font_engine =
+{
+    hz_cache_font_init,
+    hz_cache_font_load,
+    hz_cache_font_draw_text,
+    hz_cache_font_get_metrics
+};
+
+#ifdef RTGUI_USING_FONT12
+static struct hz_cache_font _hz12 =
+{
+    12,                         /* font size */
+    24,                         /* font data size */
+    "/resource/hzk12.fnt",      /* font file name */
+    -1,                         /* fd */
+};
+static struct rtgui_font rtgui_font_hz12_cache =
+{
+    "hz",                       /* family */
+    12,                         /* height */
+    1,                          /* refer count */
+    &hz_cache_font_engine,      /* font engine */
+    &_hz12,                     /* font private data */
+};
+#endif
+
+#ifdef RTGUI_USING_FONT16
+static struct hz_cache_font _hz16 =
+{
+    16,                         /* font size */
+    32,                         /* font data size */
+    "/resource/hzk16.fnt",      /* font file name */
+    -1,                         /* fd */
+};
+static struct rtgui_font rtgui_font_hz16_cache =
+{
+    "hz",                       /* family */
+    16,                         /* height */
+    1,                          /* refer count */
+    &hz_cache_font_engine,      /* font engine */
+    &_hz16,                     /* font private data */
+};
+#endif
+
+static void hz_cache_font_init(struct rtgui_font *font)
+{
+    /* set up once by rtgui_font_hz_cache_init() */
+}
+
+static void hz_cache_font_load(struct rtgui_font *font)
+{
+    /* the font file and the cache are opened on first use */
+}
+
+/* the caller holds hz_font->lock */
+static rt_err_t _cache_setup(struct hz_cache_font *hz_font)
+{
+    int index;
+
+    if (hz_font->slab != RT_NULL)
+        return RT_EOK;
+
+    hz_font->slab = mem_region_malloc(MEM_REGION_BULK,
+                                      sizeof(struct hz_glyph) * HZ_CACHE_SLOTS);
+    hz_font->line = mem_region_malloc(MEM_REGION_FAST,
+                                      sizeof(rt_uint16_t) * HZ_RUN_MAX * HZ_FONT_SIZE_MAX);
+    if (hz_font->slab == RT_NULL || hz_font->line == RT_NULL)
+    {
+        mem_region_free(hz_font->slab);
+        mem_region_free(hz_font->line);
+        hz_font->slab = RT_NULL;
+        hz_font->line = RT_NULL;
+        return -RT_ENOMEM;
+    }
+
+    hz_font->free_list = RT_NULL;
+    for (index = 0; index < HZ_CACHE_SLOTS; index ++)
+    {
+        hz_font->slab[index].hash_next = hz_font->free_list;
+        hz_font->free_list = &hz_font->slab[index];
+    }
+    rt_memset(hz_font->hash, 0, sizeof(hz_font->hash));
+
+    return RT_EOK;
+}
+
+rt_inline int _hash(rt_uint16_t hz_id)
+{
+    return (hz_id ^ (hz_id >> 8)) & (HZ_CACHE_HASH - 1);
+}
+
+rt_inline void _lru_remove(struct hz_glyph *glyph)
+{
+    glyph->lru_prev->lru_next = glyph->lru_next;
+    glyph->lru_next->lru_prev = glyph->lru_prev;
+}
+
+rt_inline void _lru_insert_head(struct hz_cache_font *hz_font, struct hz_glyph *glyph)
+{
+    glyph->lru_next = hz_font->lru.lru_next;
+    glyph->lru_prev = &hz_font->lru;
+    hz_font->lru.lru_next->lru_prev = glyph;
+    hz_font->lru.lru_next = glyph;
+}
+
+static void _hash_remove(struct hz_cache_font *hz_font, struct hz_glyph *glyph)
+{
+    struct hz_glyph **ptr;
+
+    for (ptr = &hz_font->hash[_hash(glyph->hz_id)]; *ptr != RT_NULL; ptr = &(*ptr)->hash_next)
+    {
+        if (*ptr == glyph)
+        {
+            *ptr = glyph->hash_next;
+            break;
+        }
+    }
+}
+
+static struct hz_glyph *_glyph_alloc(struct hz_cache_font *hz_font, rt_uint16_t hz_id)
+{
+    struct hz_glyph *glyph;
+
+    if (hz_font->free_list != RT_NULL)
+    {
+        glyph = hz_font->free_list;
+        hz_font->free_list = glyph->hash_next;
+    }
+    else
+    {
+        /* evict the least recently used glyph */
+        glyph = hz_font->lru.lru_prev;
+        _lru_remove(glyph);
+        _hash_remove(hz_font, glyph);
+        hz_font->stat.evict ++;
+    }
+
+    glyph->hz_id = hz_id;
+    glyph->expanded = 0;
+    glyph->invalid = 0;
+    glyph->hash_next = hz_font->hash[_hash(hz_id)];
+    hz_font->hash[_hash(hz_id)] = glyph;
+    _lru_insert_head(hz_font, glyph);
+
+    return glyph;
+}
+
+static rt_err_t _glyph_read(struct hz_cache_font *hz_font, struct hz_glyph *glyph)
+{
+    rt_uint32_t seek;
+
+    if (hz_font->fd < 0)
+    {
+        hz_font->fd = open(hz_font->font_fn, O_RDONLY, 0);
+        if (hz_font->fd < 0)
+            return -RT_ERROR;
+    }
+
+    /* calculate hz index */
+    seek = 94 * (((glyph->hz_id & 0xff) - 0xA0) - 1) + ((glyph->hz_id >> 8) - 0xA0) - 1;
+    seek *= hz_font->font_data_size;
+
+    if (lseek(hz_font->fd, seek, SEEK_SET) < 0 ||
+            read(hz_font->fd, glyph->bitmap, hz_font->font_data_size) != hz_font->font_data_size)
+        return -RT_ERROR;
+
+    return RT_EOK;
+}
+
+static void _glyph_expand(struct hz_cache_font *hz_font, struct hz_glyph *glyph,
+                          rt_uint16_t fc, rt_uint16_t bc)
+{
+    const rt_uint8_t *bits = glyph->bitmap;
+    rt_uint16_t *pixel = glyph->pixels;
+    int word_bytes, i, j;
+
+    word_bytes = (hz_font->font_size + 7) / 8;
+    for (i = 0; i < hz_font->font_size; i ++)
+    {
+        for (j = 0; j < hz_font->font_size; j ++)
+            *pixel++ = (bits[j >> 3] & (0x80 >> (j & 0x07))) ? fc : bc;
+        bits += word_bytes;
+    }
+
+    glyph->fc = fc;
+    glyph->bc = bc;
+    glyph->expanded = 1;
+}
+
+/*
+ * Look up a glyph, the pixels are expanded for (fc, bc) when expand is set.
+ * A glyph that can not be read from the font file is blank and read again
+ * on its next use. The caller holds hz_font->lock.
+ */
+static struct hz_glyph *_glyph_get(struct hz_cache_font *hz_font, rt_uint16_t hz_id,
+                                   rt_bool_t expand, rt_uint16_t fc, rt_uint16_t bc)
+{
+    struct hz_glyph *glyph, *same_id = RT_NULL;
+
+    for (glyph = hz_font->hash[_hash(hz_id)]; glyph != RT_NULL; glyph = glyph->hash_next)
+    {
+        if (glyph->hz_id != hz_id)
+            continue;
+
+        if (glyph->invalid)
+        {
+            /* the last read failed, read again into the same slot */
+            _lru_remove(glyph);
+            _lru_insert_head(hz_font, glyph);
+            break;
+        }
+
+        if (expand == RT_FALSE ||
+                (glyph->expanded && glyph->fc == fc && glyph->bc == bc))
+        {
+            hz_font->stat.hit ++;
+            _lru_remove(glyph);
+            _lru_insert_head(hz_font, glyph);
+            return glyph;
+        }
+        same_id = glyph;
+    }
+
+    if (same_id != RT_NULL)
+    {
+        /* same character in other colours, take the bitmap from there */
+        _lru_remove(same_id);
+        _lru_insert_head(hz_font, same_id);
+
+        glyph = _glyph_alloc(hz_font, hz_id);
+        if (glyph != same_id)
+            rt_memcpy(glyph->bitmap, same_id->bitmap, hz_font->font_data_size);
+        hz_font->stat.expand ++;
+    }
+    else
+    {
+        if (glyph == RT_NULL)
+            glyph = _glyph_alloc(hz_font, hz_id);
+        glyph->expanded = 0;
+        glyph->invalid = 0;
+        if (_glyph_read(hz_font, glyph) != RT_EOK)
+        {
+            /* draw it blank this time, but do not keep it as the glyph */
+            rt_memset(glyph->bitmap, 0, sizeof(glyph->bitmap));
+            glyph->invalid = 1;
+        }
+        hz_font->stat.miss ++;
+    }
+
+    if (expand)
+        _glyph_expand(hz_font, glyph, fc, bc);
+
+    return glyph;
+}
+
+/* draw a run of Chinese characters with background, one blit_line per scan-line */
+static void _draw_opaque(struct hz_cache_font *hz_font, struct rtgui_dc *dc,
+                         const rt_uint8_t *str, rt_ubase_t len, struct rtgui_rect *rect)
+{
+    struct hz_glyph *glyphs[HZ_RUN_MAX];
+    rt_uint16_t fc, bc;
+    int size, count, width, h, i, k;
+
+    size = hz_font->font_size;
+    if (rtgui_graphic_driver_get_default()->pixel_format == RTGRAPHIC_PIXEL_FORMAT_RGB565)
+    {
+        fc = rtgui_color_to_565(RTGUI_DC_FC(dc));
+        bc = rtgui_color_to_565(RTGUI_DC_BC(dc));
+    }
+    else
+    {
+        fc = rtgui_color_to_565p(RTGUI_DC_FC(dc));
+        bc = rtgui_color_to_565p(RTGUI_DC_BC(dc));
+    }
+
+    h = (size + rect->y1 > rect->y2) ? rect->y2 - rect->y1 : size;
+
+    while (len >= 2 && rect->x1 < rect->x2)
+    {
+        /* collect the glyphs which fit into the rect */
+        for (count = 0; count < HZ_RUN_MAX && len >= 2 &&
+                rect->x1 + count * size < rect->x2; count ++)
+        {
+            glyphs[count] = _glyph_get(hz_font, str[0] | (str[1] << 8), RT_TRUE, fc, bc);
+            str += 2;
+            len -= 2;
+        }
+
+        width = count * size;
+        if (rect->x1 + width > rect->x2)
+            width = rect->x2 - rect->x1;
+
+        for (i = 0; i < h; i ++)
+        {
+            for (k = 0; k < count; k ++)
+                rt_memcpy(hz_font->line + k * size, glyphs[k]->pixels + i * size,
+                          size * sizeof(rt_uint16_t));
+
+            dc->engine->blit_line(dc, rect->x1, rect->x1 + width, rect->y1 + i,
+                                  (rt_uint8_t *)hz_font->line);
+        }
+
+        rect->x1 += count * size;
+    }
+}
+
+/* draw a run of Chinese characters without background, as horizontal runs */
+static void _draw_transparent(struct hz_cache_font *hz_font, struct rtgui_dc *dc,
+                              const rt_uint8_t *str, rt_ubase_t len, struct rtgui_rect *rect)
+{
+    struct hz_glyph *glyph;
+    const rt_uint8_t *bits;
+    int size, word_bytes, h, i, j, start, x_end;
+
+    size = hz_font->font_size;
+    word_bytes = (size + 7) / 8;
+    h = (size + rect->y1 > rect->y2) ? rect->y2 - rect->y1 : size;
+
+    while (len >= 2 && rect->x1 < rect->x2)
+    {
+        glyph = _glyph_get(hz_font, str[0] | (str[1] << 8), RT_FALSE, 0, 0);
+
+        x_end = size;
+        if (rect->x1 + x_end > rect->x2)
+            x_end = rect->x2 - rect->x1;
+
+        bits = glyph->bitmap;
+        for (i = 0; i < h; i ++, bits += word_bytes)
+        {
+            for (j = 0; j < x_end; j ++)
+            {
+                if (!(bits[j >> 3] & (0x80 >> (j & 0x07))))
+                    continue;
+
+                for (start = j; j < x_end && (bits[j >> 3] & (0x80 >> (j & 0x07))); j ++);
+                rtgui_dc_draw_hline(dc, rect->x1 + start, rect->x1 + j, rect->y1 + i);
+            }
+        }
+
+        rect->x1 += size;
+        str += 2;
+        len -= 2;
+    }
+}
+
+static void hz_cache_font_draw_text(struct rtgui_font *font, struct rtgui_dc *dc,
+                                    const char *text, rt_ubase_t length, struct rtgui_rect *rect)
+{
+    rt_uint32_t len;
+    struct rtgui_font *efont;
+    struct hz_cache_font *hz_font = (struct hz_cache_font *)font->data;
+    struct rtgui_rect text_rect;
+    rt_bool_t opaque;
+
+    RT_ASSERT(dc != RT_NULL);
+    RT_ASSERT(hz_font != RT_NULL);
+
+    rtgui_font_get_metrics(rtgui_dc_get_gc(dc)->font, text, &text_rect);
+    rtgui_rect_moveto_align(rect, &text_rect, RTGUI_DC_TEXTALIGN(dc));
+
+    /* get English font */
+    efont = rtgui_font_refer((const rt_uint8_t *)"asc", hz_font->font_size);
+    if (efont == RT_NULL) efont = rtgui_font_default(); /* use system default font */
+
+    opaque = (rtgui_dc_get_gc(dc)->textstyle & RTGUI_TEXTSTYLE_DRAW_BACKGROUND) ? RT_TRUE : RT_FALSE;
+
+    while (length > 0)
+    {
+        len = 0;
+        while (((rt_uint8_t)*(text + len)) < 0x80 && *(text + len) && len < length) len ++;
+        /* draw text with English font */
+        if (len > 0)
+        {
+            rtgui_font_draw(efont, dc, text, len, &text_rect);
+
+            text += len;
+            length -= len;
+        }
+
+        len = 0;
+        while (((rt_uint8_t)*(text + len)) >= 0x80 && len < length) len ++;
+        if (len > 0)
+        {
+            rt_mutex_take(&hz_font->lock, RT_WAITING_FOREVER);
+            if (_cache_setup(hz_font) == RT_EOK)
+            {
+                if (opaque)
+                    _draw_opaque(hz_font, dc, (const rt_uint8_t *)text, len, &text_rect);
+                else
+                    _draw_transparent(hz_font, dc, (const rt_uint8_t *)text, len, &text_rect);
+            }
+            rt_mutex_release(&hz_font->lock);
+
+            text += len;
+            length -= len;
+        }
+
+        if (*text == '\0')
+            break;
+    }
+
+    rtgui_font_derefer(efont);
+}
+
+static void hz_cache_font_get_metrics(struct rtgui_font *font, const char *text, struct rtgui_rect *rect)
+{
+    struct hz_cache_font *hz_font = (struct hz_cache_font *)font->data;
+    RT_ASSERT(hz_font != RT_NULL);
+
+    /* set metrics rect */
+    rect->x1 = rect->y1 = 0;
+    rect->x2 = (rt_int16_t)(hz_font->font_size / 2 * rt_strlen((const char *)text));
+    rect->y2 = hz_font->font_size;
+}
+
+static void _font_replace(struct rtgui_font *font)
+{
+    struct hz_cache_font *hz_font = (struct hz_cache_font *)font->data;
+    struct rtgui_font *old;
+
+    hz_font->fd = -1;
+    hz_font->slab = RT_NULL;
+    hz_font->lru.lru_next = hz_font->lru.lru_prev = &hz_font->lru;
+    rt_mutex_init(&hz_font->lock, "hzcache", RT_IPC_FLAG_FIFO);
+
+    old = rtgui_font_refer((const rt_uint8_t *)font->family, font->height);
+    if (old != RT_NULL)
+    {
+        rtgui_font_derefer(old);
+        if (rtgui_font_default() == old)
+            rtgui_font_set_defaut(font);
+        rtgui_font_system_remove_font(old);
+    }
+
+    rtgui_font_system_add_font(font);
+}
+
+void rtgui_font_hz_cache_init(void)
+{
+#ifdef RTGUI_USING_FONT12
+    _font_replace(&rtgui_font_hz12_cache);
+#endif
+#ifdef RTGUI_USING_FONT16
+    _font_replace(&rtgui_font_hz16_cache);
+#endif
+}
+
+void rtgui_font_hz_cache_stat(rt_uint16_t font_size, struct rtgui_hz_cache_stat *stat)
+{
+    rt_memset(stat, 0, sizeof(struct rtgui_hz_cache_stat));
+
+#ifdef RTGUI_USING_FONT12
+    if (font_size == 12) *stat = _hz12.stat;
+#endif
+#ifdef RTGUI_USING_FONT16
+    if (font_size == 16) *stat = _hz16.stat;
+#endif
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void list_hz_cache(void)
+{
+    struct rtgui_hz_cache_stat stat;
+    int size;
+
+    rt_kprintf("font hit      expand   miss     evict\n");
+    rt_kprintf("---- -------- -------- -------- --------\n");
+    for (size = 12; size <= 16; size += 4)
+    {
+        rtgui_font_hz_cache_stat(size, &stat);
+        rt_kprintf("hz%-2d %-8d %-8d %-8d %-8d\n", size,
+                   stat.hit, stat.expand, stat.miss, stat.evict);
+    }
+}
+FINSH_FUNCTION_EXPORT(list_hz_cache, list Chinese glyph cache statistics);
+#endif
+
+#else
+void rtgui_font_hz_cache_init(void)
+{
+}
+
+void rtgui_font_hz_cache_stat(rt_uint16_t font_size, struct rtgui_hz_cache_stat *stat)
+{
+    rt_memset(stat, 0, sizeof(struct rtgui_hz_cache_stat));
+}
+#endif /* RTGUI_USING_HZ_FILE */
@@ -0,0 +1,41 @@
+/*
+ * File      : font_hz_cache.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-14     realtouch    first version
+ */
+
+#ifndef __FONT_HZ_CACHE_H__
+#define __FONT_HZ_CACHE_H__
+
+#include <rtgui/font.h>
+
+/*
+ * Cached Chinese file font.
+ *
+ * Glyphs read from the HZK font files are kept in a bounded cache, both as
+ * bitmap and pre-expanded to RGB565 pixels for one foreground/background
+ * colour pair. Opaque text is drawn with one blit_line per scan-line for a
+ * whole run of characters, transparent text with horizontal runs.
+ */
+struct rtgui_hz_cache_stat
+{
+    rt_uint32_t hit;            /* glyph found with the requested colours */
+    rt_uint32_t expand;         /* bitmap cached, pixels expanded again */
+    rt_uint32_t miss;           /* glyph read from the font file */
+    rt_uint32_t evict;          /* glyphs dropped to make room */
+};
+
+/* replace the "hz" file fonts registered by rtgui_font_system_init() */
+void rtgui_font_hz_cache_init(void);
+
+void rtgui_font_hz_cache_stat(rt_uint16_t font_size, struct rtgui_hz_cache_stat *stat);
+
+#endif
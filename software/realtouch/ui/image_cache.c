@@ -0,0 +1,501 @@
+/*
+ * File      : image_cache.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <rtm.h>
+#include <dfs_posix.h>
+#include <rtgui/rtgui_system.h>
+
+#include "image_cache.h"
+#include "mem_region.h"
+
+#define IMAGE_CACHE_DECODERS    4
+/* files remembered as not decodable */
+#define IMAGE_CACHE_FAILED      8
+
+struct image_cache_decoder
+{
+    const char *type;
+    image_cache_decoder_t decode;
+};
+
+struct image_cache_failure
+{
+    char *filename;
+    rt_uint32_t mtime;
+};
+
+static struct
+{
+    /* images nobody holds, most recently used first */
+    rt_list_t lru;
+    /* images with a reference */
+    rt_list_t used;
+
+    struct rt_mutex lock;
+    rt_bool_t inited;
+
+    struct image_cache_decoder decoders[IMAGE_CACHE_DECODERS];
+    /* oldest first */
+    struct image_cache_failure failed[IMAGE_CACHE_FAILED];
+    struct image_cache_stat stat;
+} _cache;
+
+void image_cache_init(void)
+{
+    if (_cache.inited)
+        return;
+
+    rt_list_init(&_cache.lru);
+    rt_list_init(&_cache.used);
+    rt_mutex_init(&_cache.lock, "icache", RT_IPC_FLAG_FIFO);
+    _cache.inited = RT_TRUE;
+}
+
+static rt_uint32_t _pixel_bytes(rt_uint8_t format)
+{
+    switch (format)
+    {
+    case RTGRAPHIC_PIXEL_FORMAT_MONO:
+    case RTGRAPHIC_PIXEL_FORMAT_GRAY4:
+    case RTGRAPHIC_PIXEL_FORMAT_GRAY16:
+    case RTGRAPHIC_PIXEL_FORMAT_RGB332:
+        return 1;
+    case RTGRAPHIC_PIXEL_FORMAT_RGB666:
+    case RTGRAPHIC_PIXEL_FORMAT_RGB888:
+        return 3;
+    case RTGRAPHIC_PIXEL_FORMAT_ARGB888:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+/* the engines do not tell what they allocate, count the pixels */
+static rt_uint32_t _image_size(rtgui_image_t *image, rt_uint8_t format)
+{
+    rt_uint32_t size;
+
+    size = sizeof(struct image_cache_item) + sizeof(rtgui_image_t) +
+           image->w * image->h * _pixel_bytes(format);
+    if (image->palette != RT_NULL)
+        size += image->palette->ncolors * sizeof(rtgui_color_t);
+
+    return size;
+}
+
+static void _item_destroy(struct image_cache_item *item)
+{
+    rt_list_remove(&item->list);
+    _cache.stat.images --;
+    _cache.stat.bytes -= item->size;
+
+    rtgui_image_destroy(item->image);
+    rt_free(item->filename);
+    rt_free(item);
+}
+
+static void _cache_shrink(rt_uint32_t size)
+{
+    struct image_cache_item *item;
+
+    while (_cache.stat.bytes > size && !rt_list_isempty(&_cache.lru))
+    {
+        item = rt_list_entry(_cache.lru.prev, struct image_cache_item, list);
+        _item_destroy(item);
+        _cache.stat.evictions ++;
+    }
+}
+
+static struct image_cache_item *_item_find(rt_list_t *list, const char *filename,
+        rt_uint16_t width, rt_uint16_t height, rt_uint8_t format)
+{
+    struct rt_list_node *node;
+    struct image_cache_item *item;
+
+    for (node = list->next; node != list; node = node->next)
+    {
+        item = rt_list_entry(node, struct image_cache_item, list);
+        if (!item->stale && item->width == width && item->height == height &&
+                item->format == format && rt_strcmp(item->filename, filename) == 0)
+            return item;
+    }
+
+    return RT_NULL;
+}
+
+static struct image_cache_item *_cache_find(const char *filename,
+        rt_uint16_t width, rt_uint16_t height, rt_uint8_t format)
+{
+    struct image_cache_item *item;
+
+    item = _item_find(&_cache.used, filename, width, height, format);
+    if (item == RT_NULL)
+        item = _item_find(&_cache.lru, filename, width, height, format);
+
+    return item;
+}
+
+/* the file of the image was replaced, the holders keep the old image */
+static void _item_retire(struct image_cache_item *item)
+{
+    if (item->refcount == 0)
+        _item_destroy(item);
+    else
+        item->stale = RT_TRUE;
+}
+
+static image_cache_decoder_t _decoder_find(const char *filename)
+{
+    struct rtgui_image_engine *engine;
+    int index;
+
+    engine = rtgui_image_get_engine_by_filename(filename);
+    if (engine == RT_NULL)
+        return RT_NULL;
+
+    for (index = 0; index < IMAGE_CACHE_DECODERS; index ++)
+    {
+        if (_cache.decoders[index].type != RT_NULL &&
+                rt_strcmp(_cache.decoders[index].type, engine->name) == 0)
+            return _cache.decoders[index].decode;
+    }
+
+    return RT_NULL;
+}
+
+/* allocations the memory regions could not satisfy so far */
+static rt_uint32_t _alloc_failures(void)
+{
+    struct mem_region_stat stat;
+    rt_uint32_t failures = 0;
+    int id;
+
+    for (id = 0; id < MEM_REGION_MAX; id ++)
+    {
+        if (mem_region_stat((enum mem_region_id)id, &stat) == RT_EOK)
+            failures += stat.fail_count;
+    }
+
+    return failures;
+}
+
+static struct image_cache_failure *_failure_find(const char *filename)
+{
+    int index;
+
+    for (index = 0; index < IMAGE_CACHE_FAILED; index ++)
+    {
+        if (_cache.failed[index].filename != RT_NULL &&
+                rt_strcmp(_cache.failed[index].filename, filename) == 0)
+            return &_cache.failed[index];
+    }
+
+    return RT_NULL;
+}
+
+/* the file did not decode for other reasons than memory */
+static void _failure_add(const char *filename, rt_uint32_t mtime)
+{
+    struct image_cache_failure *failure;
+    char *name;
+
+    name = rt_strdup(filename);
+    if (name == RT_NULL)
+        return;
+
+    failure = _failure_find(filename);
+    if (failure == RT_NULL)
+    {
+        /* forget the oldest */
+        rt_free(_cache.failed[0].filename);
+        rt_memmove(&_cache.failed[0], &_cache.failed[1],
+                   (IMAGE_CACHE_FAILED - 1) * sizeof(struct image_cache_failure));
+        failure = &_cache.failed[IMAGE_CACHE_FAILED - 1];
+    }
+    else
+        rt_free(failure->filename);
+
+    failure->filename = name;
+    failure->mtime = mtime;
+    _cache.stat.failed ++;
+}
+
+static rtgui_image_t *_image_decode(image_cache_decoder_t decode, const char *filename,
+                                    rt_uint16_t width, rt_uint16_t height)
+{
+    if (decode != RT_NULL)
+        return decode(filename, width, height);
+
+    return rtgui_image_create(filename, RT_TRUE);
+}
+
+/*
+ * Look up the image, decode it on a miss. The decode runs without the
+ * lock, another thread may have put the same image into the cache
+ * meanwhile: then that one is used.
+ */
+static struct image_cache_item *_cache_get(const char *filename,
+        rt_uint16_t width, rt_uint16_t height, rt_uint8_t format, rt_bool_t hold)
+{
+    struct image_cache_item *item, *other;
+    struct image_cache_failure *failure;
+    image_cache_decoder_t decode;
+    struct stat st;
+    rtgui_image_t *image;
+    rt_uint32_t failures;
+
+    if (rtgui_image_get_engine_by_filename(filename) == RT_NULL ||
+            stat(filename, &st) != 0)
+        return RT_NULL;
+
+    image_cache_init();
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    decode = _decoder_find(filename);
+    /* no way to decode to another size */
+    if (decode == RT_NULL)
+        width = height = 0;
+
+    item = _cache_find(filename, width, height, format);
+    if (item != RT_NULL && item->mtime != (rt_uint32_t)st.st_mtime)
+    {
+        _item_retire(item);
+        item = RT_NULL;
+    }
+
+    if (item != RT_NULL)
+    {
+        _cache.stat.hits ++;
+        goto __hold;
+    }
+
+    /* a file that did not decode is tried again once it changed */
+    failure = _failure_find(filename);
+    if (failure != RT_NULL && failure->mtime == (rt_uint32_t)st.st_mtime)
+    {
+        rt_mutex_release(&_cache.lock);
+        return RT_NULL;
+    }
+    _cache.stat.misses ++;
+    rt_mutex_release(&_cache.lock);
+
+    failures = _alloc_failures();
+    image = _image_decode(decode, filename, width, height);
+    if (image == RT_NULL)
+    {
+        rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+        if (_alloc_failures() == failures)
+        {
+            _failure_add(filename, st.st_mtime);
+            rt_mutex_release(&_cache.lock);
+            return RT_NULL;
+        }
+
+        /* out of memory: give it the images nobody holds */
+        if (rt_list_isempty(&_cache.lru))
+        {
+            rt_mutex_release(&_cache.lock);
+            return RT_NULL;
+        }
+        _cache_shrink(0);
+        rt_mutex_release(&_cache.lock);
+
+        image = _image_decode(decode, filename, width, height);
+        if (image == RT_NULL)
+            return RT_NULL;
+    }
+
+    item = (struct image_cache_item *)rt_malloc(sizeof(struct image_cache_item));
+    if (item != RT_NULL)
+    {
+        item->filename = rt_strdup(filename);
+        if (item->filename == RT_NULL)
+        {
+            rt_free(item);
+            item = RT_NULL;
+        }
+    }
+    if (item == RT_NULL)
+    {
+        rtgui_image_destroy(image);
+        return RT_NULL;
+    }
+
+    item->image = image;
+    item->mtime = st.st_mtime;
+    item->width = width;
+    item->height = height;
+    item->format = format;
+    item->stale = RT_FALSE;
+    item->refcount = 0;
+    item->size = _image_size(image, format);
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    other = _cache_find(filename, width, height, format);
+    if (other != RT_NULL && other->mtime == item->mtime)
+    {
+        rtgui_image_destroy(item->image);
+        rt_free(item->filename);
+        rt_free(item);
+        item = other;
+    }
+    else
+    {
+        if (other != RT_NULL)
+            _item_retire(other);
+        rt_list_insert_after(&_cache.lru, &item->list);
+        _cache.stat.images ++;
+        _cache.stat.bytes += item->size;
+    }
+
+__hold:
+    rt_list_remove(&item->list);
+    if (hold == RT_TRUE)
+    {
+        item->refcount ++;
+        rt_list_insert_after(&_cache.used, &item->list);
+    }
+    else if (item->refcount > 0)
+        rt_list_insert_after(&_cache.used, &item->list);
+    else
+        rt_list_insert_after(&_cache.lru, &item->list);
+
+    _cache_shrink(IMAGE_CACHE_SIZE);
+    rt_mutex_release(&_cache.lock);
+
+    return item;
+}
+
+struct image_cache_item *image_cache_get(const char *filename,
+        rt_uint16_t width, rt_uint16_t height, rt_uint8_t format)
+{
+    RT_ASSERT(filename != RT_NULL);
+
+    return _cache_get(filename, width, height, format, RT_TRUE);
+}
+RTM_EXPORT(image_cache_get);
+
+void image_cache_put(struct image_cache_item *item)
+{
+    if (item == RT_NULL)
+        return;
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    RT_ASSERT(item->refcount > 0);
+
+    item->refcount --;
+    if (item->refcount == 0)
+    {
+        if (item->stale)
+            _item_destroy(item);
+        else
+        {
+            rt_list_remove(&item->list);
+            rt_list_insert_after(&_cache.lru, &item->list);
+            _cache_shrink(IMAGE_CACHE_SIZE);
+        }
+    }
+    rt_mutex_release(&_cache.lock);
+}
+RTM_EXPORT(image_cache_put);
+
+rt_err_t image_cache_prefetch(const char *filename,
+                              rt_uint16_t width, rt_uint16_t height, rt_uint8_t format)
+{
+    RT_ASSERT(filename != RT_NULL);
+
+    if (_cache_get(filename, width, height, format, RT_FALSE) == RT_NULL)
+        return -RT_ERROR;
+
+    return RT_EOK;
+}
+RTM_EXPORT(image_cache_prefetch);
+
+void image_cache_shrink(rt_uint32_t size)
+{
+    image_cache_init();
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    _cache_shrink(size);
+    rt_mutex_release(&_cache.lock);
+}
+RTM_EXPORT(image_cache_shrink);
+
+rt_err_t image_cache_register_decoder(const char *type, image_cache_decoder_t decoder)
+{
+    int index;
+    rt_err_t result = -RT_EFULL;
+
+    image_cache_init();
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    for (index = 0; index < IMAGE_CACHE_DECODERS; index ++)
+    {
+        if (_cache.decoders[index].type == RT_NULL ||
+                rt_strcmp(_cache.decoders[index].type, type) == 0)
+        {
+            _cache.decoders[index].type = type;
+            _cache.decoders[index].decode = decoder;
+            result = RT_EOK;
+            break;
+        }
+    }
+    rt_mutex_release(&_cache.lock);
+
+    return result;
+}
+
+void image_cache_get_stat(struct image_cache_stat *stat)
+{
+    *stat = _cache.stat;
+}
+RTM_EXPORT(image_cache_get_stat);
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void icache(void)
+{
+    struct rt_list_node *node;
+    struct image_cache_item *item;
+    int index;
+
+    image_cache_init();
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    for (node = _cache.used.next; node != &_cache.used; node = node->next)
+    {
+        item = rt_list_entry(node, struct image_cache_item, list);
+        rt_kprintf("%-40s %3dx%-3d %7d used %d\n", item->filename,
+                   item->image->w, item->image->h, item->size, item->refcount);
+    }
+    for (node = _cache.lru.next; node != &_cache.lru; node = node->next)
+    {
+        item = rt_list_entry(node, struct image_cache_item, list);
+        rt_kprintf("%-40s %3dx%-3d %7d\n", item->filename,
+                   item->image->w, item->image->h, item->size);
+    }
+    for (index = 0; index < IMAGE_CACHE_FAILED; index ++)
+    {
+        if (_cache.failed[index].filename != RT_NULL)
+            rt_kprintf("%-40s failed\n", _cache.failed[index].filename);
+    }
+    rt_kprintf("%d images, %d bytes, %d hits, %d misses, %d evictions, %d failed\n",
+               _cache.stat.images, _cache.stat.bytes, _cache.stat.hits,
+               _cache.stat.misses, _cache.stat.evictions, _cache.stat.failed);
+    rt_mutex_release(&_cache.lock);
+}
+FINSH_FUNCTION_EXPORT(icache, show decoded images in the cache);
+FINSH_FUNCTION_EXPORT(image_cache_shrink, drop unused images down to a size);
+#endif
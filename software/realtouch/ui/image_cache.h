@@ -0,0 +1,86 @@
+/*
+ * File      : image_cache.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <rtthread.h>
+#include <rtgui/image.h>
+
+/*
+ * Cache of decoded images, shared by the launcher and the application
+ * modules.
+ *
+ * An image is looked up by file name, file time, the size it was decoded
+ * to and the pixel format. image_cache_get() takes a reference, the image
+ * stays valid until image_cache_put(). Images nobody holds are kept on a
+ * least recently used list and dropped once the decoded bytes of the cache
+ * go over IMAGE_CACHE_SIZE, or when a decode runs out of memory. Out of
+ * memory is what the memory regions report as a failed allocation, a
+ * file that fails to decode otherwise is remembered and not decoded again
+ * until it changes.
+ *
+ * A width and height of 0 is the size of the file. Other sizes need a
+ * decoder registered for the type of the file, without one the image is
+ * decoded at its own size and cached as such.
+ */
+#define IMAGE_CACHE_SIZE        (384 * 1024)
+
+struct image_cache_item
+{
+    rtgui_image_t *image;
+
+    /* private */
+    rt_list_t list;
+    char *filename;
+    rt_uint32_t mtime;
+    rt_uint16_t width, height;
+    rt_uint8_t format;
+    rt_uint8_t stale;           /* file replaced while the image was held */
+    rt_uint16_t refcount;
+    rt_uint32_t size;
+};
+
+/* decode filename to at most width x height pixels */
+typedef rtgui_image_t *(*image_cache_decoder_t)(const char *filename,
+        rt_uint16_t width, rt_uint16_t height);
+
+struct image_cache_stat
+{
+    rt_uint32_t hits;
+    rt_uint32_t misses;
+    rt_uint32_t evictions;
+    rt_uint32_t failed;         /* decodes failed for other reasons than memory */
+
+    rt_uint32_t images;
+    rt_uint32_t bytes;          /* decoded bytes of all images */
+};
+
+void image_cache_init(void);
+
+struct image_cache_item *image_cache_get(const char *filename,
+        rt_uint16_t width, rt_uint16_t height, rt_uint8_t format);
+void image_cache_put(struct image_cache_item *item);
+
+/* decode into the cache without taking a reference */
+rt_err_t image_cache_prefetch(const char *filename,
+                              rt_uint16_t width, rt_uint16_t height, rt_uint8_t format);
+
+/* drop unused images until at most size bytes are cached */
+void image_cache_shrink(rt_uint32_t size);
+
+rt_err_t image_cache_register_decoder(const char *type, image_cache_decoder_t decoder);
+void image_cache_get_stat(struct image_cache_stat *stat);
+
+#endif
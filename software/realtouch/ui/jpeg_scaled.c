@@ -0,0 +1,506 @@
+/*
+ * File      : jpeg_scaled.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <rtm.h>
+#include <dfs_posix.h>
+#include <rtgui/rtgui_system.h>
+#include <rtgui/driver.h>
+
+#include "jpeg_scaled.h"
+#include "mem_region.h"
+
+#ifdef RTGUI_IMAGE_JPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "image_cache.h"
+
+#define JPEG_INPUT_SIZE     4096
+
+struct jpeg_scaled_error
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+};
+
+struct jpeg_scaled
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_scaled_error error;
+    struct jpeg_source_mgr src;
+
+    int fd;
+    rt_uint8_t *input;
+
+    /* one scanline of the IDCT scaled image, RGB */
+    JSAMPROW scanline;
+
+    /* size after dropping rows and columns */
+    rt_uint16_t width, height;
+    rt_uint8_t format;
+    /* bytes of a pixel in format, 0 for formats written as colors */
+    rt_uint8_t pixel_bytes;
+
+    void (*emit)(struct jpeg_scaled *js, int y, const rt_uint8_t *line);
+    void *user;
+    /* where jpeg_scaled_blit() puts the image */
+    struct rtgui_rect area;
+};
+
+/* pixels of a decoded image, image->data */
+struct jpeg_scaled_pixels
+{
+    rt_uint8_t format;
+    rt_uint8_t pixel_bytes;
+    rt_uint8_t *pixels;
+};
+
+static void _error_exit(j_common_ptr cinfo)
+{
+    struct jpeg_scaled_error *error = (struct jpeg_scaled_error *)cinfo->err;
+
+    longjmp(error->jmp, 1);
+}
+
+static void _output_message(j_common_ptr cinfo)
+{
+}
+
+static void _init_source(j_decompress_ptr cinfo)
+{
+}
+
+static boolean _fill_input_buffer(j_decompress_ptr cinfo)
+{
+    struct jpeg_scaled *js = (struct jpeg_scaled *)cinfo;
+    int length;
+
+    length = read(js->fd, js->input, JPEG_INPUT_SIZE);
+    if (length <= 0)
+    {
+        /* truncated file: end it, libjpeg shows the rows it got */
+        js->input[0] = 0xFF;
+        js->input[1] = JPEG_EOI;
+        length = 2;
+    }
+
+    js->src.next_input_byte = js->input;
+    js->src.bytes_in_buffer = length;
+
+    return TRUE;
+}
+
+static void _skip_input_data(j_decompress_ptr cinfo, long count)
+{
+    struct jpeg_scaled *js = (struct jpeg_scaled *)cinfo;
+
+    if (count <= 0)
+        return;
+
+    if (count <= (long)js->src.bytes_in_buffer)
+    {
+        js->src.next_input_byte += count;
+        js->src.bytes_in_buffer -= count;
+        return;
+    }
+
+    /* jump over the data not in the buffer */
+    count -= js->src.bytes_in_buffer;
+    lseek(js->fd, count, SEEK_CUR);
+    js->src.bytes_in_buffer = 0;
+}
+
+static void _term_source(j_decompress_ptr cinfo)
+{
+}
+
+static rt_uint8_t _pixel_bytes(rt_uint8_t format)
+{
+    switch (format)
+    {
+    case RTGRAPHIC_PIXEL_FORMAT_RGB565:
+    case RTGRAPHIC_PIXEL_FORMAT_RGB565P:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/* RGB to the format of the display, for blit_line */
+static void _convert(rt_uint8_t format, rt_uint8_t *pixel, const rt_uint8_t *rgb)
+{
+    rt_uint16_t value;
+
+    if (format == RTGRAPHIC_PIXEL_FORMAT_RGB565P)
+        value = ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+    else
+        value = ((rgb[2] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[0] >> 3);
+
+    *(rt_uint16_t *)pixel = value;
+}
+
+/* choose the IDCT scale and the size the image ends up with */
+static void _jpeg_fit(struct jpeg_scaled *js, rt_uint16_t width, rt_uint16_t height)
+{
+    struct jpeg_decompress_struct *cinfo = &js->cinfo;
+    rt_uint32_t image_width, image_height, num;
+
+    image_width = cinfo->image_width;
+    image_height = cinfo->image_height;
+
+    if (width == 0 || width > image_width) width = image_width;
+    if (height == 0 || height > image_height) height = image_height;
+
+    /* keep the aspect ratio */
+    if (width * image_height > height * image_width)
+        width = image_width * height / image_height;
+    else
+        height = image_height * width / image_width;
+    if (width == 0) width = 1;
+    if (height == 0) height = 1;
+
+    /* the smallest N/8 which still covers the target */
+    for (num = 1; num < 8; num ++)
+    {
+        if ((image_width * num + 7) / 8 >= width &&
+                (image_height * num + 7) / 8 >= height)
+            break;
+    }
+
+    cinfo->scale_num = num;
+    cinfo->scale_denom = 8;
+    cinfo->out_color_space = JCS_RGB;
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->do_fancy_upsampling = FALSE;
+    jpeg_calc_output_dimensions(cinfo);
+
+    /* the IDCT rounds up */
+    if (width > cinfo->output_width) width = cinfo->output_width;
+    if (height > cinfo->output_height) height = cinfo->output_height;
+
+    js->width = width;
+    js->height = height;
+}
+
+static rt_err_t _jpeg_open(struct jpeg_scaled *js, const char *filename)
+{
+    js->fd = open(filename, O_RDONLY, 0);
+    if (js->fd < 0)
+        return -RT_ERROR;
+
+    js->input = (rt_uint8_t *)rtgui_malloc(JPEG_INPUT_SIZE);
+    if (js->input == RT_NULL)
+    {
+        close(js->fd);
+        return -RT_ENOMEM;
+    }
+
+    js->scanline = RT_NULL;
+    js->cinfo.err = jpeg_std_error(&js->error.pub);
+    js->error.pub.error_exit = _error_exit;
+    js->error.pub.output_message = _output_message;
+
+    /* libjpeg leaves through error_exit when it has no memory for itself */
+    if (setjmp(js->error.jmp))
+    {
+        jpeg_destroy_decompress(&js->cinfo);
+        rtgui_free(js->input);
+        close(js->fd);
+        return -RT_ENOMEM;
+    }
+    jpeg_create_decompress(&js->cinfo);
+
+    js->src.init_source = _init_source;
+    js->src.fill_input_buffer = _fill_input_buffer;
+    js->src.skip_input_data = _skip_input_data;
+    js->src.resync_to_restart = jpeg_resync_to_restart;
+    js->src.term_source = _term_source;
+    js->src.bytes_in_buffer = 0;
+    js->src.next_input_byte = RT_NULL;
+    js->cinfo.src = &js->src;
+
+    return RT_EOK;
+}
+
+static void _jpeg_close(struct jpeg_scaled *js)
+{
+    jpeg_destroy_decompress(&js->cinfo);
+    if (js->scanline != RT_NULL)
+        rtgui_free(js->scanline);
+    rtgui_free(js->input);
+    close(js->fd);
+}
+
+/*
+ * Decode the image to js->width x js->height, one row at a time: a
+ * scanline of the scaled image becomes a row of the result when the
+ * nearest neighbour of that row falls on it.
+ */
+static rt_err_t _jpeg_decode(struct jpeg_scaled *js, rt_uint8_t *line)
+{
+    struct jpeg_decompress_struct *cinfo = &js->cinfo;
+    rt_uint32_t row, y, x, sx;
+    rt_uint8_t *pixel;
+
+    js->scanline = (JSAMPROW)rtgui_malloc(cinfo->output_width * cinfo->output_components);
+    if (js->scanline == RT_NULL)
+        return -RT_ENOMEM;
+
+    jpeg_start_decompress(cinfo);
+
+    for (row = 0, y = 0; cinfo->output_scanline < cinfo->output_height; row ++)
+    {
+        jpeg_read_scanlines(cinfo, &js->scanline, 1);
+
+        if (y >= js->height || y * cinfo->output_height / js->height != row)
+            continue;
+
+        for (x = 0, pixel = line; x < js->width; x ++)
+        {
+            sx = x * cinfo->output_width / js->width;
+            if (js->pixel_bytes != 0)
+            {
+                _convert(js->format, pixel, &js->scanline[sx * 3]);
+                pixel += js->pixel_bytes;
+            }
+            else
+            {
+                *(rtgui_color_t *)pixel = RTGUI_RGB(js->scanline[sx * 3],
+                                                   js->scanline[sx * 3 + 1], js->scanline[sx * 3 + 2]);
+                pixel += sizeof(rtgui_color_t);
+            }
+        }
+
+        js->emit(js, y, line);
+        y ++;
+    }
+
+    jpeg_finish_decompress(cinfo);
+
+    return RT_EOK;
+}
+
+static void _emit_dc(struct jpeg_scaled *js, int y, const rt_uint8_t *line)
+{
+    struct rtgui_dc *dc = (struct rtgui_dc *)js->user;
+    struct rtgui_rect *rect = &js->area;
+    int x;
+
+    if (js->pixel_bytes != 0)
+    {
+        dc->engine->blit_line(dc, rect->x1, rect->x1 + js->width, rect->y1 + y, (rt_uint8_t *)line);
+        return;
+    }
+
+    for (x = 0; x < js->width; x ++)
+        rtgui_dc_draw_color_point(dc, rect->x1 + x, rect->y1 + y, ((const rtgui_color_t *)line)[x]);
+}
+
+rt_err_t jpeg_scaled_blit(const char *filename, struct rtgui_dc *dc, struct rtgui_rect *rect)
+{
+    struct jpeg_scaled *js;
+    rt_uint8_t *volatile line = RT_NULL;
+    rt_err_t result;
+
+    RT_ASSERT(filename != RT_NULL && dc != RT_NULL && rect != RT_NULL);
+
+    js = (struct jpeg_scaled *)rtgui_malloc(sizeof(struct jpeg_scaled));
+    if (js == RT_NULL)
+        return -RT_ENOMEM;
+
+    result = _jpeg_open(js, filename);
+    if (result != RT_EOK)
+    {
+        rtgui_free(js);
+        return result;
+    }
+
+    if (setjmp(js->error.jmp))
+    {
+        result = -RT_ERROR;
+        goto __exit;
+    }
+
+    jpeg_read_header(&js->cinfo, TRUE);
+    _jpeg_fit(js, rtgui_rect_width(*rect), rtgui_rect_height(*rect));
+
+    js->format = rtgui_graphic_driver_get_default()->pixel_format;
+    js->pixel_bytes = _pixel_bytes(js->format);
+    line = (rt_uint8_t *)rtgui_malloc(js->width *
+                                      (js->pixel_bytes ? js->pixel_bytes : sizeof(rtgui_color_t)));
+    if (line == RT_NULL)
+    {
+        result = -RT_ENOMEM;
+        goto __exit;
+    }
+
+    /* centred */
+    js->area.x1 = rect->x1 + (rtgui_rect_width(*rect) - js->width) / 2;
+    js->area.y1 = rect->y1 + (rtgui_rect_height(*rect) - js->height) / 2;
+    js->area.x2 = js->area.x1 + js->width;
+    js->area.y2 = js->area.y1 + js->height;
+    js->emit = _emit_dc;
+    js->user = dc;
+
+    result = _jpeg_decode(js, line);
+
+__exit:
+    if (line != RT_NULL)
+        rtgui_free(line);
+    _jpeg_close(js);
+    rtgui_free(js);
+
+    return result;
+}
+RTM_EXPORT(jpeg_scaled_blit);
+
+static void _image_unload(struct rtgui_image *image)
+{
+    struct jpeg_scaled_pixels *data = (struct jpeg_scaled_pixels *)image->data;
+
+    if (data != RT_NULL)
+    {
+        mem_region_free(data->pixels);
+        rtgui_free(data);
+        image->data = RT_NULL;
+    }
+}
+
+static void _image_blit(struct rtgui_image *image, struct rtgui_dc *dc, struct rtgui_rect *rect)
+{
+    struct jpeg_scaled_pixels *data = (struct jpeg_scaled_pixels *)image->data;
+    rt_uint32_t pitch;
+    int w, h, x, y;
+    rt_uint8_t *row;
+
+    w = image->w < rtgui_rect_width(*rect) ? image->w : rtgui_rect_width(*rect);
+    h = image->h < rtgui_rect_height(*rect) ? image->h : rtgui_rect_height(*rect);
+    pitch = image->w * (data->pixel_bytes ? data->pixel_bytes : sizeof(rtgui_color_t));
+
+    for (y = 0, row = data->pixels; y < h; y ++, row += pitch)
+    {
+        if (data->pixel_bytes != 0)
+        {
+            dc->engine->blit_line(dc, rect->x1, rect->x1 + w, rect->y1 + y, row);
+            continue;
+        }
+
+        for (x = 0; x < w; x ++)
+            rtgui_dc_draw_color_point(dc, rect->x1 + x, rect->y1 + y, ((rtgui_color_t *)row)[x]);
+    }
+}
+
+/* images decoded here are never loaded from a file by RTGUI */
+static const struct rtgui_image_engine _jpeg_scaled_engine =
+{
+    "jpeg",
+    { RT_NULL },
+    RT_NULL,
+    RT_NULL,
+    _image_unload,
+    _image_blit,
+};
+
+static void _emit_pixels(struct jpeg_scaled *js, int y, const rt_uint8_t *line)
+{
+    struct jpeg_scaled_pixels *data = (struct jpeg_scaled_pixels *)js->user;
+    rt_uint32_t pitch;
+
+    pitch = js->width * (js->pixel_bytes ? js->pixel_bytes : sizeof(rtgui_color_t));
+    rt_memcpy(data->pixels + y * pitch, line, pitch);
+}
+
+rtgui_image_t *jpeg_scaled_create(const char *filename, rt_uint16_t width, rt_uint16_t height)
+{
+    struct jpeg_scaled *js;
+    struct jpeg_scaled_pixels *volatile data = RT_NULL;
+    rtgui_image_t *volatile image = RT_NULL;
+    rt_uint8_t *volatile line = RT_NULL;
+    rt_uint32_t pitch;
+
+    RT_ASSERT(filename != RT_NULL);
+
+    js = (struct jpeg_scaled *)rtgui_malloc(sizeof(struct jpeg_scaled));
+    if (js == RT_NULL)
+        return RT_NULL;
+
+    if (_jpeg_open(js, filename) != RT_EOK)
+    {
+        rtgui_free(js);
+        return RT_NULL;
+    }
+
+    if (setjmp(js->error.jmp))
+        goto __error;
+
+    jpeg_read_header(&js->cinfo, TRUE);
+    _jpeg_fit(js, width, height);
+
+    js->format = rtgui_graphic_driver_get_default()->pixel_format;
+    js->pixel_bytes = _pixel_bytes(js->format);
+    pitch = js->width * (js->pixel_bytes ? js->pixel_bytes : sizeof(rtgui_color_t));
+
+    image = (rtgui_image_t *)rtgui_malloc(sizeof(rtgui_image_t));
+    data = (struct jpeg_scaled_pixels *)rtgui_malloc(sizeof(struct jpeg_scaled_pixels));
+    line = (rt_uint8_t *)rtgui_malloc(pitch);
+    if (data != RT_NULL) data->pixels = RT_NULL;
+    if (image == RT_NULL || data == RT_NULL || line == RT_NULL)
+        goto __error;
+
+    data->format = js->format;
+    data->pixel_bytes = js->pixel_bytes;
+    /* through mem_region, so that the image cache sees when it does not fit */
+    data->pixels = (rt_uint8_t *)mem_region_malloc(MEM_REGION_BULK, pitch * js->height);
+    if (data->pixels == RT_NULL)
+        goto __error;
+
+    js->emit = _emit_pixels;
+    js->user = data;
+    if (_jpeg_decode(js, line) != RT_EOK)
+        goto __error;
+
+    image->w = js->width;
+    image->h = js->height;
+    image->engine = &_jpeg_scaled_engine;
+    image->palette = RT_NULL;
+    image->data = data;
+
+    rtgui_free(line);
+    _jpeg_close(js);
+    rtgui_free(js);
+
+    return image;
+
+__error:
+    if (line != RT_NULL) rtgui_free(line);
+    if (data != RT_NULL)
+    {
+        if (data->pixels != RT_NULL) mem_region_free(data->pixels);
+        rtgui_free(data);
+    }
+    if (image != RT_NULL) rtgui_free(image);
+    _jpeg_close(js);
+    rtgui_free(js);
+
+    return RT_NULL;
+}
+RTM_EXPORT(jpeg_scaled_create);
+
+void jpeg_scaled_init(void)
+{
+    image_cache_register_decoder("jpeg", jpeg_scaled_create);
+}
+
+#endif
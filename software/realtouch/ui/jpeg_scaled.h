@@ -0,0 +1,41 @@
+/*
+ * File      : jpeg_scaled.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#ifndef __JPEG_SCALED_H__
+#define __JPEG_SCALED_H__
+
+#include <rtthread.h>
+#include <rtgui/dc.h>
+#include <rtgui/image.h>
+
+/*
+ * JPEG decoding to a target size.
+ *
+ * libjpeg scales in the IDCT by N/8, so a photo is decoded to the first
+ * size of 1/8, 2/8 .. 8/8 of its own which is not smaller than the target,
+ * and the rows and columns left over are dropped while the scanlines are
+ * streamed out. The aspect ratio is kept, images are never enlarged. The
+ * decoder only holds a few scanlines of the scaled image, not the photo.
+ */
+
+/* decode straight to the dc, centred in rect */
+rt_err_t jpeg_scaled_blit(const char *filename, struct rtgui_dc *dc, struct rtgui_rect *rect);
+
+/* decode into an image of at most width x height pixels, 0 for the size of the file */
+rtgui_image_t *jpeg_scaled_create(const char *filename, rt_uint16_t width, rt_uint16_t height);
+
+/* decode JPEG files of the image cache with jpeg_scaled_create() */
+void jpeg_scaled_init(void);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * File      : module_cache.c
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#include <rtthread.h>
+#include <dfs_posix.h>
+
+#include "mem_region.h"
+#include "module_cache.h"
+
+#ifdef RT_USING_MODULE
+
+struct module_image
+{
+    rt_list_t list;             /* most recently launched first */
+
+    char path[64];
+    rt_uint32_t size;
+    rt_time_t mtime;
+    void *image;
+};
+
+static struct
+{
+    rt_list_t images;
+    rt_uint32_t count;
+    struct rt_mutex lock;
+    rt_bool_t inited;
+
+    struct module_cache_stat stat;
+} _cache;
+
+static void _cache_init(void)
+{
+    if (_cache.inited)
+        return;
+
+    rt_list_init(&_cache.images);
+    rt_mutex_init(&_cache.lock, "mcache", RT_IPC_FLAG_FIFO);
+    _cache.inited = RT_TRUE;
+}
+
+static void _image_drop(struct module_image *mi)
+{
+    rt_list_remove(&mi->list);
+    _cache.count --;
+    _cache.stat.bytes -= mi->size;
+
+    mem_region_free(mi->image);
+    rt_free(mi);
+}
+
+static struct module_image *_image_find(const char *path)
+{
+    struct rt_list_node *node;
+    struct module_image *mi;
+
+    for (node = _cache.images.next; node != &_cache.images; node = node->next)
+    {
+        mi = rt_list_entry(node, struct module_image, list);
+        if (rt_strcmp(mi->path, path) == 0)
+            return mi;
+    }
+
+    return RT_NULL;
+}
+
+/* make room for size bytes, dropping the least recently launched images */
+static void _cache_reserve(rt_uint32_t size)
+{
+    struct module_image *mi;
+
+    while (!rt_list_isempty(&_cache.images) &&
+            (_cache.stat.bytes + size > MODULE_CACHE_SIZE ||
+             _cache.count >= MODULE_CACHE_MAX))
+    {
+        mi = rt_list_entry(_cache.images.prev, struct module_image, list);
+        _image_drop(mi);
+    }
+}
+
+static void *_image_read(const char *path, rt_uint32_t size)
+{
+    rt_uint8_t *image;
+    int fd, length;
+
+    image = (rt_uint8_t *)mem_region_malloc(MEM_REGION_BULK, size);
+    if (image == RT_NULL)
+        return RT_NULL;
+
+    fd = open(path, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        mem_region_free(image);
+        return RT_NULL;
+    }
+
+    length = read(fd, image, size);
+    close(fd);
+
+    if (length != (int)size)
+    {
+        mem_region_free(image);
+        return RT_NULL;
+    }
+
+    return image;
+}
+
+/*
+ * Drop every image but keep. The module space comes from the same heap as
+ * the images, so a load that failed may fit afterwards.
+ */
+static rt_bool_t _cache_drop_others(struct module_image *keep)
+{
+    struct module_image *mi;
+    struct rt_list_node *node, *next;
+    rt_bool_t dropped = RT_FALSE;
+
+    for (node = _cache.images.next; node != &_cache.images; node = next)
+    {
+        next = node->next;
+        mi = rt_list_entry(node, struct module_image, list);
+        if (mi != keep)
+        {
+            _image_drop(mi);
+            dropped = RT_TRUE;
+        }
+    }
+
+    return dropped;
+}
+
+static rt_module_t _image_load(const char *name, void *image, struct module_image *keep)
+{
+    rt_module_t module;
+
+    module = rt_module_load(name, image);
+    if (module == RT_NULL && _cache_drop_others(keep))
+    {
+        _cache.stat.retries ++;
+        module = rt_module_load(name, image);
+    }
+
+    return module;
+}
+
+/**
+ * This function loads a module from the cached image of its file, reading
+ * the file into the cache when it is not there or has changed.
+ *
+ * @param name the name of the module
+ * @param path the path of the .mo file
+ * @param module the loaded module
+ *
+ * @return RT_EOK on success; -RT_EIO when the file could not be read into
+ *         memory, the caller may still try rt_module_open(); -RT_ERROR when
+ *         the image was read but the module did not load, also after the
+ *         other images were dropped to make room.
+ */
+rt_err_t module_cache_open(const char *name, const char *path, rt_module_t *module)
+{
+    struct module_image *mi;
+    struct stat st;
+    void *image;
+
+    *module = RT_NULL;
+    if (stat(path, &st) != 0 || st.st_size == 0)
+        return -RT_EIO;
+
+    _cache_init();
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+
+    mi = _image_find(path);
+    if (mi != RT_NULL && (mi->size != st.st_size || mi->mtime != st.st_mtime))
+    {
+        /* the file was replaced */
+        _image_drop(mi);
+        mi = RT_NULL;
+    }
+
+    if (mi != RT_NULL)
+    {
+        _cache.stat.hits ++;
+        rt_list_remove(&mi->list);
+        rt_list_insert_after(&_cache.images, &mi->list);
+
+        *module = _image_load(name, mi->image, mi);
+        rt_mutex_release(&_cache.lock);
+
+        return *module != RT_NULL ? RT_EOK : -RT_ERROR;
+    }
+
+    _cache.stat.misses ++;
+    if (st.st_size <= MODULE_CACHE_SIZE)
+        _cache_reserve(st.st_size);
+
+    image = _image_read(path, st.st_size);
+    if (image == RT_NULL && _cache_drop_others(RT_NULL))
+    {
+        _cache.stat.retries ++;
+        image = _image_read(path, st.st_size);
+    }
+    if (image == RT_NULL)
+    {
+        rt_mutex_release(&_cache.lock);
+        return -RT_EIO;
+    }
+
+    *module = _image_load(name, image, RT_NULL);
+
+    mi = RT_NULL;
+    if (*module != RT_NULL && st.st_size <= MODULE_CACHE_SIZE)
+        mi = (struct module_image *)rt_malloc(sizeof(struct module_image));
+
+    if (mi != RT_NULL)
+    {
+        rt_strncpy(mi->path, path, sizeof(mi->path) - 1);
+        mi->path[sizeof(mi->path) - 1] = '\0';
+        mi->size = st.st_size;
+        mi->mtime = st.st_mtime;
+        mi->image = image;
+
+        rt_list_insert_after(&_cache.images, &mi->list);
+        _cache.count ++;
+        _cache.stat.bytes += mi->size;
+    }
+    else
+        mem_region_free(image);
+
+    rt_mutex_release(&_cache.lock);
+
+    return *module != RT_NULL ? RT_EOK : -RT_ERROR;
+}
+
+void module_cache_flush(void)
+{
+    _cache_init();
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    while (!rt_list_isempty(&_cache.images))
+        _image_drop(rt_list_entry(_cache.images.next, struct module_image, list));
+    rt_mutex_release(&_cache.lock);
+}
+
+void module_cache_get_stat(struct module_cache_stat *stat)
+{
+    *stat = _cache.stat;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void mcache(void)
+{
+    struct rt_list_node *node;
+    struct module_image *mi;
+
+    _cache_init();
+
+    rt_mutex_take(&_cache.lock, RT_WAITING_FOREVER);
+    for (node = _cache.images.next; node != &_cache.images; node = node->next)
+    {
+        mi = rt_list_entry(node, struct module_image, list);
+        rt_kprintf("%-40s %7d\n", mi->path, mi->size);
+    }
+    rt_kprintf("%d bytes cached, %d hits, %d misses, %d retries\n", _cache.stat.bytes,
+               _cache.stat.hits, _cache.stat.misses, _cache.stat.retries);
+    rt_mutex_release(&_cache.lock);
+}
+FINSH_FUNCTION_EXPORT(mcache, show cached module images);
+FINSH_FUNCTION_EXPORT(module_cache_flush, drop all cached module images);
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * File      : module_cache.h
+ * This file is part of RT-Thread RTOS
+ * COPYRIGHT (C) 2013, RT-Thread Development Team
+ *
+ * The license and distribution terms for this file may be
+ * found in the file LICENSE in this distribution or at
+ * http://www.rt-thread.org/license/LICENSE
+ *
+ * Change Logs:
+ * Date           Author       Notes
+ * 2013-03-21     realtouch    first version
+ */
+
+#ifndef __MODULE_CACHE_H__
+#define __MODULE_CACHE_H__
+
+#include <rtthread.h>
+
+/*
+ * Cache of .mo file images in external SRAM for the application launcher.
+ *
+ * rt_module_load() copies the segments out of the file image and relocates
+ * the copy, the image itself stays untouched. So a module launched again
+ * is loaded straight from the cached image and the SD card is only asked
+ * for the size and time of the file: an image whose file changed is read
+ * again. The least recently launched images are dropped when the cache
+ * is over MODULE_CACHE_SIZE. The images share external SRAM with the
+ * module spaces and the image cache, so a module that does not load or a
+ * file that can not be read is tried once more after the other images are
+ * dropped.
+ *
+ * Only the read of the file is saved: a cached launch still copies the
+ * segments into a new module space and relocates them, as every launch
+ * did before. The .mo files of programs/ are a few K to some 20K each.
+ */
+#define MODULE_CACHE_SIZE       (64 * 1024)
+#define MODULE_CACHE_MAX        8
+
+struct module_cache_stat
+{
+    rt_uint32_t hits;
+    rt_uint32_t misses;
+    rt_uint32_t retries;        /* loads or reads repeated after dropping images */
+    rt_uint32_t bytes;          /* image bytes in the cache */
+};
+
+#ifdef RT_USING_MODULE
+rt_err_t module_cache_open(const char *name, const char *path, rt_module_t *module);
+void module_cache_flush(void);
+void module_cache_get_stat(struct module_cache_stat *stat);
+#endif
+
+#endif
@@ -6,6 +6,12 @@
 #include <rtgui/widgets/list_view.h>
 #include <rtgui/rtgui_xml.h>
 #include <rtgui/widgets/panel.h>
+#include <rtgui/driver.h>
+
+#include "program.h"
+#include "module_cache.h"
+#include "image_cache.h"
+#include "xpm/exec.xpm"
 
 #ifdef _WIN32
 #include <io.h>
@@ -18,11 +24,55 @@
 #endif
 
 #define APP_PATH            "/SD/programs"
-#define ITEM_MAX            (32)
+/* kept out of APP_PATH, writing it must not change the time of the directory */
+#define APP_INDEX           "/SD/programs.idx"
+#define APP_INDEX_MAGIC     0x58444941  /* "AIDX" */
+
+#define ICON_THREAD_PRIORITY    24      /* below the GUI */
+#define ICON_THREAD_STACK       4096
+
+/* one application, also the record of the index file */
+struct program_app
+{
+    char name[32];
+    char icon[64];
+};
+
+struct program_index
+{
+    rt_uint32_t magic;
+    rt_uint32_t mtime;          /* of APP_PATH */
+    rt_uint32_t signature;      /* hash of the entry names in APP_PATH */
+    rt_uint32_t count;
+};
+
+enum icon_state
+{
+    ICON_NONE,                  /* shows the default icon */
+    ICON_LOADING,               /* decoded by the icon thread */
+    ICON_READY,                 /* decoded, not yet in the list view */
+    ICON_SHOWN,
+    ICON_FAILED,
+};
+
+struct program_icon
+{
+    rt_uint8_t state;
+    struct image_cache_item *item;
+};
 
+static struct program_app *apps = RT_NULL;
+static struct program_icon *icons = RT_NULL;
 static struct rtgui_list_item *items = RT_NULL;
+static int count = 0;
 static rtgui_list_view_t* _view = RT_NULL;
-static int pos = -1;
+static rtgui_image_t *default_icon = RT_NULL;
+static int shown_page = -1;
+
+static struct rt_semaphore icon_sem;
+static rt_thread_t gui_tid = RT_NULL;
+/* a PROGRAM_CMD_ICON is in the GUI queue, the icons ready since go with it */
+static rt_bool_t icon_posted = RT_FALSE;
 
 typedef enum
 {
@@ -33,41 +83,60 @@ typedef enum
     READ_LICENSE,
 }XML_STATUS;
 
+struct xml_context
+{
+    XML_STATUS status;
+    struct program_app *app;
+};
+
+static struct program_app *app_append(void)
+{
+    struct program_app *list;
+
+    list = (struct program_app *)rtgui_realloc(apps, (count + 1) * sizeof(struct program_app));
+    if (list == RT_NULL)
+        return RT_NULL;
+
+    apps = list;
+    rt_memset(&apps[count], 0, sizeof(struct program_app));
+    return &apps[count ++];
+}
+
 static int xml_event_handler(rt_uint8_t event, const char* text, rt_size_t len, void* user)
 {
-    static XML_STATUS status = IDLE;
-    char fn[64];
+    struct xml_context *ctx = (struct xml_context *)user;
 
     if(event == EVENT_START)
     {
         if(strcmp(text, "name") == 0)
-            status = READ_NAME;
+            ctx->status = READ_NAME;
         else if(strcmp(text, "image") == 0)
-            status = READ_ICON;
+            ctx->status = READ_ICON;
         else if(strcmp(text, "author") == 0)
-            status = READ_AUTHOR;
+            ctx->status = READ_AUTHOR;
         else if(strcmp(text, "license") == 0)
-            status = READ_LICENSE;
+            ctx->status = READ_LICENSE;
     }
     else if(event == EVENT_TEXT)
     {
-        switch(status)
+        switch(ctx->status)
         {
         case READ_NAME:
-            items[++pos].name = rt_strdup(text);
-            items[pos].parameter = items[pos].name;
+            ctx->app = app_append();
+            if(ctx->app != RT_NULL)
+                rt_strncpy(ctx->app->name, text, sizeof(ctx->app->name) - 1);
             break;
         case READ_ICON:
-            rt_snprintf(fn, sizeof(fn), "%s/%s", APP_PATH, text);
-            items[pos].image = rtgui_image_create(fn, RT_TRUE);
-            if(items[pos].image == RT_NULL) rt_kprintf("image create failed\n");
+            /* the icon is only decoded once its row is visible */
+            if(ctx->app != RT_NULL)
+                rt_strncpy(ctx->app->icon, text, sizeof(ctx->app->icon) - 1);
             break;
         case READ_AUTHOR:
             break;
         case READ_LICENSE:
             break;
         }
-        status = IDLE;
+        ctx->status = IDLE;
     }
 
     return 1;
@@ -76,6 +145,7 @@ static int xml_event_handler(rt_uint8_t event, const char* text, rt_size_t len,
 static int xml_load_items(const char* filename)
 {
     struct rtgui_filerw* filerw;
+    struct xml_context ctx;
     char buffer[512];
     rtgui_xml_t *xml;
     int length;
@@ -88,18 +158,14 @@ static int xml_load_items(const char* filename)
         return 0;
     }
 
-    length = rtgui_filerw_read(filerw, buffer, 512, 1);
-    if(length <= 0)
-    {
-        rt_kprintf("read fail\n");
-        rtgui_filerw_close(filerw);
-        return 0;
-    }
-
-    xml = rtgui_xml_create(512, xml_event_handler, RT_NULL);
+    ctx.status = IDLE;
+    ctx.app = RT_NULL;
+    xml = rtgui_xml_create(512, xml_event_handler, &ctx);
     if (xml != RT_NULL)
     {
-        rtgui_xml_parse(xml, buffer, length);
+        /* the parser keeps its state, feed the file in pieces */
+        while ((length = rtgui_filerw_read(filerw, buffer, 1, sizeof(buffer))) > 0)
+            rtgui_xml_parse(xml, buffer, length);
         rtgui_xml_destroy(xml);
     }
 
@@ -120,7 +186,13 @@ static void exec_app(rtgui_widget_t* widget, void* parameter)
 #ifndef _WIN32
     module = rt_module_find((const char*)parameter);
     if(module == RT_NULL)
-        rt_module_open(path);
+    {
+        /* launched again: no SD read when the image is still cached. Only
+           a file the cache could not read is left to the module loader, a
+           module that did not load from its image would not load again */
+        if(module_cache_open((const char*)parameter, path, &module) == -RT_EIO)
+            rt_module_open(path);
+    }
     else
     {
         struct rtgui_app* app;
@@ -133,6 +205,88 @@ static void exec_app(rtgui_widget_t* widget, void* parameter)
 #endif
 }
 
+/*
+ * FNV-1a over the entry names of the application directory. FAT does not
+ * update the time of a directory when an entry is added, so the index is
+ * only used when the names match as well.
+ */
+static rt_uint32_t app_dir_signature(const char* path)
+{
+    DIR* dir;
+    struct dirent* entry;
+    rt_uint32_t hash = 2166136261u;
+    const char *ptr;
+
+    dir = opendir(path);
+    if (dir == RT_NULL)
+        return 0;
+
+    while ((entry = readdir(dir)) != RT_NULL)
+    {
+        for (ptr = entry->d_name; ; ptr ++)
+        {
+            hash ^= (rt_uint8_t)*ptr;
+            hash *= 16777619u;
+            if (*ptr == '\0') break;
+        }
+    }
+
+    closedir(dir);
+    return hash;
+}
+
+static rt_bool_t app_index_load(const struct program_index *expect)
+{
+    struct program_index index;
+    int fd, size;
+
+    fd = open(APP_INDEX, O_RDONLY, 0);
+    if (fd < 0)
+        return RT_FALSE;
+
+    if (read(fd, &index, sizeof(index)) != sizeof(index) ||
+        index.magic != expect->magic || index.mtime != expect->mtime ||
+        index.signature != expect->signature || index.count == 0)
+    {
+        close(fd);
+        return RT_FALSE;
+    }
+
+    size = index.count * sizeof(struct program_app);
+    apps = (struct program_app *)rtgui_malloc(size);
+    if (apps == RT_NULL || read(fd, apps, size) != size)
+    {
+        close(fd);
+        if (apps != RT_NULL) rtgui_free(apps);
+        apps = RT_NULL;
+        return RT_FALSE;
+    }
+    close(fd);
+
+    count = index.count;
+    return RT_TRUE;
+}
+
+static void app_index_save(struct program_index *index)
+{
+    int fd;
+
+    fd = open(APP_INDEX, O_WRONLY | O_CREAT | O_TRUNC, 0);
+    if (fd < 0)
+        return;
+
+    index->count = count;
+    if (write(fd, index, sizeof(*index)) != sizeof(*index) ||
+        write(fd, apps, count * sizeof(struct program_app)) != (int)(count * sizeof(struct program_app)))
+    {
+        close(fd);
+        /* never leave half an index behind */
+        unlink(APP_INDEX);
+        return;
+    }
+    close(fd);
+}
+
 static void scan_app_dir(const char* path)
 {
     DIR* dir;
@@ -153,16 +307,16 @@ static void scan_app_dir(const char* path)
         if (entry == RT_NULL)
             break;
 
-        if (strcmp(entry->d_name, ".") == 0 
+        if (strcmp(entry->d_name, ".") == 0
              || strcmp(entry->d_name, "..") == 0)
             continue;
-        
+
         rt_sprintf(fn, "%s/%s", path, entry->d_name);
-        if (dfs_file_stat(fn, &stat) != 0) 
+        if (dfs_file_stat(fn, &stat) != 0)
             break;
         if(! DFS_S_ISDIR(stat.st_mode))
             continue;
-        
+
         rt_sprintf(fn, "%s/%s/%s.xml", path, entry->d_name, entry->d_name);
 
         xml_load_items(fn);
@@ -172,27 +326,270 @@ static void scan_app_dir(const char* path)
     closedir(dir);
 }
 
+/* names from the index when the directory did not change, from the XML files otherwise */
+static void load_apps(void)
+{
+    struct program_index index;
+    struct stat st;
+
+    if (stat(APP_PATH, &st) != 0)
+    {
+        rt_kprintf("open directory %s failed\n", APP_PATH);
+        return;
+    }
+
+    index.magic = APP_INDEX_MAGIC;
+    index.mtime = st.st_mtime;
+    index.signature = app_dir_signature(APP_PATH);
+    if (app_index_load(&index) == RT_TRUE)
+        return;
+
+    scan_app_dir(APP_PATH);
+    if (count > 0)
+        app_index_save(&index);
+}
+
+/* the rows in sight, one page of the icon view */
+static int visible_page(int *first, int *last)
+{
+    int page;
+
+    if (_view->page_items == 0)
+        return -1;
+
+    page = _view->current_item / _view->page_items;
+    *first = page * _view->page_items;
+    *last = *first + _view->page_items;
+    if (*last > count) *last = count;
+
+    return page;
+}
+
+static void icon_thread_entry(void* parameter)
+{
+    struct rtgui_event_command ecmd;
+    struct program_icon *icon;
+    struct image_cache_item *item;
+    rt_uint8_t format;
+    char fn[96];
+    int index, first, last, ready, retry;
+
+    format = rtgui_graphic_driver_get_default()->pixel_format;
+    while (1)
+    {
+        rt_sem_take(&icon_sem, RT_WAITING_FOREVER);
+        ready = 0;
+
+        if (visible_page(&first, &last) < 0)
+            continue;
+
+        for (index = first; index < last; index ++)
+        {
+            icon = &icons[index];
+
+            rt_enter_critical();
+            if (icon->state != ICON_NONE)
+            {
+                rt_exit_critical();
+                continue;
+            }
+            icon->state = ICON_LOADING;
+            rt_exit_critical();
+
+            item = RT_NULL;
+            if (apps[index].icon[0] != '\0')
+            {
+                rt_snprintf(fn, sizeof(fn), "%s/%s", APP_PATH, apps[index].icon);
+                item = image_cache_get(fn, 0, 0, format);
+            }
+
+            rt_enter_critical();
+            if (icon->state == ICON_LOADING)
+            {
+                icon->item = item;
+                icon->state = item != RT_NULL ? ICON_READY : ICON_FAILED;
+                item = RT_NULL;
+            }
+            rt_exit_critical();
+
+            /* the page was left meanwhile */
+            if (item != RT_NULL)
+            {
+                image_cache_put(item);
+                continue;
+            }
+            ready ++;
+        }
+        if (ready == 0 || icon_posted == RT_TRUE)
+            continue;
+
+        /* let the GUI thread put the icons into the list view */
+        icon_posted = RT_TRUE;
+        RTGUI_EVENT_COMMAND_INIT(&ecmd);
+        ecmd.wid = RT_NULL;
+        ecmd.type = RTGUI_CMD_USER_INT;
+        ecmd.command_id = PROGRAM_CMD_ICON;
+        for (retry = 0; retry < 10; retry ++)
+        {
+            if (rtgui_send(gui_tid, &ecmd.parent, sizeof(ecmd)) == RT_EOK)
+                break;
+            rt_thread_delay(RT_TICK_PER_SECOND / 10);
+        }
+        if (retry == 10)
+            icon_posted = RT_FALSE;
+    }
+}
+
+/* hand the icons more than one page away back to the image cache */
+static void icons_release(int page)
+{
+    struct program_icon *icon;
+    struct image_cache_item *item;
+    int index;
+
+    for (index = 0; index < count; index ++)
+    {
+        if (index / _view->page_items >= page - 1 &&
+            index / _view->page_items <= page + 1)
+            continue;
+
+        icon = &icons[index];
+        item = RT_NULL;
+
+        rt_enter_critical();
+        if (icon->state != ICON_NONE)
+        {
+            if (icon->state == ICON_READY || icon->state == ICON_SHOWN)
+                item = icon->item;
+            icon->item = RT_NULL;
+            icon->state = ICON_NONE;
+        }
+        rt_exit_critical();
+
+        if (item != RT_NULL)
+        {
+            items[index].image = default_icon;
+            image_cache_put(item);
+        }
+    }
+}
+
+static rt_bool_t program_view_event_handler(struct rtgui_object* object, struct rtgui_event* event)
+{
+    rt_bool_t result;
+    int page, first, last;
+
+    result = rtgui_list_view_event_handler(object, event);
+
+    page = visible_page(&first, &last);
+    if (page >= 0 && page != shown_page)
+    {
+        shown_page = page;
+        icons_release(page);
+        rt_sem_release(&icon_sem);
+    }
+
+    return result;
+}
+
+rt_bool_t program_event_handler(struct rtgui_object* object, struct rtgui_event* event)
+{
+    struct rtgui_event_command *ecmd = (struct rtgui_event_command *)event;
+    rt_bool_t update = RT_FALSE;
+    int index;
+
+    if (event->type != RTGUI_EVENT_COMMAND ||
+        ecmd->type != RTGUI_CMD_USER_INT || ecmd->command_id != PROGRAM_CMD_ICON)
+        return RT_FALSE;
+
+    icon_posted = RT_FALSE;
+    if (_view == RT_NULL)
+        return RT_TRUE;
+
+    for (index = 0; index < count; index ++)
+    {
+        rt_enter_critical();
+        if (icons[index].state == ICON_READY)
+        {
+            icons[index].state = ICON_SHOWN;
+            items[index].image = icons[index].item->image;
+            update = RT_TRUE;
+        }
+        rt_exit_critical();
+    }
+
+    if (update == RT_TRUE)
+        rtgui_widget_update(RTGUI_WIDGET(_view));
+
+    return RT_TRUE;
+}
+
 struct rtgui_panel* program_create(struct rtgui_panel* panel)
 {
     int i = 0;
     struct rtgui_rect rect;
+    rt_thread_t tid;
 
     RT_ASSERT(panel != RT_NULL);
     rtgui_widget_get_extent(RTGUI_WIDGET(panel), &rect);
 
-    items = (struct rtgui_list_item *) rtgui_malloc((ITEM_MAX) * sizeof(struct rtgui_list_item));
-    for(i=0; i< ITEM_MAX; i++) items[i].action = exec_app;
-
     /* create application list */
     rtgui_rect_inflate(&rect, -15);
 
-    scan_app_dir(APP_PATH);
-    if(pos >= 0)
+    load_apps();
+    if(count == 0)
+        return RTGUI_PANEL(panel);
+
+    default_icon = rtgui_image_create_from_mem("xpm", (const rt_uint8_t*)exec_xpm, sizeof(exec_xpm), RT_FALSE);
+    items = (struct rtgui_list_item *) rtgui_malloc(count * sizeof(struct rtgui_list_item));
+    icons = (struct program_icon *) rtgui_malloc(count * sizeof(struct program_icon));
+    if(items == RT_NULL || icons == RT_NULL)
+    {
+        rt_kprintf("no memory for %d applications\n", count);
+        return RTGUI_PANEL(panel);
+    }
+
+    /* the names are shown at once, the icons follow from the icon thread */
+    for(i=0; i< count; i++)
     {
-        _view = rtgui_list_view_create(items, pos + 1, &rect, RTGUI_LIST_VIEW_ICON);
-        rtgui_container_add_child(RTGUI_CONTAINER(panel), RTGUI_WIDGET(_view));
+        items[i].name = apps[i].name;
+        items[i].parameter = apps[i].name;
+        items[i].image = default_icon;
+        items[i].action = exec_app;
+
+        icons[i].state = ICON_NONE;
+        icons[i].item = RT_NULL;
     }
 
+    _view = rtgui_list_view_create(items, count, &rect, RTGUI_LIST_VIEW_ICON);
+    rtgui_object_set_event_handler(RTGUI_OBJECT(_view), program_view_event_handler);
+    rtgui_container_add_child(RTGUI_CONTAINER(panel), RTGUI_WIDGET(_view));
+
+    image_cache_init();
+    gui_tid = rt_thread_self();
+    rt_sem_init(&icon_sem, "icon", 0, RT_IPC_FLAG_FIFO);
+    tid = rt_thread_create("icon", icon_thread_entry, RT_NULL,
+        ICON_THREAD_STACK, ICON_THREAD_PRIORITY, 20);
+    if(tid != RT_NULL) rt_thread_startup(tid);
+
+    /* first page */
+    shown_page = 0;
+    rt_sem_release(&icon_sem);
+
     return RTGUI_PANEL(panel);
 }
 
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+void list_programs(void)
+{
+    int index;
+    const char *state[] = {"-", "loading", "ready", "shown", "failed"};
+
+    for (index = 0; icons != RT_NULL && index < count; index ++)
+        rt_kprintf("%-32s %-24s %s\n", apps[index].name, apps[index].icon,
+                   state[icons[index].state]);
+    rt_kprintf("%d applications, index %s\n", count, APP_INDEX);
+}
+FINSH_FUNCTION_EXPORT(list_programs, list the applications of the launcher);
+#endif
@@ -0,0 +1,14 @@
+#ifndef __PROGRAM_H__
+#define __PROGRAM_H__
+
+#include <rtgui/event.h>
+#include <rtgui/rtgui_object.h>
+#include <rtgui/widgets/panel.h>
+
+/* command sent to the application manager when icons were decoded */
+#define PROGRAM_CMD_ICON        0x100
+
+rt_bool_t program_event_handler(struct rtgui_object* object, struct rtgui_event* event);
+struct rtgui_panel* program_create(struct rtgui_panel* panel);
+
+#endif
@@ -6,6 +6,8 @@
 #include "setup.h"
 #include "appmgr.h"
 #include "statusbar.h"
+#include "font_hz_cache.h"
+#include "jpeg_scaled.h"
 
 rt_bool_t cali_setup(void)
 {
@@ -57,6 +59,12 @@ void realtouch_ui_init(void)
     rtgui_graphic_set_device(device); 
     /*font system init*/		
     rtgui_font_system_init();
+    /* cached Chinese file font */
+    rtgui_font_hz_cache_init();
+#ifdef RTGUI_IMAGE_JPEG
+    /* photos are decoded to the size they are shown at */
+    jpeg_scaled_init();
+#endif
     app_mgr_init();
     rt_thread_delay(10);
 
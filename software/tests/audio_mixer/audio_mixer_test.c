@@ -0,0 +1,297 @@
+/*
+ * Host test of drivers/audio_mixer.c.
+ *
+ * The mixer source is included here so that the test can run
+ * _mixer_mix() block by block in place of the mixer thread, against a
+ * "snd" that only reports how much it still has queued. The Makefile
+ * builds it on the C QADD16 and on the intrinsic (../stub/stm32f4xx.h).
+ * It checks
+ *
+ *   - audio_mixer_add: saturation at both ends, the gain, odd frame
+ *     counts, and random frames against a plain reference,
+ *   - a 44.1kHz and a resampled 32kHz stream mixed for 20 seconds: the
+ *     sum in every block, the rate each stream is consumed at, no
+ *     underruns and the latency figures,
+ *   - a stream running dry: silence in its place, the other stream going
+ *     on, and exactly one underrun once it writes again,
+ *   - the playback position and the buffers handed back on close.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "../../realtouch/drivers/audio_mixer.c"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+#define FRAME(l, r)     ((rt_uint32_t)(rt_uint16_t)(l) | ((rt_uint32_t)(rt_uint16_t)(r) << 16))
+#define LEFT(v)         ((rt_int16_t)(v))
+#define RIGHT(v)        ((rt_int16_t)((v) >> 16))
+
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size)
+{
+    return malloc(size);
+}
+
+void mem_region_free(void *ptr)
+{
+    free(ptr);
+}
+
+/* "snd": the frames it holds, as CODEC_CMD_GET_POSITION reports them */
+static rt_uint32_t snd_queued;
+
+static rt_err_t snd_control(rt_device_t dev, rt_uint8_t cmd, void *args)
+{
+    struct codec_position *pos = (struct codec_position *)args;
+
+    if (cmd == CODEC_CMD_GET_POSITION)
+    {
+        rt_memset(pos, 0, sizeof(*pos));
+        pos->queued = snd_queued;
+        pos->rate = AUDIO_MIXER_RATE;
+    }
+
+    return RT_EOK;
+}
+
+static struct rt_device snd = {.control = snd_control};
+
+rt_device_t rt_device_find(const char *name)
+{
+    return strcmp(name, "snd") == 0 ? &snd : RT_NULL;
+}
+
+rt_err_t rt_device_register(rt_device_t dev, const char *name, rt_uint16_t flags)
+{
+    return RT_EOK;
+}
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(rt_uint32_t range)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % range;
+}
+
+static int released;
+
+static rt_err_t stream_done(rt_device_t dev, void *buffer)
+{
+    released ++;
+    return RT_EOK;
+}
+
+static rt_int32_t ref_add(rt_int16_t d, rt_int16_t s, rt_uint32_t gain)
+{
+    rt_int32_t v = d + (gain >= MIXER_GAIN_UNITY ? s : (s * (rt_int32_t)gain) >> 15);
+
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+}
+
+static void test_add(void)
+{
+    static rt_uint32_t dst[67], src[67], expect[67];
+    rt_uint32_t gain;
+    rt_size_t frames, index;
+    int round, bad = 0;
+
+    /* saturation both ways, and the sum next to the limits */
+    dst[0] = FRAME(30000, -30000);  src[0] = FRAME(10000, -10000);
+    dst[1] = FRAME(100, -100);      src[1] = FRAME(200, -200);
+    dst[2] = FRAME(-32768, 32767);  src[2] = FRAME(-1, 1);
+    dst[3] = FRAME(32767, -32768);  src[3] = FRAME(-1, 1);
+    audio_mixer_add(dst, src, 4, MIXER_GAIN_UNITY);
+    CHECK(dst[0] == FRAME(32767, -32768));
+    CHECK(dst[1] == FRAME(300, -300));
+    CHECK(dst[2] == FRAME(-32768, 32767));
+    CHECK(dst[3] == FRAME(32766, -32767));
+
+    /* half gain, and just below unity still saturates */
+    dst[0] = 0;                     src[0] = FRAME(-32768, 32767);
+    audio_mixer_add(dst, src, 1, MIXER_GAIN_UNITY / 2);
+    CHECK(dst[0] == FRAME(-16384, 16383));
+    dst[0] = FRAME(32767, -32768);  src[0] = FRAME(32767, -32768);
+    audio_mixer_add(dst, src, 1, MIXER_GAIN_UNITY - 1);
+    CHECK(dst[0] == FRAME(32767, -32768));
+
+    /* no gain adds nothing */
+    dst[0] = FRAME(1234, -1234);    src[0] = FRAME(-32768, 32767);
+    audio_mixer_add(dst, src, 1, 0);
+    CHECK(dst[0] == FRAME(1234, -1234));
+
+    /* every length up to 67, the frame after the last one untouched */
+    for (round = 0; round < 20000 && !bad; round ++)
+    {
+        frames = rnd(66);
+        gain = rnd(3) ? rnd(MIXER_GAIN_UNITY + 1) : MIXER_GAIN_UNITY;
+        for (index = 0; index <= frames; index ++)
+        {
+            dst[index] = rnd(65536) | (rnd(65536) << 16);
+            src[index] = rnd(65536) | (rnd(65536) << 16);
+            expect[index] = FRAME(ref_add(LEFT(dst[index]), LEFT(src[index]), gain),
+                                  ref_add(RIGHT(dst[index]), RIGHT(src[index]), gain));
+        }
+        expect[frames] = dst[frames];
+
+        audio_mixer_add(dst, src, frames, gain);
+        if (memcmp(dst, expect, (frames + 1) * 4) != 0)
+        {
+            printf("audio_mixer_add: %zu frames at gain %u differ\n", frames, gain);
+            failures ++;
+            bad = 1;
+        }
+    }
+}
+
+#define WRITE_A         1152            /* an MP3 frame */
+#define WRITE_B         1000
+#define BUFFERS         (MIXER_NODE_MAX - 1)
+#define LEVEL           1000
+
+static rt_uint32_t buf_a[BUFFERS][WRITE_A], buf_b[BUFFERS][WRITE_B];
+static int next_a, next_b;
+
+/* keep the stream a few blocks ahead, like a decoder would */
+static void feed(struct mixer_stream *s, rt_uint32_t *buf, rt_size_t frames, int *next)
+{
+    while (s->queued < 3000)
+    {
+        CHECK(_stream_write(&s->parent, 0, buf + (*next % BUFFERS) * frames,
+                            frames * 4) == frames * 4);
+        (*next) ++;
+    }
+}
+
+static void feed_a(struct mixer_stream *s)
+{
+    feed(s, buf_a[0], WRITE_A, &next_a);
+}
+
+static void feed_b(struct mixer_stream *s)
+{
+    feed(s, buf_b[0], WRITE_B, &next_b);
+}
+
+static int block_is(const rt_uint32_t *block, rt_int32_t level, rt_int32_t slack)
+{
+    rt_size_t index;
+
+    for (index = 0; index < MIXER_FRAMES; index ++)
+    {
+        if (abs(LEFT(block[index]) - level) > slack || abs(RIGHT(block[index]) + level) > slack)
+            return 0;
+    }
+    return 1;
+}
+
+static void test_streams(void)
+{
+    static rt_uint32_t block[MIXER_FRAMES];
+    struct mixer_stream *a = &_mixer.stream[0], *b = &_mixer.stream[1];
+    struct codec_position pos;
+    rt_uint32_t in_a, in_b, out = 0, blocks;
+    int rate = 32000, gain = 50, index, j, latency;
+    double ratio;
+
+    CHECK(audio_mixer_init() == RT_EOK);
+    for (index = 0; index < BUFFERS; index ++)
+    {
+        for (j = 0; j < WRITE_A; j ++) buf_a[index][j] = FRAME(LEVEL, -LEVEL);
+        for (j = 0; j < WRITE_B; j ++) buf_b[index][j] = FRAME(2 * LEVEL, -2 * LEVEL);
+    }
+
+    a->parent.tx_complete = b->parent.tx_complete = stream_done;
+    CHECK(_stream_open(&a->parent, RT_DEVICE_OFLAG_WRONLY) == RT_EOK);
+    CHECK(_stream_control(&b->parent, CODEC_CMD_SAMPLERATE, &rate) == RT_EOK);
+    CHECK(_stream_control(&b->parent, MIXER_CMD_GAIN, &gain) == RT_EOK);
+    CHECK(_stream_open(&b->parent, RT_DEVICE_OFLAG_WRONLY) == RT_EOK);
+    CHECK(_mixer.snd == &snd && b->rs_active && !a->rs_active);
+    CHECK(_mixer_state() == MIXER_IDLE);
+
+    /* 20 seconds, both streams kept ahead: LEVEL + 2 * LEVEL / 2 */
+    blocks = 20 * AUDIO_MIXER_RATE / MIXER_FRAMES;
+    for (index = 0; index < (int)blocks; index ++)
+    {
+        feed_a(a);
+        feed_b(b);
+        CHECK(_mixer_state() == MIXER_READY);
+        CHECK(_mixer_mix(block));
+        out += MIXER_FRAMES;
+
+        /* the resampler fades in over its first taps */
+        if (index > 0 && !block_is(block, 2 * LEVEL, 2))
+        {
+            printf("block %d: %d %d\n", index, LEFT(block[0]), RIGHT(block[0]));
+            failures ++;
+            break;
+        }
+    }
+
+    in_a = next_a * WRITE_A - a->queued;
+    in_b = next_b * WRITE_B - b->queued;
+    CHECK(in_a == out && a->stats.frames == in_a);
+    ratio = (double)in_b / out;
+    CHECK(fabs(ratio - 32000.0 / AUDIO_MIXER_RATE) < 1e-3);
+    CHECK(a->stats.underruns == 0 && b->stats.underruns == 0);
+
+    /* queued input plus the blocks in flight, no more than 3000 frames */
+    CHECK(a->stats.latency_max <= 3000 * 1000 / 44100 + 1 + 3 * MIXER_FRAMES * 1000 / 44100);
+    CHECK(b->stats.latency_max <= 3000 * 1000 / 32000 + 1 + 3 * MIXER_FRAMES * 1000 / 44100);
+    printf("20s mixed: 32k stream at %.5f of the output, latency %ums (max %u) and %ums (max %u)\n",
+           ratio, a->stats.latency, a->stats.latency_max, b->stats.latency, b->stats.latency_max);
+
+    /* b runs dry: a goes on alone, with silence in place of b */
+    while (b->queued > 0)
+    {
+        feed_a(a);
+        _mixer_mix(block);
+    }
+    feed_a(a);
+    CHECK(_mixer_state() == MIXER_READY);
+    _mixer_mix(block);
+    CHECK(block_is(block, LEVEL, 0));
+    CHECK(b->starved);
+    feed_a(a);
+    _mixer_mix(block);
+    CHECK(block_is(block, LEVEL, 0));
+
+    CHECK(_stream_write(&b->parent, 0, buf_b[0], 100 * 4) == 100 * 4);
+    CHECK(b->stats.underruns == 1 && a->stats.underruns == 0);
+    CHECK(_mixer_state() == MIXER_SHORT);
+    feed_b(b);
+    CHECK(_mixer_state() == MIXER_READY);
+    CHECK(b->stats.underruns == 1);
+
+    /* position: what "snd" still holds, at the stream rate, is not played */
+    snd_queued = 2 * MIXER_FRAMES;
+    CHECK(_stream_control(&a->parent, CODEC_CMD_GET_POSITION, &pos) == RT_EOK);
+    CHECK(pos.rate == AUDIO_MIXER_RATE);
+    CHECK(pos.played == a->stats.frames - snd_queued);
+    CHECK(pos.queued == a->queued + snd_queued);
+    CHECK(_stream_control(&a->parent, CODEC_CMD_GET_LATENCY, &latency) == RT_EOK);
+    CHECK(latency == (int)(pos.queued * 1000 / AUDIO_MIXER_RATE));
+    CHECK(_stream_control(&b->parent, CODEC_CMD_GET_POSITION, &pos) == RT_EOK);
+    CHECK(pos.rate == 32000);
+    CHECK(pos.played + pos.queued == b->stats.frames + b->queued);
+
+    /* closing hands back every buffer still queued */
+    _stream_close(&b->parent);
+    _stream_close(&a->parent);
+    CHECK(_mixer.opened == 0 && _mixer.snd == RT_NULL);
+    CHECK(released == next_a + next_b + 1);
+    CHECK(a->queued == 0 && a->read_index == a->put_index);
+}
+
+int main(void)
+{
+    test_add();
+    test_streams();
+
+    printf("audio_mixer: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Host stand-in for the parts of rtthread.h used by audio_mixer.c and
+ * audio_resample.c, on top of the shared one. The test runs the mixer from
+ * one thread, so the IPC objects do nothing; devices call through their
+ * function pointers.
+ */
+#ifndef __MIXER_RTTHREAD_H__
+#define __MIXER_RTTHREAD_H__
+
+#include "../../stub/rtthread.h"
+
+/* the counts are all _mixer_mix() looks at */
+struct rt_mempool
+{
+    rt_size_t block_total_count;
+    rt_size_t block_free_count;
+};
+struct rt_mutex { int value; };
+struct rt_semaphore { int value; };
+struct rt_thread { int stat; };
+typedef struct rt_thread *rt_thread_t;
+
+static inline rt_err_t rt_mp_init(struct rt_mempool *mp, const char *name,
+                                  void *start, rt_size_t size, rt_size_t block_size)
+{
+    mp->block_total_count = mp->block_free_count =
+        size / (block_size + sizeof(rt_uint8_t *));
+    return RT_EOK;
+}
+static inline void *rt_mp_alloc(struct rt_mempool *mp, rt_int32_t time) { return RT_NULL; }
+static inline void rt_mp_free(void *block) { }
+
+static inline rt_err_t rt_mutex_init(struct rt_mutex *m, const char *name, rt_uint8_t flag) { return RT_EOK; }
+static inline rt_err_t rt_mutex_take(struct rt_mutex *m, rt_int32_t time) { return RT_EOK; }
+static inline rt_err_t rt_mutex_release(struct rt_mutex *m) { return RT_EOK; }
+
+static inline rt_err_t rt_sem_init(struct rt_semaphore *s, const char *name,
+                                   rt_uint32_t value, rt_uint8_t flag) { return RT_EOK; }
+static inline rt_err_t rt_sem_take(struct rt_semaphore *s, rt_int32_t time) { return RT_EOK; }
+static inline rt_err_t rt_sem_release(struct rt_semaphore *s) { return RT_EOK; }
+
+/* the thread is created and never runs, the test takes its place */
+static inline rt_thread_t rt_thread_create(const char *name, void (*entry)(void *),
+    void *parameter, rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick)
+{
+    static struct rt_thread thread;
+
+    return &thread;
+}
+static inline rt_err_t rt_thread_startup(rt_thread_t thread) { return RT_EOK; }
+
+/* provided by the test: "snd" and the registered streams */
+rt_device_t rt_device_find(const char *name);
+rt_err_t rt_device_register(rt_device_t dev, const char *name, rt_uint16_t flags);
+
+static inline rt_err_t rt_device_set_tx_complete(rt_device_t dev,
+    rt_err_t (*tx_done)(rt_device_t dev, void *buffer))
+{
+    dev->tx_complete = tx_done;
+    return RT_EOK;
+}
+static inline rt_err_t rt_device_open(rt_device_t dev, rt_uint16_t oflag)
+{
+    return dev->open ? dev->open(dev, oflag) : RT_EOK;
+}
+static inline rt_err_t rt_device_close(rt_device_t dev)
+{
+    return dev->close ? dev->close(dev) : RT_EOK;
+}
+static inline rt_size_t rt_device_write(rt_device_t dev, rt_off_t pos,
+                                        const void *buffer, rt_size_t size)
+{
+    return dev->write ? dev->write(dev, pos, buffer, size) : 0;
+}
+static inline rt_err_t rt_device_control(rt_device_t dev, rt_uint8_t cmd, void *args)
+{
+    return dev->control ? dev->control(dev, cmd, args) : -RT_ENOSYS;
+}
+
+#endif
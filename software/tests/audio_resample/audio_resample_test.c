@@ -0,0 +1,229 @@
+/*
+ * Host test of drivers/audio_resample.c.
+ *
+ * The Makefile builds this file twice, on the generic dot product and on
+ * the SMLALD one with the intrinsics done in C (../stub/stm32f4xx.h), both
+ * with the address sanitizer. Each build checks that
+ *
+ *   - a stream cut into random pieces, with the output limited now and
+ *     then, gives the same frames as the stream in one go,
+ *   - the output has in * up / down frames, give or take rounding,
+ *   - a 1kHz tone at -1dBFS keeps the SINAD audio_resample.h promises,
+ *   - large decimation ratios, where the taps grow far beyond the quality
+ *     setting, stay inside the history buffers,
+ *
+ * and prints a hash of every output; the two listings must be identical.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include <rtthread.h>
+#include "mem_region.h"
+#include "audio_resample.h"
+
+#define IN_FRAMES       60000
+#define OUT_FRAMES      (IN_FRAMES * 12 + 16)
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+/* the placement of the tables does not matter here */
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size)
+{
+    return malloc(size);
+}
+
+void mem_region_free(void *ptr)
+{
+    free(ptr);
+}
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(rt_uint32_t range)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % range;
+}
+
+static rt_int16_t in[IN_FRAMES * 2];
+static rt_int16_t out_whole[OUT_FRAMES * 2], out_pieces[OUT_FRAMES * 2];
+
+/* the whole input, or random pieces with the output limited now and then */
+static rt_size_t run(struct audio_resampler *rs, rt_size_t frames, rt_int16_t *out,
+                     int pieces)
+{
+    rt_size_t done = 0, produced = 0, chunk, taken, bound, limit, n;
+
+    audio_resampler_reset(rs);
+    while (done < frames)
+    {
+        chunk = pieces ? 1 + rnd(700) : frames - done;
+        if (chunk > frames - done)
+            chunk = frames - done;
+
+        bound = audio_resampler_out_frames(rs, chunk);
+        limit = (pieces && rnd(3) == 0) ? 1 + rnd(bound) : bound;
+
+        taken = chunk;
+        n = audio_resampler_process(rs, in + done * 2, &taken, out + produced * 2, limit);
+
+        CHECK(n <= limit);
+        CHECK(taken <= chunk);
+        if (!pieces)
+            CHECK(taken == chunk);
+
+        produced += n;
+        done += taken;
+    }
+
+    /* a limited last call leaves frames behind, no input fetches them */
+    do
+    {
+        taken = 0;
+        n = audio_resampler_process(rs, in, &taken, out + produced * 2, 64);
+        produced += n;
+    } while (n > 0);
+
+    return produced;
+}
+
+static rt_uint32_t hash(const rt_int16_t *pcm, rt_size_t samples)
+{
+    rt_uint32_t h = 2166136261u;
+
+    while (samples--)
+        h = (h ^ (rt_uint16_t)*pcm++) * 16777619u;
+    return h;
+}
+
+static void test_stream(rt_uint32_t in_rate, rt_uint32_t out_rate, int quality)
+{
+    struct audio_resampler rs;
+    rt_size_t a, b, index;
+    double expect;
+
+    if (audio_resampler_init(&rs, in_rate, out_rate, quality) != RT_EOK)
+    {
+        printf("%6u -> %5u q%d: init failed\n", in_rate, out_rate, quality);
+        failures ++;
+        return;
+    }
+
+    for (index = 0; index < IN_FRAMES * 2; index ++)
+        in[index] = (rt_int16_t)rnd(65536);
+
+    a = run(&rs, IN_FRAMES, out_whole, 0);
+    b = run(&rs, IN_FRAMES, out_pieces, 1);
+
+    expect = (double)IN_FRAMES * out_rate / in_rate;
+    CHECK(fabs(a - expect) <= 2);
+    CHECK(a == b);
+    CHECK(memcmp(out_whole, out_pieces, (a < b ? a : b) * 4) == 0);
+
+    printf("%6u -> %5u q%d: %3u taps, %6zu frames, hash %08x\n", in_rate, out_rate,
+           quality, rs.taps, a, hash(out_whole, a * 2));
+
+    audio_resampler_deinit(&rs);
+}
+
+/* SINAD of a 1kHz tone at -1dBFS, the tone fitted by least squares */
+static double sinad(rt_uint32_t in_rate, rt_uint32_t out_rate, int quality)
+{
+    struct audio_resampler rs;
+    double amp = 32767 * pow(10, -1 / 20.0);
+    double w, s, c, ss = 0, cc = 0, sc = 0, xs = 0, xc = 0, xx = 0, x, a, b;
+    double signal, noise;
+    rt_size_t n, index, start, count;
+
+    audio_resampler_init(&rs, in_rate, out_rate, quality);
+    for (index = 0; index < IN_FRAMES; index ++)
+    {
+        in[index * 2] = in[index * 2 + 1] =
+            (rt_int16_t)lrint(amp * sin(2 * M_PI * 1000 * index / in_rate));
+    }
+    n = run(&rs, IN_FRAMES, out_whole, 0);
+    audio_resampler_deinit(&rs);
+
+    /* skip the start and the end, where the filter sees silence; the window
+       is no whole number of periods, so no mean is taken out */
+    start = n / 8;
+    count = n - 2 * start;
+
+    w = 2 * M_PI * 1000 / out_rate;
+    for (index = start; index < start + count; index ++)
+    {
+        x = out_whole[index * 2];
+        s = sin(w * index);
+        c = cos(w * index);
+        ss += s * s; cc += c * c; sc += s * c;
+        xs += x * s; xc += x * c; xx += x * x;
+    }
+
+    /* x ~ a sin + b cos */
+    a = (xs * cc - xc * sc) / (ss * cc - sc * sc);
+    b = (xc * ss - xs * sc) / (ss * cc - sc * sc);
+    signal = (a * a + b * b) / 2 * count;
+    noise = xx - (a * xs + b * xc);
+    if (noise < 1e-9)
+        noise = 1e-9;
+
+    return 10 * log10(signal / noise);
+}
+
+static void test_quality(void)
+{
+    /* the lower ends of the table in audio_resample.h, 1dB to spare */
+    static const double min_sinad[] = {0, 61, 79, 81};
+    static const rt_uint32_t rates[] = {8000, 22050, 32000, 48000, 96000};
+    rt_size_t index;
+    int quality;
+    double v;
+
+    for (quality = AUDIO_RESAMPLE_LOW; quality <= AUDIO_RESAMPLE_HIGH; quality ++)
+    {
+        for (index = 0; index < sizeof(rates) / sizeof(rates[0]); index ++)
+        {
+            v = sinad(rates[index], 44100, quality);
+            CHECK(v >= min_sinad[quality]);
+            if (v < min_sinad[quality])
+                printf("%6u -> 44100 q%d: SINAD %.1fdB\n", rates[index], quality, v);
+        }
+    }
+}
+
+static void test_bad_rates(void)
+{
+    struct audio_resampler rs;
+
+    CHECK(audio_resampler_init(&rs, 0, 44100, AUDIO_RESAMPLE_LOW) != RT_EOK);
+    CHECK(audio_resampler_init(&rs, 44100, 44100, AUDIO_RESAMPLE_OFF) != RT_EOK);
+    /* up = 44100, beyond AUDIO_RESAMPLE_UP_MAX */
+    CHECK(audio_resampler_init(&rs, 44101, 44100, AUDIO_RESAMPLE_LOW) != RT_EOK);
+}
+
+int main(void)
+{
+    static const rt_uint32_t rates[] = {8000, 11025, 16000, 22050, 32000, 48000, 96000};
+    rt_size_t index;
+    int quality;
+
+    for (quality = AUDIO_RESAMPLE_LOW; quality <= AUDIO_RESAMPLE_HIGH; quality ++)
+        for (index = 0; index < sizeof(rates) / sizeof(rates[0]); index ++)
+            test_stream(rates[index], 44100, quality);
+
+    /* decimation with several hundred taps per phase */
+    test_stream(96000, 8000, AUDIO_RESAMPLE_HIGH);
+    test_stream(192000, 8000, AUDIO_RESAMPLE_LOW);
+    test_stream(192000, 8000, AUDIO_RESAMPLE_HIGH);
+    test_stream(8000, 96000, AUDIO_RESAMPLE_MEDIUM);
+
+    test_quality();
+    test_bad_rates();
+
+    printf("audio_resample: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Host test of the playback position of drivers/codec_wm8978_i2c.c.
+ *
+ * The driver source is included here and runs against a simulated I2S DMA
+ * stream (stub/stm32f4xx.h): the test moves NDTR down by random steps and
+ * raises the TC interrupt some time after the transfer has ended, the way
+ * a busy system would. The writer keeps the data list full with buffers of
+ * random size. After every step CODEC_CMD_GET_POSITION must give
+ *
+ *   - played equal to the frames the stream has moved,
+ *   - played + queued equal to the frames written,
+ *   - a position that never goes backwards,
+ *
+ * both with the stream going to the codec as it is and through the
+ * resampler, where queued also covers the block being filled.
+ */
+#include <stdlib.h>
+
+#include "../../realtouch/drivers/codec_wm8978_i2c.c"
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size)
+{
+    return malloc(size);
+}
+
+void mem_region_free(void *ptr)
+{
+    free(ptr);
+}
+
+SPI_TypeDef sim_spi3 = {SPI_I2S_FLAG_TXE, 0, 0};
+DMA_Stream_TypeDef sim_dma1_stream7;
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(rt_uint32_t range)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % range;
+}
+
+static uint64_t moved;           /* half words the stream has sent */
+static int returned;
+
+static rt_err_t stream_done(rt_device_t dev, void *buffer)
+{
+    returned ++;
+    return RT_EOK;
+}
+
+/* the DMA moves a few half words, the TC interrupt may come late */
+static void sim_dma_step(rt_uint32_t max)
+{
+    DMA_Stream_TypeDef *s = &sim_dma1_stream7;
+    rt_uint32_t step;
+
+    if (s->enabled && s->NDTR > 0)
+    {
+        step = rnd(max + 1);
+        if (step > s->NDTR)
+            step = s->NDTR;
+        s->NDTR -= step;
+        moved += step;
+        if (s->NDTR == 0)
+            s->tc = 1;
+    }
+
+    if (s->tc && rnd(4) == 0)
+        DMA1_Stream7_IRQHandler();
+}
+
+/* the driver waits for a buffer: finish the transfer in progress */
+void sim_wait(void)
+{
+    DMA_Stream_TypeDef *s = &sim_dma1_stream7;
+
+    if (!s->enabled)
+    {
+        printf("driver waits with the DMA stream idle\n");
+        exit(1);
+    }
+
+    moved += s->NDTR;
+    s->NDTR = 0;
+    s->tc = 1;
+    DMA1_Stream7_IRQHandler();
+}
+
+static void start(int quality, int rate)
+{
+    memset(&sim_dma1_stream7, 0, sizeof(sim_dma1_stream7));
+    moved = 0;
+    returned = 0;
+
+    CHECK(codec_control(&codec.parent, CODEC_CMD_RESAMPLE, &quality) == RT_EOK);
+    CHECK(codec_open(&codec.parent, RT_DEVICE_FLAG_WRONLY) == RT_EOK);
+    CHECK(codec_control(&codec.parent, CODEC_CMD_SAMPLERATE, &rate) == RT_EOK);
+}
+
+/* let the stream play out everything queued */
+static void play_out(void)
+{
+    while (sim_dma1_stream7.enabled)
+    {
+        sim_dma_step(4096);
+        if (sim_dma1_stream7.tc)
+            DMA1_Stream7_IRQHandler();
+    }
+}
+
+static rt_uint16_t buffers[DATA_NODE_MAX + 1][4096];
+
+static void test_direct(void)
+{
+    struct codec_position pos, last;
+    uint64_t written = 0;
+    rt_size_t size;
+    int step, next = 0, writes = 0, latency, bad = 0;
+
+    start(AUDIO_RESAMPLE_OFF, 44100);
+    CHECK(!codec.rs_active);
+    memset(&last, 0, sizeof(last));
+
+    for (step = 0; step < 2000000 && !bad; step ++)
+    {
+        /* keep the data list full */
+        size = (rnd(1024) + 1) * 4;
+        if (codec_write(&codec.parent, 0, buffers[next % (DATA_NODE_MAX + 1)], size) == size)
+        {
+            written += size / 4;
+            next ++;
+            writes ++;
+        }
+
+        sim_dma_step(64);
+
+        CHECK(codec_control(&codec.parent, CODEC_CMD_GET_POSITION, &pos) == RT_EOK);
+        if (pos.played != moved / 2 || pos.played + pos.queued != written ||
+            pos.played < last.played || pos.rate != 44100)
+        {
+            printf("step %d: played %u queued %u, moved %llu written %llu\n", step,
+                   pos.played, pos.queued, (unsigned long long)moved,
+                   (unsigned long long)written);
+            failures ++;
+            bad = 1;
+        }
+        last = pos;
+    }
+
+    CHECK(pos.time == (rt_uint32_t)((uint64_t)pos.played * 1000 / 44100));
+    CHECK(codec_control(&codec.parent, CODEC_CMD_GET_LATENCY, &latency) == RT_EOK);
+    CHECK(latency == (int)(pos.queued * 1000 / 44100));
+
+    play_out();
+    CHECK(codec_control(&codec.parent, CODEC_CMD_GET_POSITION, &pos) == RT_EOK);
+    CHECK(pos.played == written && pos.queued == 0);
+    CHECK(returned == writes);
+    printf("direct:    %u frames played (%u s), latency at the end of the run %dms\n",
+           pos.played, pos.time / 1000, latency);
+
+    codec_close(&codec.parent);
+}
+
+static void test_resampled(void)
+{
+    struct codec_position pos, last;
+    uint64_t written = 0;
+    rt_size_t size;
+    int step, next = 0, writes = 0, bad = 0;
+    double expect;
+
+    start(AUDIO_RESAMPLE_MEDIUM, 32000);
+    CHECK(codec.rs_active);
+    memset(&last, 0, sizeof(last));
+
+    for (step = 0; step < 300000 && !bad; step ++)
+    {
+        /* the resampler takes every write, the pool holds the writer back */
+        if (rnd(8) == 0)
+        {
+            size = (rnd(1024) + 1) * 4;
+            CHECK(codec_write(&codec.parent, 0, buffers[next % (DATA_NODE_MAX + 1)], size) == size);
+            written += size / 4;
+            next ++;
+            writes ++;
+        }
+
+        sim_dma_step(64);
+
+        CHECK(codec_control(&codec.parent, CODEC_CMD_GET_POSITION, &pos) == RT_EOK);
+        if (pos.played != moved / 2 || pos.played < last.played ||
+            pos.played + pos.queued < last.played + last.queued || pos.rate != 44100)
+        {
+            printf("step %d: played %u queued %u, moved %llu\n", step, pos.played,
+                   pos.queued, (unsigned long long)moved);
+            failures ++;
+            bad = 1;
+        }
+        last = pos;
+    }
+
+    /* every buffer is handed back as soon as it is converted */
+    CHECK(returned == writes);
+
+    /* queue the block being filled and play everything */
+    codec_resampler_flush();
+    play_out();
+    CHECK(codec_control(&codec.parent, CODEC_CMD_GET_POSITION, &pos) == RT_EOK);
+    CHECK(pos.queued == 0);
+    expect = (double)written * 44100 / 32000;
+    CHECK(pos.played <= expect + 2 && pos.played + 2 >= expect);
+    CHECK(codec.rs_mp.block_free_count == codec.rs_mp.block_total_count);
+    printf("resampled: %llu frames at 32kHz written, %u played at 44.1kHz\n",
+           (unsigned long long)written, pos.played);
+
+    codec_close(&codec.parent);
+}
+
+int main(void)
+{
+    CHECK(codec_hw_init("i2c1") == RT_EOK);
+    codec.parent.tx_complete = stream_done;
+    CHECK(codec_init(&codec.parent) == RT_EOK);
+
+    test_direct();
+    test_resampled();
+
+    printf("codec_position: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for the I2C part of rtdevice.h: every register write to
+ * the codec succeeds.
+ */
+#ifndef __RT_DEVICE_H__
+#define __RT_DEVICE_H__
+
+#include <rtthread.h>
+
+#define RT_I2C_WR       0x0000
+
+struct rt_i2c_msg
+{
+    rt_uint16_t addr;
+    rt_uint16_t flags;
+    rt_uint16_t len;
+    rt_uint8_t  *buf;
+};
+
+struct rt_i2c_bus_device
+{
+    int unused;
+};
+
+static inline struct rt_i2c_bus_device *rt_i2c_bus_device_find(const char *name)
+{
+    static struct rt_i2c_bus_device bus;
+
+    return &bus;
+}
+
+static inline rt_size_t rt_i2c_transfer(struct rt_i2c_bus_device *bus,
+                                        struct rt_i2c_msg *msgs, rt_uint32_t num)
+{
+    return num;
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Host stand-in for the parts of rtthread.h used by codec_wm8978_i2c.c and
+ * audio_resample.c, on top of the shared one. Where the driver would
+ * block, waiting for the DMA to give a buffer back, the stand-ins call
+ * sim_wait() of the test, which moves the simulated DMA stream on instead.
+ */
+#ifndef __CODEC_RTTHREAD_H__
+#define __CODEC_RTTHREAD_H__
+
+/* the driver reports an empty data list on the console, not needed here */
+#define rt_kprintf(...)
+
+#include "../../stub/rtthread.h"
+
+static inline rt_err_t rt_device_register(rt_device_t dev, const char *name,
+                                          rt_uint16_t flags)
+{
+    return RT_EOK;
+}
+
+static inline void rt_set_errno(rt_err_t error) { }
+static inline void rt_interrupt_enter(void) { }
+static inline void rt_interrupt_leave(void) { }
+
+/* provided by the test: let the simulated DMA stream run for a while */
+void sim_wait(void);
+
+static inline rt_err_t rt_thread_delay(rt_int32_t tick)
+{
+    sim_wait();
+    return RT_EOK;
+}
+
+/* fixed size blocks, each with the pool in front of it as in mempool.c */
+struct rt_mempool
+{
+    rt_uint8_t *start_address;
+    rt_size_t block_size;
+    rt_size_t block_total_count;
+    rt_size_t block_free_count;
+    rt_uint8_t *block_list;
+};
+
+static inline rt_err_t rt_mp_init(struct rt_mempool *mp, const char *name,
+                                  void *start, rt_size_t size, rt_size_t block_size)
+{
+    rt_uint8_t *block;
+    rt_size_t index;
+
+    mp->start_address = (rt_uint8_t *)start;
+    mp->block_size = block_size;
+    mp->block_total_count = mp->block_free_count = size / (block_size + sizeof(rt_uint8_t *));
+    mp->block_list = RT_NULL;
+    for (index = 0; index < mp->block_total_count; index ++)
+    {
+        block = mp->start_address + index * (block_size + sizeof(rt_uint8_t *));
+        *(rt_uint8_t **)block = mp->block_list;
+        mp->block_list = block;
+    }
+
+    return RT_EOK;
+}
+
+static inline rt_err_t rt_mp_detach(struct rt_mempool *mp)
+{
+    assert(mp->block_free_count == mp->block_total_count);
+    return RT_EOK;
+}
+
+static inline void *rt_mp_alloc(struct rt_mempool *mp, rt_int32_t time)
+{
+    rt_uint8_t *block;
+
+    while (mp->block_list == RT_NULL)
+    {
+        if (time != RT_WAITING_FOREVER)
+            return RT_NULL;
+        sim_wait();
+    }
+
+    block = mp->block_list;
+    mp->block_list = *(rt_uint8_t **)block;
+    mp->block_free_count --;
+    *(struct rt_mempool **)block = mp;
+
+    return block + sizeof(rt_uint8_t *);
+}
+
+static inline void rt_mp_free(void *ptr)
+{
+    rt_uint8_t *block = (rt_uint8_t *)ptr - sizeof(rt_uint8_t *);
+    struct rt_mempool *mp = *(struct rt_mempool **)block;
+
+    *(rt_uint8_t **)block = mp->block_list;
+    mp->block_list = block;
+    mp->block_free_count ++;
+}
+
+#endif
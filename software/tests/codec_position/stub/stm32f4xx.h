@@ -0,0 +1,165 @@
+/*
+ * Host stand-in for the device header and the parts of the standard
+ * peripheral library the codec driver uses. Only the I2S DMA stream is
+ * simulated: DMA_Init() loads NDTR, the test counts it down, sets the TC
+ * flag at zero and calls the interrupt handler itself. Everything else
+ * does nothing.
+ */
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#include <stdint.h>
+
+#define ENABLE                  1
+#define DISABLE                 0
+
+typedef struct
+{
+    volatile uint32_t SR;
+    volatile uint32_t DR;
+    volatile uint32_t I2SCFGR;
+} SPI_TypeDef;
+
+/* the stream as the test sees it */
+typedef struct
+{
+    uint32_t NDTR;              /* half words still to move */
+    uint32_t size;              /* of the transfer */
+    int enabled;
+    int tc;                     /* transfer complete flag */
+} DMA_Stream_TypeDef;
+
+extern SPI_TypeDef sim_spi3;
+extern DMA_Stream_TypeDef sim_dma1_stream7;
+
+#define SPI3                    (&sim_spi3)
+#define DMA1_Stream7            (&sim_dma1_stream7)
+#define DMA1_Stream7_IRQn       47
+#define SPI3_IRQn               51
+
+#define SPI_I2S_FLAG_TXE        0x0002
+#define SPI_I2S_FLAG_BSY        0x0080
+#define SPI_I2S_DMAReq_Tx       0x0002
+
+#define DMA_IT_TC               0x10
+#define DMA_IT_TCIF7            0x28000020
+#define DMA_Channel_0           0
+#define DMA_DIR_MemoryToPeripheral      0x40
+#define DMA_PeripheralInc_Disable       0
+#define DMA_MemoryInc_Enable            0x400
+#define DMA_PeripheralDataSize_HalfWord 0x800
+#define DMA_MemoryDataSize_HalfWord     0x2000
+#define DMA_Mode_Normal                 0
+#define DMA_Priority_High               0x20000
+#define DMA_FIFOMode_Disable            0
+#define DMA_FIFOThreshold_1QuarterFull  0
+#define DMA_MemoryBurst_Single          0
+#define DMA_PeripheralBurst_Single      0
+
+#define I2S_Standard_Phillips   0
+#define I2S_Mode_SlaveTx        0
+#define I2S_Mode_MasterTx       0x200
+#define I2S_MCLKOutput_Disable  0
+#define I2S_DataFormat_16b      0
+#define I2S_CPOL_Low            0
+#define I2S_AudioFreq_96k       96000
+
+#define RCC_I2S2CLKSource_PLLI2S    0
+#define RCC_APB1Periph_SPI3         0x8000
+#define RCC_AHB1Periph_GPIOA        0x01
+#define RCC_AHB1Periph_GPIOB        0x02
+#define RCC_AHB1Periph_GPIOC        0x04
+#define RCC_AHB1Periph_DMA1         0x200000
+
+#define GPIOA                   0
+#define GPIOB                   1
+#define GPIOC                   2
+#define GPIO_Mode_AF            2
+#define GPIO_Speed_50MHz        2
+#define GPIO_OType_PP           0
+#define GPIO_PuPd_UP            1
+#define GPIO_Pin_3              0x0008
+#define GPIO_Pin_4              0x0010
+#define GPIO_Pin_5              0x0020
+#define GPIO_Pin_15             0x8000
+#define GPIO_PinSource3         3
+#define GPIO_PinSource4         4
+#define GPIO_PinSource5         5
+#define GPIO_PinSource15        15
+#define GPIO_AF_SPI3            6
+#define GPIO_AF_I2S3ext         7
+
+typedef struct
+{
+    uint32_t NVIC_IRQChannel;
+    uint32_t NVIC_IRQChannelPreemptionPriority;
+    uint32_t NVIC_IRQChannelSubPriority;
+    uint32_t NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+typedef struct
+{
+    uint32_t GPIO_Pin;
+    uint32_t GPIO_Mode;
+    uint32_t GPIO_Speed;
+    uint32_t GPIO_OType;
+    uint32_t GPIO_PuPd;
+} GPIO_InitTypeDef;
+
+typedef struct
+{
+    uint32_t I2S_Mode;
+    uint32_t I2S_Standard;
+    uint32_t I2S_DataFormat;
+    uint32_t I2S_MCLKOutput;
+    uint32_t I2S_AudioFreq;
+    uint32_t I2S_CPOL;
+} I2S_InitTypeDef;
+
+typedef struct
+{
+    uint32_t DMA_Channel;
+    uint32_t DMA_PeripheralBaseAddr;
+    uint32_t DMA_Memory0BaseAddr;
+    uint32_t DMA_DIR;
+    uint32_t DMA_BufferSize;
+    uint32_t DMA_PeripheralInc;
+    uint32_t DMA_MemoryInc;
+    uint32_t DMA_PeripheralDataSize;
+    uint32_t DMA_MemoryDataSize;
+    uint32_t DMA_Mode;
+    uint32_t DMA_Priority;
+    uint32_t DMA_FIFOMode;
+    uint32_t DMA_FIFOThreshold;
+    uint32_t DMA_MemoryBurst;
+    uint32_t DMA_PeripheralBurst;
+} DMA_InitTypeDef;
+
+static inline void DMA_Init(DMA_Stream_TypeDef *s, DMA_InitTypeDef *init)
+{
+    s->NDTR = s->size = init->DMA_BufferSize;
+}
+static inline void DMA_DeInit(DMA_Stream_TypeDef *s) { s->NDTR = 0; }
+static inline void DMA_Cmd(DMA_Stream_TypeDef *s, int state) { s->enabled = state; }
+static inline uint32_t DMA_GetCurrDataCounter(DMA_Stream_TypeDef *s) { return s->NDTR; }
+static inline void DMA_ITConfig(DMA_Stream_TypeDef *s, uint32_t it, int state) { }
+static inline int DMA_GetITStatus(DMA_Stream_TypeDef *s, uint32_t it) { return s->tc; }
+static inline void DMA_ClearITPendingBit(DMA_Stream_TypeDef *s, uint32_t it) { s->tc = 0; }
+
+static inline void SPI_I2S_DMACmd(SPI_TypeDef *spi, uint32_t req, int state) { }
+static inline void I2S_Init(SPI_TypeDef *spi, I2S_InitTypeDef *init) { }
+static inline void I2S_Cmd(SPI_TypeDef *spi, int state) { }
+
+static inline void GPIO_Init(int port, GPIO_InitTypeDef *init) { }
+static inline void GPIO_PinAFConfig(int port, int source, int af) { }
+static inline void NVIC_Init(NVIC_InitTypeDef *init) { }
+static inline void NVIC_EnableIRQ(int irq) { }
+static inline void NVIC_DisableIRQ(int irq) { }
+
+static inline void RCC_AHB1PeriphClockCmd(uint32_t periph, int state) { }
+static inline void RCC_APB1PeriphClockCmd(uint32_t periph, int state) { }
+static inline void RCC_PLLI2SConfig(uint32_t n, uint32_t r) { }
+static inline void RCC_I2SCLKConfig(uint32_t source) { }
+static inline void RCC_PLLI2SCmd(int state) { }
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * Host build of the demac core (5_media_ape/ape).
+ *
+ * The Makefile builds this file twice: once on vector_math_generic.h and
+ * once on vector_math16_armv7m.h with the CMSIS intrinsics done in C
+ * (../stub/stm32f4xx.h). Both decode the same streams and print a line per
+ * stream with the blocks decoded and a hash of the PCM; the two listings
+ * must be identical.
+ *
+ * There is no APE encoder on the host, so the streams are made here:
+ * residuals of changing size, with the odd spike that needs the escape
+ * code, are range coded the way entropy_decode3980() reads them. The
+ * predictor and all the filter stages of each level then run on them
+ * exactly as on a real file, in an arena of APE_DECODER_ARENA_SIZE bytes.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ape_decoder.h"
+
+#define STREAM_FILE     "demac_test.ape"
+#define STREAM_BLOCKS   40000
+#define STREAM_BYTES    (STREAM_BLOCKS * 2 * 8 + 64)
+
+static uint32_t lcg;
+
+static uint32_t rnd(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return lcg >> 8;
+}
+
+/* the input window and the file parser take theirs from the system heap */
+void *rt_malloc(rt_size_t size)
+{
+    return malloc(size);
+}
+
+void rt_free(void *ptr)
+{
+    free(ptr);
+}
+
+/* the 3.98+ symbol model of entropy.c */
+static const uint32_t counts_3980[65] =
+{
+        0,19578,36160,48417,56323,60899,63265,64435,
+    64971,65232,65351,65416,65447,65466,65476,65482,
+    65485,65488,65490,65491,65492,65493,65494,65495,
+    65496,65497,65498,65499,65500,65501,65502,65503,
+    65504,65505,65506,65507,65508,65509,65510,65511,
+    65512,65513,65514,65515,65516,65517,65518,65519,
+    65520,65521,65522,65523,65524,65525,65526,65527,
+    65528,65529,65530,65531,65532,65533,65534,65535,
+    65536
+};
+
+/* range encoder matching the decoder of entropy.c (Schindler's rangecod
+   with Monkey's always-multiply update) */
+#define TOP_VALUE       ((uint32_t)1 << 31)
+#define BOTTOM_VALUE    (TOP_VALUE >> 8)
+#define SHIFT_BITS      23
+
+struct encoder
+{
+    uint8_t* out;
+    int bytes;
+    uint32_t low, range, help;
+    uint8_t buffer;
+};
+
+struct rice
+{
+    uint32_t k, ksum;
+};
+
+static void put_byte(struct encoder* e, uint8_t c)
+{
+    e->out[e->bytes++] = c;
+}
+
+static void enc_normalize(struct encoder* e)
+{
+    while (e->range <= BOTTOM_VALUE)
+    {
+        if (e->low < ((uint32_t)0xff << SHIFT_BITS))
+        {
+            put_byte(e, e->buffer);
+            for (; e->help; e->help--)
+                put_byte(e, 0xff);
+            e->buffer = e->low >> SHIFT_BITS;
+        }
+        else if (e->low & TOP_VALUE)
+        {
+            put_byte(e, e->buffer + 1);
+            for (; e->help; e->help--)
+                put_byte(e, 0x00);
+            e->buffer = e->low >> SHIFT_BITS;
+        }
+        else
+        {
+            e->help++;
+        }
+        e->range <<= 8;
+        e->low = (e->low << 8) & (TOP_VALUE - 1);
+    }
+}
+
+static void encode_freq(struct encoder* e, uint32_t sy_f, uint32_t lt_f, uint32_t tot_f)
+{
+    uint32_t r;
+
+    enc_normalize(e);
+    r = e->range / tot_f;
+    e->low += r * lt_f;
+    e->range = r * sy_f;
+}
+
+static void encode_shift(struct encoder* e, uint32_t sy_f, uint32_t lt_f, int shift)
+{
+    uint32_t r;
+
+    enc_normalize(e);
+    r = e->range >> shift;
+    e->low += r * lt_f;
+    e->range = r * sy_f;
+}
+
+static void encode_done(struct encoder* e)
+{
+    uint32_t tmp;
+
+    enc_normalize(e);
+    tmp = (e->low >> SHIFT_BITS) + 1;
+    if (tmp > 0xff)
+    {
+        put_byte(e, e->buffer + 1);
+        for (; e->help; e->help--)
+            put_byte(e, 0x00);
+    }
+    else
+    {
+        put_byte(e, e->buffer);
+        for (; e->help; e->help--)
+            put_byte(e, 0xff);
+    }
+    put_byte(e, tmp & 0xff);
+    put_byte(e, 0);
+    put_byte(e, 0);
+    put_byte(e, 0);
+}
+
+static void update_rice(struct rice* rice, uint32_t x)
+{
+    rice->ksum += ((x + 1) / 2) - ((rice->ksum + 16) >> 5);
+
+    if (rice->k == 0)
+    {
+        rice->k = 1;
+    }
+    else
+    {
+        uint32_t lim = 1 << (rice->k + 4);
+        if (rice->ksum < lim)
+            rice->k--;
+        else if (rice->ksum >= 2 * lim)
+            rice->k++;
+    }
+}
+
+/* the inverse of entropy_decode3980() */
+static void encode_residual(struct encoder* e, struct rice* rice, int32_t value)
+{
+    uint32_t x, pivot, overflow, base;
+    int nbits, lo_bits;
+
+    x = (value > 0) ? 2 * (uint32_t)value - 1 : 2 * (uint32_t)(-value);
+
+    pivot = rice->ksum >> 5;
+    if (pivot == 0)
+        pivot = 1;
+    overflow = x / pivot;
+    base = x % pivot;
+
+    if (overflow >= 63)
+    {
+        encode_shift(e, counts_3980[64] - counts_3980[63], counts_3980[63], 16);
+        encode_shift(e, 1, overflow >> 16, 16);
+        encode_shift(e, 1, overflow & 0xffff, 16);
+    }
+    else
+    {
+        encode_shift(e, counts_3980[overflow + 1] - counts_3980[overflow],
+                     counts_3980[overflow], 16);
+    }
+
+    if (pivot >= 0x10000)
+    {
+        nbits = 17;
+        while ((pivot >> nbits) > 0)
+            nbits++;
+        lo_bits = nbits - 16;
+
+        encode_freq(e, 1, base >> lo_bits, (pivot >> lo_bits) + 1);
+        encode_shift(e, 1, base & ((1 << lo_bits) - 1), lo_bits);
+    }
+    else
+    {
+        encode_freq(e, 1, base, pivot);
+    }
+
+    update_rice(rice, x);
+}
+
+/* a residual of the size the current stretch of the stream asks for */
+static int32_t residual(uint32_t block, int bps)
+{
+    static const int32_t sizes[] = {3, 40, 700, 9000, 30000, 150};
+    int32_t size = sizes[(block / 1500) % 6];
+
+    if (bps == 24)
+        size *= 200;
+    if (rnd() % 700 == 0)
+        size *= 64;
+
+    return (int32_t)(rnd() % (2 * size + 1)) - size;
+}
+
+static void put16(uint8_t* p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    put16(p, v & 0xffff);
+    put16(p + 2, v >> 16);
+}
+
+/* a version 3.99 file of one frame: descriptor, header, seek table and
+   the range coded residuals */
+static void make_stream(int level, int channels, int bps, uint32_t seed)
+{
+    static uint8_t stream[STREAM_BYTES], file[80 + STREAM_BYTES];
+    struct encoder e;
+    struct rice rice_x, rice_y;
+    uint32_t block;
+    int i, size;
+    FILE* fp;
+
+    memset(file, 0, 80);
+    memcpy(file, "MAC ", 4);
+    put16(file + 4, 3990);      /* file version */
+    put32(file + 8, 52);        /* descriptor length */
+    put32(file + 12, 24);       /* header length */
+    put32(file + 16, 4);        /* seek table length */
+
+    put16(file + 52, level);
+    put32(file + 56, STREAM_BLOCKS);    /* blocks per frame */
+    put32(file + 60, STREAM_BLOCKS);    /* final frame blocks */
+    put32(file + 64, 1);                /* total frames */
+    put16(file + 68, bps);
+    put16(file + 70, channels);
+    put32(file + 72, 44100);
+    put32(file + 76, 80);               /* seek table: the frame */
+
+    /* CRC without the frame flags bit, then the coder; the byte the coder
+       starts with (buffer) is the one the decoder ignores */
+    memset(&e, 0, sizeof(e));
+    e.out = stream;
+    e.range = TOP_VALUE;
+    put_byte(&e, 0x12);
+    put_byte(&e, 0x34);
+    put_byte(&e, 0x56);
+    put_byte(&e, 0x78);
+
+    rice_x.k = rice_y.k = 10;
+    rice_x.ksum = rice_y.ksum = (1 << 10) * 16;
+
+    lcg = seed;
+    for (block = 0; block < STREAM_BLOCKS; block++)
+    {
+        encode_residual(&e, &rice_y, residual(block, bps));
+        if (channels == 2)
+            encode_residual(&e, &rice_x, residual(block, bps));
+    }
+    encode_done(&e);
+
+    /* the decoder takes the bytes of each 32-bit word from the top down */
+    size = RT_ALIGN(e.bytes, 4);
+    for (i = e.bytes; i < size; i++)
+        stream[i] = 0;
+    for (i = 0; i < size; i++)
+        file[80 + i] = stream[(i & ~3) + 3 - (i & 3)];
+
+    fp = fopen(STREAM_FILE, "wb");
+    if (fp == NULL || fwrite(file, 1, 80 + size, fp) != (size_t)(80 + size))
+    {
+        perror(STREAM_FILE);
+        exit(2);
+    }
+    fclose(fp);
+}
+
+/* blocks decoded, hash in *hash; -1 if the decoder can not be created.
+   Worst case 24-bit stereo takes some 5 bytes a block, so the steps stay
+   well inside the APE_INPUT_CHUNKSIZE window demac.c has always used */
+static long decode_stream(uint32_t* hash)
+{
+    static uint8_t pcm[APE_DECODE_BLOCKS * 2 * 3];
+    static uint8_t arena[APE_DECODER_ARENA_SIZE];
+    struct ape_decoder* dec;
+    long total = 0;
+    int fd, n, i, size;
+
+    fd = open(STREAM_FILE, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    /* odd arena start, ape_decoder_create aligns it */
+    dec = ape_decoder_create(fd, arena + 3, sizeof(arena) - 3);
+    if (dec == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+
+    size = dec->ctx.channels * dec->ctx.bps / 8;
+    *hash = 2166136261u;
+    while ((n = ape_decoder_decode(dec, pcm, 256)) > 0)
+    {
+        for (i = 0; i < n * size; i++)
+            *hash = (*hash ^ pcm[i]) * 16777619u;
+        total += n;
+    }
+    if (n < 0)
+        total = -total - 1;
+
+    ape_decoder_destroy(dec);
+    close(fd);
+    return total;
+}
+
+int main(void)
+{
+    static const int levels[] = {1000, 2000, 3000, 4000, 5000};
+    static const struct { int channels, bps; } formats[] =
+    {
+        {2, 16}, {1, 16}, {2, 24}, {1, 24},
+    };
+    uint32_t hash, seed = 1;
+    long blocks;
+    unsigned int l, f;
+    int failed = 0;
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+    {
+        /* demac.c gives the decoder an arena of APE_DECODER_ARENA_SIZE */
+        if (ape_decoder_memsize(levels[l]) == 0 ||
+            ape_decoder_memsize(levels[l]) > APE_DECODER_ARENA_SIZE - 3)
+        {
+            printf("level %d needs %u bytes\n", levels[l],
+                   (unsigned)ape_decoder_memsize(levels[l]));
+            failed = 1;
+        }
+
+        for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+        {
+            make_stream(levels[l], formats[f].channels, formats[f].bps, seed++);
+            hash = 0;
+            blocks = decode_stream(&hash);
+            printf("level %d, %d ch, %2d bit: %6ld blocks, pcm %08x\n", levels[l],
+                   formats[f].channels, formats[f].bps, blocks, (unsigned)hash);
+
+            if (blocks != STREAM_BLOCKS)
+                failed = 1;
+        }
+    }
+
+    unlink(STREAM_FILE);
+    return failed;
+}
@@ -0,0 +1,3 @@
+/* Host stand-in: filter.c picks the MMX header on x86-64 hosts, the tree
+   has none, so the reference build uses the generic C code */
+#include "vector_math_generic.h"
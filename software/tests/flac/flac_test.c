@@ -0,0 +1,779 @@
+/*
+ * Host test and benchmark of the FLAC decoder (5_media_flac/flac).
+ *
+ * FLAC is lossless, so the PCM an encoder was given is exactly what
+ * "flac -d" gives back. The test encodes its own streams from known PCM
+ * and checks every decoded frame against it, sample by sample. The
+ * schedule walks through constant, verbatim, fixed orders 0-4 and LPC
+ * orders 1-12 and 32 (the specialised kernels) as well as 16 and 20 (the
+ * generic loops), all four channel assignments, Rice partition orders
+ * 0-4 and escaped partitions, for 16 and 24 bit.
+ *
+ *   flac_test                          check, then benchmark
+ *   flac_test -w bps file.flac file.raw
+ *                                      write a test stream and its PCM
+ *   flac_test file.flac file.raw       decode file.flac against raw PCM,
+ *                                      e.g. from "flac -d --force-raw-format
+ *                                      --endian=little --sign=signed"
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decoder.h"
+
+#define BLOCKSIZE       4096
+#define TAIL_BLOCKSIZE  1000        /* last frame, also tests blocksize code 7 */
+#define SAMPLERATE      44100
+#define FRAME_BYTES     (BLOCKSIZE * 2 * 4 + 64)
+
+static int failures;
+
+/* subframe methods */
+enum
+{
+    M_CONSTANT = -2,
+    M_VERBATIM = -1,
+    M_FIXED = 0,                    /* M_FIXED + order, 0..4 */
+    M_LPC = 8,                      /* M_LPC + order, 1..32 */
+};
+
+static const int schedule[] =
+{
+    M_CONSTANT, M_VERBATIM,
+    M_FIXED + 0, M_FIXED + 1, M_FIXED + 2, M_FIXED + 3, M_FIXED + 4,
+    M_LPC + 1, M_LPC + 2, M_LPC + 3, M_LPC + 4, M_LPC + 5, M_LPC + 6,
+    M_LPC + 7, M_LPC + 8, M_LPC + 9, M_LPC + 10, M_LPC + 11, M_LPC + 12,
+    M_LPC + 16, M_LPC + 20, M_LPC + 32,
+};
+#define SCHEDULE_SIZE   (int)(sizeof(schedule) / sizeof(schedule[0]))
+
+/* a stream in memory: the frames and the PCM they were made from */
+struct stream
+{
+    int bps, channels;
+    int samples;
+    int32_t *pcm;                   /* interleaved */
+    uint8_t *data;
+    int size;
+    int frames;
+    int *frame_offset;
+};
+
+static uint32_t lcg;
+
+static uint32_t rnd(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return lcg >> 8;
+}
+
+/* music-like PCM: a few drifting tones and some noise, the right channel
+   following the left */
+static void make_pcm(struct stream *st, uint32_t seed)
+{
+    double full = (double)(1 << (st->bps - 1));
+    double phase[3] = {0, 0, 0};
+    int i, c;
+
+    lcg = seed;
+    for (i = 0; i < st->samples; i++)
+    {
+        double t = (double)i / SAMPLERATE;
+        double v = 0.3 * sin(phase[0]) + 0.2 * sin(phase[1]) + 0.1 * sin(phase[2]);
+        double noise = ((double)(rnd() % 2001) - 1000) / 1000;
+
+        phase[0] += 2 * M_PI * (220 + 30 * sin(t)) / SAMPLERATE;
+        phase[1] += 2 * M_PI * (1250 + 400 * sin(0.3 * t)) / SAMPLERATE;
+        phase[2] += 2 * M_PI * 7000 / SAMPLERATE;
+
+        for (c = 0; c < st->channels; c++)
+        {
+            double x = (c == 0 ? v : 0.8 * v + 0.1 * sin(phase[2] * 0.37)) + 0.01 * noise;
+            st->pcm[i * st->channels + c] = (int32_t)lrint(x * (full - 1));
+        }
+    }
+}
+
+/* bit writer, MSB first into a cleared buffer */
+struct bitwriter
+{
+    uint8_t *buf;
+    int bits;
+};
+
+static void put_bits(struct bitwriter *w, int n, uint32_t v)
+{
+    while (n--)
+    {
+        if ((v >> n) & 1)
+            w->buf[w->bits >> 3] |= 0x80 >> (w->bits & 7);
+        w->bits++;
+    }
+}
+
+static void put_sbits(struct bitwriter *w, int n, int32_t v)
+{
+    put_bits(w, n, (uint32_t)v & (n == 32 ? 0xffffffff : (1u << n) - 1));
+}
+
+static void put_rice(struct bitwriter *w, int k, int32_t v)
+{
+    uint32_t u = v < 0 ? ~((uint32_t)v << 1) : (uint32_t)v << 1;
+    uint32_t q = u >> k;
+
+    while (q--)
+        put_bits(w, 1, 0);
+    put_bits(w, 1, 1);
+    if (k)
+        put_bits(w, k, u & ((1u << k) - 1));
+}
+
+static void put_utf8(struct bitwriter *w, uint32_t n)
+{
+    int bytes, i;
+
+    if (n < 0x80)
+    {
+        put_bits(w, 8, n);
+        return;
+    }
+
+    for (bytes = 2; n >= (1u << (5 * bytes + 1)); bytes++)
+        ;
+    put_bits(w, 8, ((0xff00 >> bytes) & 0xff) | (n >> (6 * (bytes - 1))));
+    for (i = bytes - 2; i >= 0; i--)
+        put_bits(w, 8, 0x80 | ((n >> (6 * i)) & 0x3f));
+}
+
+static uint8_t crc8(const uint8_t *p, int n)
+{
+    uint8_t crc = 0;
+    int i;
+
+    while (n--)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *p, int n)
+{
+    uint16_t crc = 0;
+    int i;
+
+    while (n--)
+    {
+        crc ^= *p++ << 8;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+    }
+    return crc;
+}
+
+/* bits of a signed value in two's complement */
+static int sbits(int32_t v)
+{
+    int n = 1;
+
+    while (v < -(1LL << (n - 1)) || v >= (1LL << (n - 1)))
+        n++;
+    return n;
+}
+
+/* residual partitions; partition 0 is escaped when escape is set */
+static void put_residual(struct bitwriter *w, const int32_t *res, int blocksize,
+                         int pred_order, int order, int escape)
+{
+    int partitions = 1 << order, samples = blocksize >> order;
+    int k[16], method = 0, p, i, start, end, n;
+
+    for (p = 0; p < partitions; p++)
+    {
+        uint64_t sum = 0;
+
+        start = p ? p * samples : pred_order;
+        end = (p + 1) * samples;
+        for (i = start; i < end; i++)
+            sum += res[i] < 0 ? -(int64_t)res[i] * 2 - 1 : (int64_t)res[i] * 2;
+
+        for (k[p] = 0; k[p] < 30 && ((uint64_t)(end - start) << (k[p] + 1)) < sum; k[p]++)
+            ;
+        if (k[p] > 14)
+            method = 1;
+    }
+
+    put_bits(w, 2, method);
+    put_bits(w, 4, order);
+    for (p = 0; p < partitions; p++)
+    {
+        start = p ? p * samples : pred_order;
+        end = (p + 1) * samples;
+
+        if (escape && p == 0)
+        {
+            for (n = 1, i = start; i < end; i++)
+                if (sbits(res[i]) > n)
+                    n = sbits(res[i]);
+            put_bits(w, method ? 5 : 4, method ? 31 : 15);
+            put_bits(w, 5, n);
+            for (i = start; i < end; i++)
+                put_sbits(w, n, res[i]);
+        }
+        else
+        {
+            put_bits(w, method ? 5 : 4, k[p]);
+            for (i = start; i < end; i++)
+                put_rice(w, k[p], res[i]);
+        }
+    }
+}
+
+/* quantised LPC coefficients of x by Levinson-Durbin, -1 if there are none */
+static int lpc_coeffs(const int32_t *x, int n, int order, int precision,
+                      int *coeffs, int *shift)
+{
+    double r[33], a[33], tmp[33], err, k, cmax = 0, q, e = 0;
+    int i, j, exp, lim = (1 << (precision - 1)) - 1;
+
+    for (i = 0; i <= order; i++)
+    {
+        r[i] = 0;
+        for (j = i; j < n; j++)
+            r[i] += (double)x[j] * x[j - i];
+    }
+    if (r[0] == 0)
+        return -1;
+
+    err = r[0] * (1 + 1e-9);
+    for (i = 1; i <= order; i++)
+    {
+        k = r[i];
+        for (j = 1; j < i; j++)
+            k -= a[j] * r[i - j];
+        k /= err;
+        for (j = 1; j < i; j++)
+            tmp[j] = a[j] - k * a[i - j];
+        for (j = 1; j < i; j++)
+            a[j] = tmp[j];
+        a[i] = k;
+        err *= 1 - k * k;
+    }
+
+    for (i = 1; i <= order; i++)
+        if (fabs(a[i]) > cmax)
+            cmax = fabs(a[i]);
+    if (cmax == 0)
+        return -1;
+
+    frexp(cmax, &exp);
+    *shift = precision - exp;
+    if (*shift > 15)
+        *shift = 15;
+    if (*shift < 0)
+        return -1;
+
+    for (i = 0; i < order; i++)
+    {
+        q = a[i + 1] * (1 << *shift) + e;
+        coeffs[i] = (int)lrint(q);
+        if (coeffs[i] > lim) coeffs[i] = lim;
+        if (coeffs[i] < -lim - 1) coeffs[i] = -lim - 1;
+        e = q - coeffs[i];
+    }
+    return 0;
+}
+
+/* one subframe of x; falls back to fixed order 2 where the LPC sums would
+   not fit the 32-bit accumulator the decoder uses up to 16 bits */
+static void put_subframe(struct bitwriter *w, const int32_t *x, int blocksize,
+                         int bps, int frame_bps, int method, int rice_order, int escape)
+{
+    static int32_t res[BLOCKSIZE];
+    int coeffs[32], shift = 0, order, i, j, precision = 12;
+
+    if (method >= M_LPC)
+    {
+        order = method - M_LPC;
+        precision = frame_bps > 16 ? 15 : 12;
+        if (lpc_coeffs(x, blocksize, order, precision, coeffs, &shift) < 0)
+            method = M_FIXED + 2;
+
+        for (i = order; method >= M_LPC && i < blocksize; i++)
+        {
+            int64_t sum = 0;
+
+            for (j = 0; j < order; j++)
+                sum += (int64_t)coeffs[j] * x[i - j - 1];
+            if (frame_bps <= 16 && (sum > INT32_MAX || sum < INT32_MIN))
+                method = M_FIXED + 2;
+            res[i] = x[i] - (int32_t)(sum >> shift);
+        }
+    }
+
+    if (method == M_CONSTANT)
+    {
+        for (i = 1; i < blocksize && x[i] == x[0]; i++)
+            ;
+        if (i < blocksize)
+            method = M_VERBATIM;
+    }
+
+    put_bits(w, 1, 0);
+    if (method == M_CONSTANT)
+    {
+        put_bits(w, 6, 0);
+        put_bits(w, 1, 0);
+        put_sbits(w, bps, x[0]);
+    }
+    else if (method == M_VERBATIM)
+    {
+        put_bits(w, 6, 1);
+        put_bits(w, 1, 0);
+        for (i = 0; i < blocksize; i++)
+            put_sbits(w, bps, x[i]);
+    }
+    else if (method < M_LPC)
+    {
+        order = method - M_FIXED;
+        for (i = order; i < blocksize; i++)
+        {
+            switch (order)
+            {
+            case 0: res[i] = x[i]; break;
+            case 1: res[i] = x[i] - x[i - 1]; break;
+            case 2: res[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+            case 3: res[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+            case 4: res[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+            }
+        }
+
+        put_bits(w, 6, 8 + order);
+        put_bits(w, 1, 0);
+        for (i = 0; i < order; i++)
+            put_sbits(w, bps, x[i]);
+        put_residual(w, res, blocksize, order, rice_order, escape);
+    }
+    else
+    {
+        order = method - M_LPC;
+        put_bits(w, 6, 32 + order - 1);
+        put_bits(w, 1, 0);
+        for (i = 0; i < order; i++)
+            put_sbits(w, bps, x[i]);
+        put_bits(w, 4, precision - 1);
+        put_sbits(w, 5, shift);
+        for (i = 0; i < order; i++)
+            put_sbits(w, precision, coeffs[i]);
+        put_residual(w, res, blocksize, order, rice_order, escape);
+    }
+}
+
+/* encode st->pcm; method < M_CONSTANT walks the schedule, anything else
+   is used for every subframe of a mid/side stream */
+static void encode_stream(struct stream *st, int method)
+{
+    static int32_t ch[2][BLOCKSIZE];
+    struct bitwriter w;
+    int frame, offset, blocksize, assignment, i, c, start, rice_order;
+
+    st->frames = (st->samples + BLOCKSIZE - 1) / BLOCKSIZE;
+    st->frame_offset = malloc(sizeof(int) * (st->frames + 1));
+    st->data = calloc(1, (size_t)st->frames * FRAME_BYTES + 16);
+    w.buf = st->data;
+    w.bits = 0;
+
+    for (frame = 0; frame < st->frames; frame++)
+    {
+        offset = frame * BLOCKSIZE;
+        blocksize = st->samples - offset < BLOCKSIZE ? st->samples - offset : BLOCKSIZE;
+        assignment = st->channels == 2 ? (method < M_CONSTANT ? frame % 4 : 3) : 0;
+
+        /* constant subframes need constant PCM: a frame of DC */
+        if (method < M_CONSTANT && schedule[frame % SCHEDULE_SIZE] == M_CONSTANT)
+            for (i = 0; i < blocksize * st->channels; i++)
+                st->pcm[offset * st->channels + i] = (frame & 1) ? -7 : 0;
+
+        for (i = 0; i < blocksize; i++)
+        {
+            int32_t l = st->pcm[(offset + i) * st->channels];
+            int32_t r = st->channels == 2 ? st->pcm[(offset + i) * 2 + 1] : 0;
+
+            switch (assignment)
+            {
+            case 0: ch[0][i] = l; ch[1][i] = r; break;
+            case 1: ch[0][i] = l; ch[1][i] = l - r; break;
+            case 2: ch[0][i] = l - r; ch[1][i] = r; break;
+            case 3: ch[0][i] = (l + r) >> 1; ch[1][i] = l - r; break;
+            }
+        }
+
+        /* frame header */
+        start = w.bits >> 3;
+        st->frame_offset[frame] = start;
+        put_bits(&w, 15, 0x7ffc);
+        put_bits(&w, 1, 0);
+        put_bits(&w, 4, blocksize == BLOCKSIZE ? 12 : 7);
+        put_bits(&w, 4, 9);
+        put_bits(&w, 4, assignment ? 7 + assignment : st->channels - 1);
+        put_bits(&w, 3, st->bps == 16 ? 4 : 6);
+        put_bits(&w, 1, 0);
+        put_utf8(&w, frame);
+        if (blocksize != BLOCKSIZE)
+            put_bits(&w, 16, blocksize - 1);
+        put_bits(&w, 8, crc8(st->data + start, (w.bits >> 3) - start));
+
+        /* as many partitions as the first one and the blocksize allow */
+        rice_order = frame % 5;
+        while (rice_order && ((blocksize >> rice_order) <= 32 ||
+                              (blocksize & ((1 << rice_order) - 1))))
+            rice_order--;
+
+        for (c = 0; c < st->channels; c++)
+        {
+            int bps = st->bps + ((assignment == 1 && c == 1) ||
+                                 (assignment == 2 && c == 0) ||
+                                 (assignment == 3 && c == 1));
+            int m = method;
+
+            if (method < M_CONSTANT)
+                m = schedule[(frame + c * 7) % SCHEDULE_SIZE];
+            put_subframe(&w, ch[c], blocksize, bps, st->bps, m, rice_order,
+                         method < M_CONSTANT && frame % 3 == 0);
+        }
+
+        /* byte align, frame CRC */
+        w.bits = (w.bits + 7) & ~7;
+        put_bits(&w, 16, crc16(st->data + start, (w.bits >> 3) - start));
+    }
+
+    st->frame_offset[frame] = w.bits >> 3;
+    st->size = w.bits >> 3;
+}
+
+/* the PCM of the decoded frame, undone the way the format describes it */
+static void frame_pcm(FLACContext *fc, int32_t *pcm)
+{
+    int i;
+
+    for (i = 0; i < fc->blocksize; i++)
+    {
+        int32_t a = fc->decoded0[i], b = fc->channels == 2 ? fc->decoded1[i] : 0;
+        int32_t mid;
+
+        switch (fc->decorrelation)
+        {
+        case INDEPENDENT:
+            break;
+        case LEFT_SIDE:
+            b = a - b;
+            break;
+        case RIGHT_SIDE:
+            a = a + b;
+            break;
+        case MID_SIDE:
+            mid = (int32_t)((uint32_t)a << 1) | (b & 1);
+            a = (mid + b) >> 1;
+            b = (mid - b) >> 1;
+            break;
+        }
+
+        pcm[i * fc->channels] = a;
+        if (fc->channels == 2)
+            pcm[i * 2 + 1] = b;
+    }
+}
+
+static void decoder_init(FLACContext *fc, int bps, int channels)
+{
+    memset(fc, 0, sizeof(*fc));
+    fc->bps = bps;
+    fc->channels = channels;
+    fc->samplerate = SAMPLERATE;
+    fc->min_blocksize = fc->max_blocksize = BLOCKSIZE;
+    fc->decoded0 = malloc(sizeof(int32_t) * BLOCKSIZE);
+    fc->decoded1 = malloc(sizeof(int32_t) * BLOCKSIZE);
+}
+
+static void decoder_done(FLACContext *fc)
+{
+    free(fc->decoded0);
+    free(fc->decoded1);
+}
+
+/* decode buf frame by frame against the interleaved PCM in expect;
+   returns the frames decoded, -1 on the first mismatch */
+static int decode_check(const char *name, FLACContext *fc, uint8_t *buf, int size,
+                        const int32_t *expect, int samples)
+{
+    static int16_t wav[BLOCKSIZE * 2];
+    static int32_t pcm[BLOCKSIZE * 2];
+    int offset = 0, done = 0, frames = 0, res, i, n;
+
+    while (offset < size && done < samples)
+    {
+        res = flac_decode_frame(fc, buf + offset, size - offset, wav);
+        if (res < 0)
+        {
+            printf("%s: frame %d: decoder error %d\n", name, frames, res);
+            return -1;
+        }
+
+        n = fc->blocksize * fc->channels;
+        if (fc->samplenumber != (unsigned long)done || done + fc->blocksize > samples)
+        {
+            printf("%s: frame %d: sample number %lu, expected %d\n", name,
+                   frames, fc->samplenumber, done);
+            return -1;
+        }
+
+        frame_pcm(fc, pcm);
+        for (i = 0; i < n; i++)
+        {
+            /* the decoder hands out 16-bit PCM, the 16-bit streams are
+               checked on it as well */
+            if (pcm[i] != expect[done * fc->channels + i] ||
+                (fc->bps == 16 && wav[fc->channels == 2 ? i : 2 * i] != pcm[i]))
+            {
+                printf("%s: frame %d: sample %d is %d, expected %d\n", name, frames,
+                       done + i / fc->channels, (int)pcm[i],
+                       (int)expect[done * fc->channels + i]);
+                return -1;
+            }
+        }
+
+        offset += fc->framesize;
+        done += fc->blocksize;
+        frames++;
+    }
+
+    if (done != samples)
+    {
+        printf("%s: %d samples decoded, expected %d\n", name, done, samples);
+        return -1;
+    }
+    return frames;
+}
+
+static void stream_init(struct stream *st, int bps, int channels, int samples,
+                        uint32_t seed, int method)
+{
+    memset(st, 0, sizeof(*st));
+    st->bps = bps;
+    st->channels = channels;
+    st->samples = samples;
+    st->pcm = malloc(sizeof(int32_t) * samples * channels);
+    make_pcm(st, seed);
+    encode_stream(st, method);
+}
+
+static void stream_free(struct stream *st)
+{
+    free(st->pcm);
+    free(st->data);
+    free(st->frame_offset);
+}
+
+static void test_stream(int bps, int channels)
+{
+    struct stream st;
+    FLACContext fc;
+    char name[32];
+    int frames;
+
+    /* every method with every channel assignment, and a short last frame */
+    stream_init(&st, bps, channels, (SCHEDULE_SIZE * 4 * 2) * BLOCKSIZE + TAIL_BLOCKSIZE,
+                bps * 10 + channels, M_CONSTANT - 1);
+    decoder_init(&fc, bps, channels);
+
+    snprintf(name, sizeof(name), "%d bit, %d ch", bps, channels);
+    frames = decode_check(name, &fc, st.data, st.size, st.pcm, st.samples);
+    if (frames < 0)
+        failures++;
+    else
+        printf("%s: %d frames, %d samples bit-exact\n", name, frames, st.samples);
+
+    decoder_done(&fc);
+    stream_free(&st);
+}
+
+/* decoding speed of one subframe method on 60 s of stereo */
+static void bench(const char *name, int bps, int method)
+{
+    static int16_t wav[BLOCKSIZE * 2];
+    struct stream st;
+    FLACContext fc;
+    struct timespec t0, t1;
+    double ns;
+    int frame;
+
+    stream_init(&st, bps, 2, 60 * SAMPLERATE, 99, method);
+    decoder_init(&fc, bps, 2);
+
+    if (decode_check(name, &fc, st.data, st.size, st.pcm, st.samples) < 0)
+        failures++;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (frame = 0; frame < st.frames; frame++)
+        flac_decode_frame(&fc, st.data + st.frame_offset[frame],
+                          st.frame_offset[frame + 1] - st.frame_offset[frame], wav);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("%-24s %6.2f ns/sample, %6.0fx realtime\n", name, ns / st.samples,
+           60e9 / ns);
+
+    decoder_done(&fc);
+    stream_free(&st);
+}
+
+static int write_stream(int bps, const char *flac_name, const char *raw_name)
+{
+    struct stream st;
+    uint8_t head[42];
+    uint64_t info;
+    FILE *fp;
+    int i, b;
+
+    stream_init(&st, bps, 2, 200 * BLOCKSIZE + TAIL_BLOCKSIZE, 7, M_CONSTANT - 1);
+
+    /* "fLaC" and the only metadata block, STREAMINFO without MD5 */
+    memset(head, 0, sizeof(head));
+    memcpy(head, "fLaC", 4);
+    head[4] = 0x80;
+    head[7] = 34;
+    head[8] = BLOCKSIZE >> 8;
+    head[10] = BLOCKSIZE >> 8;
+    info = ((uint64_t)SAMPLERATE << 44) | ((uint64_t)(st.channels - 1) << 41) |
+           ((uint64_t)(bps - 1) << 36) | (uint64_t)st.samples;
+    for (i = 0; i < 8; i++)
+        head[18 + i] = info >> (56 - 8 * i);
+
+    fp = fopen(flac_name, "wb");
+    if (fp == NULL)
+        return 2;
+    fwrite(head, 1, sizeof(head), fp);
+    fwrite(st.data, 1, st.size, fp);
+    fclose(fp);
+
+    /* raw little endian signed PCM, as flac -d --force-raw-format writes */
+    fp = fopen(raw_name, "wb");
+    if (fp == NULL)
+        return 2;
+    for (i = 0; i < st.samples * st.channels; i++)
+        for (b = 0; b < bps / 8; b++)
+            fputc((st.pcm[i] >> (8 * b)) & 0xff, fp);
+    fclose(fp);
+
+    stream_free(&st);
+    return 0;
+}
+
+static uint8_t *read_file(const char *name, int *size)
+{
+    FILE *fp = fopen(name, "rb");
+    uint8_t *buf;
+
+    if (fp == NULL)
+    {
+        perror(name);
+        exit(2);
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = calloc(1, *size + 16);
+    if (fread(buf, 1, *size, fp) != (size_t)*size)
+        *size = 0;
+    fclose(fp);
+    return buf;
+}
+
+static int check_file(const char *flac_name, const char *raw_name)
+{
+    FLACContext fc;
+    uint8_t *buf, *raw, *p;
+    int32_t *pcm;
+    int size, raw_size, last, length, samples, bps, channels, width, i, b, frames;
+
+    buf = read_file(flac_name, &size);
+    raw = read_file(raw_name, &raw_size);
+    if (size < 42 || memcmp(buf, "fLaC", 4) != 0)
+    {
+        printf("%s: not a FLAC file\n", flac_name);
+        return 1;
+    }
+
+    /* STREAMINFO comes first, the other metadata blocks are skipped */
+    p = buf + 4;
+    channels = ((p[16] >> 1) & 7) + 1;
+    bps = (((p[16] & 1) << 4) | (p[17] >> 4)) + 1;
+    do
+    {
+        last = p[0] & 0x80;
+        length = (p[1] << 16) | (p[2] << 8) | p[3];
+        p += 4 + length;
+    } while (!last && p < buf + size);
+
+    width = (bps + 7) / 8;
+    samples = raw_size / width / channels;
+    pcm = malloc(sizeof(int32_t) * samples * channels);
+    for (i = 0; i < samples * channels; i++)
+    {
+        uint32_t v = 0;
+
+        for (b = 0; b < width; b++)
+            v |= raw[i * width + b] << (8 * b);
+        pcm[i] = (int32_t)(v << (32 - 8 * width)) >> (32 - 8 * width);
+    }
+
+    decoder_init(&fc, bps, channels);
+    fc.min_blocksize = (buf[8] << 8) | buf[9];
+    fc.max_blocksize = (buf[10] << 8) | buf[11];
+    if (fc.max_blocksize > BLOCKSIZE)
+    {
+        printf("%s: blocks of %d samples, the test takes %d\n", flac_name,
+               fc.max_blocksize, BLOCKSIZE);
+        return 1;
+    }
+
+    frames = decode_check(flac_name, &fc, p, buf + size - p, pcm, samples);
+    if (frames >= 0)
+        printf("%s: %d frames, %d samples bit-exact\n", flac_name, frames, samples);
+
+    decoder_done(&fc);
+    free(pcm);
+    free(raw);
+    free(buf);
+    return frames < 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 5 && strcmp(argv[1], "-w") == 0)
+        return write_stream(atoi(argv[2]), argv[3], argv[4]);
+    if (argc == 3)
+        return check_file(argv[1], argv[2]);
+
+    test_stream(16, 2);
+    test_stream(16, 1);
+    test_stream(24, 2);
+    test_stream(24, 1);
+
+    bench("16 bit, fixed 2", 16, M_FIXED + 2);
+    bench("16 bit, lpc 8", 16, M_LPC + 8);
+    bench("16 bit, lpc 12", 16, M_LPC + 12);
+    bench("16 bit, lpc 16 (generic)", 16, M_LPC + 16);
+    bench("16 bit, lpc 32", 16, M_LPC + 32);
+    bench("24 bit, lpc 8", 24, M_LPC + 8);
+    bench("24 bit, lpc 20 (generic)", 24, M_LPC + 20);
+    bench("24 bit, lpc 32", 24, M_LPC + 32);
+
+    printf("flac: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,477 @@
+/*
+ * Host test of ui/image_cache.c.
+ *
+ * The cache source is included here and built against the kernel and
+ * RTGUI headers of the tree. The files are a table of name, time, size
+ * and whether they decode; the "png" engine decodes at the size of the
+ * file, the "jpeg" decoder registered with the cache to the size asked
+ * for. Decodes take their pixels from a heap with a limit, an allocation
+ * over the limit is counted as a failure of the memory regions, the way
+ * mem_region.c does. The test checks that
+ *
+ *   - a get hits an image of the same file, time, size and format,
+ *   - the unused images go least recently used first once the cache is
+ *     over IMAGE_CACHE_SIZE, held images stay,
+ *   - a file replaced while held is decoded again, the holders keep the
+ *     old image until they put it,
+ *   - a decode out of memory drops the unused images and is tried again,
+ *   - a file that does not decode is not decoded again until it changes,
+ *     and drops nothing; IMAGE_CACHE_FAILED files are remembered,
+ *   - an image another thread put into the cache during the decode is
+ *     the one returned,
+ *
+ * and that all images are gone after image_cache_shrink(0).
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../realtouch/ui/image_cache.c"
+
+#define F       RTGRAPHIC_PIXEL_FORMAT_RGB565
+#define FILES   64
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+/* the files */
+struct sim_file
+{
+    char name[24];
+    time_t mtime;
+    rt_uint16_t w, h;
+    int broken;
+};
+
+static struct sim_file files[FILES];
+static int file_count;
+
+static struct sim_file *file_find(const char *name)
+{
+    int index;
+
+    for (index = 0; index < file_count; index ++)
+    {
+        if (strcmp(files[index].name, name) == 0)
+            return &files[index];
+    }
+
+    return RT_NULL;
+}
+
+static void file_add(const char *name, rt_uint16_t w, rt_uint16_t h)
+{
+    struct sim_file *f = &files[file_count ++];
+
+    strcpy(f->name, name);
+    f->mtime = 1;
+    f->w = w;
+    f->h = h;
+    f->broken = 0;
+}
+
+int sim_stat(const char *path, struct stat *st)
+{
+    struct sim_file *f = file_find(path);
+
+    if (f == RT_NULL)
+        return -1;
+    memset(st, 0, sizeof(*st));
+    st->st_mtime = f->mtime;
+
+    return 0;
+}
+
+/* the heap the pixels come from */
+static long heap_used, heap_limit = 1L << 30;
+static long decodes, live_images;
+static rt_uint32_t region_failures;
+
+rt_err_t mem_region_stat(enum mem_region_id id, struct mem_region_stat *stat)
+{
+    memset(stat, 0, sizeof(*stat));
+    if (id == MEM_REGION_EXT)
+        stat->fail_count = region_failures;
+
+    return RT_EOK;
+}
+
+/* called inside a decode, as if another thread ran */
+static void (*during_decode)(void);
+
+static rtgui_image_t *image_make(const char *filename, rt_uint16_t w, rt_uint16_t h)
+{
+    struct sim_file *f = file_find(filename);
+    rtgui_image_t *image;
+    long size;
+
+    if (during_decode != RT_NULL)
+    {
+        void (*hook)(void) = during_decode;
+
+        during_decode = RT_NULL;
+        hook();
+    }
+
+    decodes ++;
+    if (f == RT_NULL || f->broken)
+        return RT_NULL;
+
+    if (w == 0 || w > f->w) w = f->w;
+    if (h == 0 || h > f->h) h = f->h;
+    size = (long)w * h * 2;
+    if (heap_used + size > heap_limit)
+    {
+        region_failures ++;
+        return RT_NULL;
+    }
+
+    image = (rtgui_image_t *)calloc(1, sizeof(*image));
+    image->w = w;
+    image->h = h;
+    image->data = malloc(size);
+    heap_used += size;
+    live_images ++;
+
+    return image;
+}
+
+static struct rtgui_image_engine png_engine = {"png"}, jpeg_engine = {"jpeg"};
+
+struct rtgui_image_engine *rtgui_image_get_engine_by_filename(const char *fn)
+{
+    const char *ext = strrchr(fn, '.');
+
+    if (ext == RT_NULL)
+        return RT_NULL;
+    if (strcmp(ext, ".png") == 0)
+        return &png_engine;
+    if (strcmp(ext, ".jpg") == 0)
+        return &jpeg_engine;
+
+    return RT_NULL;
+}
+
+struct rtgui_image *rtgui_image_create(const char *filename, rt_bool_t load)
+{
+    return image_make(filename, 0, 0);
+}
+
+void rtgui_image_destroy(struct rtgui_image *image)
+{
+    heap_used -= (long)image->w * image->h * 2;
+    free(image->data);
+    free(image);
+    live_images --;
+}
+
+static rtgui_image_t *jpeg_scaled(const char *filename, rt_uint16_t width, rt_uint16_t height)
+{
+    return image_make(filename, width, height);
+}
+
+/* the kernel */
+static int lock_depth;
+
+rt_err_t rt_mutex_init(rt_mutex_t mutex, const char *name, rt_uint8_t flag)
+{
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_take(rt_mutex_t mutex, rt_int32_t time)
+{
+    CHECK(lock_depth == 0);
+    lock_depth ++;
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_release(rt_mutex_t mutex)
+{
+    CHECK(lock_depth == 1);
+    lock_depth --;
+    return RT_EOK;
+}
+
+void *rt_malloc(rt_size_t size)
+{
+    return malloc(size);
+}
+
+void rt_free(void *ptr)
+{
+    free(ptr);
+}
+
+char *rt_strdup(const char *s)
+{
+    return strdup(s);
+}
+
+rt_ubase_t rt_strcmp(const char *cs, const char *ct)
+{
+    return strcmp(cs, ct);
+}
+
+void *rt_memmove(void *dest, const void *src, rt_ubase_t n)
+{
+    return memmove(dest, src, n);
+}
+
+void rt_kprintf(const char *fmt, ...)
+{
+}
+
+static void test_lookup(void)
+{
+    struct image_cache_stat st;
+    struct image_cache_item *a, *b;
+
+    a = image_cache_get("/i0.png", 0, 0, F);
+    b = image_cache_get("/i0.png", 0, 0, F);
+    CHECK(a != RT_NULL && a->image->w == 160);
+    CHECK(b == a && a->refcount == 2);
+    image_cache_get_stat(&st);
+    CHECK(st.hits == 1 && st.misses == 1 && st.images == 1);
+    image_cache_put(b);
+    image_cache_put(a);
+
+    /* the format is part of the key */
+    a = image_cache_get("/i0.png", 0, 0, RTGRAPHIC_PIXEL_FORMAT_RGB888);
+    CHECK(a != RT_NULL && decodes == 2);
+    image_cache_put(a);
+
+    /* unknown types and missing files are not decoded */
+    CHECK(image_cache_get("/note.txt", 0, 0, F) == RT_NULL);
+    CHECK(image_cache_get("/none.png", 0, 0, F) == RT_NULL);
+    CHECK(decodes == 2);
+
+    image_cache_shrink(0);
+}
+
+static void test_budget(void)
+{
+    struct image_cache_stat st;
+    struct image_cache_item *a;
+    char name[24];
+    long before;
+    int index;
+
+    /* 38400 bytes and more each: IMAGE_CACHE_SIZE holds nine */
+    a = image_cache_get("/i1.png", 0, 0, F);
+    for (index = 2; index < 30; index ++)
+    {
+        sprintf(name, "/i%d.png", index);
+        image_cache_put(image_cache_get(name, 0, 0, F));
+    }
+    image_cache_get_stat(&st);
+    CHECK(st.bytes <= IMAGE_CACHE_SIZE && st.images >= 9);
+    CHECK(a->image->w == 160 && a->refcount == 1);
+
+    /* the most recent is a hit, the oldest was dropped */
+    before = decodes;
+    image_cache_put(image_cache_get("/i29.png", 0, 0, F));
+    CHECK(decodes == before);
+    image_cache_put(image_cache_get("/i2.png", 0, 0, F));
+    CHECK(decodes == before + 1);
+    image_cache_put(a);
+
+    /* a prefetch makes the get a hit */
+    before = decodes;
+    CHECK(image_cache_prefetch("/i35.png", 0, 0, F) == RT_EOK && decodes == before + 1);
+    a = image_cache_get("/i35.png", 0, 0, F);
+    CHECK(decodes == before + 1 && a->refcount == 1);
+    image_cache_put(a);
+
+    image_cache_shrink(0);
+}
+
+static void test_replaced(void)
+{
+    struct image_cache_item *a, *b, *c;
+    long live;
+
+    a = image_cache_get("/i36.png", 0, 0, F);
+    file_find("/i36.png")->mtime = 2;
+    file_find("/i36.png")->w = 100;
+    b = image_cache_get("/i36.png", 0, 0, F);
+    c = image_cache_get("/i36.png", 0, 0, F);
+    CHECK(b != a && b->image->w == 100 && a->image->w == 160);
+    CHECK(c == b);
+
+    live = live_images;
+    image_cache_put(a);
+    CHECK(live_images == live - 1);
+    image_cache_put(b);
+    image_cache_put(c);
+
+    image_cache_shrink(0);
+}
+
+static void test_out_of_memory(void)
+{
+    struct image_cache_stat st, before;
+    struct image_cache_item *a, *b;
+    char name[24];
+    int index;
+
+    for (index = 3; index < 8; index ++)
+    {
+        sprintf(name, "/i%d.png", index);
+        image_cache_put(image_cache_get(name, 0, 0, F));
+    }
+
+    /* no room for another 38400 bytes: the unused images go */
+    a = image_cache_get("/i37.png", 0, 0, F);
+    heap_limit = heap_used + 20000;
+    image_cache_get_stat(&before);
+    b = image_cache_get("/i38.png", 0, 0, F);
+    image_cache_get_stat(&st);
+    CHECK(b != RT_NULL);
+    CHECK(st.images == 2 && st.evictions == before.evictions + 5 && st.failed == before.failed);
+    CHECK(a->image->w == 160);
+    image_cache_put(a);
+    image_cache_put(b);
+
+    /* nothing to give: no image, but not remembered either */
+    image_cache_shrink(0);
+    heap_limit = 0;
+    CHECK(image_cache_get("/i39.png", 0, 0, F) == RT_NULL);
+    heap_limit = 1L << 30;
+    a = image_cache_get("/i39.png", 0, 0, F);
+    CHECK(a != RT_NULL);
+    image_cache_put(a);
+
+    image_cache_shrink(0);
+}
+
+static void test_broken(void)
+{
+    struct image_cache_stat st, before;
+    char name[24];
+    long count;
+    int index;
+
+    for (index = 3; index < 8; index ++)
+    {
+        sprintf(name, "/i%d.png", index);
+        image_cache_put(image_cache_get(name, 0, 0, F));
+    }
+
+    /* one decode, the unused images stay */
+    file_find("/bad.png")->broken = 1;
+    image_cache_get_stat(&before);
+    count = decodes;
+    CHECK(image_cache_get("/bad.png", 0, 0, F) == RT_NULL);
+    CHECK(image_cache_get("/bad.png", 0, 0, F) == RT_NULL);
+    CHECK(image_cache_prefetch("/bad.png", 0, 0, F) != RT_EOK);
+    image_cache_get_stat(&st);
+    CHECK(decodes == count + 1);
+    CHECK(st.images == before.images && st.evictions == before.evictions);
+    CHECK(st.failed == before.failed + 1);
+
+    /* the file was replaced by one that decodes */
+    file_find("/bad.png")->broken = 0;
+    file_find("/bad.png")->mtime = 5;
+    image_cache_put(image_cache_get("/bad.png", 0, 0, F));
+    CHECK(decodes == count + 2);
+
+    /* the oldest failure is forgotten */
+    for (index = 40; index < 40 + IMAGE_CACHE_FAILED + 1; index ++)
+    {
+        sprintf(name, "/i%d.png", index);
+        file_find(name)->broken = 1;
+        CHECK(image_cache_get(name, 0, 0, F) == RT_NULL);
+    }
+    count = decodes;
+    for (index = 40 + IMAGE_CACHE_FAILED; index > 40; index --)
+    {
+        sprintf(name, "/i%d.png", index);
+        CHECK(image_cache_get(name, 0, 0, F) == RT_NULL);
+    }
+    CHECK(decodes == count);
+    CHECK(image_cache_get("/i40.png", 0, 0, F) == RT_NULL);
+    CHECK(decodes == count + 1);
+
+    image_cache_shrink(0);
+}
+
+static void prefetch_same(void)
+{
+    CHECK(image_cache_prefetch("/photo.jpg", 320, 240, F) == RT_EOK);
+}
+
+static void test_sizes(void)
+{
+    struct image_cache_item *a, *b;
+    long live;
+
+    /* without a decoder the size is not part of the key */
+    a = image_cache_get("/photo.jpg", 320, 240, F);
+    b = image_cache_get("/photo.jpg", 0, 0, F);
+    CHECK(a != RT_NULL && a->image->w == 800 && a->width == 0);
+    CHECK(b == a);
+    image_cache_put(a);
+    image_cache_put(b);
+
+    CHECK(image_cache_register_decoder("jpeg", jpeg_scaled) == RT_EOK);
+    a = image_cache_get("/photo.jpg", 320, 240, F);
+    b = image_cache_get("/photo.jpg", 0, 0, F);
+    CHECK(a != RT_NULL && a->image->w == 320);
+    CHECK(b != a && b->image->w == 800);
+    image_cache_put(a);
+    image_cache_put(b);
+    image_cache_shrink(0);
+
+    /* another thread decoded the same image meanwhile: one of them stays */
+    during_decode = prefetch_same;
+    a = image_cache_get("/photo.jpg", 320, 240, F);
+    live = live_images;
+    b = image_cache_get("/photo.jpg", 320, 240, F);
+    CHECK(a != RT_NULL && b == a && a->refcount == 2);
+    CHECK(live == 1 && live_images == 1);
+    image_cache_put(a);
+    image_cache_put(b);
+
+    image_cache_shrink(0);
+}
+
+int main(void)
+{
+    struct image_cache_stat st;
+    char name[24];
+    int index;
+
+    /* 160x120 at two bytes a pixel */
+    for (index = 0; index < 50; index ++)
+    {
+        sprintf(name, "/i%d.png", index);
+        file_add(name, 160, 120);
+    }
+    file_add("/bad.png", 160, 120);
+    file_add("/photo.jpg", 800, 480);
+    file_add("/note.txt", 1, 1);
+
+    image_cache_init();
+    test_lookup();
+    test_budget();
+    test_replaced();
+    test_out_of_memory();
+    test_broken();
+    test_sizes();
+
+    image_cache_get_stat(&st);
+    CHECK(st.images == 0 && st.bytes == 0 && live_images == 0 && heap_used == 0);
+    CHECK(lock_depth == 0);
+    printf("%lu hits, %lu misses, %lu evictions, %lu failed, %ld decodes\n", st.hits,
+           st.misses, st.evictions, st.failed, decodes);
+
+    for (index = 0; index < IMAGE_CACHE_FAILED; index ++)
+        free(_cache.failed[index].filename);
+
+    printf("image_cache: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for dfs_posix.h: the files are a table of the test, only
+ * their time matters to the cache.
+ */
+#ifndef __DFS_POSIX_H__
+#define __DFS_POSIX_H__
+
+#include <sys/stat.h>
+
+int sim_stat(const char *path, struct stat *st);
+
+#define stat(path, st)          sim_stat(path, st)
+
+#endif
@@ -0,0 +1,432 @@
+/*
+ * Replay of touch events through drivers/input_queue.c.
+ *
+ * The queue is included here and built against the kernel and RTGUI
+ * headers of the tree. The test plays the kernel on a clock of ticks, the
+ * input thread a coroutine which runs until it waits for its semaphore or
+ * a delay, and the RTGUI server, which passes each event on to the queue
+ * of the application at once. The application takes the events one at a
+ * time and needs a number of ticks for a pen move, one for a release.
+ *
+ * The event stream is what the touch thread posts for a tap, a drag of
+ * 100 samples and a second tap: a press, the moves as further presses of
+ * the same button every 5 ticks (20Hz), a release. It is replayed to the
+ * application directly, as before the queue, and through the queue. It
+ * checks that
+ *
+ *   - an application faster than the pen gets every event, nothing merged,
+ *   - a slow one gets every press and release, in order, the positions in
+ *     order and the last one before the release; nothing is lost and it
+ *     lags behind the pen by at most three moves,
+ *   - a move is held at most INPUT_HOLD_MAX, also for a stuck application,
+ *     which then loses events in its own queue as before,
+ *   - the counters add up, a full queue refuses the event and counts it,
+ *   - a queue watched twice takes one place, and no more are watched than
+ *     fit,
+ *
+ * and prints how far the application is behind the pen, directly and
+ * through the queue.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "../../realtouch/drivers/input_queue.c"
+
+#define SAMPLES_MAX         256
+#define APP_QUEUE_SIZE      32
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+/* the clock and the input thread */
+static rt_tick_t now;
+static struct rt_thread input_thread;
+static ucontext_t main_context, input_context;
+static char input_stack[64 * 1024];
+static void (*input_entry)(void *parameter);
+static int in_input;
+static rt_tick_t input_wake;        /* RT_TICK_MAX: on its semaphore */
+
+static void input_start(void)
+{
+    input_entry(RT_NULL);
+}
+
+static void switch_to_main(void)
+{
+    in_input = 0;
+    swapcontext(&input_context, &main_context);
+    in_input = 1;
+}
+
+rt_tick_t rt_tick_get(void)
+{
+    return now;
+}
+
+void rt_enter_critical(void)
+{
+}
+
+void rt_exit_critical(void)
+{
+}
+
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter), void *parameter,
+                             rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick)
+{
+    CHECK(priority < RTGUI_SVR_THREAD_PRIORITY);
+    input_entry = entry;
+    return &input_thread;
+}
+
+rt_err_t rt_thread_startup(rt_thread_t thread)
+{
+    getcontext(&input_context);
+    input_context.uc_stack.ss_sp = input_stack;
+    input_context.uc_stack.ss_size = sizeof(input_stack);
+    input_context.uc_link = RT_NULL;
+    makecontext(&input_context, input_start, 0);
+    input_wake = now;
+
+    return RT_EOK;
+}
+
+rt_err_t rt_thread_delay(rt_tick_t tick)
+{
+    CHECK(in_input);
+    input_wake = now + tick;
+    switch_to_main();
+
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_init(rt_sem_t sem, const char *name, rt_uint32_t value, rt_uint8_t flag)
+{
+    sem->value = value;
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t time)
+{
+    CHECK(in_input);
+    while (sem->value == 0)
+    {
+        input_wake = RT_TICK_MAX;
+        switch_to_main();
+    }
+    sem->value --;
+
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_release(rt_sem_t sem)
+{
+    sem->value ++;
+    if (input_wake == RT_TICK_MAX)
+        input_wake = now;
+
+    return RT_EOK;
+}
+
+/* the input thread runs until it waits for something not there yet */
+static void input_run(void)
+{
+    while (input_wake <= now)
+    {
+        in_input = 1;
+        swapcontext(&main_context, &input_context);
+        in_input = 0;
+    }
+}
+
+void rt_kprintf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+/* the server, its own queue empty, and the application */
+static struct rt_thread server_thread;
+static struct rtgui_app server_app;
+static struct rt_messagequeue server_mq;
+
+static struct rt_messagequeue app_mq;
+static struct rtgui_event_mouse app_events[APP_QUEUE_SIZE];
+static int app_head;
+static int app_lost, app_lost_releases;
+
+rt_thread_t rtgui_get_server(void)
+{
+    return &server_thread;
+}
+
+void rtgui_server_post_event(struct rtgui_event *event, rt_size_t size)
+{
+    struct rtgui_event_mouse *emouse = (struct rtgui_event_mouse *)event;
+
+    CHECK(event->type == RTGUI_EVENT_MOUSE_BUTTON && size == sizeof(*emouse));
+    if (app_mq.entry == APP_QUEUE_SIZE)
+    {
+        app_lost ++;
+        if (emouse->button & RTGUI_MOUSE_BUTTON_UP)
+            app_lost_releases ++;
+        return;
+    }
+
+    app_events[(app_head + app_mq.entry) % APP_QUEUE_SIZE] = *emouse;
+    app_mq.entry ++;
+}
+
+/* the stream: x is the number of the sample, y its tick */
+struct sample
+{
+    rt_tick_t tick;
+    rt_uint16_t button;
+};
+
+static struct sample samples[SAMPLES_MAX];
+static int sample_count;
+
+static void gesture(rt_tick_t start, int moves)
+{
+    int index;
+
+    for (index = 0; index <= moves + 1; index ++)
+    {
+        samples[sample_count].tick = start + index * 5;
+        samples[sample_count].button = RTGUI_MOUSE_BUTTON_LEFT |
+                                       (index <= moves ? RTGUI_MOUSE_BUTTON_DOWN : RTGUI_MOUSE_BUTTON_UP);
+        sample_count ++;
+    }
+}
+
+/* what the application did */
+static int handled, presses, releases, out_of_order;
+static int last_sample;
+static rt_tick_t lag_sum, lag_max;
+
+static void app_handle(struct rtgui_event_mouse *event)
+{
+    rt_tick_t lag = now - samples[event->x].tick;
+
+    /* presses and releases are never merged: nothing before them is lost */
+    if (event->x <= last_sample)
+        out_of_order ++;
+    if ((event->button & RTGUI_MOUSE_BUTTON_UP) || event->x == 0 ||
+            (samples[event->x - 1].button & RTGUI_MOUSE_BUTTON_UP))
+    {
+        if (event->x != last_sample + 1)
+            out_of_order ++;
+    }
+    last_sample = event->x;
+
+    if (event->button & RTGUI_MOUSE_BUTTON_UP)
+        releases ++;
+    else if (event->x == 0 || (samples[event->x - 1].button & RTGUI_MOUSE_BUTTON_UP))
+        presses ++;
+
+    lag_sum += lag;
+    if (lag > lag_max)
+        lag_max = lag;
+    handled ++;
+}
+
+/* replays the stream, the application needs move_ticks for a move */
+static void replay(rt_bool_t queued, int move_ticks)
+{
+    struct rtgui_event_mouse event, busy_event;
+    rt_tick_t busy_until = 0;
+    rt_bool_t busy = RT_FALSE;
+    int next = 0;
+
+    handled = presses = releases = out_of_order = 0;
+    app_lost = app_lost_releases = 0;
+    last_sample = -1;
+    lag_sum = lag_max = 0;
+    memset(&_queue.stat, 0, sizeof(_queue.stat));
+
+    memset(&event, 0, sizeof(event));
+    event.parent.type = RTGUI_EVENT_MOUSE_BUTTON;
+
+    for (now = 0; next < sample_count || busy || app_mq.entry > 0 || _queue.count > 0; now ++)
+    {
+        if (busy && now >= busy_until)
+        {
+            app_handle(&busy_event);
+            busy = RT_FALSE;
+        }
+
+        /* the touch thread */
+        while (next < sample_count && samples[next].tick == now)
+        {
+            event.x = next;
+            event.y = now;
+            event.button = samples[next].button;
+            if (queued)
+                CHECK(input_queue_post(&event) == RT_EOK);
+            else
+                rtgui_server_post_event(&event.parent, sizeof(event));
+            next ++;
+        }
+
+        input_run();
+
+        if (!busy && app_mq.entry > 0)
+        {
+            busy_event = app_events[app_head];
+            app_head = (app_head + 1) % APP_QUEUE_SIZE;
+            app_mq.entry --;
+            busy = RT_TRUE;
+            busy_until = now + (busy_event.button & RTGUI_MOUSE_BUTTON_UP ? 1 : move_ticks);
+        }
+    }
+}
+
+static void print(const char *what, int move_ticks)
+{
+    printf("%-10s app %3dms a move: %3d of %3d handled, behind the pen mean %4ldms, worst %4ldms, "
+           "%2d lost", what, move_ticks * 1000 / RT_TICK_PER_SECOND, handled, sample_count,
+           (long)(handled ? lag_sum * 1000 / RT_TICK_PER_SECOND / handled : 0),
+           (long)(lag_max * 1000 / RT_TICK_PER_SECOND), app_lost);
+    if (_queue.stat.posted > 0)
+        printf(", %2u merged", (unsigned)_queue.stat.merged);
+    printf("\n");
+}
+
+static void test_replay(void)
+{
+    static const int move_ticks[] = {3, 8, 15};
+    rt_tick_t direct_lag;
+    int index;
+
+    for (index = 0; index < 3; index ++)
+    {
+        replay(RT_FALSE, move_ticks[index]);
+        print("direct", move_ticks[index]);
+        direct_lag = handled ? lag_sum / handled : 0;
+
+        replay(RT_TRUE, move_ticks[index]);
+        print("queued", move_ticks[index]);
+
+        CHECK(app_lost == 0 && releases == 3 && presses == 3 && out_of_order == 0);
+        CHECK(_queue.stat.posted == (rt_uint32_t)sample_count);
+        CHECK(_queue.stat.delivered + _queue.stat.merged == _queue.stat.posted);
+        CHECK(_queue.stat.delivered == (rt_uint32_t)handled);
+        CHECK(_queue.stat.dropped == 0 && _queue.stat.depth == 0);
+        CHECK(_queue.stat.latency_max <= INPUT_HOLD_MAX);
+        CHECK(lag_max <= 3 * move_ticks[index]);
+
+        if (move_ticks[index] < 5)
+        {
+            /* the application keeps up: nothing held */
+            CHECK(_queue.stat.merged == 0 && handled == sample_count);
+            CHECK(lag_sum / handled == direct_lag);
+        }
+        else
+        {
+            CHECK(_queue.stat.merged > 0);
+            CHECK(lag_sum / handled * 4 < direct_lag);
+        }
+    }
+}
+
+/* a stuck application: a move goes on after INPUT_HOLD_MAX all the same */
+static void test_hold(void)
+{
+    replay(RT_TRUE, 1000);
+
+    CHECK(_queue.stat.latency_max == INPUT_HOLD_MAX);
+    CHECK(_queue.stat.merged > 0 && _queue.stat.delivered * 2 < _queue.stat.posted);
+}
+
+/* press and release, never merged, until the queue is full */
+static void test_full(void)
+{
+    struct rtgui_event_mouse event;
+    int index;
+
+    memset(&event, 0, sizeof(event));
+    memset(&_queue.stat, 0, sizeof(_queue.stat));
+    event.parent.type = RTGUI_EVENT_MOUSE_BUTTON;
+
+    for (index = 0; index < INPUT_QUEUE_SIZE; index ++)
+    {
+        event.x = index;
+        event.button = RTGUI_MOUSE_BUTTON_LEFT | (index % 2 ? RTGUI_MOUSE_BUTTON_UP : RTGUI_MOUSE_BUTTON_DOWN);
+        CHECK(input_queue_post(&event) == RT_EOK);
+    }
+    event.button = RTGUI_MOUSE_BUTTON_LEFT | RTGUI_MOUSE_BUTTON_DOWN;
+    CHECK(input_queue_post(&event) == -RT_EFULL);
+
+    CHECK(_queue.stat.dropped == 1 && _queue.stat.merged == 0);
+    CHECK(_queue.stat.depth == INPUT_QUEUE_SIZE && _queue.stat.max_depth == INPUT_QUEUE_SIZE);
+
+    /* only moves are held */
+    input_run();
+    CHECK(_queue.count == 0 && app_mq.entry == INPUT_QUEUE_SIZE);
+    for (index = 0; index < INPUT_QUEUE_SIZE; index ++)
+        CHECK(app_events[(app_head + index) % APP_QUEUE_SIZE].x == index);
+    app_head = (app_head + app_mq.entry) % APP_QUEUE_SIZE;
+    app_mq.entry = 0;
+
+    /* a release after a release is not a move either */
+    event.button = RTGUI_MOUSE_BUTTON_LEFT | RTGUI_MOUSE_BUTTON_UP;
+    CHECK(input_queue_post(&event) == RT_EOK);
+    CHECK(input_queue_post(&event) == RT_EOK);
+    CHECK(_queue.count == 2 && _queue.stat.merged == 0);
+    input_run();
+    CHECK(_queue.count == 0 && app_mq.entry == 2);
+    app_head = (app_head + app_mq.entry) % APP_QUEUE_SIZE;
+    app_mq.entry = 0;
+}
+
+static void test_watch(void)
+{
+    struct rt_messagequeue mqs[INPUT_WATCH_MAX];
+    int index;
+
+    /* app_mq is watched already */
+    CHECK(input_queue_watch(&app_mq) == RT_EOK);
+    for (index = 0; index < INPUT_WATCH_MAX - 1; index ++)
+        CHECK(input_queue_watch(&mqs[index]) == RT_EOK);
+    CHECK(input_queue_watch(&mqs[index]) == -RT_EFULL);
+
+    input_queue_unwatch(&mqs[0]);
+    CHECK(input_queue_watch(&mqs[index]) == RT_EOK);
+    for (index = 1; index < INPUT_WATCH_MAX; index ++)
+        input_queue_unwatch(&mqs[index]);
+
+    for (index = 0; index < INPUT_WATCH_MAX; index ++)
+        CHECK(_queue.watched[index] == RT_NULL || _queue.watched[index] == &app_mq);
+}
+
+int main(void)
+{
+    server_thread.user_data = (rt_uint32_t)&server_app;
+    server_app.mq = &server_mq;
+
+    gesture(10, 0);
+    gesture(40, 100);
+    gesture(600, 0);
+
+    CHECK(input_queue_init() == RT_EOK);
+    CHECK(input_queue_watch(&app_mq) == RT_EOK);
+
+    test_replay();
+    test_hold();
+    test_full();
+    test_watch();
+
+    printf("input_queue: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,433 @@
+/*
+ * Host test and benchmark of ui/jpeg_scaled.c.
+ *
+ * The decoder source is included here and built against the kernel and
+ * RTGUI headers of the tree and the libjpeg of the host. The Makefile
+ * links libjpeg statically and wraps malloc and free, so the heap counted
+ * here is everything the decode takes, libjpeg's own pools included.
+ *
+ * The photos are written by the test at camera sizes and fitted into the
+ * 800x480 of the panel. For each the test measures the time and the peak
+ * heap of
+ *
+ *   - a full decode of the photo followed by a nearest neighbour scale,
+ *     which is what showing it through the RTGUI jpeg engine costs,
+ *   - jpeg_scaled_blit() and jpeg_scaled_create(),
+ *
+ * and checks that
+ *
+ *   - the image keeps the aspect ratio of the photo, fills the rect in one
+ *     direction, is centred and never larger than the photo,
+ *   - every row is blitted once, and the blit and the created image have
+ *     the same pixels, close to those of the full decode,
+ *   - a baseline photo decodes in a few scanlines, not in the photo,
+ *   - a broken file is an error and a truncated one shows the rows it got,
+ *   - running out of heap anywhere, libjpeg included, gives an error,
+ *
+ * and that nothing is left behind in any case.
+ */
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../realtouch/ui/jpeg_scaled.c"
+
+#define SCREEN_W        800
+#define SCREEN_H        480
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+/* the heap, libjpeg included: -Wl,--wrap=malloc,--wrap=free */
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+static long heap_used, heap_peak;
+static int fail_at;         /* the first allocation to fail, 0 for none */
+static int allocations;
+
+void *__wrap_malloc(size_t size)
+{
+    void *ptr;
+
+    if (fail_at != 0 && ++ allocations >= fail_at)
+        return NULL;
+
+    ptr = __real_malloc(size);
+    if (ptr != NULL)
+    {
+        heap_used += malloc_usable_size(ptr);
+        if (heap_used > heap_peak)
+            heap_peak = heap_used;
+    }
+
+    return ptr;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        heap_used -= malloc_usable_size(ptr);
+        __real_free(ptr);
+    }
+}
+
+void *rtgui_malloc(rt_size_t size)
+{
+    return malloc(size);
+}
+
+void rtgui_free(void *ptr)
+{
+    free(ptr);
+}
+
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size)
+{
+    CHECK(hint == MEM_REGION_BULK);
+    return malloc(size);
+}
+
+void mem_region_free(void *ptr)
+{
+    free(ptr);
+}
+
+void *rt_memcpy(void *dst, const void *src, rt_ubase_t count)
+{
+    return memcpy(dst, src, count);
+}
+
+void rt_kprintf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    failures ++;
+}
+
+static struct rtgui_graphic_driver driver;
+
+struct rtgui_graphic_driver *rtgui_graphic_driver_get_default(void)
+{
+    return &driver;
+}
+
+rt_err_t image_cache_register_decoder(const char *type, image_cache_decoder_t decoder)
+{
+    return RT_EOK;
+}
+
+/* the panel: blit_line into a frame buffer, each row counted */
+static rt_uint16_t screen[SCREEN_H][SCREEN_W];
+static int rows_blitted[SCREEN_H];
+static struct rtgui_rect blitted;
+
+static void screen_blit_line(struct rtgui_dc *dc, int x1, int x2, int y, rt_uint8_t *line)
+{
+    if (y < 0 || y >= SCREEN_H || x1 < 0 || x2 > SCREEN_W || x1 >= x2)
+    {
+        printf("row %d from %d to %d outside the screen\n", y, x1, x2);
+        failures ++;
+        return;
+    }
+
+    memcpy(&screen[y][x1], line, (x2 - x1) * 2);
+    rows_blitted[y] ++;
+    if (blitted.x2 == 0)
+    {
+        blitted.x1 = x1;
+        blitted.y1 = y;
+    }
+    CHECK(x1 == blitted.x1);
+    blitted.x2 = x2;
+    blitted.y2 = y + 1;
+}
+
+static struct rtgui_dc_engine screen_engine;
+static struct rtgui_dc screen_dc;
+
+static void screen_clear(void)
+{
+    memset(screen, 0, sizeof(screen));
+    memset(rows_blitted, 0, sizeof(rows_blitted));
+    memset(&blitted, 0, sizeof(blitted));
+}
+
+/* a photo: smooth gradients, or a camera's sensor noise on top */
+static void photo_write(const char *path, int w, int h, int progressive, int noise)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr error;
+    JSAMPROW row;
+    rt_uint32_t lcg = 1;
+    FILE *fp;
+    int x, y;
+
+    fp = fopen(path, "wb");
+    cinfo.err = jpeg_std_error(&error);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, fp);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    if (progressive)
+        jpeg_simple_progression(&cinfo);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    row = (JSAMPROW)malloc(w * 3);
+    for (y = 0; y < h; y ++)
+    {
+        for (x = 0; x < w; x ++)
+        {
+            lcg = lcg * 1103515245 + 12345;
+            row[x * 3] = x * 255 / w;
+            row[x * 3 + 1] = y * 255 / h;
+            row[x * 3 + 2] = 128 + (x - w / 2) * (y - h / 2) * 127 / (w / 2 * h / 2);
+            if (noise)
+            {
+                row[x * 3] = (row[x * 3] + (lcg >> 28)) & 0xFF;
+                row[x * 3 + 1] = (row[x * 3 + 1] + (lcg >> 27 & 7)) & 0xFF;
+            }
+        }
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    free(row);
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    fclose(fp);
+}
+
+/*
+ * What showing a photo through the RTGUI jpeg engine costs: the whole
+ * photo in the display format, then scaled to width x height on the blit.
+ */
+static rt_uint16_t *full_decode(const char *path, int width, int height)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr error;
+    rt_uint16_t *image, *scaled;
+    JSAMPROW row;
+    rt_uint32_t x, y;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    cinfo.err = jpeg_std_error(&error);
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, fp);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    image = (rt_uint16_t *)malloc(cinfo.output_width * cinfo.output_height * 2);
+    row = (JSAMPROW)malloc(cinfo.output_width * 3);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        y = cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        for (x = 0; x < cinfo.output_width; x ++)
+            _convert(driver.pixel_format, (rt_uint8_t *)&image[y * cinfo.output_width + x], &row[x * 3]);
+    }
+
+    scaled = (rt_uint16_t *)malloc(width * height * 2);
+    for (y = 0; y < (rt_uint32_t)height; y ++)
+    {
+        for (x = 0; x < (rt_uint32_t)width; x ++)
+            scaled[y * width + x] = image[(y * cinfo.output_height / height) * cinfo.output_width +
+                                          x * cinfo.output_width / width];
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    free(row);
+    free(image);
+
+    return scaled;
+}
+
+/* how far apart two RGB565 pixels are: red, green and blue in steps of 1/64 */
+static int pixel_diff(rt_uint16_t a, rt_uint16_t b)
+{
+    return abs((a >> 11) - (b >> 11)) * 2 + abs(((a >> 5) & 0x3F) - ((b >> 5) & 0x3F)) +
+           abs((a & 0x1F) - (b & 0x1F)) * 2;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* the heap from here on: its peak is counted above what is in use now */
+static long heap_mark(void)
+{
+    heap_peak = heap_used;
+    return heap_used;
+}
+
+static void test_photo(const char *path, int w, int h, int progressive)
+{
+    struct rtgui_rect rect = {0, 0, SCREEN_W, SCREEN_H};
+    rt_uint16_t *reference;
+    rtgui_image_t *image;
+    int width, height, x, y, ok;
+    long base, full_peak, blit_peak, create_peak;
+    double t0, t1, t2, t3, diff = 0;
+
+    photo_write(path, w, h, progressive, !progressive);
+
+    /* the size the photo is shown at */
+    width = w < SCREEN_W ? w : SCREEN_W;
+    height = h < SCREEN_H ? h : SCREEN_H;
+    if (width * h > height * w)
+        width = w * height / h;
+    else
+        height = h * width / w;
+
+    base = heap_mark();
+    t0 = now_ms();
+    reference = full_decode(path, width, height);
+    t1 = now_ms();
+    full_peak = heap_peak - base;
+
+    screen_clear();
+    base = heap_mark();
+    CHECK(jpeg_scaled_blit(path, &screen_dc, &rect) == RT_EOK);
+    t2 = now_ms();
+    blit_peak = heap_peak - base;
+    CHECK(heap_used == base);
+
+    /* the rect filled in one direction, centred */
+    CHECK(rtgui_rect_width(blitted) == width && rtgui_rect_height(blitted) == height);
+    CHECK(blitted.x1 == (SCREEN_W - width) / 2 && blitted.y1 == (SCREEN_H - height) / 2);
+    for (y = 0, ok = 1; y < SCREEN_H; y ++)
+        ok &= rows_blitted[y] == (y >= blitted.y1 && y < blitted.y2);
+    CHECK(ok);
+
+    base = heap_mark();
+    image = jpeg_scaled_create(path, SCREEN_W, SCREEN_H);
+    t3 = now_ms();
+    create_peak = heap_peak - base;
+    CHECK(image != RT_NULL);
+    if (image == RT_NULL)
+        return;
+    CHECK(image->w == width && image->h == height);
+
+    /* the same pixels as the blit, close to the full decode */
+    for (y = 0, ok = 1; y < height; y ++)
+    {
+        ok &= memcmp(&screen[blitted.y1 + y][blitted.x1],
+                     ((struct jpeg_scaled_pixels *)image->data)->pixels + y * width * 2, width * 2) == 0;
+        for (x = 0; x < width; x ++)
+            diff += pixel_diff(screen[blitted.y1 + y][blitted.x1 + x], reference[y * width + x]);
+    }
+    CHECK(ok);
+    diff /= width * height;
+    CHECK(diff < 24);
+
+    image->engine->image_unload(image);
+    rtgui_free(image);
+    free(reference);
+    CHECK(heap_used == 0);
+
+    /* a baseline photo needs its scanlines, not the photo */
+    if (!progressive)
+        CHECK(blit_peak < 64 * 1024 && create_peak < 64 * 1024 + width * height * 2);
+
+    printf("%4dx%-4d %-5s %3dx%-3d | %6.1fms %6ldK | %6.1fms %6ldK | %6.1fms %6ldK | %4.1f\n",
+           w, h, progressive ? "prog" : "", width, height, t1 - t0, full_peak / 1024, t2 - t1,
+           blit_peak / 1024, t3 - t2, create_peak / 1024, diff);
+}
+
+static void test_broken(void)
+{
+    struct rtgui_rect rect = {0, 0, SCREEN_W, SCREEN_H};
+    rtgui_image_t *image;
+    FILE *fp;
+    int count;
+
+    fp = fopen("broken.jpg", "wb");
+    fputs("not a jpeg", fp);
+    fclose(fp);
+
+    CHECK(jpeg_scaled_blit("broken.jpg", &screen_dc, &rect) == -RT_ERROR);
+    CHECK(jpeg_scaled_create("broken.jpg", SCREEN_W, SCREEN_H) == RT_NULL);
+    CHECK(jpeg_scaled_blit("missing.jpg", &screen_dc, &rect) == -RT_ERROR);
+    CHECK(heap_used == 0);
+
+    /* the first third of a photo: the rows it has and grey below */
+    photo_write("photo.jpg", 1600, 1200, 0, 1);
+    CHECK(truncate("photo.jpg", 100 * 1024) == 0);
+    screen_clear();
+    CHECK(jpeg_scaled_blit("photo.jpg", &screen_dc, &rect) == RT_EOK);
+    CHECK(rtgui_rect_height(blitted) == 480);
+    image = jpeg_scaled_create("photo.jpg", SCREEN_W, SCREEN_H);
+    CHECK(image != RT_NULL && image->w == 640 && image->h == 480);
+    if (image != RT_NULL)
+    {
+        image->engine->image_unload(image);
+        rtgui_free(image);
+    }
+    CHECK(heap_used == 0);
+
+    /* the heap runs out at each allocation in turn */
+    photo_write("photo.jpg", 400, 300, 0, 1);
+    for (fail_at = 1, count = 0; ; fail_at ++)
+    {
+        allocations = 0;
+        screen_clear();
+        if (jpeg_scaled_blit("photo.jpg", &screen_dc, &rect) == RT_EOK)
+            break;
+        CHECK(heap_used == 0);
+        count ++;
+    }
+    for (fail_at = 1; ; fail_at ++)
+    {
+        allocations = 0;
+        image = jpeg_scaled_create("photo.jpg", SCREEN_W, SCREEN_H);
+        if (image != RT_NULL)
+            break;
+        CHECK(heap_used == 0);
+    }
+    fail_at = 0;
+    image->engine->image_unload(image);
+    rtgui_free(image);
+    CHECK(count > 3 && heap_used == 0);
+}
+
+int main(void)
+{
+    driver.pixel_format = RTGRAPHIC_PIXEL_FORMAT_RGB565;
+    screen_engine.blit_line = screen_blit_line;
+    screen_dc.engine = &screen_engine;
+
+    printf("photo          shown   | full decode     | jpeg_scaled_blit| "
+           "jpeg_scaled_create | diff\n");
+    test_photo("photo.jpg", 1600, 1200, 0);
+    test_photo("photo.jpg", 2592, 1944, 0);
+    test_photo("photo.jpg", 3264, 2448, 0);
+    test_photo("photo.jpg", 4000, 3000, 0);
+    test_photo("photo.jpg", 3264, 2448, 1);
+    test_photo("photo.jpg", 640, 400, 0);
+    test_photo("photo.jpg", 480, 800, 0);
+    test_broken();
+
+    printf("jpeg_scaled: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * First-fit model of the kernel heaps for the host test: a memheap with
+ * 24 byte block headers for CCM and internal SRAM, and the small memory
+ * allocator with 12 byte headers for the system heap in external SRAM.
+ * Blocks are kept in address order and merged with free neighbours.
+ */
+#include <assert.h>
+#include <rtthread.h>
+#include "heap_model.h"
+
+#define MEMHEAP_HEADER  24
+#define SYSHEAP_HEADER  12
+#define MIN_SPLIT       16
+
+struct block
+{
+    rt_uint32_t size;                   /* bytes including the header */
+    rt_uint32_t used;
+};
+
+static struct rt_memheap _system_heap;
+static struct rt_memheap *_heaps[8];
+static int _heap_count;
+
+static struct block *_first(struct rt_memheap *heap)
+{
+    return (struct block *)heap->begin;
+}
+
+static struct block *_next(struct rt_memheap *heap, struct block *block)
+{
+    struct block *next = (struct block *)((rt_uint8_t *)block + block->size);
+
+    return ((rt_uint8_t *)next < heap->begin + heap->pool_size) ? next : RT_NULL;
+}
+
+static void _heap_setup(struct rt_memheap *heap, const char *name,
+                        void *begin, rt_uint32_t size, rt_uint32_t header)
+{
+    int index;
+
+    heap->name = name;
+    heap->begin = begin;
+    heap->header = header;
+    heap->pool_size = RT_ALIGN_DOWN(size, RT_ALIGN_SIZE);
+    heap->available_size = heap->pool_size;
+    heap->max_used = 0;
+
+    _first(heap)->size = heap->pool_size;
+    _first(heap)->used = 0;
+
+    for (index = 0; index < _heap_count; index ++)
+        if (_heaps[index] == heap) return;
+    assert(_heap_count < 8);
+    _heaps[_heap_count ++] = heap;
+}
+
+static void *_heap_alloc(struct rt_memheap *heap, rt_uint32_t size)
+{
+    struct block *block, *rest;
+    rt_uint32_t need;
+
+    need = RT_ALIGN(size, RT_ALIGN_SIZE) + heap->header;
+    for (block = _first(heap); block != RT_NULL; block = _next(heap, block))
+    {
+        if (block->used || block->size < need)
+            continue;
+
+        if (block->size - need >= heap->header + MIN_SPLIT)
+        {
+            rest = (struct block *)((rt_uint8_t *)block + need);
+            rest->size = block->size - need;
+            rest->used = 0;
+            block->size = need;
+        }
+        block->used = 1;
+
+        heap->available_size -= block->size;
+        if (heap->pool_size - heap->available_size > heap->max_used)
+            heap->max_used = heap->pool_size - heap->available_size;
+
+        return (rt_uint8_t *)block + heap->header;
+    }
+
+    return RT_NULL;
+}
+
+static struct rt_memheap *_heap_of(void *ptr)
+{
+    int index;
+
+    for (index = 0; index < _heap_count; index ++)
+    {
+        if ((rt_uint8_t *)ptr >= _heaps[index]->begin &&
+                (rt_uint8_t *)ptr < _heaps[index]->begin + _heaps[index]->pool_size)
+            return _heaps[index];
+    }
+
+    return RT_NULL;
+}
+
+static void _heap_free(struct rt_memheap *heap, void *ptr)
+{
+    struct block *block, *prev = RT_NULL, *next, *iter;
+
+    block = (struct block *)((rt_uint8_t *)ptr - heap->header);
+    for (iter = _first(heap); iter != block; iter = _next(heap, iter))
+    {
+        assert(iter != RT_NULL);
+        prev = iter;
+    }
+    assert(block->used);
+
+    block->used = 0;
+    heap->available_size += block->size;
+
+    next = _next(heap, block);
+    if (next != RT_NULL && !next->used)
+        block->size += next->size;
+    if (prev != RT_NULL && !prev->used)
+        prev->size += block->size;
+}
+
+rt_uint32_t heap_model_largest_free(void *addr)
+{
+    struct rt_memheap *heap = _heap_of(addr);
+    struct block *block;
+    rt_uint32_t largest = 0;
+
+    assert(heap != RT_NULL);
+    for (block = _first(heap); block != RT_NULL; block = _next(heap, block))
+    {
+        if (!block->used && block->size - heap->header > largest)
+            largest = block->size - heap->header;
+    }
+
+    return largest;
+}
+
+rt_err_t rt_memheap_init(struct rt_memheap *heap, const char *name,
+                         void *start_addr, rt_uint32_t size)
+{
+    _heap_setup(heap, name, start_addr, size, MEMHEAP_HEADER);
+    return RT_EOK;
+}
+
+void *rt_memheap_alloc(struct rt_memheap *heap, rt_uint32_t size)
+{
+    return _heap_alloc(heap, size);
+}
+
+void rt_memheap_free(void *ptr)
+{
+    struct rt_memheap *heap = _heap_of(ptr);
+
+    assert(heap != RT_NULL && heap != &_system_heap);
+    _heap_free(heap, ptr);
+}
+
+void rt_system_heap_init(void *begin_addr, void *end_addr)
+{
+    _heap_setup(&_system_heap, "heap", begin_addr,
+                (rt_uint8_t *)end_addr - (rt_uint8_t *)begin_addr, SYSHEAP_HEADER);
+}
+
+void *rt_malloc(rt_size_t size)
+{
+    return _heap_alloc(&_system_heap, size);
+}
+
+void rt_free(void *ptr)
+{
+    if (ptr == RT_NULL)
+        return;
+
+    assert(_heap_of(ptr) == &_system_heap);
+    _heap_free(&_system_heap, ptr);
+}
+
+void rt_memory_info(rt_uint32_t *total, rt_uint32_t *used, rt_uint32_t *max_used)
+{
+    *total = _system_heap.pool_size;
+    *used = _system_heap.pool_size - _system_heap.available_size;
+    *max_used = _system_heap.max_used;
+}
@@ -0,0 +1,9 @@
+#ifndef __HEAP_MODEL_H__
+#define __HEAP_MODEL_H__
+
+#include <rtthread.h>
+
+/* largest block the heap holding addr can still hand out */
+rt_uint32_t heap_model_largest_free(void *addr);
+
+#endif
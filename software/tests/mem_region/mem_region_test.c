@@ -0,0 +1,296 @@
+/*
+ * Host test of drivers/mem_region.c.
+ *
+ * The three RAMs are mapped at their board addresses, so the address
+ * arithmetic of mem_region.c runs unchanged, and the kernel heaps are the
+ * first-fit model of heap_model.c. The first part checks placement,
+ * fallback, release and statistics; the second replays a player workload
+ * once with everything in the system heap and once with placement hints,
+ * and reports how fragmented the external SRAM ends up.
+ */
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <rtthread.h>
+#include "board.h"
+#include "mem_region.h"
+#include "heap_model.h"
+
+#define SRAM_BSS        (40 * 1024)     /* internal SRAM taken by .data/.bss */
+#define SRAM_BEGIN      (0x20000000 + SRAM_BSS)
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+static void map_ram(rt_uint32_t begin, rt_uint32_t size)
+{
+    void *ptr;
+
+    ptr = mmap((void *)(uintptr_t)begin, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (ptr != (void *)(uintptr_t)begin)
+    {
+        printf("can not map 0x%08x, skipped\n", begin);
+        exit(77);
+    }
+}
+
+static void boot(void)
+{
+    rt_system_heap_init((void *)STM32_EXT_SRAM_BEGIN, (void *)STM32_EXT_SRAM_END);
+    rt_hw_mem_region_init((void *)SRAM_BEGIN, (void *)STM32_SRAM_END);
+}
+
+static enum mem_region_id region_of(void *ptr)
+{
+    uintptr_t addr = (uintptr_t)ptr;
+
+    if (addr >= STM32_CCM_BEGIN && addr < STM32_CCM_END) return MEM_REGION_CCM;
+    if (addr >= SRAM_BEGIN && addr < STM32_SRAM_END) return MEM_REGION_SRAM;
+    if (addr >= STM32_EXT_SRAM_BEGIN && addr <= STM32_EXT_SRAM_END) return MEM_REGION_EXT;
+
+    return MEM_REGION_MAX;
+}
+
+static rt_uint32_t used_of(enum mem_region_id id)
+{
+    struct mem_region_stat stat;
+
+    mem_region_stat(id, &stat);
+    return stat.used;
+}
+
+static void test_placement(void)
+{
+    void *fast, *dma, *both, *bulk;
+
+    boot();
+
+    fast = mem_region_malloc(MEM_REGION_FAST, 1024);
+    dma  = mem_region_malloc(MEM_REGION_DMA, 1024);
+    both = mem_region_malloc(MEM_REGION_FAST | MEM_REGION_DMA, 1024);
+    bulk = mem_region_malloc(MEM_REGION_BULK, 1024);
+
+    CHECK(region_of(fast) == MEM_REGION_CCM);
+    CHECK(region_of(dma)  == MEM_REGION_SRAM);
+    CHECK(region_of(both) == MEM_REGION_SRAM);
+    CHECK(region_of(bulk) == MEM_REGION_EXT);
+    CHECK(((uintptr_t)fast & (RT_ALIGN_SIZE - 1)) == 0);
+
+    mem_region_free(fast);
+    mem_region_free(dma);
+    mem_region_free(both);
+    mem_region_free(bulk);
+    CHECK(used_of(MEM_REGION_CCM) == 0);
+    CHECK(used_of(MEM_REGION_SRAM) == 0);
+    CHECK(used_of(MEM_REGION_EXT) == 0);
+}
+
+static void test_fallback(void)
+{
+    void *ccm, *sram, *ptr, *ext;
+    struct mem_region_stat stat;
+
+    boot();
+
+    /* FAST moves on to internal SRAM once CCM is full */
+    ccm = mem_region_malloc(MEM_REGION_FAST, 60 * 1024);
+    CHECK(region_of(ccm) == MEM_REGION_CCM);
+    ptr = mem_region_malloc(MEM_REGION_FAST, 8 * 1024);
+    CHECK(region_of(ptr) == MEM_REGION_SRAM);
+    mem_region_stat(MEM_REGION_CCM, &stat);
+    CHECK(stat.fail_count == 1);
+    mem_region_free(ptr);
+
+    /* DMA never falls back to CCM, even with CCM free */
+    mem_region_free(ccm);
+    sram = mem_region_malloc(MEM_REGION_DMA, 80 * 1024);
+    CHECK(region_of(sram) == MEM_REGION_SRAM);
+    ptr = mem_region_malloc(MEM_REGION_DMA, 16 * 1024);
+    CHECK(region_of(ptr) == MEM_REGION_EXT);
+    mem_region_free(ptr);
+
+    ext = mem_region_malloc(MEM_REGION_BULK, 1020 * 1024);
+    CHECK(region_of(ext) == MEM_REGION_EXT);
+    ptr = mem_region_malloc(MEM_REGION_DMA, 16 * 1024);
+    CHECK(ptr == RT_NULL);
+
+    /* BULK walks down to CCM as the last resort */
+    ptr = mem_region_malloc(MEM_REGION_BULK, 32 * 1024);
+    CHECK(region_of(ptr) == MEM_REGION_CCM);
+    mem_region_free(ptr);
+
+    mem_region_free(ext);
+    mem_region_free(sram);
+}
+
+static void test_free_and_stat(void)
+{
+    rt_uint8_t *ptr;
+    void *blocks[16];
+    struct mem_region_stat stat;
+    rt_size_t index;
+    int zero = 1;
+
+    boot();
+
+    /* calloc clears memory which held data before */
+    ptr = mem_region_malloc(MEM_REGION_FAST, 4096);
+    memset(ptr, 0xA5, 4096);
+    mem_region_free(ptr);
+    ptr = mem_region_calloc(MEM_REGION_FAST, 64, 64);
+    for (index = 0; index < 4096; index ++)
+        if (ptr[index] != 0) zero = 0;
+    CHECK(zero);
+    mem_region_free(ptr);
+
+    for (index = 0; index < 16; index ++)
+        blocks[index] = mem_region_malloc(MEM_REGION_FAST, 2048);
+    mem_region_stat(MEM_REGION_CCM, &stat);
+    CHECK(stat.alloc_count == 18);
+    CHECK(stat.used >= 16 * 2048);
+    CHECK(stat.max_used == stat.used);
+    CHECK(stat.total == STM32_CCM_SIZE * 1024);
+    for (index = 0; index < 16; index ++)
+        mem_region_free(blocks[index]);
+
+    mem_region_stat(MEM_REGION_CCM, &stat);
+    CHECK(stat.used == 0);
+    CHECK(stat.max_used >= 16 * 2048);
+    CHECK(heap_model_largest_free((void *)STM32_CCM_BEGIN) + 64 >= stat.total);
+
+    /* a plain rt_malloc block can be released through mem_region_free */
+    ptr = rt_malloc(100);
+    mem_region_free(ptr);
+    CHECK(used_of(MEM_REGION_EXT) == 0);
+    mem_region_free(RT_NULL);
+
+    CHECK(mem_region_stat(MEM_REGION_MAX, &stat) != RT_EOK);
+}
+
+/*
+ * Fragmentation benchmark. A player is started and stopped again and again
+ * while the GUI and the file system churn through short lived blocks; now
+ * and then the GUI wants a full screen DC. With a single heap the decoder
+ * objects land between the short lived blocks and split the free space.
+ */
+#define BENCH_STEPS     200000
+#define BENCH_SLOTS     320
+#define DC_SIZE         (800 * 480 * 2)         /* full screen RGB565 DC */
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(rt_uint32_t range)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % range;
+}
+
+static void *bench_alloc(int single, rt_uint32_t hint, rt_size_t size)
+{
+    return single ? rt_malloc(size) : mem_region_malloc(hint, size);
+}
+
+static void bench_free(int single, void *ptr)
+{
+    if (single)
+        rt_free(ptr);
+    else
+        mem_region_free(ptr);
+}
+
+static void bench(int single)
+{
+    /* Helix state and frame buffers, the decoder object, two DMA halves */
+    static const rt_uint32_t player_hint[] = {MEM_REGION_FAST, MEM_REGION_FAST,
+        MEM_REGION_FAST, MEM_REGION_DMA, MEM_REGION_DMA};
+    static const rt_size_t player_size[] = {23000, 9000, 2400, 4608, 4608};
+    void *player[5] = {0};
+    void *slot[BENCH_SLOTS] = {0};
+    void *dc;
+    rt_uint32_t step, index, dc_fail = 0, dc_tries = 0, hot_fast = 0, hot = 0;
+    rt_uint32_t largest_min = 0xFFFFFFFF, largest;
+    struct mem_region_stat stat;
+
+    boot();
+    lcg = 1;
+
+    for (step = 0; step < BENCH_STEPS; step ++)
+    {
+        if (step % 2000 == 0)
+        {
+            for (index = 0; index < 5; index ++)
+            {
+                bench_free(single, player[index]);
+                player[index] = bench_alloc(single, player_hint[index], player_size[index]);
+                if (player[index] == RT_NULL) continue;
+
+                hot ++;
+                if (region_of(player[index]) != MEM_REGION_EXT) hot_fast ++;
+            }
+        }
+
+        index = rnd(BENCH_SLOTS);
+        if (slot[index] != RT_NULL)
+        {
+            bench_free(single, slot[index]);
+            slot[index] = RT_NULL;
+        }
+        else
+        {
+            /* mostly small GUI objects, some file buffers and icons */
+            rt_size_t size = rnd(8) ? 16 + rnd(512) : 1024 + rnd(8 * 1024);
+            slot[index] = bench_alloc(single, MEM_REGION_BULK, size);
+        }
+
+        if (step % 500 == 0)
+        {
+            dc_tries ++;
+            dc = bench_alloc(single, MEM_REGION_BULK, DC_SIZE);
+            if (dc == RT_NULL) dc_fail ++;
+            bench_free(single, dc);
+
+            largest = heap_model_largest_free((void *)STM32_EXT_SRAM_BEGIN);
+            if (largest < largest_min) largest_min = largest;
+        }
+    }
+
+    mem_region_stat(MEM_REGION_EXT, &stat);
+    printf("%-13s DC failed %3u/%u, ext largest free min %4u KB, "
+           "ext max used %4u KB, hot objects in internal RAM %3u%%\n",
+           single ? "single heap" : "placement", dc_fail, dc_tries,
+           largest_min / 1024, stat.max_used / 1024, hot ? hot_fast * 100 / hot : 0);
+
+    for (index = 0; index < BENCH_SLOTS; index ++)
+        bench_free(single, slot[index]);
+    for (index = 0; index < 5; index ++)
+        bench_free(single, player[index]);
+
+    if (!single)
+    {
+        CHECK(hot_fast == hot);
+        CHECK(used_of(MEM_REGION_CCM) == 0);
+        CHECK(used_of(MEM_REGION_SRAM) == 0);
+    }
+    CHECK(used_of(MEM_REGION_EXT) == 0);
+}
+
+int main(void)
+{
+    map_ram(STM32_CCM_BEGIN, STM32_CCM_SIZE * 1024);
+    map_ram(0x20000000, STM32_SRAM_SIZE * 1024);
+    map_ram(STM32_EXT_SRAM_BEGIN, STM32_EXT_SRAM_END + 1 - STM32_EXT_SRAM_BEGIN);
+
+    test_placement();
+    test_fallback();
+    test_free_and_stat();
+
+    bench(1);
+    bench(0);
+
+    printf("mem_region: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
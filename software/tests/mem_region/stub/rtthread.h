@@ -0,0 +1,31 @@
+/*
+ * Host stand-in for the parts of rtthread.h used by mem_region.c, on top
+ * of the shared one. The two kernel heaps are modelled by heap_model.c.
+ */
+#ifndef __MEM_REGION_RTTHREAD_H__
+#define __MEM_REGION_RTTHREAD_H__
+
+#include "../../stub/rtthread.h"
+
+struct rt_memheap
+{
+    const char *name;
+    rt_uint8_t *begin;
+    rt_uint32_t header;                 /* bytes of a block header */
+    rt_uint32_t pool_size;
+    rt_uint32_t available_size;
+    rt_uint32_t max_used;
+};
+
+rt_err_t rt_memheap_init(struct rt_memheap *heap, const char *name,
+                         void *start_addr, rt_uint32_t size);
+void *rt_memheap_alloc(struct rt_memheap *heap, rt_uint32_t size);
+void rt_memheap_free(void *ptr);
+
+void rt_system_heap_init(void *begin_addr, void *end_addr);
+void rt_memory_info(rt_uint32_t *total, rt_uint32_t *used, rt_uint32_t *max_used);
+
+static inline void rt_enter_critical(void) {}
+static inline void rt_exit_critical(void) {}
+
+#endif
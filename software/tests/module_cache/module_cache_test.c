@@ -0,0 +1,420 @@
+/*
+ * Host test of ui/module_cache.c.
+ *
+ * The .mo files live in memory behind the dfs_posix.h calls and the test
+ * plays the module loader: a load copies the image into a module space
+ * taken from the same heap as the cached images, the way rt_module_load()
+ * does in external SRAM. The test checks that
+ *
+ *   - a cold launch reads the file and a warm one only asks for its size
+ *     and time, a replaced file is read again,
+ *   - the least recently launched images go first, within MODULE_CACHE_SIZE
+ *     and MODULE_CACHE_MAX,
+ *   - a load or a read that fails for want of heap is tried once more after
+ *     the other images are dropped, and then succeeds,
+ *   - a module that does not load gives -RT_ERROR, a file that can not be
+ *     read -RT_EIO, so the launcher only falls back on rt_module_open() for
+ *     the latter,
+ *   - no image, module space or lock is left behind.
+ *
+ * It prints the bytes read from the card per launch and what they cost at
+ * the 2MB/s the SDIO and FAT path gives on the board.
+ */
+#include <stdlib.h>
+#include <rtthread.h>
+#include "mem_region.h"
+
+#include "module_cache.c"
+
+#define SD_BYTES_PER_MS     2048
+#define APP_SIZE            (15 * 1024)
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+/* the external SRAM heap: the cached images and the module spaces */
+static rt_uint32_t heap_limit = 1024 * 1024;
+static rt_uint32_t heap_used;
+
+struct block
+{
+    rt_uint32_t size;
+    rt_uint32_t pad;
+};
+
+static void *heap_alloc(rt_uint32_t size)
+{
+    struct block *b;
+
+    if (heap_used + size > heap_limit)
+        return RT_NULL;
+
+    b = (struct block *)malloc(sizeof(*b) + size);
+    b->size = size;
+    heap_used += size;
+
+    return b + 1;
+}
+
+static void heap_free(void *ptr)
+{
+    struct block *b = (struct block *)ptr - 1;
+
+    heap_used -= b->size;
+    free(b);
+}
+
+void *mem_region_malloc(rt_uint32_t hint, rt_size_t size)
+{
+    CHECK(hint == MEM_REGION_BULK);
+    return heap_alloc(size);
+}
+
+void mem_region_free(void *ptr)
+{
+    heap_free(ptr);
+}
+
+/* the image descriptors come from the system heap */
+void *rt_malloc(rt_size_t size)
+{
+    return malloc(size);
+}
+
+void rt_free(void *ptr)
+{
+    free(ptr);
+}
+
+/* a good image starts with "MOD", the rest is its content */
+static int loads;
+
+rt_module_t rt_module_load(const char *name, void *module_ptr)
+{
+    rt_module_t module;
+    rt_uint32_t size;
+
+    loads ++;
+    if (memcmp(module_ptr, "MOD", 3) != 0)
+        return RT_NULL;
+
+    memcpy(&size, (rt_uint8_t *)module_ptr + 4, 4);
+    module = (rt_module_t)malloc(sizeof(*module));
+    module->module_space = heap_alloc(size);
+    if (module->module_space == RT_NULL)
+    {
+        free(module);
+        return RT_NULL;
+    }
+    memcpy(module->module_space, module_ptr, size);
+    module->size = size;
+
+    return module;
+}
+
+static void module_unload(rt_module_t module)
+{
+    heap_free(module->module_space);
+    free(module);
+}
+
+/* the SD card */
+#define FILES   16
+
+struct sim_file
+{
+    char path[64];
+    rt_uint8_t *data;
+    rt_uint32_t size;
+    rt_time_t mtime;
+    int short_read;
+};
+
+static struct sim_file files[FILES];
+static struct sim_file *opened;
+static long sd_bytes;
+
+static struct sim_file *file_find(const char *path)
+{
+    int index;
+
+    for (index = 0; index < FILES; index ++)
+    {
+        if (files[index].data != RT_NULL && strcmp(files[index].path, path) == 0)
+            return &files[index];
+    }
+
+    return RT_NULL;
+}
+
+int sim_stat(const char *path, struct stat *st)
+{
+    struct sim_file *f = file_find(path);
+
+    if (f == RT_NULL)
+        return -1;
+    st->st_size = f->size;
+    st->st_mtime = f->mtime;
+
+    return 0;
+}
+
+int sim_open(const char *path, int flags)
+{
+    CHECK(opened == RT_NULL);
+    opened = file_find(path);
+
+    return opened != RT_NULL ? 3 : -1;
+}
+
+int sim_read(int fd, void *buf, rt_size_t len)
+{
+    rt_size_t length = len < opened->size ? len : opened->size;
+
+    if (opened->short_read)
+        length /= 2;
+    memcpy(buf, opened->data, length);
+    sd_bytes += length;
+
+    return (int)length;
+}
+
+int sim_close(int fd)
+{
+    opened = RT_NULL;
+    return 0;
+}
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(rt_uint32_t range)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % range;
+}
+
+static const char *app_path(int app)
+{
+    static char path[64];
+
+    sprintf(path, "/SD/programs/app%d/app%d.mo", app, app);
+    return path;
+}
+
+/* the .mo of an application, good or not */
+static void app_write(int app, rt_uint32_t size, int good)
+{
+    struct sim_file *f = &files[app];
+    rt_uint32_t index;
+
+    free(f->data);
+    strcpy(f->path, app_path(app));
+    f->data = (rt_uint8_t *)malloc(size);
+    f->size = size;
+    f->mtime ++;
+    f->short_read = 0;
+
+    for (index = 0; index < size; index ++)
+        f->data[index] = (rt_uint8_t)rnd(256);
+    if (good)
+    {
+        memcpy(f->data, "MOD", 4);
+        memcpy(f->data + 4, &size, 4);
+    }
+}
+
+/* one launch: the module must carry the file as it is now */
+static rt_err_t launch(int app, long *read)
+{
+    rt_module_t module;
+    rt_err_t result;
+    long before = sd_bytes;
+
+    result = module_cache_open("app", app_path(app), &module);
+    if (read != RT_NULL)
+        *read = sd_bytes - before;
+
+    CHECK((result == RT_EOK) == (module != RT_NULL));
+    if (module != RT_NULL)
+    {
+        CHECK(module->size == files[app].size);
+        CHECK(memcmp(module->module_space, files[app].data, module->size) == 0);
+        module_unload(module);
+    }
+    CHECK(_cache.lock.taken == 0);
+    CHECK(opened == RT_NULL);
+
+    return result;
+}
+
+static int cached(int app)
+{
+    return _image_find(app_path(app)) != RT_NULL;
+}
+
+static void test_launch(void)
+{
+    struct module_cache_stat stat;
+    long read;
+
+    app_write(0, APP_SIZE, 1);
+
+    CHECK(launch(0, &read) == RT_EOK);
+    CHECK(read == APP_SIZE);
+    printf("cold launch: %6ld bytes from SD, %.1fms at 2MB/s\n", read,
+           (double)read / SD_BYTES_PER_MS);
+
+    CHECK(launch(0, &read) == RT_EOK);
+    CHECK(read == 0);
+    printf("warm launch: %6ld bytes from SD\n", read);
+
+    /* the file was replaced with one of the same size */
+    app_write(0, APP_SIZE, 1);
+    CHECK(launch(0, &read) == RT_EOK);
+    CHECK(read == APP_SIZE);
+
+    module_cache_get_stat(&stat);
+    CHECK(stat.hits == 1 && stat.misses == 2 && stat.retries == 0);
+    CHECK(stat.bytes == APP_SIZE);
+    CHECK(loads == 3);
+
+    module_cache_flush();
+    CHECK(heap_used == 0);
+}
+
+static void test_lru(void)
+{
+    struct module_cache_stat stat;
+    int app;
+
+    /* 15K images: the fifth goes over MODULE_CACHE_SIZE */
+    for (app = 0; app < 5; app ++)
+    {
+        app_write(app, APP_SIZE, 1);
+        CHECK(launch(app, RT_NULL) == RT_EOK);
+    }
+    CHECK(!cached(0) && cached(1) && cached(4));
+
+    /* launching 1 again makes 2 the oldest */
+    CHECK(launch(1, RT_NULL) == RT_EOK);
+    app_write(5, APP_SIZE, 1);
+    CHECK(launch(5, RT_NULL) == RT_EOK);
+    CHECK(cached(1) && !cached(2) && cached(5));
+
+    module_cache_get_stat(&stat);
+    CHECK(stat.bytes <= MODULE_CACHE_SIZE && stat.bytes == 4 * APP_SIZE);
+    module_cache_flush();
+
+    /* small images: no more than MODULE_CACHE_MAX of them */
+    for (app = 0; app < MODULE_CACHE_MAX + 2; app ++)
+    {
+        app_write(app, 1024, 1);
+        CHECK(launch(app, RT_NULL) == RT_EOK);
+    }
+    CHECK(_cache.count == MODULE_CACHE_MAX);
+    CHECK(!cached(0) && !cached(1) && cached(2) && cached(MODULE_CACHE_MAX + 1));
+
+    module_cache_flush();
+    CHECK(heap_used == 0);
+}
+
+static void test_out_of_memory(void)
+{
+    struct module_cache_stat before, after;
+    int app;
+
+    for (app = 0; app < 5; app ++)
+        app_write(app, APP_SIZE, 1);
+
+    /* 0..3 cached; 0 is dropped for the image of 4, then there is no room
+       for the module space of 4 until 1..3 are gone as well */
+    for (app = 0; app < 4; app ++)
+        CHECK(launch(app, RT_NULL) == RT_EOK);
+    heap_limit = heap_used + APP_SIZE - 1;
+    module_cache_get_stat(&before);
+    loads = 0;
+    CHECK(launch(4, RT_NULL) == RT_EOK);
+    module_cache_get_stat(&after);
+    CHECK(after.retries == before.retries + 1 && loads == 2);
+    CHECK(cached(4) && _cache.count == 1);
+
+    /* a cached image whose module does not fit keeps its own image */
+    heap_limit = 1024 * 1024;
+    CHECK(launch(0, RT_NULL) == RT_EOK);
+    heap_limit = heap_used + APP_SIZE - 1;
+    module_cache_get_stat(&before);
+    CHECK(launch(4, RT_NULL) == RT_EOK);
+    module_cache_get_stat(&after);
+    CHECK(after.hits == before.hits + 1 && after.retries == before.retries + 1);
+    CHECK(cached(4) && !cached(0));
+
+    /* no room for the image either */
+    heap_limit = 1024 * 1024;
+    CHECK(launch(1, RT_NULL) == RT_EOK);
+    heap_limit = heap_used + APP_SIZE - 1;
+    module_cache_get_stat(&before);
+    CHECK(launch(2, RT_NULL) == RT_EOK);
+    module_cache_get_stat(&after);
+    CHECK(after.retries == before.retries + 1);
+    CHECK(cached(2) && _cache.count == 1);
+
+    /* image and module space fit nowhere: nothing cached, nothing left */
+    heap_limit = APP_SIZE * 3 / 2;
+    loads = 0;
+    CHECK(launch(3, RT_NULL) == -RT_ERROR);
+    CHECK(loads == 1 && !cached(3) && _cache.count == 0);
+    CHECK(heap_used == 0);
+
+    heap_limit = 1024 * 1024;
+}
+
+static void test_errors(void)
+{
+    int app;
+    rt_module_t module;
+
+    for (app = 0; app < 3; app ++)
+    {
+        app_write(app, APP_SIZE, 1);
+        CHECK(launch(app, RT_NULL) == RT_EOK);
+    }
+
+    /* a broken module is tried once more without the other images, then
+       given up; the launcher does not hand it to the module loader */
+    app_write(3, APP_SIZE, 0);
+    loads = 0;
+    CHECK(launch(3, RT_NULL) == -RT_ERROR);
+    CHECK(loads == 2 && !cached(3));
+
+    /* missing, empty or short files are for rt_module_open() */
+    CHECK(module_cache_open("app", "/SD/programs/none/none.mo", &module) == -RT_EIO);
+    CHECK(module == RT_NULL);
+    app_write(4, 0, 0);
+    CHECK(launch(4, RT_NULL) == -RT_EIO);
+    app_write(5, APP_SIZE, 1);
+    files[5].short_read = 1;
+    CHECK(launch(5, RT_NULL) == -RT_EIO);
+    CHECK(!cached(5));
+
+    module_cache_flush();
+    CHECK(heap_used == 0);
+}
+
+int main(void)
+{
+    int index;
+
+    test_launch();
+    test_lru();
+    test_out_of_memory();
+    test_errors();
+
+    for (index = 0; index < FILES; index ++)
+        free(files[index].data);
+
+    printf("module_cache: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
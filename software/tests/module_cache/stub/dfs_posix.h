@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for dfs_posix.h: the files live in memory, see the test.
+ */
+#ifndef __DFS_POSIX_H__
+#define __DFS_POSIX_H__
+
+#include <rtthread.h>
+
+#define O_RDONLY    0
+
+struct stat
+{
+    rt_uint32_t st_size;
+    rt_time_t st_mtime;
+};
+
+int sim_stat(const char *path, struct stat *st);
+int sim_open(const char *path, int flags);
+int sim_read(int fd, void *buf, rt_size_t len);
+int sim_close(int fd);
+
+#define stat(path, st)          sim_stat(path, st)
+#define open(path, flags, mode) sim_open(path, flags)
+#define read(fd, buf, len)      sim_read(fd, buf, len)
+#define close(fd)               sim_close(fd)
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Host stand-in for the parts of rtthread.h used by module_cache.c, on top
+ * of the shared one.
+ */
+#ifndef __MODULE_CACHE_RTTHREAD_H__
+#define __MODULE_CACHE_RTTHREAD_H__
+
+#include "../../stub/rtthread.h"
+
+/* one thread launches the modules here */
+struct rt_mutex
+{
+    int taken;
+};
+
+static inline rt_err_t rt_mutex_init(struct rt_mutex *m, const char *name, rt_uint8_t flag)
+{
+    m->taken = 0;
+    return RT_EOK;
+}
+
+static inline rt_err_t rt_mutex_take(struct rt_mutex *m, int time)
+{
+    m->taken ++;
+    return RT_EOK;
+}
+
+static inline rt_err_t rt_mutex_release(struct rt_mutex *m)
+{
+    m->taken --;
+    return RT_EOK;
+}
+
+/* the test plays the module loader */
+struct rt_module
+{
+    void *module_space;
+    rt_uint32_t size;
+};
+typedef struct rt_module *rt_module_t;
+
+rt_module_t rt_module_load(const char *name, void *module_ptr);
+
+#endif
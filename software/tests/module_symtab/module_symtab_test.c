@@ -0,0 +1,291 @@
+/*
+ * Host test of applications/module_symtab.c.
+ *
+ * The Makefile puts an RTMSymTab section of 800 entries together from the
+ * RTM_EXPORTs of this tree and the imports of the snake, tetris and button
+ * modules, which it builds from programs/ as host relocatable objects.
+ * The test checks that
+ *
+ *   - the first lookup builds the index,
+ *   - every name is found, at the address of its first entry,
+ *   - names that are not exported are not found,
+ *   - without the index (allocation failed) the linear scan gives the
+ *     same answers,
+ *
+ * then loads each module the way the loader resolves it: every relocation
+ * against an undefined symbol looks the name up. It reports the imports,
+ * the relocations and the time per load with the linear scan and with the
+ * index. The modules are x86-64 objects here, not the ARM .mo files, but
+ * the names and the relocations against them are the same.
+ */
+#include <elf.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <rtthread.h>
+#include <rtm.h>
+#include "mem_region.h"
+#include "module_symtab.h"
+
+#define LOADS           2000
+
+extern const struct rt_module_symtab __start_RTMSymTab[], __stop_RTMSymTab[];
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+static int calloc_fails;
+
+void *mem_region_calloc(rt_uint32_t hint, rt_size_t count, rt_size_t size)
+{
+    return calloc_fails ? NULL : calloc(count, size);
+}
+
+/* what rt_module_symbol_find() does without the index */
+static void *linear_find(const char *name)
+{
+    const struct rt_module_symtab *symbol;
+
+    for (symbol = __start_RTMSymTab; symbol < __stop_RTMSymTab; symbol ++)
+    {
+        if (strcmp(symbol->name, name) == 0)
+            return symbol->addr;
+    }
+
+    return RT_NULL;
+}
+
+static void test_lookup(void)
+{
+    static const char *missing[] = {"", "rt_mallo", "rt_malloc_", "RT_MALLOC",
+        "rtgui_win_show2", "no_such_symbol"};
+    const struct rt_module_symtab *symbol, *first = RT_NULL, *second = RT_NULL;
+    struct module_symtab_stat stat;
+    rt_size_t index;
+    int pass;
+
+    /* nothing is built at boot, the first lookup builds the index */
+    module_symtab_get_stat(&stat);
+    CHECK(stat.slots == 0);
+    CHECK(module_symtab_find("rt_free") == linear_find("rt_free"));
+    module_symtab_get_stat(&stat);
+    CHECK(stat.slots >= 2 * stat.symbols && stat.lookups == 1);
+
+    /* no memory for the index: everything goes through the linear scan */
+    for (pass = 0; pass < 2; pass ++)
+    {
+        calloc_fails = (pass == 0);
+        CHECK(module_symtab_init() == (pass == 0 ? -RT_ENOMEM : RT_EOK));
+
+        for (symbol = __start_RTMSymTab; symbol < __stop_RTMSymTab; symbol ++)
+        {
+            if (module_symtab_find(symbol->name) != linear_find(symbol->name))
+            {
+                printf("%s: wrong address, pass %d\n", symbol->name, pass);
+                failures ++;
+            }
+        }
+        for (index = 0; index < sizeof(missing) / sizeof(missing[0]); index ++)
+            CHECK(module_symtab_find(missing[index]) == RT_NULL);
+    }
+
+    /* of two entries with the same name the first in the section wins */
+    for (symbol = __start_RTMSymTab; symbol < __stop_RTMSymTab; symbol ++)
+    {
+        if (strcmp(symbol->name, "rt_malloc") != 0)
+            continue;
+        if (first == RT_NULL)
+            first = symbol;
+        else
+            second = symbol;
+    }
+    CHECK(second != RT_NULL && first->addr != second->addr);
+    CHECK(module_symtab_find("rt_malloc") == first->addr);
+
+    module_symtab_get_stat(&stat);
+    CHECK(stat.symbols == __stop_RTMSymTab - __start_RTMSymTab);
+    CHECK(stat.slots >= 2 * stat.symbols);
+    printf("%u symbols in %u slots, longest probe %u\n", stat.symbols, stat.slots,
+           stat.max_probe);
+}
+
+struct module
+{
+    const char *path;
+    rt_uint8_t *image;
+    const Elf64_Sym *symbols;
+    rt_size_t symbol_count;
+    const char *names;
+};
+
+static void *read_file(const char *path)
+{
+    FILE *fp;
+    long size;
+    void *data;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    data = malloc(size);
+    if (data != NULL && fread(data, 1, size, fp) != (size_t)size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+
+    return data;
+}
+
+/*
+ * One load: every relocation against an undefined symbol resolves its name.
+ * Returns the relocations, *unresolved counts the names not found.
+ */
+static int resolve(const struct module *m, void *(*find)(const char *), int *unresolved)
+{
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)m->image;
+    const Elf64_Shdr *shdr = (const Elf64_Shdr *)(m->image + ehdr->e_shoff);
+    const Elf64_Rela *rela;
+    const Elf64_Sym *sym;
+    rt_size_t index, count;
+    int relocs = 0;
+
+    *unresolved = 0;
+    for (index = 0; index < ehdr->e_shnum; index ++)
+    {
+        if (shdr[index].sh_type != SHT_RELA ||
+                !(shdr[shdr[index].sh_info].sh_flags & SHF_ALLOC))
+            continue;
+
+        rela = (const Elf64_Rela *)(m->image + shdr[index].sh_offset);
+        for (count = shdr[index].sh_size / sizeof(*rela); count > 0; count --, rela ++)
+        {
+            sym = &m->symbols[ELF64_R_SYM(rela->r_info)];
+            if (ELF64_R_SYM(rela->r_info) == 0 || sym->st_shndx != SHN_UNDEF)
+                continue;
+
+            relocs ++;
+            if (find(m->names + sym->st_name) == RT_NULL)
+                (*unresolved) ++;
+        }
+    }
+
+    return relocs;
+}
+
+/* the undefined symbols, each found at the same address by index and scan */
+static int imports(const struct module *m)
+{
+    const char *name;
+    rt_size_t index;
+    int count = 0;
+
+    for (index = 1; index < m->symbol_count; index ++)
+    {
+        name = m->names + m->symbols[index].st_name;
+        if (m->symbols[index].st_shndx != SHN_UNDEF || *name == '\0')
+            continue;
+
+        count ++;
+        if (module_symtab_find(name) != linear_find(name))
+        {
+            printf("%s: %s resolves to another address\n", m->path, name);
+            failures ++;
+        }
+    }
+
+    return count;
+}
+
+static int load(struct module *m)
+{
+    const Elf64_Ehdr *ehdr;
+    const Elf64_Shdr *shdr;
+    rt_size_t index;
+
+    m->image = (rt_uint8_t *)read_file(m->path);
+    if (m->image == NULL)
+        return -1;
+
+    ehdr = (const Elf64_Ehdr *)m->image;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+            ehdr->e_type != ET_REL)
+        return -1;
+
+    shdr = (const Elf64_Shdr *)(m->image + ehdr->e_shoff);
+    for (index = 0; index < ehdr->e_shnum; index ++)
+    {
+        if (shdr[index].sh_type == SHT_SYMTAB)
+        {
+            m->symbols = (const Elf64_Sym *)(m->image + shdr[index].sh_offset);
+            m->symbol_count = shdr[index].sh_size / sizeof(Elf64_Sym);
+            m->names = (const char *)(m->image + shdr[shdr[index].sh_link].sh_offset);
+        }
+    }
+
+    return m->symbols != RT_NULL ? 0 : -1;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void test_module(const char *path)
+{
+    struct module m = {path};
+    struct module_symtab_stat before, after;
+    int relocs, count, unresolved, round;
+    double t0, t1, t2;
+
+    if (load(&m) != 0)
+    {
+        printf("%s: not a relocatable ELF64 object\n", path);
+        failures ++;
+        free(m.image);
+        return;
+    }
+
+    count = imports(&m);
+    relocs = resolve(&m, module_symtab_find, &unresolved);
+    CHECK(unresolved == 0);
+    CHECK(count > 0 && relocs >= count);
+
+    t0 = now_us();
+    for (round = 0; round < LOADS; round ++)
+        resolve(&m, linear_find, &unresolved);
+    t1 = now_us();
+    module_symtab_get_stat(&before);
+    for (round = 0; round < LOADS; round ++)
+        resolve(&m, module_symtab_find, &unresolved);
+    t2 = now_us();
+    module_symtab_get_stat(&after);
+
+    printf("%-10s %2d imports, %3d relocations: linear %7.2fus, index %5.2fus per load, "
+           "%.2f slots a lookup\n", path, count, relocs, (t1 - t0) / LOADS, (t2 - t1) / LOADS,
+           (double)(after.probes - before.probes) / (after.lookups - before.lookups));
+    free(m.image);
+}
+
+int main(int argc, char **argv)
+{
+    int index;
+
+    test_lookup();
+    for (index = 1; index < argc; index ++)
+        test_module(argv[index]);
+
+    printf("module_symtab: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for rtm.h: the layout of an RTMSymTab entry. The entries
+ * themselves are generated by the Makefile into exports.c.
+ */
+#ifndef __RTM_H__
+#define __RTM_H__
+
+struct rt_module_symtab
+{
+    void *addr;
+    const char *name;
+};
+
+#endif
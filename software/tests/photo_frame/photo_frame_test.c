@@ -0,0 +1,691 @@
+/*
+ * Latency simulation of the photo frame example,
+ * examples/4_gui_photo_frame/applications/picture.c.
+ *
+ * The example is included here and built against the kernel and RTGUI
+ * headers of the tree. The GUI thread is the test, the prefetch thread a
+ * coroutine on a clock of its own: it runs while the GUI thread waits for
+ * the next key press or slideshow tick, and is preempted by it the way a
+ * thread of lower priority is. Reading the directory, decoding a picture
+ * and moving pixels cost time on that clock:
+ *
+ *   - the SD card reads 2MB/s and a directory entry takes 30us,
+ *   - a write to the LCD is 6 HCLK and an access to the external SRAM
+ *     10 HCLK at 168MHz, the FSMC timings of ra8875.c and ext_sram.c.
+ *
+ * These are a model, not a measurement; the latency on the board has not
+ * been measured. Each picture is drawn in a colour of its own, so the
+ * test sees what is on the screen and when. It checks that
+ *
+ *   - the slots are laid out in the external SRAM, one at 800x480,
+ *   - every step ends with the picture stepped to on the screen,
+ *   - a slideshow step, the next picture rendered ahead, only costs the
+ *     copy to the LCD, and is several times faster than a decode,
+ *   - a picture which no longer opens is dropped from the index when
+ *     rendered ahead, and not shown,
+ *   - the lock is never taken by one thread while the other holds it,
+ *
+ * and prints the latency of the steps with the slots and without.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <rtgui/rtgui_app.h>
+
+/* the examples are built with an RTGUI whose rtgui_app_create() only takes the title */
+#define rtgui_app_create(title)     sim_app_create(title)
+struct rtgui_app *sim_app_create(const char *title);
+
+#include "../../examples/examples/4_gui_photo_frame/applications/picture.c"
+
+#define SCREEN_W            800
+#define SCREEN_H            480
+#define PICTURES            40
+#define ENTRIES             300
+
+/* the cost model, in us */
+#define HCLK_MHZ            168.0
+#define SD_BYTES_PER_US     2.0
+#define DIRENT_US           30.0
+#define LCD_WRITE_US        (6 / HCLK_MHZ)
+#define SRAM_ACCESS_US      (10 / HCLK_MHZ)
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+rt_uint8_t sim_ext_sram[1024 * 1024];
+static int ext_sram_inits;
+
+void ext_sram_init(void)
+{
+    ext_sram_inits ++;
+}
+
+/*
+ * The two threads and the clock. The prefetch thread runs until it
+ * waits for its semaphore, or until the GUI thread has something to do.
+ */
+static struct rt_thread gui_thread, prefetch_thread;
+static ucontext_t gui_context, prefetch_context;
+static char prefetch_stack[64 * 1024];
+static void (*prefetch_func)(void *parameter);
+static int in_prefetch, prefetch_runnable;
+
+static double now;          /* us */
+static double next_input;   /* when the GUI thread wakes up */
+
+static void prefetch_start(void)
+{
+    prefetch_func(RT_NULL);
+}
+
+/* from the prefetch thread: the GUI thread preempts it */
+static void switch_to_gui(void)
+{
+    in_prefetch = 0;
+    swapcontext(&prefetch_context, &gui_context);
+    in_prefetch = 1;
+}
+
+static void switch_to_prefetch(void)
+{
+    in_prefetch = 1;
+    swapcontext(&gui_context, &prefetch_context);
+    in_prefetch = 0;
+}
+
+/* time spent by the thread running */
+static void sim_cost(double us)
+{
+    while (in_prefetch && now + us >= next_input)
+    {
+        us -= next_input - now;
+        now = next_input;
+        switch_to_gui();
+    }
+    now += us;
+}
+
+rt_thread_t rt_thread_self(void)
+{
+    return in_prefetch ? &prefetch_thread : &gui_thread;
+}
+
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter), void *parameter,
+                             rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick)
+{
+    CHECK(priority > 20);
+    prefetch_func = entry;
+    return &prefetch_thread;
+}
+
+rt_err_t rt_thread_startup(rt_thread_t thread)
+{
+    getcontext(&prefetch_context);
+    prefetch_context.uc_stack.ss_sp = prefetch_stack;
+    prefetch_context.uc_stack.ss_size = sizeof(prefetch_stack);
+    prefetch_context.uc_link = RT_NULL;
+    makecontext(&prefetch_context, prefetch_start, 0);
+    prefetch_runnable = 1;
+
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_init(rt_sem_t sem, const char *name, rt_uint32_t value, rt_uint8_t flag)
+{
+    sem->value = value;
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t time)
+{
+    CHECK(in_prefetch);
+    while (sem->value == 0)
+    {
+        prefetch_runnable = 0;
+        switch_to_gui();
+    }
+    sem->value --;
+
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_release(rt_sem_t sem)
+{
+    sem->value ++;
+    prefetch_runnable = 1;
+
+    return RT_EOK;
+}
+
+static int lock_contended;
+
+rt_err_t rt_mutex_init(rt_mutex_t mutex, const char *name, rt_uint8_t flag)
+{
+    mutex->hold = 0;
+    mutex->owner = RT_NULL;
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_take(rt_mutex_t mutex, rt_int32_t time)
+{
+    if (mutex->hold != 0 && mutex->owner != rt_thread_self())
+        lock_contended ++;
+    mutex->owner = rt_thread_self();
+    mutex->hold ++;
+
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_release(rt_mutex_t mutex)
+{
+    CHECK(mutex->hold > 0 && mutex->owner == rt_thread_self());
+    if (-- mutex->hold == 0)
+        mutex->owner = RT_NULL;
+
+    return RT_EOK;
+}
+
+void *rt_realloc(void *ptr, rt_size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void rt_free(void *ptr)
+{
+    free(ptr);
+}
+
+void rt_kprintf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+rt_int32_t rt_snprintf(char *buf, rt_size_t size, const char *format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(buf, size, format, args);
+    va_end(args);
+
+    return length;
+}
+
+/* the SD card: the pictures among other files, in the order of FAT */
+struct sim_entry
+{
+    char name[16];
+    int picture;            /* 1.., 0 for other files */
+    int broken;
+};
+
+struct sim_dir
+{
+    int index;
+    struct dirent entry;
+};
+
+static struct sim_entry entries[ENTRIES];
+
+DIR *sim_opendir(const char *name)
+{
+    DIR *dir = (DIR *)calloc(1, sizeof(DIR));
+
+    CHECK(strcmp(name, PICTURE_DIR) == 0);
+    return dir;
+}
+
+struct dirent *sim_readdir(DIR *dir)
+{
+    if (dir->index == ENTRIES)
+        return RT_NULL;
+
+    sim_cost(DIRENT_US);
+    strcpy(dir->entry.d_name, entries[dir->index ++].name);
+
+    return &dir->entry;
+}
+
+int sim_closedir(DIR *dir)
+{
+    free(dir);
+    return 0;
+}
+
+static struct sim_entry *entry_find(const char *name)
+{
+    int index;
+
+    for (index = 0; index < ENTRIES; index ++)
+    {
+        if (strcmp(entries[index].name, name) == 0)
+            return &entries[index];
+    }
+
+    return RT_NULL;
+}
+
+/* the pictures: a colour each, decoded row by row from the card */
+struct sim_image
+{
+    struct rtgui_image parent;
+    int picture;
+};
+
+struct rtgui_image *rtgui_image_create_from_file(const char *type, const char *filename,
+        rt_bool_t load)
+{
+    struct sim_entry *entry = entry_find(strrchr(filename, '/') + 1);
+    struct sim_image *image;
+
+    CHECK(strcmp(type, "bmp") == 0 && load == RT_FALSE);
+    if (entry == RT_NULL || entry->broken)
+        return RT_NULL;
+
+    image = (struct sim_image *)calloc(1, sizeof(*image));
+    image->parent.w = SCREEN_W;
+    image->parent.h = SCREEN_H;
+    image->picture = entry->picture;
+
+    return &image->parent;
+}
+
+void rtgui_image_blit(struct rtgui_image *image, struct rtgui_dc *dc, struct rtgui_rect *rect)
+{
+    rt_uint16_t line[SCREEN_W];
+    int x, y;
+
+    for (x = 0; x < SCREEN_W; x ++)
+        line[x] = ((struct sim_image *)image)->picture;
+
+    for (y = 0; y < image->h && y < rtgui_rect_height(*rect); y ++)
+    {
+        sim_cost(image->w * 2 / SD_BYTES_PER_US);
+        dc->engine->blit_line(dc, rect->x1, rect->x1 + image->w, rect->y1 + y, (rt_uint8_t *)line);
+    }
+}
+
+void rtgui_image_destroy(struct rtgui_image *image)
+{
+    free(image);
+}
+
+/* the slots draw into the external SRAM */
+static struct rtgui_dc_engine sim_slot_engine;
+
+static void sim_slot_fill_rect(struct rtgui_dc *dc, rtgui_rect_t *rect)
+{
+    sim_cost(rtgui_rect_width(*rect) * rtgui_rect_height(*rect) * SRAM_ACCESS_US);
+    slot_engine.fill_rect(dc, rect);
+}
+
+static void sim_slot_blit_line(struct rtgui_dc *dc, int x1, int x2, int y, rt_uint8_t *line)
+{
+    sim_cost((x2 - x1) * SRAM_ACCESS_US);
+    slot_engine.blit_line(dc, x1, x2, y, line);
+}
+
+/* the screen: the picture is the colour of its middle row */
+static struct rtgui_dc_engine screen_engine;
+static struct rtgui_dc screen_dc;
+static int screen_picture;
+static int screen_rows;
+
+static void screen_fill_rect(struct rtgui_dc *dc, rtgui_rect_t *rect)
+{
+    sim_cost(rtgui_rect_width(*rect) * rtgui_rect_height(*rect) * LCD_WRITE_US);
+    screen_picture = 0;
+}
+
+static void screen_blit_line(struct rtgui_dc *dc, int x1, int x2, int y, rt_uint8_t *line)
+{
+    CHECK(!in_prefetch);
+    CHECK(x1 == 0 && x2 == SCREEN_W && y >= 0 && y < SCREEN_H);
+
+    /* from a slot: read the external SRAM as well */
+    if (line >= sim_ext_sram && line < sim_ext_sram + sizeof(sim_ext_sram))
+        sim_cost((x2 - x1) * SRAM_ACCESS_US);
+    sim_cost((x2 - x1) * LCD_WRITE_US);
+
+    if (y == SCREEN_H / 2)
+        screen_picture = ((rt_uint16_t *)line)[0];
+    screen_rows ++;
+}
+
+void rtgui_dc_draw_text(struct rtgui_dc *dc, const char *text, struct rtgui_rect *rect)
+{
+}
+
+struct rtgui_dc *rtgui_dc_begin_drawing(rtgui_widget_t *owner)
+{
+    CHECK(!in_prefetch);
+    return &screen_dc;
+}
+
+static void paint_done(void);
+
+void rtgui_dc_end_drawing(struct rtgui_dc *dc)
+{
+    paint_done();
+}
+
+/* RTGUI: one window with the container of the pictures */
+const struct rtgui_type _rtgui_object, _rtgui_widget, _rtgui_container;
+static struct rtgui_graphic_driver driver = {RTGRAPHIC_PIXEL_FORMAT_RGB565P, 16, SCREEN_W, SCREEN_H};
+static struct rtgui_app sim_app;
+static struct rtgui_win sim_win;
+static struct rtgui_container sim_container;
+static rtgui_event_handler_ptr view_handler;
+static int paints_posted;
+
+rtgui_object_t *rtgui_object_check_cast(rtgui_object_t *object, rtgui_type_t *type,
+                                        const char *func, int line)
+{
+    return object;
+}
+
+struct rtgui_app *sim_app_create(const char *title)
+{
+    sim_app.tid = &gui_thread;
+    return &sim_app;
+}
+
+void rtgui_app_destroy(struct rtgui_app *app)
+{
+}
+
+struct rtgui_graphic_driver *rtgui_graphic_driver_get_default(void)
+{
+    return &driver;
+}
+
+void rtgui_graphic_driver_get_rect(const struct rtgui_graphic_driver *driver, rtgui_rect_t *rect)
+{
+    rect->x1 = rect->y1 = 0;
+    rect->x2 = SCREEN_W;
+    rect->y2 = SCREEN_H;
+}
+
+rtgui_win_t *rtgui_win_create(struct rtgui_win *parent_window, const char *title,
+                              rtgui_rect_t *rect, rt_uint16_t style)
+{
+    return &sim_win;
+}
+
+void rtgui_win_set_onkey(rtgui_win_t *win, rtgui_event_handler_ptr handler)
+{
+}
+
+rt_base_t rtgui_win_show(struct rtgui_win *win, rt_bool_t is_modal)
+{
+    return 0;
+}
+
+rtgui_container_t *rtgui_container_create(void)
+{
+    sim_container.parent.gc.background = RTGUI_RGB(0, 0, 0);
+    return &sim_container;
+}
+
+void rtgui_container_add_child(rtgui_container_t *container, rtgui_widget_t *child)
+{
+}
+
+rt_bool_t rtgui_container_event_handler(struct rtgui_object *widget, struct rtgui_event *event)
+{
+    return RT_FALSE;
+}
+
+void rtgui_widget_set_rect(rtgui_widget_t *widget, const rtgui_rect_t *rect)
+{
+}
+
+void rtgui_widget_get_rect(rtgui_widget_t *widget, rtgui_rect_t *rect)
+{
+    rect->x1 = rect->y1 = 0;
+    rect->x2 = SCREEN_W;
+    rect->y2 = SCREEN_H;
+}
+
+void rtgui_object_set_event_handler(struct rtgui_object *object, rtgui_event_handler_ptr handler)
+{
+    view_handler = handler;
+}
+
+void rtgui_widget_update(rtgui_widget_t *widget)
+{
+    struct rtgui_event_paint epaint;
+
+    RTGUI_EVENT_PAINT_INIT(&epaint);
+    view_handler(RTGUI_OBJECT(widget), &epaint.parent);
+}
+
+/* a paint posted by the prefetch thread: the GUI thread takes over */
+rt_err_t rtgui_send(rt_thread_t tid, struct rtgui_event *event, rt_size_t event_size)
+{
+    CHECK(tid == &gui_thread && event->type == RTGUI_EVENT_PAINT);
+    paints_posted ++;
+    if (in_prefetch)
+        switch_to_gui();
+
+    return RT_EOK;
+}
+
+rtgui_timer_t *rtgui_timer_create(rt_int32_t time, rt_base_t flag, rtgui_timeout_func timeout,
+                                  void *parameter)
+{
+    return RT_NULL;
+}
+
+void rtgui_timer_start(rtgui_timer_t *timer)
+{
+}
+
+/* the steps and how long the picture stepped to took to show */
+static double step_time;
+static int step_pending;
+static int steps, shown;
+static double latency_sum, latency_max;
+
+static int picture_of(const char *name)
+{
+    return entry_find(name)->picture;
+}
+
+static void paint_done(void)
+{
+    if (step_pending && current >= 0 && screen_picture == picture_of(names[current]))
+    {
+        double latency = now - step_time;
+
+        latency_sum += latency;
+        if (latency > latency_max)
+            latency_max = latency;
+        shown ++;
+        step_pending = 0;
+    }
+}
+
+/* the GUI thread waits until t, painting what is posted meanwhile */
+static void idle_until(double t)
+{
+    while (now < t)
+    {
+        if (paints_posted > 0)
+        {
+            paints_posted --;
+            rtgui_widget_update(RTGUI_WIDGET(container));
+            continue;
+        }
+        if (!prefetch_runnable)
+            break;
+
+        next_input = t;
+        switch_to_prefetch();
+    }
+
+    if (now < t)
+        now = t;
+    next_input = 1e18;
+}
+
+static void step(int direction)
+{
+    step_time = now;
+    step_pending = 1;
+    steps ++;
+    picture_step(direction);
+}
+
+static void stats_reset(void)
+{
+    steps = shown = 0;
+    latency_sum = latency_max = 0;
+}
+
+static void stats_print(const char *what)
+{
+    printf("%-40s mean %6.1fms, worst %6.1fms, %d of %d shown\n", what,
+           shown ? latency_sum / shown / 1000 : 0, latency_max / 1000, shown, steps);
+}
+
+/* steps every interval ms, forward but every back-th */
+static void run(int count, int interval, int back)
+{
+    int index;
+
+    stats_reset();
+    for (index = 0; index < count; index ++)
+    {
+        step(back != 0 && index % back == back - 1 ? -1 : 1);
+        idle_until(step_time + interval * 1000.0);
+    }
+    /* the last one */
+    idle_until(now + 2000 * 1000.0);
+}
+
+static void test_layout(void)
+{
+    CHECK(ext_sram_inits == 1);
+    CHECK(slot_count == 1);
+    CHECK(slots[0].pixels == sim_ext_sram);
+    CHECK(slot_pitch * slot_height <= (int)sizeof(sim_ext_sram));
+}
+
+static void test_steps(void)
+{
+    double with_mean, without_mean;
+    int saved = slot_count;
+
+    /* the slideshow, rendered ahead */
+    run(PICTURES, 500, 0);
+    stats_print("slideshow 500ms, next rendered ahead:");
+    CHECK(shown == steps && screen_picture == picture_of(names[current]));
+    CHECK(latency_max < 50 * 1000);
+    with_mean = latency_sum / shown;
+
+    /* pressed faster than a picture decodes, and back now and then */
+    run(20, 150, 0);
+    stats_print("next every 150ms:");
+    CHECK(screen_picture == picture_of(names[current]));
+    run(20, 600, 3);
+    stats_print("every 600ms, every third back:");
+    CHECK(shown == steps && screen_picture == picture_of(names[current]));
+
+    /* no slots: every step decodes */
+    slot_count = 0;
+    run(PICTURES, 500, 0);
+    stats_print("slideshow 500ms, decoded on each step:");
+    CHECK(shown == steps && screen_picture == picture_of(names[current]));
+    without_mean = latency_sum / shown;
+    slot_count = saved;
+
+    CHECK(with_mean * 5 < without_mean);
+}
+
+static void test_broken(void)
+{
+    struct sim_entry *entry;
+    int before;
+
+    /* the slot back in use, the one after the next no longer opens */
+    run(1, 500, 0);
+    before = count;
+    entry = entry_find(names[(current + 2) % count]);
+    entry->broken = 1;
+    run(3, 500, 0);
+    CHECK(count == before - 1);
+    CHECK(shown == steps && screen_picture != entry->picture);
+    entry->broken = 0;
+}
+
+rt_base_t rtgui_app_run(struct rtgui_app *app)
+{
+    int index;
+
+    /* the slots move pixels over the FSMC */
+    sim_slot_engine = slot_engine;
+    sim_slot_engine.fill_rect = sim_slot_fill_rect;
+    sim_slot_engine.blit_line = sim_slot_blit_line;
+    for (index = 0; index < slot_count; index ++)
+        slots[index].dc.engine = &sim_slot_engine;
+
+    /* the first picture */
+    idle_until(1000 * 1000.0);
+
+    test_layout();
+    test_steps();
+    test_broken();
+    CHECK(lock_contended == 0);
+
+    return 0;
+}
+
+int main(void)
+{
+    rt_uint32_t lcg = 1;
+    int index, other, picture = 0;
+    struct sim_entry swap;
+
+    /* every seventh or so file a picture, shuffled */
+    for (index = 0; index < ENTRIES; index ++)
+    {
+        if (index % (ENTRIES / PICTURES) == 0 && picture < PICTURES)
+        {
+            entries[index].picture = ++ picture;
+            sprintf(entries[index].name, "img%03d.bmp", picture);
+        }
+        else
+            sprintf(entries[index].name, "note%03d.txt", index);
+    }
+    for (index = ENTRIES - 1; index > 0; index --)
+    {
+        lcg = lcg * 1103515245 + 12345;
+        other = (lcg >> 8) % (index + 1);
+        swap = entries[index];
+        entries[index] = entries[other];
+        entries[other] = swap;
+    }
+
+    screen_engine.fill_rect = screen_fill_rect;
+    screen_engine.blit_line = screen_blit_line;
+    screen_dc.engine = &screen_engine;
+
+    picture_show();
+    CHECK(in_prefetch == 0);
+
+    printf("photo_frame: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for the board.h of the examples: the external SRAM is an
+ * array of the test.
+ */
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+#include <rtthread.h>
+
+extern rt_uint8_t sim_ext_sram[];
+
+#define STM32_EXT_SRAM          0
+#define STM32_EXT_SRAM_BEGIN    ((rt_ubase_t)sim_ext_sram)
+#define STM32_EXT_SRAM_END      (STM32_EXT_SRAM_BEGIN + 0xFFFFF)
+
+#endif
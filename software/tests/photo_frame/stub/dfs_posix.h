@@ -0,0 +1,23 @@
+/*
+ * Host stand-in for dfs_posix.h: the picture directory is a table of the
+ * test, reading it costs time on the simulated clock.
+ */
+#ifndef __DFS_POSIX_H__
+#define __DFS_POSIX_H__
+
+struct dirent
+{
+    char d_name[256];
+};
+
+typedef struct sim_dir DIR;
+
+DIR *sim_opendir(const char *name);
+struct dirent *sim_readdir(DIR *dir);
+int sim_closedir(DIR *dir);
+
+#define opendir(name)           sim_opendir(name)
+#define readdir(dir)            sim_readdir(dir)
+#define closedir(dir)           sim_closedir(dir)
+
+#endif
@@ -0,0 +1,642 @@
+/*
+ * Host benchmark of the application list of ui/program.c.
+ *
+ * The launcher source is included here and built against the kernel and
+ * RTGUI headers of the tree. The test plays the kernel, the list view and
+ * the image cache: a decode reads the icon and spends some time per pixel,
+ * the icon thread runs until it waits on its semaphore again. The test
+ * builds a directory of 200 applications, some with XML files longer than
+ * the 512 byte read buffer, and starts the launcher on it several times:
+ *
+ *   - without an index all names come from the XML files and the index is
+ *     written, then the next start reads the index and no XML file,
+ *   - an added application changes the directory signature, the index is
+ *     built again, a broken index is ignored,
+ *   - the list has every application, beyond the old limit of 32,
+ *   - only the page in view is decoded, and while paging through the whole
+ *     list only the icons of the page in view and its neighbours are held.
+ *
+ * It prints the time until the names are listed and until the first page
+ * of icons is shown, with the files opened and icons decoded.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../realtouch/ui/program.c"
+
+#define APPS            200
+#define PAGE_ITEMS      12
+#define ICON_SIZE       48
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+static long files_opened, xml_opened, icons_decoded, icons_held, icons_held_max;
+
+/* the file system: /SD is the SD directory next to the test */
+const char *sim_path(const char *path)
+{
+    static char host[256];
+
+    snprintf(host, sizeof(host), ".%s", path);
+    return host;
+}
+
+/* added to the time of the directories, the test is faster than the clock */
+static time_t dir_time;
+
+int sim_stat(const char *path, struct stat *st)
+{
+    int result;
+
+    result = lstat(sim_path(path), st);
+    if (result == 0 && S_ISDIR(st->st_mode))
+        st->st_mtime += dir_time;
+
+    return result;
+}
+
+struct sim_filerw
+{
+    struct rtgui_filerw parent;
+    FILE *fp;
+};
+
+struct rtgui_filerw *rtgui_filerw_create_file(const char *filename, const char *mode)
+{
+    struct sim_filerw *rw;
+    FILE *fp;
+
+    fp = fopen(sim_path(filename), mode);
+    if (fp == RT_NULL)
+        return RT_NULL;
+
+    files_opened ++;
+    if (strstr(filename, ".xml") != RT_NULL)
+        xml_opened ++;
+    rw = (struct sim_filerw *)calloc(1, sizeof(*rw));
+    rw->fp = fp;
+
+    return &rw->parent;
+}
+
+int rtgui_filerw_read(struct rtgui_filerw *context, void *buffer, rt_size_t size, rt_size_t count)
+{
+    return fread(buffer, size, count, ((struct sim_filerw *)context)->fp);
+}
+
+int rtgui_filerw_close(struct rtgui_filerw *context)
+{
+    fclose(((struct sim_filerw *)context)->fp);
+    free(context);
+    return 0;
+}
+
+/* enough of an XML parser for the application files, fed in pieces */
+struct rtgui_xml
+{
+    rtgui_xml_event_handler_t handler;
+    void *user;
+    int in_tag;
+    char text[128];
+    rt_size_t length;
+};
+
+rtgui_xml_t *rtgui_xml_create(rt_size_t buffer_size, rtgui_xml_event_handler_t handler, void *user)
+{
+    rtgui_xml_t *xml = (rtgui_xml_t *)calloc(1, sizeof(*xml));
+
+    xml->handler = handler;
+    xml->user = user;
+    return xml;
+}
+
+int rtgui_xml_parse(rtgui_xml_t *xml, const char *buf, rt_size_t len)
+{
+    rt_size_t index;
+    char c;
+
+    for (index = 0; index < len; index ++)
+    {
+        c = buf[index];
+        if (c == '<')
+        {
+            xml->text[xml->length] = '\0';
+            if (xml->length > 0)
+                xml->handler(EVENT_TEXT, xml->text, xml->length, xml->user);
+            xml->in_tag = 1;
+            xml->length = 0;
+        }
+        else if (c == '>')
+        {
+            xml->text[xml->length] = '\0';
+            if (xml->text[0] != '/' && xml->text[0] != '?')
+                xml->handler(EVENT_START, xml->text, xml->length, xml->user);
+            xml->in_tag = 0;
+            xml->length = 0;
+        }
+        else if (c != '\n' && xml->length < sizeof(xml->text) - 1)
+            xml->text[xml->length ++] = c;
+    }
+
+    return 0;
+}
+
+void rtgui_xml_destroy(rtgui_xml_t *xml)
+{
+    free(xml);
+}
+
+/* the image cache: a 48x48 decode costs some work for every pixel */
+struct image_cache_item *image_cache_get(const char *filename,
+        rt_uint16_t width, rt_uint16_t height, rt_uint8_t format)
+{
+    struct image_cache_item *item;
+    rt_uint8_t buffer[4096];
+    rt_uint16_t *pixels;
+    rt_uint32_t hash = 1;
+    size_t length, index, round;
+    FILE *fp;
+
+    fp = fopen(sim_path(filename), "rb");
+    if (fp == RT_NULL)
+        return RT_NULL;
+    files_opened ++;
+    length = fread(buffer, 1, sizeof(buffer), fp);
+    fclose(fp);
+
+    item = (struct image_cache_item *)calloc(1, sizeof(*item));
+    item->image = (rtgui_image_t *)calloc(1, sizeof(rtgui_image_t));
+    item->image->w = item->image->h = ICON_SIZE;
+    pixels = (rt_uint16_t *)malloc(ICON_SIZE * ICON_SIZE * 2);
+    for (index = 0; index < ICON_SIZE * ICON_SIZE; index ++)
+    {
+        for (round = 0; round < 40; round ++)
+            hash = hash * 1103515245u + buffer[(index * 7 + round) % length];
+        pixels[index] = hash >> 16;
+    }
+    item->image->data = pixels;
+
+    icons_decoded ++;
+    icons_held ++;
+    if (icons_held > icons_held_max)
+        icons_held_max = icons_held;
+
+    return item;
+}
+
+void image_cache_put(struct image_cache_item *item)
+{
+    free(item->image->data);
+    free(item->image);
+    free(item);
+    icons_held --;
+}
+
+void image_cache_init(void)
+{
+}
+
+/* the kernel: the icon thread runs when the test says so */
+static jmp_buf icon_wait;
+static struct rt_thread icon_thread;
+static struct rtgui_event_command posted;
+static int posts;
+
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter), void *parameter,
+                             rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick)
+{
+    return &icon_thread;
+}
+
+rt_err_t rt_thread_startup(rt_thread_t thread)
+{
+    return RT_EOK;
+}
+
+rt_thread_t rt_thread_self(void)
+{
+    return RT_NULL;
+}
+
+rt_err_t rt_thread_delay(rt_tick_t tick)
+{
+    return RT_EOK;
+}
+
+void rt_enter_critical(void)
+{
+}
+
+void rt_exit_critical(void)
+{
+}
+
+rt_err_t rt_sem_init(rt_sem_t sem, const char *name, rt_uint32_t value, rt_uint8_t flag)
+{
+    sem->value = value;
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t time)
+{
+    if (sem->value == 0)
+        longjmp(icon_wait, 1);
+    sem->value --;
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_release(rt_sem_t sem)
+{
+    sem->value ++;
+    return RT_EOK;
+}
+
+rt_err_t rtgui_send(rt_thread_t tid, struct rtgui_event *event, rt_size_t event_size)
+{
+    memcpy(&posted, event, sizeof(posted));
+    posts ++;
+    return RT_EOK;
+}
+
+void rt_kprintf(const char *fmt, ...)
+{
+}
+
+rt_int32_t rt_snprintf(char *buf, rt_size_t size, const char *format, ...)
+{
+    va_list args;
+    rt_int32_t length;
+
+    va_start(args, format);
+    length = vsnprintf(buf, size, format, args);
+    va_end(args);
+
+    return length;
+}
+
+rt_int32_t rt_sprintf(char *buf, const char *format, ...)
+{
+    va_list args;
+    rt_int32_t length;
+
+    va_start(args, format);
+    length = vsprintf(buf, format, args);
+    va_end(args);
+
+    return length;
+}
+
+char *rt_strncpy(char *dest, const char *src, rt_ubase_t n)
+{
+    return strncpy(dest, src, n);
+}
+
+void *rt_memset(void *src, int c, rt_ubase_t n)
+{
+    return memset(src, c, n);
+}
+
+rt_module_t rt_module_find(const char *name)
+{
+    return RT_NULL;
+}
+
+rt_module_t rt_module_open(const char *filename)
+{
+    return RT_NULL;
+}
+
+rt_err_t module_cache_open(const char *name, const char *path, rt_module_t *module)
+{
+    return -RT_EIO;
+}
+
+/* RTGUI: the list view only keeps its items and the row in view */
+const struct rtgui_type _rtgui_object, _rtgui_widget, _rtgui_container;
+static struct rtgui_list_view view;
+static struct rtgui_graphic_driver driver = {RTGRAPHIC_PIXEL_FORMAT_RGB565};
+static rtgui_image_t exec_image;
+
+void *rtgui_malloc(rt_size_t size)
+{
+    return malloc(size);
+}
+
+void *rtgui_realloc(void *ptr, rt_size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void rtgui_free(void *ptr)
+{
+    free(ptr);
+}
+
+rtgui_object_t *rtgui_object_check_cast(rtgui_object_t *object, rtgui_type_t *type,
+                                        const char *func, int line)
+{
+    return object;
+}
+
+void rtgui_object_set_event_handler(struct rtgui_object *object, rtgui_event_handler_ptr handler)
+{
+}
+
+rtgui_list_view_t *rtgui_list_view_create(const struct rtgui_list_item *items, rt_uint16_t count,
+        rtgui_rect_t *rect, rt_uint16_t flag)
+{
+    memset(&view, 0, sizeof(view));
+    view.items = items;
+    view.items_count = count;
+    view.page_items = PAGE_ITEMS;
+    view.flag = flag;
+
+    return &view;
+}
+
+rt_bool_t rtgui_list_view_event_handler(struct rtgui_object *widget, struct rtgui_event *event)
+{
+    return RT_TRUE;
+}
+
+void rtgui_container_add_child(rtgui_container_t *container, rtgui_widget_t *child)
+{
+}
+
+void rtgui_widget_get_extent(rtgui_widget_t *widget, rtgui_rect_t *rect)
+{
+    rect->x1 = rect->y1 = 0;
+    rect->x2 = 800;
+    rect->y2 = 480;
+}
+
+void rtgui_rect_inflate(rtgui_rect_t *rect, int d)
+{
+}
+
+void rtgui_widget_update(rtgui_widget_t *widget)
+{
+}
+
+struct rtgui_image *rtgui_image_create_from_mem(const char *type, const rt_uint8_t *data,
+        rt_size_t length, rt_bool_t load)
+{
+    return &exec_image;
+}
+
+void rtgui_app_activate(struct rtgui_app *app)
+{
+}
+
+struct rtgui_graphic_driver *rtgui_graphic_driver_get_default(void)
+{
+    return &driver;
+}
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(rt_uint32_t range)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return (lcg >> 8) % range;
+}
+
+static void write_file(const char *path, const void *data, size_t length)
+{
+    FILE *fp = fopen(sim_path(path), "wb");
+
+    fwrite(data, 1, length, fp);
+    fclose(fp);
+}
+
+/* appNNN/appNNN.xml and its icon; every fifth file has a long description
+   ahead of the name */
+static void app_create(int app)
+{
+    char path[96], xml[1024], icon[2048];
+    int length, index;
+
+    snprintf(path, sizeof(path), "/SD/programs/app%03d", app);
+    mkdir(sim_path(path), 0755);
+
+    length = sprintf(xml, "<?xml version=\"1.0\"?>\n<application>\n");
+    if (app % 5 == 0)
+    {
+        length += sprintf(xml + length, "<description>");
+        for (index = 0; index < 600; index ++)
+            xml[length ++] = 'a' + index % 26;
+        length += sprintf(xml + length, "</description>\n");
+    }
+    length += sprintf(xml + length, "<name>app%03d</name>\n<image>app%03d/icon.png</image>\n"
+                      "<author>realtouch</author>\n<license>GPL</license>\n</application>\n",
+                      app, app);
+    snprintf(path, sizeof(path), "/SD/programs/app%03d/app%03d.xml", app, app);
+    write_file(path, xml, length);
+
+    for (index = 0; index < (int)sizeof(icon); index ++)
+        icon[index] = rnd(256);
+    snprintf(path, sizeof(path), "/SD/programs/app%03d/icon.png", app);
+    write_file(path, icon, sizeof(icon));
+}
+
+/* what program_create() expects of a fresh boot */
+static void launcher_reset(void)
+{
+    int index;
+
+    for (index = 0; index < count; index ++)
+    {
+        if (icons[index].item != RT_NULL)
+            image_cache_put(icons[index].item);
+    }
+    free(apps);
+    free(items);
+    free(icons);
+    apps = RT_NULL;
+    items = RT_NULL;
+    icons = RT_NULL;
+    count = 0;
+    _view = RT_NULL;
+    shown_page = -1;
+    icon_posted = RT_FALSE;
+
+    files_opened = xml_opened = icons_decoded = 0;
+    posts = 0;
+}
+
+/* let the icon thread run, then the GUI thread take its command */
+static void icons_run(void)
+{
+    if (setjmp(icon_wait) == 0)
+        icon_thread_entry(RT_NULL);
+
+    if (posts > 0)
+    {
+        posts = 0;
+        CHECK(posted.command_id == PROGRAM_CMD_ICON);
+        CHECK(program_event_handler(RT_NULL, &posted.parent) == RT_TRUE);
+    }
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* one start of the launcher; returns the applications listed */
+static int boot(const char *what)
+{
+    static struct rtgui_panel panel;
+    double t0, t1, t2;
+    char name[16];
+    int index, found, shown = 0;
+
+    launcher_reset();
+
+    t0 = now_ms();
+    program_create(&panel);
+    t1 = now_ms();
+    icons_run();
+    t2 = now_ms();
+
+    /* every application once, whatever the directory order */
+    for (found = 0; found < APPS + 1; found ++)
+    {
+        snprintf(name, sizeof(name), "app%03d", found);
+        for (index = 0; index < count; index ++)
+        {
+            if (strcmp(apps[index].name, name) == 0)
+                break;
+        }
+        if (index == count)
+            break;
+        CHECK(strcmp(apps[index].icon + 6, "/icon.png") == 0);
+        CHECK(items[index].name == apps[index].name);
+    }
+    CHECK(found == count);
+
+    /* the first page is shown, the rest waits */
+    for (index = 0; index < count; index ++)
+    {
+        if (index < PAGE_ITEMS)
+        {
+            CHECK(icons[index].state == ICON_SHOWN);
+            CHECK(items[index].image == icons[index].item->image);
+            shown ++;
+        }
+        else
+        {
+            CHECK(icons[index].state == ICON_NONE);
+            CHECK(items[index].image == &exec_image);
+        }
+    }
+    CHECK(icons_decoded == shown);
+
+    printf("%-16s %3d apps: names %5.2fms, first page %5.2fms; %3ld files, %3ld XML, "
+           "%2ld icons decoded\n", what, count, t1 - t0, t2 - t0, files_opened, xml_opened,
+           icons_decoded);
+
+    return count;
+}
+
+static void test_index(void)
+{
+    struct stat st;
+
+    CHECK(boot("no index") == APPS);
+    CHECK(xml_opened == APPS);
+    CHECK(stat(APP_INDEX, &st) == 0 &&
+          st.st_size == sizeof(struct program_index) + APPS * sizeof(struct program_app));
+
+    CHECK(boot("index") == APPS);
+    CHECK(xml_opened == 0);
+
+    /* FAT leaves the time of the directory alone, the names tell */
+    app_create(APPS);
+    CHECK(boot("app added") == APPS + 1);
+    CHECK(xml_opened == APPS + 1);
+    CHECK(boot("index") == APPS + 1);
+    CHECK(xml_opened == 0);
+
+    /* a directory of the same names but a new time */
+    dir_time ++;
+    CHECK(boot("new time") == APPS + 1);
+    CHECK(xml_opened == APPS + 1);
+
+    /* cut short */
+    CHECK(truncate(sim_path(APP_INDEX), sizeof(struct program_index) + 100) == 0);
+    CHECK(boot("broken index") == APPS + 1);
+    CHECK(xml_opened == APPS + 1);
+    CHECK(boot("index") == APPS + 1);
+    CHECK(xml_opened == 0);
+}
+
+static void test_paging(void)
+{
+    int page, index, held;
+
+    boot("paging");
+    icons_held_max = icons_held;
+
+    for (page = 1; page * PAGE_ITEMS < count; page ++)
+    {
+        view.current_item = page * PAGE_ITEMS;
+        program_view_event_handler(RT_NULL, RT_NULL);
+        icons_run();
+
+        held = 0;
+        for (index = 0; index < count; index ++)
+        {
+            if (icons[index].state != ICON_NONE)
+            {
+                CHECK(index / PAGE_ITEMS >= page - 1 && index / PAGE_ITEMS <= page);
+                held ++;
+            }
+        }
+        CHECK(held == icons_held);
+        for (index = page * PAGE_ITEMS; index < count && index < (page + 1) * PAGE_ITEMS; index ++)
+            CHECK(icons[index].state == ICON_SHOWN);
+    }
+    CHECK(icons_held_max <= 2 * PAGE_ITEMS);
+
+    /* back to the first page: its icons are decoded again */
+    view.current_item = 0;
+    program_view_event_handler(RT_NULL, RT_NULL);
+    icons_run();
+    CHECK(icons[0].state == ICON_SHOWN && icons[count - 1].state == ICON_NONE);
+
+    printf("paged through %d apps: at most %ld icons (%ldK) decoded at a time\n", count,
+           icons_held_max, icons_held_max * ICON_SIZE * ICON_SIZE * 2 / 1024);
+
+    launcher_reset();
+    CHECK(icons_held == 0);
+}
+
+int main(void)
+{
+    int app;
+
+    /* the card of the last run, with the application it added */
+    CHECK(system("rm -rf ./SD") == 0);
+    mkdir(sim_path("/SD"), 0755);
+    mkdir(sim_path(APP_PATH), 0755);
+    for (app = 0; app < APPS; app ++)
+        app_create(app);
+
+    test_index();
+    test_paging();
+
+    printf("program_list: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for dfs_posix.h: the DFS calls go to the host file system,
+ * with /SD mapped to the directory the test builds, see sim_path().
+ */
+#ifndef __DFS_POSIX_H__
+#define __DFS_POSIX_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+const char *sim_path(const char *path);
+int sim_stat(const char *path, struct stat *st);
+
+#define DFS_S_ISDIR(mode)       S_ISDIR(mode)
+
+#define open(path, flags, mode) open(sim_path(path), flags, 0644)
+#define unlink(path)            unlink(sim_path(path))
+#define opendir(path)           opendir(sim_path(path))
+#define stat(path, st)          sim_stat(path, st)
+#define dfs_file_stat(path, st) sim_stat(path, st)
+
+#endif
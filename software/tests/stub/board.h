@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for the board.h of the examples: no placement sections,
+ * the intrinsics come from the stand-in device header.
+ */
+#ifndef __BOARD_H__
+#define __BOARD_H__
+
+#include <stm32f4xx.h>
+
+#define SECTION_CCM
+#define SECTION_FASTCODE
+#define SECTION_DMABUF
+#define __packed
+
+#endif
@@ -0,0 +1 @@
+/* Host stand-in: the code under test only needs the POSIX file calls */
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for dfs_posix.h: the files are files of the host. A test
+ * that simulates them has its own stub/dfs_posix.h.
+ */
+#ifndef __DFS_POSIX_H__
+#define __DFS_POSIX_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#endif
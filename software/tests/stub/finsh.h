@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for finsh.h: no shell, the commands are not exported.
+ */
+#ifndef __FINSH_H__
+#define __FINSH_H__
+
+#define FINSH_FUNCTION_EXPORT(name, desc)
+
+#endif
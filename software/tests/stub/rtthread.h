@@ -0,0 +1,134 @@
+/*
+ * Host stand-in for rtthread.h, shared by the tests that do not build
+ * against the kernel headers of programs/rt-thread/include: the types,
+ * error codes and helpers of rtdef.h, the string and console calls of the
+ * C library, and the device and list structures as the kernel has them.
+ *
+ * The heap is declared and left to the test, which may make it fail. A
+ * test whose code needs more of the kernel (IPC, memory pools, modules)
+ * has its own stub/rtthread.h, which includes this one and adds those.
+ * It may also define rt_kprintf before including this one.
+ */
+#ifndef __RT_THREAD_H__
+#define __RT_THREAD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+typedef int8_t          rt_int8_t;
+typedef int16_t         rt_int16_t;
+typedef int32_t         rt_int32_t;
+typedef uint8_t         rt_uint8_t;
+typedef uint16_t        rt_uint16_t;
+typedef uint32_t        rt_uint32_t;
+typedef int             rt_bool_t;
+typedef long            rt_base_t;
+typedef unsigned long   rt_ubase_t;
+typedef rt_base_t       rt_err_t;
+typedef long            rt_time_t;
+typedef rt_uint32_t     rt_tick_t;
+typedef size_t          rt_size_t;
+typedef rt_base_t       rt_off_t;
+
+#define RT_TRUE         1
+#define RT_FALSE        0
+#define RT_NULL         0
+
+#define RT_EOK          0
+#define RT_ERROR        1
+#define RT_ETIMEOUT     2
+#define RT_EFULL        3
+#define RT_EEMPTY       4
+#define RT_ENOMEM       5
+#define RT_ENOSYS       6
+#define RT_EBUSY        7
+#define RT_EIO          8
+
+#define RT_NAME_MAX             8
+#define RT_ALIGN_SIZE           4
+#define RT_TICK_PER_SECOND      100
+#define RT_WAITING_FOREVER      -1
+#define RT_IPC_FLAG_FIFO        0x00
+
+#define RT_ALIGN(size, align)           (((size) + (align) - 1) & ~((align) - 1))
+#define RT_ALIGN_DOWN(size, align)      ((size) & ~((align) - 1))
+#define RT_ASSERT(cond)                 assert(cond)
+
+#define rt_memset       memset
+#define rt_memcpy       memcpy
+#define rt_memmove      memmove
+#define rt_strcmp       strcmp
+#define rt_strncpy      strncpy
+#define rt_snprintf     snprintf
+#ifndef rt_kprintf
+#define rt_kprintf      printf
+#endif
+
+void *rt_malloc(rt_size_t size);
+void *rt_calloc(rt_size_t count, rt_size_t size);
+void *rt_realloc(void *ptr, rt_size_t size);
+void rt_free(void *ptr);
+
+struct rt_list_node
+{
+    struct rt_list_node *next;
+    struct rt_list_node *prev;
+};
+typedef struct rt_list_node rt_list_t;
+
+#define rt_list_entry(node, type, member) \
+    ((type *)((char *)(node) - (unsigned long)(&((type *)0)->member)))
+
+static inline void rt_list_init(rt_list_t *l)
+{
+    l->next = l->prev = l;
+}
+
+static inline void rt_list_insert_after(rt_list_t *l, rt_list_t *n)
+{
+    l->next->prev = n;
+    n->next = l->next;
+    l->next = n;
+    n->prev = l;
+}
+
+static inline void rt_list_remove(rt_list_t *n)
+{
+    n->next->prev = n->prev;
+    n->prev->next = n->next;
+    n->next = n->prev = n;
+}
+
+static inline int rt_list_isempty(const rt_list_t *l)
+{
+    return l->next == l;
+}
+
+#define RT_DEVICE_FLAG_WRONLY       0x002
+#define RT_DEVICE_FLAG_STANDALONE   0x008
+#define RT_DEVICE_FLAG_DMA_TX       0x800
+#define RT_DEVICE_OFLAG_WRONLY      0x002
+#define RT_Device_Class_Sound       8
+
+typedef struct rt_device *rt_device_t;
+struct rt_device
+{
+    int type;
+
+    rt_err_t (*rx_indicate)(rt_device_t dev, rt_size_t size);
+    rt_err_t (*tx_complete)(rt_device_t dev, void *buffer);
+
+    rt_err_t  (*init)   (rt_device_t dev);
+    rt_err_t  (*open)   (rt_device_t dev, rt_uint16_t oflag);
+    rt_err_t  (*close)  (rt_device_t dev);
+    rt_size_t (*read)   (rt_device_t dev, rt_off_t pos, void *buffer, rt_size_t size);
+    rt_size_t (*write)  (rt_device_t dev, rt_off_t pos, const void *buffer, rt_size_t size);
+    rt_err_t  (*control)(rt_device_t dev, rt_uint8_t cmd, void *args);
+
+    void *user_data;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Host stand-in for the device header: the Cortex-M4 intrinsics the DSP
+ * builds take from CMSIS, written in C, so that they can be built and
+ * compared with the generic code on the host. No peripherals; a test that
+ * simulates one has its own stub/stm32f4xx.h.
+ */
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#include <stdint.h>
+
+#define __IO    volatile
+
+static inline int32_t __host_ssat(int32_t x, int bits)
+{
+    int32_t max = (1 << (bits - 1)) - 1;
+
+    return x > max ? max : (x < -max - 1 ? -max - 1 : x);
+}
+#define __SSAT(x, bits) __host_ssat((x), (bits))
+
+static inline uint32_t __SMLAD(uint32_t a, uint32_t b, uint32_t acc)
+{
+    return acc + (int16_t)a * (int16_t)b + (int16_t)(a >> 16) * (int16_t)(b >> 16);
+}
+
+static inline uint32_t __SMLADX(uint32_t a, uint32_t b, uint32_t acc)
+{
+    return acc + (int16_t)a * (int16_t)(b >> 16) + (int16_t)(a >> 16) * (int16_t)b;
+}
+
+static inline uint64_t __SMLALD(uint32_t a, uint32_t b, uint64_t acc)
+{
+    return acc + (int64_t)((int16_t)a * (int32_t)(int16_t)b) +
+        (int64_t)((int16_t)(a >> 16) * (int32_t)(int16_t)(b >> 16));
+}
+
+static inline uint32_t __SADD16(uint32_t a, uint32_t b)
+{
+    return (uint16_t)(a + b) | ((uint32_t)(uint16_t)((a >> 16) + (b >> 16)) << 16);
+}
+
+static inline uint32_t __SSUB16(uint32_t a, uint32_t b)
+{
+    return (uint16_t)(a - b) | ((uint32_t)(uint16_t)((a >> 16) - (b >> 16)) << 16);
+}
+
+static inline uint32_t __QADD16(uint32_t a, uint32_t b)
+{
+    int32_t l = __host_ssat((int16_t)a + (int16_t)b, 16);
+    int32_t r = __host_ssat((int16_t)(a >> 16) + (int16_t)(b >> 16), 16);
+
+    return (uint16_t)l | ((uint32_t)(uint16_t)r << 16);
+}
+
+#define __PKHBT(ARG1, ARG2, ARG3) \
+    ((((uint32_t)(ARG1)) & 0x0000FFFFUL) | ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+
+static inline uint32_t __REV(uint32_t x)
+{
+    return __builtin_bswap32(x);
+}
+
+static inline uint32_t __CLZ(uint32_t x)
+{
+    return x ? __builtin_clz(x) : 32;
+}
+
+#endif
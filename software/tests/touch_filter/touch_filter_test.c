@@ -0,0 +1,392 @@
+/*
+ * Jitter and latency of drivers/touch_filter.c on raw touch samples.
+ *
+ * The filter is included here and built against the kernel headers of the
+ * tree. The raw stream is made from a pen path in ADC steps with gaussian
+ * noise and spikes of 60 steps, the way the controller reads a resistive
+ * screen: a 500ms rest, a 600ms drag, a rest until the release at 1600ms.
+ * It is sampled the way touch.c did before, and the way it does now:
+ *
+ *   - before: 100ms debounce, 8 single conversions per axis at 0.15ms
+ *     each, the middle four of a sort averaged, a batch every 50ms, an 8
+ *     pixel dead zone and two lines printed at 115200 baud,
+ *   - now: the first batch one tick after the press, 8 conversions per
+ *     axis in one transfer of 0.5ms, a batch every tick while the pen
+ *     moves and every 4 ticks after 10 at rest, through touch_filter_feed.
+ *
+ * The timing is that of the code, not measured on the board. It checks
+ * that
+ *
+ *   - touch_median() is the median, for every batch size,
+ *   - a batch with more than a quarter of outliers is dropped, a resting
+ *     pen stays in the dead zone,
+ *   - the filter reports the first position sooner, a resting pen with
+ *     less error and a dragged one with less lag than before,
+ *
+ * and prints the jitter and latency of both.
+ */
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../realtouch/drivers/touch_filter.c"
+
+/* ADC steps per pixel, of the calibration data saved by touch.c */
+#define RAW_PER_PX_X        (1949.0 / 800)
+#define RAW_PER_PX_Y        (1864.0 / 480)
+
+/* the pen, in ms */
+#define T_DRAG0             500
+#define T_DRAG1             1100
+#define T_UP                1600
+
+#define REPORTS_MAX         4096
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+void *rt_memset(void *s, int c, rt_ubase_t count)
+{
+    return memset(s, c, count);
+}
+
+/* only RT_ASSERT prints */
+void rt_kprintf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    exit(1);
+}
+
+static rt_uint32_t lcg = 1;
+
+static double uniform(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return ((lcg >> 8) & 0xFFFFFF) / 16777216.0;
+}
+
+static double gauss(void)
+{
+    double u = uniform() + 1e-9, v = uniform();
+
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* the pen at t ms: rest, drag, rest */
+static void pen(double t, double *x, double *y)
+{
+    double f = t < T_DRAG0 ? 0 : t > T_DRAG1 ? 1 : (t - T_DRAG0) / (T_DRAG1 - T_DRAG0);
+
+    *x = 1000 + 600 * f;
+    *y = 900 - 500 * f;
+}
+
+static double noise_sigma, spike_rate;
+
+/* one conversion */
+static rt_uint16_t convert(double value)
+{
+    value += noise_sigma * gauss();
+    if (uniform() < spike_rate)
+        value += uniform() < 0.5 ? -60 : 60;
+
+    if (value < 0) return 0;
+    if (value > 2047) return 2047;
+    return (rt_uint16_t)(value + 0.5);
+}
+
+/* what is reported, in pixels */
+struct report
+{
+    double t, x, y;
+};
+
+static struct report reports[REPORTS_MAX];
+static int report_count;
+
+static void report(double t, double raw_x, double raw_y)
+{
+    if (report_count == REPORTS_MAX)
+        return;
+
+    reports[report_count].t = t;
+    reports[report_count].x = raw_x / RAW_PER_PX_X;
+    reports[report_count].y = raw_y / RAW_PER_PX_Y;
+    report_count ++;
+}
+
+static int value_compare(const void *a, const void *b)
+{
+    return *(const rt_uint16_t *)a - *(const rt_uint16_t *)b;
+}
+
+/* touch.c before */
+static void run_before(void)
+{
+    rt_uint16_t xs[8], ys[8];
+    double t = 100, shown_x = -1000, shown_y = -1000;
+    double x, y, raw_x, raw_y;
+    int index;
+
+    while (t < T_UP)
+    {
+        for (index = 0; index < 8; index ++)
+        {
+            pen(t, &x, &y);
+            xs[index] = convert(x);
+            ys[index] = convert(y);
+            t += 0.15;
+        }
+        qsort(xs, 8, sizeof(xs[0]), value_compare);
+        qsort(ys, 8, sizeof(ys[0]), value_compare);
+        t += 0.05;
+
+        if (xs[5] - xs[2] <= 10 && ys[5] - ys[2] <= 10)
+        {
+            raw_x = (xs[2] + xs[3] + xs[4] + xs[5]) / 4.0;
+            raw_y = (ys[2] + ys[3] + ys[4] + ys[5]) / 4.0;
+
+            /* the sample, 26 characters at 115200 */
+            t += 26 * 0.087;
+            if (fabs(raw_x / RAW_PER_PX_X - shown_x) > 8 ||
+                    fabs(raw_y / RAW_PER_PX_Y - shown_y) > 8)
+            {
+                shown_x = raw_x / RAW_PER_PX_X;
+                shown_y = raw_y / RAW_PER_PX_Y;
+                report(t, raw_x, raw_y);
+                /* the motion */
+                t += 26 * 0.087;
+            }
+        }
+        t += 50;
+    }
+}
+
+/* touch.c now */
+static void run_now(void)
+{
+    struct touch_filter filter;
+    rt_uint16_t xs[8], ys[8], x_out, y_out;
+    double t = 10, period = 10, start, x, y;
+    int index, rest = 0;
+    rt_err_t result;
+
+    touch_filter_reset(&filter);
+    while (t < T_UP)
+    {
+        start = t;
+        for (index = 0; index < 8; index ++)
+        {
+            pen(t, &x, &y);
+            xs[index] = convert(x);
+            t += 0.032;
+        }
+        for (index = 0; index < 8; index ++)
+        {
+            pen(t, &x, &y);
+            ys[index] = convert(y);
+            t += 0.032;
+        }
+        t += 0.05;
+
+        result = touch_filter_feed(&filter, xs, ys, 8, &x_out, &y_out);
+        if (result == RT_EOK)
+        {
+            report(t, x_out, y_out);
+            rest = 0;
+            period = 10;
+        }
+        else if (result == -RT_EBUSY && ++ rest >= 10)
+            period = 40;
+
+        t = start + period;
+    }
+}
+
+struct quality
+{
+    double first;                   /* ms from the press */
+    int rest_moves;                 /* reported while the pen rests */
+    double rest_rms, rest_max;      /* px from the pen */
+    double lag_mean, lag_max;       /* ms behind the pen while dragged */
+};
+
+/* what the screen shows every ms: the last report */
+static void measure(struct quality *q)
+{
+    double t, s, px, py, shown_x, shown_y, error, best, lag, sq = 0;
+    int index, last = -1, drag = 0, rest = 0;
+
+    memset(q, 0, sizeof(*q));
+    q->first = report_count > 0 ? reports[0].t : T_UP;
+    for (index = 0; index < report_count; index ++)
+    {
+        if ((reports[index].t > 200 && reports[index].t < T_DRAG0) || reports[index].t > T_DRAG1 + 150)
+            q->rest_moves ++;
+    }
+
+    for (t = 0; t < T_UP; t += 1)
+    {
+        while (last + 1 < report_count && reports[last + 1].t <= t)
+            last ++;
+        if (last < 0)
+            continue;
+        shown_x = reports[last].x;
+        shown_y = reports[last].y;
+
+        if (t > T_DRAG0 + 100 && t < T_DRAG1)
+        {
+            /* where the pen was when it was there */
+            best = 1e9;
+            lag = 0;
+            for (s = 0; s < 400; s += 0.5)
+            {
+                pen(t - s, &px, &py);
+                error = hypot(px / RAW_PER_PX_X - shown_x, py / RAW_PER_PX_Y - shown_y);
+                if (error < best)
+                {
+                    best = error;
+                    lag = s;
+                }
+            }
+            q->lag_mean += lag;
+            if (lag > q->lag_max)
+                q->lag_max = lag;
+            drag ++;
+        }
+        else if ((t > 200 && t < T_DRAG0) || t > T_DRAG1 + 150)
+        {
+            pen(t, &px, &py);
+            error = hypot(px / RAW_PER_PX_X - shown_x, py / RAW_PER_PX_Y - shown_y);
+            sq += error * error;
+            if (error > q->rest_max)
+                q->rest_max = error;
+            rest ++;
+        }
+    }
+
+    q->rest_rms = rest ? sqrt(sq / rest) : 0;
+    q->lag_mean = drag ? q->lag_mean / drag : 0;
+}
+
+static void print(const char *what, struct quality *q)
+{
+    printf("  %-7s first %3.0fms | at rest %d moves, error rms %.1fpx, worst %.1fpx | "
+           "dragged %2d reports, lag mean %2.0fms, worst %2.0fms\n", what, q->first,
+           q->rest_moves, q->rest_rms, q->rest_max, report_count, q->lag_mean, q->lag_max);
+}
+
+static void test_stream(double sigma, double spikes)
+{
+    struct quality before, now;
+
+    noise_sigma = sigma;
+    spike_rate = spikes;
+    printf("noise %.0f ADC steps, %.0f%% spikes of 60:\n", sigma, spikes * 100);
+
+    lcg = 1;
+    report_count = 0;
+    run_before();
+    measure(&before);
+    print("before", &before);
+
+    lcg = 1;
+    report_count = 0;
+    run_now();
+    measure(&now);
+    print("now", &now);
+
+    CHECK(now.first <= 20 && now.first < before.first);
+    CHECK(now.rest_rms < 1.5 && now.rest_rms < before.rest_rms);
+    CHECK(now.rest_moves <= 2);
+    CHECK(now.lag_mean < 10 && now.lag_mean < before.lag_mean);
+    CHECK(now.lag_max < 30 && now.lag_max < before.lag_max);
+}
+
+static void test_median(void)
+{
+    rt_uint16_t values[TOUCH_FILTER_BATCH_MAX], sorted[TOUCH_FILTER_BATCH_MAX];
+    int n, round, index;
+
+    for (n = 1; n <= TOUCH_FILTER_BATCH_MAX; n ++)
+    {
+        for (round = 0; round < 1000; round ++)
+        {
+            for (index = 0; index < n; index ++)
+            {
+                /* few distinct values in some rounds, duplicates */
+                values[index] = round % 2 ? uniform() * 4 : uniform() * 2048;
+                sorted[index] = values[index];
+            }
+            qsort(sorted, n, sizeof(sorted[0]), value_compare);
+            CHECK(touch_median(values, n) == sorted[n / 2]);
+        }
+    }
+}
+
+static void test_feed(void)
+{
+    struct touch_filter filter;
+    rt_uint16_t xs[8], ys[8], x, y;
+    int index;
+
+    touch_filter_reset(&filter);
+    for (index = 0; index < 8; index ++)
+    {
+        xs[index] = 1000 + index % 3;
+        ys[index] = 500 + index % 2;
+    }
+    CHECK(touch_filter_feed(&filter, xs, ys, 8, &x, &y) == RT_EOK);
+    CHECK(x >= 1000 && x <= 1002 && y >= 500 && y <= 501);
+
+    /* the same place, and a little off: the dead zone */
+    for (index = 0; index < 8; index ++)
+    {
+        xs[index] = 1003;
+        ys[index] = 499;
+    }
+    CHECK(touch_filter_feed(&filter, xs, ys, 8, &x, &y) == -RT_EBUSY);
+
+    /* three of eight far off: dropped, two: kept */
+    for (index = 0; index < 8; index ++)
+    {
+        xs[index] = index < 3 ? 1500 : 1000;
+        ys[index] = 500;
+    }
+    CHECK(touch_filter_feed(&filter, xs, ys, 8, &x, &y) == -RT_ERROR);
+    for (index = 0; index < 8; index ++)
+    {
+        xs[index] = 1000;
+        ys[index] = index < 2 ? 100 : 500;
+    }
+    CHECK(touch_filter_feed(&filter, xs, ys, 8, &x, &y) != -RT_ERROR);
+
+    /* a jump is followed at once */
+    for (index = 0; index < 8; index ++)
+    {
+        xs[index] = 1800;
+        ys[index] = 200;
+    }
+    CHECK(touch_filter_feed(&filter, xs, ys, 8, &x, &y) == RT_EOK);
+    CHECK(x >= 1800 && y <= 200);
+}
+
+int main(void)
+{
+    test_median();
+    test_feed();
+    test_stream(4, 0.05);
+    test_stream(8, 0.10);
+
+    printf("touch_filter: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
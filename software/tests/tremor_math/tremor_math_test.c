@@ -0,0 +1,873 @@
+/*
+ * Host test of the Tremor math (5_media_ogg/ogg): the Cortex-M4 primitives
+ * of asm_arm.h against the C math of misc.h, and whole decodes.
+ *
+ * The Makefile builds this test three times: with the Cortex-M4 math on
+ * its non-GNU path (what MDK and IAR compile), with the full precision C
+ * math of misc.h, and with _LOW_ACCURACY_, the 32 bit approximation the
+ * board used before. Each build prints
+ *
+ *   - a hash of MULT32, MULT31, MULT31_SHIFT15, XPROD32, XPROD31, XNPROD31
+ *     and CLIP_TO_15 over random and edge operands, except the
+ *     _LOW_ACCURACY_ build whose math is not meant to match,
+ *   - a hash of the PCM of a decode,
+ *
+ * and the Makefile checks that the Cortex-M4 and misc.h builds print the
+ * same. The stream is written by the test: stereo with channel coupling,
+ * 256 and 2048 sample blocks, floor 1 with cascaded partition classes,
+ * residue types 1 and 2 over lattice and explicit VQ books.
+ *
+ * It also checks that
+ *   - the decode has the length the last granule position tells,
+ *   - with -r, the decode is within the SNR bound of the reference PCM,
+ *   - a scratch arena that can not grow makes ov_read() fail with
+ *     OV_EFAULT, and the next ov_read() decodes again.
+ *
+ *   tremor_math_test                   check, print the hashes
+ *   tremor_math_test -o file.pcm       and write the decode
+ *   tremor_math_test -r file.pcm       and compare the decode with it
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ivorbiscodec.h"
+#include "ivorbisfile.h"
+#include "misc.h"
+
+#define RATE            44100
+#define CHANNELS        2
+#define SHORT_BITS      8           /* 256 sample blocks */
+#define LONG_BITS       11          /* 2048 sample blocks */
+#define PACKETS         400
+#define PACKETS_PAGE    4
+#define STREAM_MAX      (1024 * 1024)
+#define PCM_MAX         (PACKETS * 2048 * CHANNELS)
+/* dB, _LOW_ACCURACY_ against full precision; its 8 bit MDCT and window
+   tables keep it near 30 dB */
+#define SNR_MIN         25.0
+
+#define MATH_ROUNDS     2000000
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+static uint32_t lcg = 1;
+
+static uint32_t random_next(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return lcg >> 8;
+}
+
+static int32_t random32(void)
+{
+    return (int32_t)((random_next() << 16) ^ random_next());
+}
+
+/* the heap of the decoder, requests over heap_limit fail */
+static size_t heap_limit = (size_t)-1;
+
+void *rt_malloc(size_t size)
+{
+    return size > heap_limit ? NULL : malloc(size);
+}
+
+void *rt_calloc(size_t count, size_t size)
+{
+    return count * size > heap_limit ? NULL : calloc(count, size);
+}
+
+void *rt_realloc(void *ptr, size_t size)
+{
+    return size > heap_limit ? NULL : realloc(ptr, size);
+}
+
+void rt_free(void *ptr)
+{
+    free(ptr);
+}
+
+static uint32_t hash_add(uint32_t hash, int32_t value)
+{
+    int index;
+
+    for (index = 0; index < 4; index ++)
+    {
+        hash ^= (uint32_t)value >> (index * 8) & 0xff;
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+#ifndef _LOW_ACCURACY_
+/* operands at the ends of the ranges Tremor uses */
+static const int32_t edges[] =
+{
+    0, 1, -1, 2, -2, 0x7fff, -0x8000, 0x8000, 0xffff, 0x10000,
+    0x3fffffff, -0x40000000, 0x7fffffff, -0x7fffffff, 0x12345678, -0x12345678,
+};
+#define EDGES   (int)(sizeof(edges) / sizeof(edges[0]))
+
+/*
+ * MULT31 and the XPROD31 family shift their sum left, which the decoder
+ * keeps inside 32 bits: the data operands stay within 2^30 and (t, v) is a
+ * rotation of Q31 length, like the MDCT twiddles and windows.
+ */
+static void test_math(void)
+{
+    uint32_t mult32 = 2166136261u, mult31 = 2166136261u, shift15 = 2166136261u;
+    uint32_t xprod32 = 2166136261u, xprod31 = 2166136261u, xnprod31 = 2166136261u;
+    uint32_t clip = 2166136261u;
+    int32_t a, b, t, v, x, y;
+    double angle;
+    int round;
+
+    for (round = 0; round < MATH_ROUNDS + EDGES * EDGES; round ++)
+    {
+        if (round < EDGES * EDGES)
+        {
+            x = edges[round / EDGES];
+            y = edges[round % EDGES];
+        }
+        else
+        {
+            x = random32();
+            y = random32();
+        }
+        mult32 = hash_add(mult32, MULT32(x, y));
+        shift15 = hash_add(shift15, MULT31_SHIFT15(x, y));
+        if (!(x == -0x7fffffff - 1 && y == -0x7fffffff - 1))
+            mult31 = hash_add(mult31, MULT31(x >> 1, y));
+
+        a = random32() >> 1;
+        b = random32() >> 1;
+        angle = (random_next() & 0xffff) * (2 * 3.14159265358979 / 65536);
+        t = (int32_t)(cos(angle) * 2147483647.0);
+        v = (int32_t)(sin(angle) * 2147483647.0);
+
+        XPROD32(a, b, t, v, &x, &y);
+        xprod32 = hash_add(hash_add(xprod32, x), y);
+        XPROD31(a, b, t, v, &x, &y);
+        xprod31 = hash_add(hash_add(xprod31, x), y);
+        XNPROD31(a, b, t, v, &x, &y);
+        xnprod31 = hash_add(hash_add(xnprod31, x), y);
+    }
+
+    for (x = -70000; x <= 70000; x ++)
+    {
+        clip = hash_add(clip, CLIP_TO_15(x));
+        CHECK(CLIP_TO_15(x) == (x > 32767 ? 32767 : x < -32768 ? -32768 : x));
+    }
+    for (round = 0; round < EDGES; round ++)
+        clip = hash_add(clip, CLIP_TO_15(edges[round]));
+
+    printf("MULT32         %08x\n", mult32);
+    printf("MULT31         %08x\n", mult31);
+    printf("MULT31_SHIFT15 %08x\n", shift15);
+    printf("XPROD32        %08x\n", xprod32);
+    printf("XPROD31        %08x\n", xprod31);
+    printf("XNPROD31       %08x\n", xnprod31);
+    printf("CLIP_TO_15     %08x\n", clip);
+}
+#endif
+
+/* bits packed least significant first, like oggpack */
+struct bits
+{
+    uint8_t data[16384];
+    long bit;
+};
+
+static void put(struct bits *b, uint32_t value, int count)
+{
+    int index;
+
+    for (index = 0; index < count; index ++, b->bit ++)
+    {
+        if ((b->bit & 7) == 0)
+            b->data[b->bit >> 3] = 0;
+        if (value >> index & 1)
+            b->data[b->bit >> 3] |= 1 << (b->bit & 7);
+    }
+}
+
+static void put_string(struct bits *b, const char *text)
+{
+    while (*text)
+        put(b, *text++, 8);
+}
+
+/* the float32 of the codebook header: mantissa * 2^(exponent - 788) */
+static void put_float(struct bits *b, int mantissa, int exponent)
+{
+    uint32_t value = (uint32_t)abs(mantissa) | (uint32_t)(exponent + 788) << 21;
+
+    if (mantissa < 0)
+        value |= 0x80000000u;
+    put(b, value, 32);
+}
+
+/* the books, codewords are assigned from the lengths as the decoder does */
+#define BOOK_FLOOR      0           /* 64 entries, floor post values */
+#define BOOK_CLASS      1           /* 9 entries, two residue classes of 3 */
+#define BOOK_LATTICE    2           /* 16 entries of 2, values -1.5..1.5 */
+#define BOOK_EXPLICIT   3           /* 32 entries of 4, 8 bit values */
+#define BOOK_MASTER     4           /* 8 entries, floor cascade */
+#define BOOKS           5
+
+struct book
+{
+    int dim, entries;
+    int length[64];
+    uint32_t codeword[64];
+};
+
+static struct book books[BOOKS];
+
+static void book_lengths(struct book *book)
+{
+    uint32_t marker[33];
+    uint32_t entry;
+    int index, length, j;
+
+    memset(marker, 0, sizeof(marker));
+    for (index = 0; index < book->entries; index ++)
+    {
+        length = book->length[index];
+        entry = marker[length];
+        book->codeword[index] = entry;
+
+        for (j = length; j > 0; j --)
+        {
+            if (marker[j] & 1)
+            {
+                if (j == 1)
+                    marker[1] ++;
+                else
+                    marker[j] = marker[j - 1] << 1;
+                break;
+            }
+            marker[j] ++;
+        }
+        for (j = length + 1; j < 33; j ++)
+        {
+            if ((marker[j] >> 1) == entry)
+            {
+                entry = marker[j];
+                marker[j] = marker[j - 1] << 1;
+            }
+            else
+                break;
+        }
+    }
+}
+
+static void book_init(int number, int dim, int entries, int length)
+{
+    struct book *book = &books[number];
+    int index;
+
+    book->dim = dim;
+    book->entries = entries;
+    for (index = 0; index < entries; index ++)
+        book->length[index] = length;
+}
+
+static void setup_books(void)
+{
+    int index;
+
+    book_init(BOOK_FLOOR, 1, 64, 6);
+    /* 7 codewords of 3 bits and 2 of 4 */
+    book_init(BOOK_CLASS, 2, 9, 3);
+    books[BOOK_CLASS].length[7] = books[BOOK_CLASS].length[8] = 4;
+    book_init(BOOK_LATTICE, 2, 16, 4);
+    book_init(BOOK_EXPLICIT, 4, 32, 5);
+    book_init(BOOK_MASTER, 1, 8, 3);
+
+    for (index = 0; index < BOOKS; index ++)
+        book_lengths(&books[index]);
+}
+
+/* a codeword, its first bit is the one the decoder reads first */
+static void put_entry(struct bits *b, int number, int entry)
+{
+    const struct book *book = &books[number];
+    int index;
+
+    for (index = book->length[entry] - 1; index >= 0; index --)
+        put(b, book->codeword[entry] >> index, 1);
+}
+
+static void put_book(struct bits *b, int number)
+{
+    const struct book *book = &books[number];
+    int index;
+
+    put(b, 0x564342, 24);
+    put(b, book->dim, 16);
+    put(b, book->entries, 24);
+    put(b, 0, 1);                   /* unordered */
+    put(b, 0, 1);                   /* not sparse */
+    for (index = 0; index < book->entries; index ++)
+        put(b, book->length[index] - 1, 5);
+
+    if (number == BOOK_LATTICE)
+    {
+        /* lookup type 1: 4 values per dimension */
+        put(b, 1, 4);
+        put_float(b, -3, -1);
+        put_float(b, 1, 0);
+        put(b, 2 - 1, 4);
+        put(b, 0, 1);
+        for (index = 0; index < 4; index ++)
+            put(b, index, 2);
+    }
+    else if (number == BOOK_EXPLICIT)
+    {
+        /* lookup type 2: -8 + value / 16 */
+        put(b, 2, 4);
+        put_float(b, -1, 3);
+        put_float(b, 1, -4);
+        put(b, 8 - 1, 4);
+        put(b, 0, 1);
+        for (index = 0; index < book->entries * book->dim; index ++)
+            put(b, random_next() & 0xff, 8);
+    }
+    else
+    {
+        put(b, 0, 4);
+    }
+}
+
+/*
+ * Floor 1 of a block size: partitions of class 0 (2 posts, no cascade) and
+ * class 1 (3 posts, a master book choosing between no book and the post
+ * book for each), multiplier 2 so posts are 7 bits.
+ */
+static const int floor_classes[2][4] = {{0, 1}, {0, 1, 0, 1}};
+static const int floor_partitions[2] = {2, 4};
+static const int floor_rangebits[2] = {SHORT_BITS - 1, LONG_BITS - 1};
+
+static void put_floor(struct bits *b, int block)
+{
+    int index, posts, x;
+    int used[1 << LONG_BITS];
+
+    put(b, 1, 16);                  /* floor type 1 */
+    put(b, floor_partitions[block], 5);
+    for (index = 0; index < floor_partitions[block]; index ++)
+        put(b, floor_classes[block][index], 4);
+
+    /* class 0 */
+    put(b, 2 - 1, 3);
+    put(b, 0, 2);
+    put(b, BOOK_FLOOR + 1, 8);
+    /* class 1 */
+    put(b, 3 - 1, 3);
+    put(b, 1, 2);
+    put(b, BOOK_MASTER, 8);
+    put(b, 0, 8);                   /* no book: the post is predicted */
+    put(b, BOOK_FLOOR + 1, 8);
+
+    put(b, 2 - 1, 2);
+    put(b, floor_rangebits[block], 4);
+
+    memset(used, 0, sizeof(used));
+    posts = 0;
+    for (index = 0; index < floor_partitions[block]; index ++)
+        posts += floor_classes[block][index] ? 3 : 2;
+    for (index = 0; index < posts; index ++)
+    {
+        do
+            x = 1 + random_next() % ((1 << floor_rangebits[block]) - 1);
+        while (used[x]);
+        used[x] = 1;
+        put(b, x, floor_rangebits[block]);
+    }
+}
+
+/*
+ * Residues: three classes, none, the lattice book, and the lattice then
+ * the explicit book. Type 1 for short blocks, each channel apart, type 2
+ * for long ones, the channels interleaved.
+ */
+#define RESIDUE_CLASSES 3
+static const int residue_type[2] = {1, 2};
+static const int residue_grouping[2] = {16, 32};
+
+static int residue_end(int block)
+{
+    int end = 1 << ((block ? LONG_BITS : SHORT_BITS) - 1);
+
+    return residue_type[block] == 2 ? end * CHANNELS : end;
+}
+
+static void put_residue(struct bits *b, int block)
+{
+    put(b, residue_type[block], 16);
+    put(b, 0, 24);
+    put(b, residue_end(block), 24);
+    put(b, residue_grouping[block] - 1, 24);
+    put(b, RESIDUE_CLASSES - 1, 6);
+    put(b, BOOK_CLASS, 8);
+
+    put(b, 0, 3); put(b, 0, 1);     /* class 0: no stage */
+    put(b, 1, 3); put(b, 0, 1);     /* class 1: stage 0 */
+    put(b, 3, 3); put(b, 0, 1);     /* class 2: stages 0 and 1 */
+
+    put(b, BOOK_LATTICE, 8);
+    put(b, BOOK_LATTICE, 8);
+    put(b, BOOK_EXPLICIT, 8);
+}
+
+static void put_mapping(struct bits *b, int block)
+{
+    put(b, 0, 16);                  /* mapping type 0 */
+    put(b, 0, 1);                   /* one submap */
+    put(b, 1, 1);                   /* coupling */
+    put(b, 1 - 1, 8);
+    put(b, 0, 1);                   /* magnitude: channel 0 */
+    put(b, 1, 1);                   /* angle: channel 1 */
+    put(b, 0, 2);
+    put(b, 0, 8);
+    put(b, block, 8);               /* floor */
+    put(b, block, 8);               /* residue */
+}
+
+static void header_id(struct bits *b)
+{
+    b->bit = 0;
+    put(b, 1, 8);
+    put_string(b, "vorbis");
+    put(b, 0, 32);
+    put(b, CHANNELS, 8);
+    put(b, RATE, 32);
+    put(b, 0, 32);
+    put(b, 128000, 32);
+    put(b, 0, 32);
+    put(b, SHORT_BITS, 4);
+    put(b, LONG_BITS, 4);
+    put(b, 1, 1);
+}
+
+static void header_comment(struct bits *b)
+{
+    b->bit = 0;
+    put(b, 3, 8);
+    put_string(b, "vorbis");
+    put(b, 9, 32);
+    put_string(b, "realtouch");
+    put(b, 1, 32);
+    put(b, 12, 32);
+    put_string(b, "TITLE=noise!");
+    put(b, 1, 1);
+}
+
+static void header_setup(struct bits *b)
+{
+    int index;
+
+    b->bit = 0;
+    put(b, 5, 8);
+    put_string(b, "vorbis");
+
+    put(b, BOOKS - 1, 8);
+    for (index = 0; index < BOOKS; index ++)
+        put_book(b, index);
+
+    put(b, 0, 6);                   /* time domain transforms */
+    put(b, 0, 16);
+
+    put(b, 2 - 1, 6);
+    put_floor(b, 0);
+    put_floor(b, 1);
+    put(b, 2 - 1, 6);
+    put_residue(b, 0);
+    put_residue(b, 1);
+    put(b, 2 - 1, 6);
+    put_mapping(b, 0);
+    put_mapping(b, 1);
+
+    put(b, 2 - 1, 6);               /* modes */
+    for (index = 0; index < 2; index ++)
+    {
+        put(b, index, 1);
+        put(b, 0, 16);
+        put(b, 0, 16);
+        put(b, index, 8);
+    }
+    put(b, 1, 1);
+}
+
+/* the floor of one channel: the end posts, then each partition */
+static void put_floor_packet(struct bits *b, int block)
+{
+    int index, k, cval;
+
+    put(b, 1, 1);
+    put(b, 45 + random_next() % 30, 7);
+    put(b, 45 + random_next() % 30, 7);
+
+    for (index = 0; index < floor_partitions[block]; index ++)
+    {
+        if (floor_classes[block][index] == 0)
+        {
+            put_entry(b, BOOK_FLOOR, random_next() % 16);
+            put_entry(b, BOOK_FLOOR, random_next() % 16);
+        }
+        else
+        {
+            cval = random_next() % 8;
+            put_entry(b, BOOK_MASTER, cval);
+            for (k = 0; k < 3; k ++, cval >>= 1)
+            {
+                if (cval & 1)
+                    put_entry(b, BOOK_FLOOR, random_next() % 16);
+            }
+        }
+    }
+}
+
+static void put_partition(struct bits *b, int class, int stage, int values)
+{
+    int index;
+
+    if (stage == 0 && class >= 1)
+    {
+        for (index = 0; index < values / books[BOOK_LATTICE].dim; index ++)
+            put_entry(b, BOOK_LATTICE, random_next() % 16);
+    }
+    if (stage == 1 && class == 2)
+    {
+        for (index = 0; index < values / books[BOOK_EXPLICIT].dim; index ++)
+            put_entry(b, BOOK_EXPLICIT, random_next() % 32);
+    }
+}
+
+static void put_residue_packet(struct bits *b, int block)
+{
+    int classes[CHANNELS][128];
+    int grouping = residue_grouping[block];
+    int partitions = residue_end(block) / grouping;
+    int channels = residue_type[block] == 2 ? 1 : CHANNELS;
+    int stage, index, k, j;
+
+    for (j = 0; j < channels; j ++)
+    {
+        for (index = 0; index < partitions; index ++)
+            classes[j][index] = random_next() % RESIDUE_CLASSES;
+    }
+
+    for (stage = 0; stage < 2; stage ++)
+    {
+        for (index = 0; index < partitions; index += 2)
+        {
+            if (stage == 0)
+            {
+                for (j = 0; j < channels; j ++)
+                    put_entry(b, BOOK_CLASS, classes[j][index] * 3 + classes[j][index + 1]);
+            }
+            for (k = index; k < index + 2; k ++)
+            {
+                for (j = 0; j < channels; j ++)
+                    put_partition(b, classes[j][k], stage, grouping);
+            }
+        }
+    }
+}
+
+/* an Ogg stream in memory */
+static uint8_t stream[STREAM_MAX];
+static long stream_size;
+static long page_sequence;
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+    uint32_t r;
+    int index, bit;
+
+    for (index = 0; index < 256; index ++)
+    {
+        r = (uint32_t)index << 24;
+        for (bit = 0; bit < 8; bit ++)
+            r = r & 0x80000000u ? r << 1 ^ 0x04c11db7 : r << 1;
+        crc_table[index] = r;
+    }
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+/* one page of whole packets */
+static void page(struct bits *packets, int count, int flags, int64_t granule)
+{
+    uint8_t *head = stream + stream_size;
+    uint8_t *body;
+    uint32_t crc = 0;
+    long bytes, length, index;
+    int segments = 0, p;
+
+    for (p = 0; p < count; p ++)
+        segments += (packets[p].bit + 7) / 8 / 255 + 1;
+
+    memcpy(head, "OggS", 4);
+    head[4] = 0;
+    head[5] = flags;
+    put32(head + 6, (uint32_t)granule);
+    put32(head + 10, (uint32_t)(granule >> 32));
+    put32(head + 14, 0x52545454);
+    put32(head + 18, page_sequence ++);
+    put32(head + 22, 0);
+    head[26] = segments;
+
+    segments = 0;
+    body = head + 27 + head[26];
+    for (p = 0; p < count; p ++)
+    {
+        length = (packets[p].bit + 7) / 8;
+        for (bytes = length; bytes >= 255; bytes -= 255)
+            head[27 + segments ++] = 255;
+        head[27 + segments ++] = bytes;
+        memcpy(body, packets[p].data, length);
+        body += length;
+    }
+
+    for (index = 0; index < body - head; index ++)
+        crc = crc << 8 ^ crc_table[(crc >> 24 & 0xff) ^ head[index]];
+    put32(head + 22, crc);
+
+    stream_size += body - head;
+}
+
+static struct bits packets[PACKETS_PAGE];
+
+/* write the stream, returns the samples a decode gives */
+static long make_stream(void)
+{
+    int64_t granule = 0;
+    int blocks[PACKETS + 1];
+    int index, p, flags, block, size, last = 0;
+
+    /* the same stream with or without test_math() */
+    lcg = 1;
+    stream_size = 0;
+    page_sequence = 0;
+    crc_init();
+    setup_books();
+
+    header_id(&packets[0]);
+    page(packets, 1, 0x02, 0);
+    header_comment(&packets[0]);
+    header_setup(&packets[1]);
+    page(packets, 2, 0, 0);
+
+    /* runs of long and short blocks */
+    for (index = 0; index < PACKETS; index ++)
+        blocks[index] = index == 0 || random_next() % 4 ? (index > 0 ? blocks[index - 1] : 1) :
+                        !blocks[index - 1];
+    blocks[PACKETS] = 0;
+
+    for (index = 0, p = 0; index < PACKETS; index ++)
+    {
+        struct bits *b = &packets[p];
+        int channel;
+
+        block = blocks[index];
+        b->bit = 0;
+        put(b, 0, 1);
+        put(b, block, 1);
+        if (block)
+        {
+            put(b, index > 0 ? blocks[index - 1] : 0, 1);
+            put(b, blocks[index + 1], 1);
+        }
+        for (channel = 0; channel < CHANNELS; channel ++)
+            put_floor_packet(b, block);
+        put_residue_packet(b, block);
+
+        /* the first block only primes the overlap */
+        size = 1 << (block ? LONG_BITS : SHORT_BITS);
+        if (index > 0)
+            granule += last / 4 + size / 4;
+        last = size;
+
+        if (++ p == PACKETS_PAGE || index == PACKETS - 1)
+        {
+            flags = index == PACKETS - 1 ? 0x04 : 0;
+            page(packets, p, flags, granule);
+            p = 0;
+        }
+    }
+
+    return (long)granule;
+}
+
+/* the stream as the datasource of vorbisfile */
+static long stream_position;
+
+static size_t stream_read(void *ptr, size_t size, size_t count, void *source)
+{
+    long bytes = size * count;
+
+    if (bytes > stream_size - stream_position)
+        bytes = stream_size - stream_position;
+    memcpy(ptr, stream + stream_position, bytes);
+    stream_position += bytes;
+    return bytes;
+}
+
+static int stream_seek(void *source, ogg_int64_t offset, int whence)
+{
+    if (whence == SEEK_CUR)
+        offset += stream_position;
+    else if (whence == SEEK_END)
+        offset += stream_size;
+    if (offset < 0 || offset > stream_size)
+        return -1;
+    stream_position = offset;
+    return 0;
+}
+
+static int stream_close(void *source)
+{
+    return 0;
+}
+
+static long stream_tell(void *source)
+{
+    return stream_position;
+}
+
+static const ov_callbacks stream_callbacks =
+{
+    stream_read, stream_seek, stream_close, stream_tell
+};
+
+static int16_t pcm[PCM_MAX];
+
+static long decode(long expected)
+{
+    OggVorbis_File vf;
+    uint32_t hash = 2166136261u;
+    long samples = 0, ret;
+    int section, index;
+
+    stream_position = 0;
+    CHECK(ov_open_callbacks((void *)1, &vf, NULL, 0, stream_callbacks) == 0);
+    CHECK(vf.vi.channels == CHANNELS && vf.vi.rate == RATE);
+    CHECK(strcmp(vorbis_comment_query(&vf.vc, "title", 0), "noise!") == 0);
+
+    while ((ret = ov_read(&vf, pcm + samples * CHANNELS,
+                          (PCM_MAX - samples * CHANNELS) * 2, &section)) > 0)
+        samples += ret / 2 / CHANNELS;
+    CHECK(ret == 0);
+    CHECK(samples == expected);
+    ov_clear(&vf);
+
+    for (index = 0; index < samples * CHANNELS; index ++)
+        hash = hash_add(hash, pcm[index]);
+    printf("decode         %08x, %ld samples\n", hash, samples);
+
+    return samples;
+}
+
+/* signal to noise of the decode against a reference */
+static void compare(const char *name, long samples)
+{
+    static int16_t reference[PCM_MAX];
+    double signal = 0, noise = 0, snr;
+    FILE *file;
+    long index;
+    int peak = 0;
+
+    file = fopen(name, "rb");
+    CHECK(file != NULL);
+    if (file == NULL)
+        return;
+    CHECK((long)fread(reference, 2, PCM_MAX, file) == samples * CHANNELS);
+    fclose(file);
+
+    for (index = 0; index < samples * CHANNELS; index ++)
+    {
+        signal += (double)reference[index] * reference[index];
+        noise += (double)(pcm[index] - reference[index]) * (pcm[index] - reference[index]);
+        if (abs(reference[index]) > peak)
+            peak = abs(reference[index]);
+    }
+    snr = 10 * log10(signal / (noise > 0 ? noise : 1));
+    printf("against %s: %.1f dB SNR, peak %d\n", name, snr, peak);
+    CHECK(snr >= SNR_MIN);
+    /* loud, but not clipped */
+    CHECK(peak > 4000 && peak < 32767);
+}
+
+/* the scratch arena can not take a chunk: ov_read fails, then recovers */
+static void test_scratch_exhausted(void)
+{
+    OggVorbis_File vf;
+    long ret;
+    int section;
+
+    stream_position = 0;
+    CHECK(ov_open_callbacks((void *)1, &vf, NULL, 0, stream_callbacks) == 0);
+    CHECK(ov_read(&vf, pcm, sizeof(pcm), &section) > 0);
+
+    ogg_arena_clear(&vf.scratch_arena);
+    heap_limit = 64 * 1024;
+    vf.scratch_arena.chunk_size = heap_limit + 1;
+    do
+        ret = ov_read(&vf, pcm, sizeof(pcm), &section);
+    while (ret > 0);
+    CHECK(ret == OV_EFAULT);
+
+    vf.scratch_arena.chunk_size = 4096;
+    CHECK(ov_read(&vf, pcm, sizeof(pcm), &section) > 0);
+    heap_limit = (size_t)-1;
+    ov_clear(&vf);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL, *reference = NULL;
+    long expected, samples;
+    FILE *file;
+
+    if (argc == 3 && strcmp(argv[1], "-o") == 0)
+        output = argv[2];
+    else if (argc == 3 && strcmp(argv[1], "-r") == 0)
+        reference = argv[2];
+
+#ifndef _LOW_ACCURACY_
+    test_math();
+#endif
+
+    expected = make_stream();
+    samples = decode(expected);
+    if (output != NULL)
+    {
+        file = fopen(output, "wb");
+        CHECK(file != NULL && (long)fwrite(pcm, 2, samples * CHANNELS, file) == samples * CHANNELS);
+        if (file != NULL)
+            fclose(file);
+    }
+    if (reference != NULL)
+        compare(reference, samples);
+
+    test_scratch_exhausted();
+
+    printf("tremor_math: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
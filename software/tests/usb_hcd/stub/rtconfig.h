@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for rtconfig.h: the kernel of realtouch with the USB host
+ * stack, which the board leaves out.
+ */
+#ifndef __RTTHREAD_CFG_H__
+#include "../../../realtouch/rtconfig.h"
+
+#define RT_USING_USB_HOST
+#endif
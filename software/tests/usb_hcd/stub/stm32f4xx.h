@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for stm32f4xx.h: the registers of the OTG core are read
+ * and written through the test's model of it, see usb_conf.h.
+ */
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#include <stdint.h>
+
+#define __IO    volatile
+
+uint32_t sim_reg_read(uintptr_t addr);
+void sim_reg_write(uintptr_t addr, uint32_t value);
+
+#endif
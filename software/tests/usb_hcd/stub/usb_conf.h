@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for usb_conf.h: the one of realtouch, and the register
+ * accessors of the OTG library redirected to the test's model of the core.
+ */
+#ifndef __SIM_USB_CONF_H__
+#define __SIM_USB_CONF_H__
+
+#include "../../../realtouch/drivers/usb_conf.h"
+#include "../../../realtouch/STM32F4xx_Libraries/STM32_USB_OTG_Driver/inc/usb_defines.h"
+
+#undef USB_OTG_READ_REG32
+#undef USB_OTG_WRITE_REG32
+#define USB_OTG_READ_REG32(reg)         sim_reg_read((uintptr_t)(reg))
+#define USB_OTG_WRITE_REG32(reg, value) sim_reg_write((uintptr_t)(reg), (value))
+
+#endif
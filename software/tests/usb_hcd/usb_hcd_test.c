@@ -0,0 +1,1097 @@
+/*
+ * Throughput and CPU time of USB mass storage reads and writes through
+ * drivers/stm32f4xx_hcd.c, on a model of the OTG_FS core.
+ *
+ * The driver and the ST OTG and host libraries are built from the tree;
+ * their register accesses go through sim_reg_read() and sim_reg_write(),
+ * which run the model and charge CPU time. The bus runs on a clock of its
+ * own: 1ms frames, packets and NAK handshakes take bus time, the device
+ * NAKs IN tokens until its data is ready and OUT data while it programs
+ * its flash. The core raises the channel, receive FIFO and SOF interrupts
+ * and the driver's interrupt handler runs on them. A thread waiting on a
+ * semaphore is idle, everything else is CPU time.
+ *
+ * The model costs are estimates, not measured on the board:
+ *
+ *   - 40ns a register access, 800ns to enter an interrupt, 2us for a
+ *     semaphore and a context switch, 5us of class code a command,
+ *   - full speed at 96ns a bit with stuffing, 4us for a NAK or a SOF,
+ *   - 300us from the command to the first data read, 6.6MB/s off the
+ *     flash, 1.5ms to program a 4K page.
+ *
+ * It reads and writes 4K and 32K commands and checks that
+ *
+ *   - every byte arrives as the device sent it, the data toggles match
+ *     and the transmit FIFO never overflows,
+ *   - reads run at least at 850KB/s and writes at 600KB/s,
+ *   - the CPU is busy less than 10% of the time,
+ *
+ * and prints the throughput and the CPU time of each.
+ */
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rtthread.h>
+#include <rtdevice.h>
+#include "usb_core.h"
+#include "usb_hcd.h"
+#include "usbh_core.h"
+
+#define NS_US           1000ULL
+#define NS_MS           1000000ULL
+
+/* CPU */
+#define REG_NS          40
+#define ISR_ENTRY_NS    800
+#define POLL_NS         60              /* a turn of a HCD_GetURB_State() loop */
+#define CALL_NS         500             /* USBH_Bulk*Data() */
+#define SEM_NS          2000
+#define CLASS_NS        5000
+
+/* bus, full speed */
+#define PACKET_OVERHEAD 14
+#define BIT_NS          96
+#define NAK_NS          4000
+#define SOF_NS          4000
+#define EOF_GUARD_NS    10000
+
+/* device */
+#define READ_LATENCY_NS (300 * NS_US)
+#define MEDIA_NS_BYTE   150
+#define WRITE_PAGE      4096
+#define WRITE_BUSY_NS   (1500 * NS_US)
+#define SECTOR          512
+
+#define CHANNEL_MAX     8
+#define RX_QUEUE        16
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+static uint64_t now;
+static int in_isr, irq_off, sleeping;
+static uint64_t time_thread, time_isr, time_idle;
+static unsigned long isr_count;
+
+static void irq_check(void);
+
+/*
+ * The core: its host channels, the receive FIFO and the transaction on
+ * the bus.
+ */
+struct channel
+{
+    USB_OTG_HCCHAR_TypeDef hcchar;
+    USB_OTG_HCTSIZn_TypeDef hctsiz;
+    rt_uint32_t hcint, hcintmsk;
+
+    int active;                 /* enabled and not waiting for the software */
+    int halting;
+    uint64_t halt_at;
+
+    /* OUT data in the non-periodic transmit FIFO */
+    rt_uint8_t tx[512];
+    int tx_len;
+};
+
+static struct channel channels[CHANNEL_MAX];
+static rt_uint32_t gintmsk, haintmsk, sof_pending;
+static uint64_t frame_start;
+static rt_uint32_t frame_number;
+
+struct rx_entry
+{
+    rt_uint32_t status;
+    rt_uint8_t data[64];
+    int len;
+};
+
+static struct rx_entry rx_queue[RX_QUEUE];
+static int rx_head, rx_count, rx_words;
+static rt_uint8_t rx_current[68];
+static int rx_pos;
+
+/* the channel on the bus, -2 for a SOF */
+static int busy_channel = -1;
+static uint64_t busy_end;
+static int round_robin;
+
+static unsigned long toggle_errors, fifo_overflows;
+
+/* the device, bulk-only mass storage */
+enum
+{
+    PHASE_CBW,
+    PHASE_DATA_IN,
+    PHASE_DATA_OUT,
+    PHASE_CSW,
+};
+
+static struct
+{
+    int phase;
+    rt_uint8_t cbw[31];
+    int cbw_len;
+    rt_uint32_t lba, tag;
+    int remaining, done;
+    uint64_t ready_at;
+    rt_uint8_t csw[13];
+    int toggle_in, toggle_out;
+    int page_fill;
+    unsigned long write_errors;
+} device;
+
+static rt_uint8_t pattern(rt_uint32_t lba, int offset)
+{
+    return (rt_uint8_t)(lba * 31 + offset * 7 + (offset >> 8));
+}
+
+static void device_csw(void)
+{
+    memset(device.csw, 0, sizeof(device.csw));
+    memcpy(device.csw, "USBS", 4);
+    memcpy(device.csw + 4, &device.tag, 4);
+    device.phase = PHASE_CSW;
+}
+
+/* an OUT packet, 0 for ACK, -1 for NAK */
+static int device_out(const rt_uint8_t *data, int len, int pid)
+{
+    rt_uint32_t blocks;
+    int index, offset;
+
+    if (device.phase == PHASE_DATA_OUT && now < device.ready_at)
+        return -1;
+
+    if ((pid == HC_PID_DATA1) != device.toggle_out)
+    {
+        /* a retransmission as far as the device knows: acknowledged, dropped */
+        toggle_errors ++;
+        return 0;
+    }
+    device.toggle_out ^= 1;
+
+    if (device.phase == PHASE_CBW)
+    {
+        memcpy(device.cbw + device.cbw_len, data, len);
+        device.cbw_len += len;
+        if (device.cbw_len < 31)
+            return 0;
+
+        device.cbw_len = 0;
+        memcpy(&device.tag, device.cbw + 4, 4);
+        device.lba = ((rt_uint32_t)device.cbw[17] << 24) | (device.cbw[18] << 16) |
+                     (device.cbw[19] << 8) | device.cbw[20];
+        blocks = (device.cbw[22] << 8) | device.cbw[23];
+        device.remaining = blocks * SECTOR;
+        device.done = 0;
+        if (device.cbw[15] == 0x28)
+        {
+            device.phase = PHASE_DATA_IN;
+            device.ready_at = now + READ_LATENCY_NS;
+        }
+        else
+        {
+            device.phase = PHASE_DATA_OUT;
+            device.ready_at = now;
+            device.page_fill = 0;
+        }
+        return 0;
+    }
+
+    if (device.phase == PHASE_DATA_OUT)
+    {
+        for (index = 0; index < len; index ++)
+        {
+            offset = device.done + index;
+            if (data[index] != (rt_uint8_t)~pattern(device.lba + offset / SECTOR, offset % SECTOR))
+                device.write_errors ++;
+        }
+        device.done += len;
+        device.remaining -= len;
+        device.page_fill += len;
+        if (device.page_fill >= WRITE_PAGE)
+        {
+            device.page_fill = 0;
+            device.ready_at = now + WRITE_BUSY_NS;
+        }
+        if (device.remaining <= 0)
+        {
+            device_csw();
+            device.ready_at = now + WRITE_BUSY_NS;
+        }
+    }
+
+    return 0;
+}
+
+/* an IN token, the bytes sent or -1 for NAK */
+static int device_in(rt_uint8_t *data, int mps)
+{
+    uint64_t available;
+    int len, index, offset;
+
+    if (now < device.ready_at)
+        return -1;
+
+    if (device.phase == PHASE_DATA_IN)
+    {
+        len = device.remaining < mps ? device.remaining : mps;
+        available = (now - device.ready_at) / MEDIA_NS_BYTE;
+        if (available < (uint64_t)(device.done + len))
+            return -1;
+
+        for (index = 0; index < len; index ++)
+        {
+            offset = device.done + index;
+            data[index] = pattern(device.lba + offset / SECTOR, offset % SECTOR);
+        }
+        device.done += len;
+        device.remaining -= len;
+        if (device.remaining == 0)
+            device_csw();
+        return len;
+    }
+
+    if (device.phase == PHASE_CSW)
+    {
+        memcpy(data, device.csw, 13);
+        device.phase = PHASE_CBW;
+        return 13;
+    }
+
+    return -1;
+}
+
+static uint64_t packet_ns(int len)
+{
+    return (uint64_t)(len + PACKET_OVERHEAD) * 8 * BIT_NS;
+}
+
+static int channel_is_in(int n)
+{
+    return channels[n].hcchar.b.epdir;
+}
+
+/* the length of the next OUT packet */
+static int channel_out_len(int n)
+{
+    struct channel *c = &channels[n];
+
+    return c->hctsiz.b.xfersize < c->hcchar.b.mps ? c->hctsiz.b.xfersize : c->hcchar.b.mps;
+}
+
+static int channel_ready(int n)
+{
+    struct channel *c = &channels[n];
+
+    if (!c->active || c->halting || c->hctsiz.b.pktcnt == 0)
+        return 0;
+
+    if (channel_is_in(n))
+        return rx_count < RX_QUEUE - 2 && rx_words + 16 <= RX_FIFO_FS_SIZE;
+
+    return c->tx_len >= channel_out_len(n);
+}
+
+static void rx_push(rt_uint32_t status, const rt_uint8_t *data, int len)
+{
+    struct rx_entry *entry = &rx_queue[(rx_head + rx_count) % RX_QUEUE];
+
+    entry->status = status;
+    entry->len = len;
+    if (len > 0)
+        memcpy(entry->data, data, len);
+    rx_count ++;
+    rx_words += (len + 3) / 4;
+}
+
+static void channel_halted(int n)
+{
+    struct channel *c = &channels[n];
+
+    c->hcchar.b.chen = 0;
+    c->hcchar.b.chdis = 0;
+    c->active = 0;
+    c->halting = 0;
+    /* the core flushes what the channel had posted */
+    c->tx_len = 0;
+    c->hcint |= 1 << 1;
+}
+
+static void pid_toggle(struct channel *c)
+{
+    c->hctsiz.b.pid = c->hctsiz.b.pid == HC_PID_DATA1 ? HC_PID_DATA0 : HC_PID_DATA1;
+}
+
+/* the end of a transaction on channel n */
+static void transaction_end(int n)
+{
+    struct channel *c = &channels[n];
+    USB_OTG_HCINTn_TypeDef hcint;
+    USB_OTG_GRXFSTS_TypeDef status;
+    rt_uint8_t data[64];
+    int mps = c->hcchar.b.mps, len;
+
+    hcint.d32 = 0;
+    if (channel_is_in(n))
+    {
+        len = device_in(data, mps);
+        if (len < 0)
+        {
+            hcint.b.nak = 1;
+            /* the interrupt handler enables it again */
+            c->active = 0;
+        }
+        else if ((c->hctsiz.b.pid == HC_PID_DATA1) != device.toggle_in)
+        {
+            toggle_errors ++;
+            hcint.b.datatglerr = 1;
+            c->active = 0;
+        }
+        else
+        {
+            device.toggle_in ^= 1;
+
+            status.d32 = 0;
+            status.b.chnum = n;
+            status.b.bcnt = len;
+            status.b.pktsts = 2;
+            rx_push(status.d32, data, len);
+
+            c->hctsiz.b.pktcnt --;
+            c->hctsiz.b.xfersize -= len < (int)c->hctsiz.b.xfersize ? len : c->hctsiz.b.xfersize;
+            pid_toggle(c);
+            /* the receive FIFO handler enables it again */
+            c->active = 0;
+            hcint.b.ack = 1;
+            if (c->hctsiz.b.pktcnt == 0 || len < mps)
+            {
+                status.b.pktsts = 3;
+                status.b.bcnt = 0;
+                rx_push(status.d32, RT_NULL, 0);
+                hcint.b.xfercompl = 1;
+            }
+        }
+    }
+    else
+    {
+        len = channel_out_len(n);
+        if (device_out(c->tx, len, c->hctsiz.b.pid) < 0)
+            hcint.b.nak = 1;
+        else
+        {
+            memmove(c->tx, c->tx + len, c->tx_len - len);
+            c->tx_len -= len;
+            c->hctsiz.b.pktcnt --;
+            c->hctsiz.b.xfersize -= len;
+            pid_toggle(c);
+            hcint.b.ack = 1;
+            if (c->hctsiz.b.pktcnt == 0)
+                hcint.b.xfercompl = 1;
+        }
+    }
+    c->hcint |= hcint.d32;
+}
+
+static uint64_t frame_end(void)
+{
+    return frame_start + NS_MS;
+}
+
+/* the next channel to go on the bus, if its packet fits the frame */
+static int channel_pick(void)
+{
+    int index, n, len;
+
+    for (index = 0; index < CHANNEL_MAX; index ++)
+    {
+        n = (round_robin + index) % CHANNEL_MAX;
+        if (!channel_ready(n))
+            continue;
+
+        len = channel_is_in(n) ? channels[n].hcchar.b.mps : channel_out_len(n);
+        if (now + packet_ns(len) + EOF_GUARD_NS > frame_end())
+            return -1;
+        return n;
+    }
+
+    return -1;
+}
+
+static uint64_t next_event(void)
+{
+    uint64_t t = frame_end();
+    int index;
+
+    for (index = 0; index < CHANNEL_MAX; index ++)
+    {
+        if (channels[index].halting && busy_channel != index && channels[index].halt_at < t)
+            t = channels[index].halt_at;
+    }
+    if (busy_channel != -1)
+        return busy_end < t ? busy_end : t;
+    if (channel_pick() >= 0 && now < t)
+        t = now;
+
+    return t;
+}
+
+static void bus_event(void)
+{
+    struct channel *c;
+    int index, n, len;
+
+    if (busy_channel == -2 && busy_end <= now)
+    {
+        busy_channel = -1;
+        return;
+    }
+    if (busy_channel >= 0 && busy_end <= now)
+    {
+        n = busy_channel;
+        busy_channel = -1;
+        transaction_end(n);
+        return;
+    }
+    for (index = 0; index < CHANNEL_MAX; index ++)
+    {
+        if (channels[index].halting && channels[index].halt_at <= now && busy_channel != index)
+        {
+            channel_halted(index);
+            return;
+        }
+    }
+    if (now >= frame_end())
+    {
+        frame_start += NS_MS;
+        frame_number ++;
+        sof_pending = 1;
+        if (busy_channel < 0)
+        {
+            busy_channel = -2;
+            busy_end = now + SOF_NS;
+        }
+        return;
+    }
+    if (busy_channel == -1 && (n = channel_pick()) >= 0)
+    {
+        c = &channels[n];
+        round_robin = n + 1;
+        busy_channel = n;
+
+        /* a NAK or the data, decided at the end */
+        if (now < device.ready_at && (channel_is_in(n) || device.phase == PHASE_DATA_OUT))
+            busy_end = now + NAK_NS;
+        else
+        {
+            len = channel_is_in(n) ? c->hcchar.b.mps : channel_out_len(n);
+            busy_end = now + packet_ns(len);
+        }
+    }
+}
+
+static rt_uint32_t haint(void)
+{
+    rt_uint32_t value = 0;
+    int index;
+
+    for (index = 0; index < CHANNEL_MAX; index ++)
+    {
+        if (channels[index].hcint & channels[index].hcintmsk)
+            value |= 1 << index;
+    }
+
+    return value;
+}
+
+static rt_uint32_t gintsts(void)
+{
+    USB_OTG_GINTSTS_TypeDef value;
+
+    value.d32 = 0;
+    value.b.curmode = 1;
+    value.b.sofintr = sof_pending;
+    value.b.rxstsqlvl = rx_count > 0;
+    value.b.nptxfempty = 1;
+    value.b.hcintr = (haint() & haintmsk) != 0;
+
+    return value.d32;
+}
+
+static void account(uint64_t ns)
+{
+    if (in_isr)
+        time_isr += ns;
+    else if (sleeping)
+        time_idle += ns;
+    else
+        time_thread += ns;
+}
+
+/* runs the bus until end */
+static void advance_to(uint64_t end)
+{
+    uint64_t t;
+
+    while (1)
+    {
+        if (busy_channel == -2 && busy_end <= now)
+            busy_channel = -1;
+        t = next_event();
+        if (t > end)
+            break;
+        if (t > now)
+        {
+            account(t - now);
+            now = t;
+        }
+        bus_event();
+        irq_check();
+    }
+    if (end > now)
+    {
+        account(end - now);
+        now = end;
+    }
+}
+
+static void cpu(uint64_t ns)
+{
+    advance_to(now + ns);
+}
+
+void OTG_FS_IRQHandler(void);
+
+static void irq_check(void)
+{
+    int was_sleeping, rounds = 0;
+
+    if (in_isr || irq_off || (gintsts() & gintmsk) == 0)
+        return;
+
+    was_sleeping = sleeping;
+    sleeping = 0;
+    in_isr = 1;
+    isr_count ++;
+    cpu(ISR_ENTRY_NS);
+    while ((gintsts() & gintmsk) != 0 && rounds ++ < 64)
+        OTG_FS_IRQHandler();
+    in_isr = 0;
+    sleeping = was_sleeping;
+}
+
+/* the registers, by their offset from the core */
+static rt_uint32_t reg_read(rt_uint32_t offset)
+{
+    USB_OTG_HNPTXSTS_TypeDef hnptxsts;
+    USB_OTG_HPRT0_TypeDef hprt0;
+    struct rx_entry *entry;
+    rt_uint32_t value = 0;
+    int n, used;
+
+    if (offset >= 0x1000)
+    {
+        /* the data of the status popped last */
+        if (rx_pos + 4 <= (int)sizeof(rx_current))
+            memcpy(&value, rx_current + rx_pos, 4);
+        rx_pos += 4;
+        return value;
+    }
+    if (offset >= 0x500 && offset < 0x500 + CHANNEL_MAX * 0x20)
+    {
+        n = (offset - 0x500) / 0x20;
+        switch ((offset - 0x500) % 0x20)
+        {
+        case 0x00: return channels[n].hcchar.d32;
+        case 0x08: return channels[n].hcint;
+        case 0x0C: return channels[n].hcintmsk;
+        case 0x10: return channels[n].hctsiz.d32;
+        }
+        return 0;
+    }
+
+    switch (offset)
+    {
+    case 0x14:
+        return gintsts();
+    case 0x18:
+        return gintmsk;
+    case 0x20:
+        if (rx_count == 0)
+            return 0;
+        entry = &rx_queue[rx_head];
+        memcpy(rx_current, entry->data, entry->len);
+        rx_pos = 0;
+        rx_head = (rx_head + 1) % RX_QUEUE;
+        rx_count --;
+        rx_words -= (entry->len + 3) / 4;
+        return entry->status;
+    case 0x2C:
+        used = 0;
+        for (n = 0; n < CHANNEL_MAX; n ++)
+            used += (channels[n].tx_len + 3) / 4;
+        hnptxsts.d32 = 0;
+        hnptxsts.b.nptxfspcavail = TXH_NP_FS_FIFOSIZ - used;
+        hnptxsts.b.nptxqspcavail = 8;
+        return hnptxsts.d32;
+    case 0x408:
+        return frame_number & 0x3FFF;
+    case 0x414:
+        return haint();
+    case 0x418:
+        return haintmsk;
+    case 0x440:
+        hprt0.d32 = 0;
+        hprt0.b.prtconnsts = 1;
+        hprt0.b.prtena = 1;
+        hprt0.b.prtspd = HPRT0_PRTSPD_FULL_SPEED;
+        return hprt0.d32;
+    }
+
+    return 0;
+}
+
+static void reg_write(rt_uint32_t offset, rt_uint32_t value)
+{
+    USB_OTG_HCCHAR_TypeDef hcchar;
+    struct channel *c;
+    int n;
+
+    if (offset >= 0x1000)
+    {
+        c = &channels[offset / 0x1000 - 1];
+        if (c->tx_len + 4 > (int)sizeof(c->tx) || c->tx_len + 4 > TXH_NP_FS_FIFOSIZ * 4 + 4)
+        {
+            fifo_overflows ++;
+            return;
+        }
+        memcpy(c->tx + c->tx_len, &value, 4);
+        c->tx_len += 4;
+        /* the padding of the last word does not count */
+        if (c->tx_len > (int)c->hctsiz.b.xfersize)
+            c->tx_len = c->hctsiz.b.xfersize;
+        return;
+    }
+    if (offset >= 0x500 && offset < 0x500 + CHANNEL_MAX * 0x20)
+    {
+        n = (offset - 0x500) / 0x20;
+        c = &channels[n];
+        switch ((offset - 0x500) % 0x20)
+        {
+        case 0x00:
+            hcchar.d32 = value;
+            if (hcchar.b.chdis)
+            {
+                if (c->hcchar.b.chen || c->active)
+                {
+                    c->halting = 1;
+                    c->halt_at = now + 500;
+                }
+                hcchar.b.chdis = 0;
+                hcchar.b.chen = c->hcchar.b.chen;
+                c->hcchar.d32 = hcchar.d32;
+            }
+            else
+            {
+                c->hcchar.d32 = hcchar.d32;
+                if (hcchar.b.chen && !c->halting)
+                    c->active = 1;
+            }
+            break;
+        case 0x08:
+            c->hcint &= ~value;
+            break;
+        case 0x0C:
+            c->hcintmsk = value;
+            break;
+        case 0x10:
+            c->hctsiz.d32 = value;
+            c->tx_len = 0;
+            break;
+        }
+        return;
+    }
+
+    switch (offset)
+    {
+    case 0x14:
+        if (value & (1 << 3))
+            sof_pending = 0;
+        break;
+    case 0x18:
+        gintmsk = value;
+        break;
+    case 0x418:
+        haintmsk = value;
+        break;
+    }
+}
+
+uint32_t sim_reg_read(uintptr_t addr)
+{
+    uint32_t value = reg_read((rt_uint32_t)(addr - USB_OTG_FS_BASE_ADDR));
+
+    cpu(REG_NS);
+    return value;
+}
+
+void sim_reg_write(uintptr_t addr, uint32_t value)
+{
+    reg_write((rt_uint32_t)(addr - USB_OTG_FS_BASE_ADDR), value);
+    cpu(REG_NS);
+}
+
+/* the library reads whole words, the last one may run past the packet */
+void *__real_USB_OTG_ReadPacket(USB_OTG_CORE_HANDLE *pdev, uint8_t *dest, uint16_t len);
+void *__wrap_USB_OTG_ReadPacket(USB_OTG_CORE_HANDLE *pdev, uint8_t *dest, uint16_t len)
+{
+    rt_uint8_t words[68];
+
+    __real_USB_OTG_ReadPacket(pdev, words, len);
+    memcpy(dest, words, len);
+
+    return dest + ((len + 3) & ~3);
+}
+
+/* the core comes up without the resets and waits of HCD_Init */
+static USB_OTG_CORE_HANDLE *core;
+
+USB_OTG_STS __wrap_HCD_Init(USB_OTG_CORE_HANDLE *pdev, USB_OTG_CORE_ID_TypeDef coreID)
+{
+    core = pdev;
+    USB_OTG_SelectCore(pdev, coreID);
+    USB_OTG_EnableHostInt(pdev);
+
+    return USB_OTG_OK;
+}
+
+URB_STATE __real_HCD_GetURB_State(USB_OTG_CORE_HANDLE *pdev, uint8_t ch_num);
+URB_STATE __wrap_HCD_GetURB_State(USB_OTG_CORE_HANDLE *pdev, uint8_t ch_num)
+{
+    cpu(POLL_NS);
+    return __real_HCD_GetURB_State(pdev, ch_num);
+}
+
+USBH_Status __real_USBH_BulkSendData(USB_OTG_CORE_HANDLE *pdev, uint8_t *buff, uint16_t length,
+                                     uint8_t hc_num);
+USBH_Status __wrap_USBH_BulkSendData(USB_OTG_CORE_HANDLE *pdev, uint8_t *buff, uint16_t length,
+                                     uint8_t hc_num)
+{
+    cpu(CALL_NS);
+    return __real_USBH_BulkSendData(pdev, buff, length, hc_num);
+}
+
+USBH_Status __real_USBH_BulkReceiveData(USB_OTG_CORE_HANDLE *pdev, uint8_t *buff, uint16_t length,
+                                        uint8_t hc_num);
+USBH_Status __wrap_USBH_BulkReceiveData(USB_OTG_CORE_HANDLE *pdev, uint8_t *buff, uint16_t length,
+                                        uint8_t hc_num)
+{
+    cpu(CALL_NS);
+    return __real_USBH_BulkReceiveData(pdev, buff, length, hc_num);
+}
+
+void USB_OTG_BSP_Init(USB_OTG_CORE_HANDLE *pdev)
+{
+}
+
+void USB_OTG_BSP_EnableInterrupt(USB_OTG_CORE_HANDLE *pdev)
+{
+}
+
+void USB_OTG_BSP_ConfigVBUS(uint32_t state)
+{
+}
+
+void USB_OTG_BSP_DriveVBUS(USB_OTG_CORE_HANDLE *pdev, uint8_t state)
+{
+}
+
+void USB_OTG_BSP_uDelay(const uint32_t usec)
+{
+    cpu(usec * NS_US);
+}
+
+void USB_OTG_BSP_mDelay(const uint32_t msec)
+{
+    cpu(msec * NS_MS);
+}
+
+/* the kernel */
+void rt_kprintf(const char *fmt, ...)
+{
+}
+
+rt_int32_t rt_snprintf(char *buf, rt_size_t size, const char *format, ...)
+{
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(buf, size, format, args);
+    va_end(args);
+
+    return length;
+}
+
+void *rt_malloc(rt_size_t size)
+{
+    return calloc(1, size);
+}
+
+void rt_free(void *ptr)
+{
+    free(ptr);
+}
+
+void *rt_memset(void *s, int c, rt_ubase_t count)
+{
+    return memset(s, c, count);
+}
+
+void *rt_memcpy(void *dst, const void *src, rt_ubase_t count)
+{
+    return memcpy(dst, src, count);
+}
+
+void rt_interrupt_enter(void)
+{
+}
+
+void rt_interrupt_leave(void)
+{
+}
+
+rt_base_t rt_hw_interrupt_disable(void)
+{
+    int level = irq_off;
+
+    irq_off = 1;
+    return level;
+}
+
+void rt_hw_interrupt_enable(rt_base_t level)
+{
+    irq_off = level;
+    if (!irq_off)
+        irq_check();
+}
+
+rt_tick_t rt_tick_get(void)
+{
+    return (rt_tick_t)(now / (NS_MS * 1000 / RT_TICK_PER_SECOND));
+}
+
+rt_err_t rt_sem_init(rt_sem_t sem, const char *name, rt_uint32_t value, rt_uint8_t flag)
+{
+    memset(sem, 0, sizeof(*sem));
+    sem->value = value;
+
+    return RT_EOK;
+}
+
+/* the thread sleeps, the bus and the interrupts go on */
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t time)
+{
+    uint64_t deadline, t;
+
+    if (sem->value == 0)
+    {
+        deadline = time < 0 ? (uint64_t)-1 :
+                   now + (uint64_t)time * (NS_MS * 1000 / RT_TICK_PER_SECOND);
+        cpu(SEM_NS);
+        sleeping = 1;
+        while (sem->value == 0)
+        {
+            if (busy_channel == -2 && busy_end <= now)
+                busy_channel = -1;
+            t = next_event();
+            if (t > deadline)
+            {
+                account(deadline - now);
+                now = deadline;
+                sleeping = 0;
+                return -RT_ETIMEOUT;
+            }
+            if (t > now)
+            {
+                account(t - now);
+                now = t;
+            }
+            bus_event();
+            irq_check();
+        }
+        sleeping = 0;
+        cpu(SEM_NS);
+    }
+    sem->value --;
+
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_release(rt_sem_t sem)
+{
+    sem->value ++;
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_control(rt_sem_t sem, rt_uint8_t cmd, void *arg)
+{
+    if (cmd == RT_IPC_CMD_RESET)
+        sem->value = (rt_uint32_t)(uintptr_t)arg;
+
+    return RT_EOK;
+}
+
+static struct uhcd *hcd;
+
+rt_err_t rt_device_register(rt_device_t dev, const char *name, rt_uint16_t flags)
+{
+    hcd = (struct uhcd *)dev;
+    return RT_EOK;
+}
+
+rt_err_t rt_usb_post_event(struct umsg *msg, rt_size_t size)
+{
+    return RT_EOK;
+}
+
+/* the mass storage class: a command, its data and its status */
+void rt_hw_susb_init(void);
+rt_uint8_t susb_connect(USB_OTG_CORE_HANDLE *pdev);
+
+static upipe_t pipe_in, pipe_out;
+
+static int command(int write, rt_uint32_t lba, int blocks, rt_uint8_t *buffer)
+{
+    /* whole words: the library moves the FIFO a word at a time */
+    rt_uint8_t cbw[32], csw[16];
+    int len = blocks * SECTOR;
+
+    cpu(CLASS_NS);
+    memset(cbw, 0, sizeof(cbw));
+    memcpy(cbw, "USBC", 4);
+    cbw[4] = (rt_uint8_t)lba;
+    memcpy(cbw + 8, &len, 4);
+    cbw[12] = write ? 0x00 : 0x80;
+    cbw[14] = 10;
+    cbw[15] = write ? 0x2A : 0x28;
+    cbw[17] = lba >> 24;
+    cbw[18] = lba >> 16;
+    cbw[19] = lba >> 8;
+    cbw[20] = lba;
+    cbw[22] = blocks >> 8;
+    cbw[23] = blocks;
+
+    if (hcd->ops->bulk_xfer(pipe_out, cbw, 31, 100) != 31)
+        return -1;
+    if (hcd->ops->bulk_xfer(write ? pipe_out : pipe_in, buffer, len, 100) != len)
+        return -1;
+    if (hcd->ops->bulk_xfer(pipe_in, csw, 13, 100) != 13 || memcmp(csw, "USBS", 4) != 0)
+        return -1;
+
+    return 0;
+}
+
+/* total_kb in commands of blocks, the KB/s */
+static double run(int write, int blocks, int total_kb)
+{
+    static rt_uint8_t buffer[64 * 1024];
+    uint64_t start = now, elapsed;
+    rt_uint32_t lba = 1000;
+    int bytes = 0, index, bad = 0;
+    double rate, busy;
+
+    time_thread = time_isr = time_idle = 0;
+    isr_count = 0;
+    while (bytes < total_kb * 1024)
+    {
+        if (write)
+        {
+            for (index = 0; index < blocks * SECTOR; index ++)
+                buffer[index] = ~pattern(lba + index / SECTOR, index % SECTOR);
+        }
+        if (command(write, lba, blocks, buffer) < 0)
+        {
+            printf("%s of %d blocks at %d failed\n", write ? "write" : "read", blocks, (int)lba);
+            failures ++;
+            return 0;
+        }
+        if (!write)
+        {
+            for (index = 0; index < blocks * SECTOR; index ++)
+            {
+                if (buffer[index] != pattern(lba + index / SECTOR, index % SECTOR))
+                    bad ++;
+            }
+        }
+        lba += blocks;
+        bytes += blocks * SECTOR;
+    }
+
+    elapsed = now - start;
+    rate = bytes / 1024.0 / (elapsed / 1e9);
+    busy = (double)(time_thread + time_isr) / elapsed;
+    printf("%-5s %2dK a command: %6.1fKB/s, cpu %4.1f%% (thread %4.1f%%, isr %4.1f%%, %lu interrupts)\n",
+           write ? "write" : "read", blocks / 2, rate, busy * 100,
+           100.0 * time_thread / elapsed, 100.0 * time_isr / elapsed, isr_count);
+
+    CHECK(bad == 0 && device.write_errors == 0);
+    CHECK(toggle_errors == 0 && fifo_overflows == 0);
+    CHECK(busy < 0.10);
+
+    return rate;
+}
+
+/* the driver waiting forever on something the model never does */
+static void stuck(int sig)
+{
+    printf("stuck at %lluns, device phase %d, %d bytes to go\n",
+           (unsigned long long)now, device.phase, device.remaining);
+    printf("usb_hcd: FAILED\n");
+    exit(1);
+}
+
+int main(void)
+{
+    struct uinstance instance;
+    struct uifinst ifinst;
+    struct uendpoint_descriptor ep;
+
+    signal(SIGALRM, stuck);
+    alarm(60);
+
+    rt_hw_susb_init();
+    hcd->parent.init(&hcd->parent);
+    susb_connect(core);
+    hcd->ops->hub_ctrl(1, RH_CLEAR_PORT_FEATURE, (void *)PORT_FEAT_C_CONNECTION);
+
+    memset(&instance, 0, sizeof(instance));
+    instance.address = 1;
+    ifinst.uinst = &instance;
+
+    memset(&ep, 0, sizeof(ep));
+    ep.bLength = sizeof(ep);
+    ep.bmAttributes = USB_EP_ATTR_BULK;
+    ep.wMaxPacketSize = 64;
+    ep.bEndpointAddress = 0x81;
+    CHECK(hcd->ops->alloc_pipe(&pipe_in, &ifinst, &ep, RT_NULL) == RT_EOK);
+    ep.bEndpointAddress = 0x02;
+    CHECK(hcd->ops->alloc_pipe(&pipe_out, &ifinst, &ep, RT_NULL) == RT_EOK);
+
+    CHECK(run(0, 8, 1024) > 850);
+    CHECK(run(0, 64, 2048) > 850);
+    CHECK(run(1, 8, 512) > 600);
+    CHECK(run(1, 64, 1024) > 600);
+
+    printf("usb_hcd: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}
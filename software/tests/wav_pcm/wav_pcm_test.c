@@ -0,0 +1,197 @@
+/*
+ * Host test of applications/wav_pcm.c.
+ *
+ * Every supported layout is converted from random data and compared frame
+ * by frame with a plain per-sample reference written from the format
+ * description in wav_pcm.h. The frame counts walk through all the tail
+ * lengths of the word-at-a-time kernels, and the word after the last
+ * output frame must stay untouched.
+ */
+#include <math.h>
+#include <stdio.h>
+
+#include <rtthread.h>
+#include "wav_pcm.h"
+
+#define MAX_FRAMES      4100
+#define MAX_CHANNELS    6
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures ++; } } while (0)
+
+static rt_uint32_t lcg = 1;
+
+static rt_uint32_t rnd(void)
+{
+    lcg = lcg * 1103515245 + 12345;
+    return lcg >> 8;
+}
+
+/* one sample as wav_pcm.h describes it */
+static rt_int16_t ref_sample(const struct wav_pcm_format *format, const rt_uint8_t *p)
+{
+    rt_int32_t v;
+    float f;
+
+    if (format->format == WAV_PCM_FLOAT)
+    {
+        memcpy(&f, p, 4);
+        f *= 32768.0f;
+        if (f >= 32767.0f) return 32767;
+        if (!(f > -32768.0f)) return -32768;
+        return (rt_int16_t)f;
+    }
+
+    switch (format->bits)
+    {
+    case 8:
+        return (rt_int16_t)((p[0] - 128) * 256);
+    case 16:
+        return (rt_int16_t)(p[0] | (p[1] << 8));
+    case 24:
+        v = (rt_int32_t)(((rt_uint32_t)p[0] << 8) | ((rt_uint32_t)p[1] << 16) |
+                         ((rt_uint32_t)p[2] << 24));
+        return (rt_int16_t)(v >> 16);
+    case 32:
+        v = (rt_int32_t)((rt_uint32_t)p[0] | ((rt_uint32_t)p[1] << 8) |
+                         ((rt_uint32_t)p[2] << 16) | ((rt_uint32_t)p[3] << 24));
+        return (rt_int16_t)(v >> 16);
+    }
+
+    return 0;
+}
+
+static void fill(rt_uint32_t *src, rt_size_t words, int is_float)
+{
+    rt_size_t index;
+    float f;
+
+    for (index = 0; index < words; index ++)
+    {
+        if (!is_float)
+        {
+            src[index] = rnd() ^ (rnd() << 16);
+            continue;
+        }
+
+        /* mostly in range, some clipping, the odd NaN and infinity */
+        f = (float)(rnd() % 20001) / 8000.0f - 1.25f;
+        if (rnd() % 50 == 0) f = NAN;
+        if (rnd() % 50 == 0) f = (rnd() & 1) ? INFINITY : -INFINITY;
+        if (rnd() % 50 == 0) f = (rnd() & 1) ? 1.0f : -1.0f;
+        memcpy(&src[index], &f, 4);
+    }
+}
+
+static void test_format(rt_uint16_t type, rt_uint16_t bits, rt_uint16_t channels)
+{
+    static rt_uint32_t src[MAX_FRAMES * MAX_CHANNELS + 4];
+    static rt_uint32_t dst[MAX_FRAMES + 1];
+    struct wav_pcm_format format;
+    wav_pcm_convert_t convert;
+    rt_size_t frames, index, step;
+    const rt_uint8_t *p;
+    rt_uint32_t expect;
+    int bad = 0;
+
+    format.format = type;
+    format.bits = bits;
+    format.channels = channels;
+    format.block_align = channels * bits / 8;
+    format.sample_rate = 44100;
+
+    convert = wav_pcm_converter(&format);
+    CHECK(convert != RT_NULL);
+    if (convert == RT_NULL) return;
+
+    /* every short length, then a few long ones */
+    for (frames = 0, step = 1; frames <= MAX_FRAMES && !bad; frames += step)
+    {
+        if (frames >= 16) step = 1 + rnd() % 701;
+
+        fill(src, (frames * format.block_align + 3) / 4, type == WAV_PCM_FLOAT);
+        memset(dst, 0xAA, sizeof(dst));
+        convert(dst, (const rt_uint8_t *)src, frames, format.block_align);
+
+        for (index = 0; index < frames; index ++)
+        {
+            p = (const rt_uint8_t *)src + index * format.block_align;
+            expect = (rt_uint16_t)ref_sample(&format, p) |
+                ((rt_uint32_t)(rt_uint16_t)ref_sample(&format,
+                    p + (channels > 1 ? bits / 8 : 0)) << 16);
+
+            if (dst[index] != expect)
+            {
+                printf("format %d, %2d bit, %d ch: frame %zu of %zu is %08x, expected %08x\n",
+                       type, bits, channels, index, frames, dst[index], expect);
+                failures ++;
+                bad = 1;
+                break;
+            }
+        }
+        if (dst[frames] != 0xAAAAAAAA)
+        {
+            printf("format %d, %2d bit, %d ch: %zu frames written past the end\n",
+                   type, bits, channels, frames);
+            failures ++;
+            bad = 1;
+        }
+    }
+}
+
+static void test_formats(void)
+{
+    static const rt_uint16_t layouts[][2] =
+    {
+        {WAV_PCM_INT, 8}, {WAV_PCM_INT, 16}, {WAV_PCM_INT, 24},
+        {WAV_PCM_INT, 32}, {WAV_PCM_FLOAT, 32},
+    };
+    rt_size_t index;
+    rt_uint16_t channels;
+
+    for (index = 0; index < sizeof(layouts) / sizeof(layouts[0]); index ++)
+        for (channels = 1; channels <= MAX_CHANNELS; channels ++)
+            test_format(layouts[index][0], layouts[index][1], channels);
+}
+
+static void test_unsupported(void)
+{
+    struct wav_pcm_format format = {WAV_PCM_INT, 2, 16, 4, 44100};
+
+    CHECK(wav_pcm_is_native(&format));
+
+    format.bits = 12;
+    format.block_align = 4;
+    CHECK(wav_pcm_converter(&format) == RT_NULL);
+    CHECK(!wav_pcm_is_native(&format));
+
+    /* block_align must match the sample layout */
+    format.bits = 16;
+    format.block_align = 6;
+    CHECK(wav_pcm_converter(&format) == RT_NULL);
+    CHECK(!wav_pcm_is_native(&format));
+
+    format.block_align = 4;
+    format.channels = 0;
+    CHECK(wav_pcm_converter(&format) == RT_NULL);
+
+    format.channels = 2;
+    format.format = WAV_PCM_FLOAT;
+    CHECK(wav_pcm_converter(&format) == RT_NULL);
+    CHECK(!wav_pcm_is_native(&format));
+
+    format.format = 2;                  /* ADPCM */
+    CHECK(wav_pcm_converter(&format) == RT_NULL);
+}
+
+int main(void)
+{
+    test_formats();
+    test_unsupported();
+
+    printf("wav_pcm: %s\n", failures ? "FAILED" : "passed");
+    return failures != 0;
+}